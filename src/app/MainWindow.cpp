@@ -33,6 +33,7 @@
 #include "ImageMetadataLoader.h"
 #include "LoadFileTask.h"
 #include "LoadFilesStatusDialog.h"
+#include "MemoryCostEstimator.h"
 #include "NewOpenProjectPanel.h"
 #include "OutOfMemoryDialog.h"
 #include "OutOfMemoryHandler.h"
@@ -390,6 +391,7 @@ void MainWindow::switchToNewProject(const std::shared_ptr<ProjectPages>& pages,
   m_stages = std::make_shared<StageSequence>(pages, newPageSelectionAccessor());
   if (projectReader) {
     projectReader->readFilterSettings(m_stages->filters());
+    projectReader->readStageDigests(m_stages->stageDigests());
   }
 
   // Connect the filter list model to the view and select
@@ -1117,11 +1119,17 @@ void MainWindow::startBatchProcessing() {
   m_interactiveQueue->cancelAndClear();
 
   m_batchQueue = std::make_unique<ProcessingTaskQueue>();
+  const StageDigests& stageDigests = m_stages->stageDigests();
   PageInfo page(m_thumbSequence->selectionLeader());
   for (; !page.isNull(); page = m_thumbSequence->nextPage(page.id())) {
     for (int i = 0; i < m_stages->count(); i++) {
       m_stages->filterAt(i)->loadDefaultSettings(page);
     }
+    // Pages that haven't changed since they were last processed aren't even loaded.
+    // Debug images are only produced by actual processing though.
+    if (!m_debug && stageDigests.isUpToDate(*m_stages, m_curFilter, page, m_outFileNameGen)) {
+      continue;
+    }
     m_batchQueue->addProcessingTask(page, createCompositeTask(page, m_curFilter, /*batch=*/true, m_debug));
   }
 
@@ -1140,7 +1148,9 @@ void MainWindow::startBatchProcessing() {
       }
     } while ((task = m_batchQueue->takeForProcessing()));
   } else {
+    // Either there are no pages or all of them are up to date.
     stopBatchProcessing();
+    return;
   }
 
   page = m_batchQueue->selectedPage();
@@ -1182,14 +1192,19 @@ void MainWindow::stopBatchProcessing(MainAreaAction mainArea) {
 void MainWindow::filterResult(const BackgroundTaskPtr& task, const FilterResultPtr& result) {
   // Cancelled or not, we must mark it as finished.
   m_interactiveQueue->processingFinished(task);
+  PageInfo batchPage;
   if (m_batchQueue) {
-    m_batchQueue->processingFinished(task);
+    batchPage = m_batchQueue->processingFinished(task);
   }
 
   if (task->isCancelled()) {
     return;
   }
 
+  if (!batchPage.isNull() && (result->filter() == m_stages->filterAt(m_curFilter))) {
+    m_stages->stageDigests().recordProcessed(*m_stages, m_curFilter, batchPage, m_outFileNameGen);
+  }
+
   if (!isBatchProcessingInProgress()) {
     if (!result->filter()) {
       // Error loading file.  No special action is necessary.
@@ -1646,7 +1661,7 @@ bool MainWindow::closeProjectInteractive() {
 
   ProjectWriter writer(m_pages, m_selectedPage, m_outFileNameGen);
 
-  if (!writer.write(backupFilePath, m_stages->filters())) {
+  if (!writer.write(backupFilePath, m_stages->filters(), m_stages->stageDigests())) {
     // Backup file could not be written???
     QFile::remove(backupFilePath);
     switch (promptProjectSave()) {
@@ -1695,7 +1710,7 @@ void MainWindow::closeProjectWithoutSaving() {
 bool MainWindow::saveProjectWithFeedback(const QString& projectFile) {
   ProjectWriter writer(m_pages, m_selectedPage, m_outFileNameGen);
 
-  if (!writer.write(projectFile, m_stages->filters())) {
+  if (!writer.write(projectFile, m_stages->filters(), m_stages->stageDigests())) {
     QMessageBox::warning(this, tr("Error"), tr("Error saving the project file!"));
     return false;
   }
@@ -1973,8 +1988,10 @@ BackgroundTaskPtr MainWindow::createCompositeTask(const PageInfo& page,
     debug = false;
   }
   assert(fixOrientationTask);
-  return std::make_shared<LoadFileTask>(batch ? BackgroundTask::BATCH : BackgroundTask::INTERACTIVE, page,
-                                        m_thumbnailCache, m_pages, fixOrientationTask);
+  auto task = std::make_shared<LoadFileTask>(batch ? BackgroundTask::BATCH : BackgroundTask::INTERACTIVE, page,
+                                             m_thumbnailCache, m_pages, fixOrientationTask);
+  task->setMemoryCost(MemoryCostEstimator::estimate(page, *m_stages, lastFilterIdx));
+  return task;
 }  // MainWindow::createCompositeTask
 
 std::shared_ptr<CompositeCacheDrivenTask> MainWindow::createCompositeCacheDrivenTask(const int lastFilterIdx) {
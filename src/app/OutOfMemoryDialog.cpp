@@ -85,7 +85,7 @@ void OutOfMemoryDialog::saveProjectAs() {
 bool OutOfMemoryDialog::saveProjectWithFeedback(const QString& projectFile) {
   ProjectWriter writer(m_pages, m_selectedPage, m_outFileNameGen);
 
-  if (!writer.write(projectFile, m_stages->filters())) {
+  if (!writer.write(projectFile, m_stages->filters(), m_stages->stageDigests())) {
     QMessageBox::warning(this, tr("Error"), tr("Error saving the project file!"));
     return false;
   }
@@ -5,16 +5,26 @@
 
 #include <core/IconProvider.h>
 
+#include <QCoreApplication>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QRunnable>
 #include <QSettings>
 #include <QSortFilterProxyModel>
-#include <deque>
 
+#include "ImageMetadataCache.h"
 #include "ImageMetadataLoader.h"
 #include "NonCopyable.h"
 #include "SmartFilenameOrdering.h"
 
+namespace {
+/**
+ * Loading metadata is mostly waiting for I/O, so more files are loaded at once
+ * than there are cores, though not so many as to swamp network storage.
+ */
+const int MAX_CONCURRENT_LOADS = 8;
+}  // namespace
+
 class ProjectFilesDialog::Item {
  public:
   enum Status { STATUS_DEFAULT, STATUS_LOAD_OK, STATUS_LOAD_FAILED };
@@ -46,8 +56,6 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
   DECLARE_NON_COPYABLE(FileList)
 
  public:
-  enum LoadStatus { LOAD_OK, LOAD_FAILED, NO_MORE_FILES };
-
   FileList();
 
   ~FileList() override;
@@ -77,9 +85,17 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
 
   void remove(const QItemSelection& selection);
 
-  void prepareForLoadingFiles();
+  /**
+   * \return Indexes of all the items, in the order they are displayed.
+   */
+  std::vector<int> itemsToLoad() const;
 
-  LoadStatus loadNextFile();
+  const QFileInfo& fileInfo(int itemIdx) const { return m_items[itemIdx].fileInfo(); }
+
+  /**
+   * \return true if the item got loaded, false if it failed to.
+   */
+  bool setLoadResult(int itemIdx, ImageMetadataLoader::Status status, std::vector<ImageMetadata> perPageMetadata);
 
  private:
   int rowCount(const QModelIndex& parent) const override;
@@ -89,7 +105,6 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
   Qt::ItemFlags flags(const QModelIndex& index) const override;
 
   std::vector<Item> m_items;
-  std::deque<int> m_itemsToLoad;
 };
 
 
@@ -114,6 +129,58 @@ class ProjectFilesDialog::ItemVisualOrdering {
 };
 
 
+class ProjectFilesDialog::LoadResultEvent : public QEvent {
+ public:
+  LoadResultEvent(int itemIdx, ImageMetadataLoader::Status status, std::vector<ImageMetadata> perPageMetadata)
+      : QEvent(User), m_itemIdx(itemIdx), m_status(status), m_perPageMetadata(std::move(perPageMetadata)) {}
+
+  int itemIdx() const { return m_itemIdx; }
+
+  ImageMetadataLoader::Status status() const { return m_status; }
+
+  std::vector<ImageMetadata>& perPageMetadata() { return m_perPageMetadata; }
+
+ private:
+  int m_itemIdx;
+  ImageMetadataLoader::Status m_status;
+  std::vector<ImageMetadata> m_perPageMetadata;
+};
+
+
+/**
+ * Loads the metadata of a file, unless it's cached, and posts
+ * a LoadResultEvent to the dialog.
+ */
+class ProjectFilesDialog::LoadMetadataTask : public QRunnable {
+ public:
+  LoadMetadataTask(QObject* receiver, int itemIdx, const QString& filePath, std::shared_ptr<ImageMetadataCache> cache)
+      : m_receiver(receiver), m_itemIdx(itemIdx), m_filePath(filePath), m_cache(std::move(cache)) {}
+
+  void run() override {
+    // The QFileInfo objects of the dialog aren't to be used from other threads.
+    const QFileInfo fileInfo(m_filePath);
+
+    std::vector<ImageMetadata> perPageMetadata;
+    ImageMetadataLoader::Status status = ImageMetadataLoader::LOADED;
+    if (!m_cache->lookup(fileInfo, perPageMetadata)) {
+      status = ImageMetadataLoader::load(
+          m_filePath, [&](const ImageMetadata& metadata) { perPageMetadata.push_back(metadata); });
+      if (status == ImageMetadataLoader::LOADED) {
+        m_cache->store(fileInfo, perPageMetadata);
+      }
+    }
+
+    QCoreApplication::postEvent(m_receiver, new LoadResultEvent(m_itemIdx, status, std::move(perPageMetadata)));
+  }
+
+ private:
+  QObject* m_receiver;
+  int m_itemIdx;
+  QString m_filePath;
+  std::shared_ptr<ImageMetadataCache> m_cache;
+};
+
+
 template <typename OutFunc>
 void ProjectFilesDialog::FileList::files(OutFunc out) const {
   auto it(m_items.begin());
@@ -162,7 +229,8 @@ ProjectFilesDialog::ProjectFilesDialog(QWidget* parent)
       m_offProjectFilesSorted(std::make_unique<SortedFileList>(*m_offProjectFiles)),
       m_inProjectFiles(std::make_unique<FileList>()),
       m_inProjectFilesSorted(std::make_unique<SortedFileList>(*m_inProjectFiles)),
-      m_loadTimerId(0),
+      m_numFilesToLoad(0),
+      m_numFilesLoaded(0),
       m_metadataLoadFailed(false),
       m_autoOutDir(true) {
   m_supportedExtensions.insert("png");
@@ -175,6 +243,8 @@ ProjectFilesDialog::ProjectFilesDialog(QWidget* parent)
 
   setupIcons();
 
+  m_metadataLoadPool.setMaxThreadCount(MAX_CONCURRENT_LOADS);
+
   offProjectList->setModel(m_offProjectFilesSorted->model());
   inProjectList->setModel(m_inProjectFilesSorted->model());
 
@@ -185,9 +255,12 @@ ProjectFilesDialog::ProjectFilesDialog(QWidget* parent)
   connect(addToProjectBtn, SIGNAL(clicked()), this, SLOT(addToProject()));
   connect(removeFromProjectBtn, SIGNAL(clicked()), this, SLOT(removeFromProject()));
   connect(buttonBox, SIGNAL(accepted()), this, SLOT(onOK()));
+  connect(this, &QDialog::rejected, this, &ProjectFilesDialog::cancelLoadingMetadata);
 }
 
-ProjectFilesDialog::~ProjectFilesDialog() = default;
+ProjectFilesDialog::~ProjectFilesDialog() {
+  cancelLoadingMetadata();
+}
 
 QString ProjectFilesDialog::inputDirectory() const {
   return inpDirLine->text();
@@ -405,59 +478,70 @@ void ProjectFilesDialog::onOK() {
 }  // ProjectFilesDialog::onOK
 
 void ProjectFilesDialog::startLoadingMetadata() {
-  m_inProjectFiles->prepareForLoadingFiles();
-
-  progressBar->setMaximum(static_cast<int>(m_inProjectFiles->count()));
-  inpDirLine->setEnabled(false);
-  inpDirBrowseBtn->setEnabled(false);
-  outDirLine->setEnabled(false);
-  outDirBrowseBtn->setEnabled(false);
-  addToProjectBtn->setEnabled(false);
-  removeFromProjectBtn->setEnabled(false);
-  offProjectSelectAllBtn->setEnabled(false);
-  inProjectSelectAllBtn->setEnabled(false);
-  rtlLayoutCB->setEnabled(false);
-  forceFixDpi->setEnabled(false);
-  buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
+  if (!m_metadataCache) {
+    m_metadataCache = std::make_shared<ImageMetadataCache>(ImageMetadataCache::defaultFilePath());
+  }
+  const std::vector<int> itemIndexes(m_inProjectFiles->itemsToLoad());
+  m_numFilesToLoad = itemIndexes.size();
+  m_numFilesLoaded = 0;
+
+  progressBar->setMaximum(static_cast<int>(m_numFilesToLoad));
+  progressBar->setValue(0);
+  setControlsEnabled(false);
   offProjectList->clearSelection();
   inProjectList->clearSelection();
-  m_loadTimerId = startTimer(0);
   m_metadataLoadFailed = false;
+
+  // The tasks are started in the display order, so the results come in roughly the same order.
+  for (const int itemIdx : itemIndexes) {
+    const QString filePath(m_inProjectFiles->fileInfo(itemIdx).absoluteFilePath());
+    m_metadataLoadPool.start(new LoadMetadataTask(this, itemIdx, filePath, m_metadataCache));
+  }
+}  // ProjectFilesDialog::startLoadingMetadata
+
+void ProjectFilesDialog::customEvent(QEvent* event) {
+  auto* evt = dynamic_cast<LoadResultEvent*>(event);
+  if (!evt) {
+    QDialog::customEvent(event);
+    return;
+  }
+  if (m_numFilesToLoad == 0) {
+    // Loading was cancelled.
+    return;
+  }
+
+  if (!m_inProjectFiles->setLoadResult(evt->itemIdx(), evt->status(), std::move(evt->perPageMetadata()))) {
+    m_metadataLoadFailed = true;
+  }
+  ++m_numFilesLoaded;
+  progressBar->setValue(static_cast<int>(m_numFilesLoaded));
+
+  if (m_numFilesLoaded == m_numFilesToLoad) {
+    finishLoadingMetadata();
+  }
 }
 
-void ProjectFilesDialog::timerEvent(QTimerEvent* event) {
-  if (event->timerId() != m_loadTimerId) {
-    QWidget::timerEvent(event);
+void ProjectFilesDialog::cancelLoadingMetadata() {
+  if (m_numFilesToLoad == 0) {
     return;
   }
+  m_numFilesToLoad = 0;
 
-  switch (m_inProjectFiles->loadNextFile()) {
-    case FileList::NO_MORE_FILES:
-      finishLoadingMetadata();
-      break;
-    case FileList::LOAD_FAILED:
-      m_metadataLoadFailed = true;
-      // Fall through.
-    case FileList::LOAD_OK:
-      progressBar->setValue(progressBar->value() + 1);
-      break;
+  m_metadataLoadPool.clear();
+  m_metadataLoadPool.waitForDone();
+  // Drop the results of the tasks that have already finished.
+  QCoreApplication::removePostedEvents(this, QEvent::User);
+
+  if (m_metadataCache) {
+    m_metadataCache->save();
   }
+  setControlsEnabled(true);
 }
 
 void ProjectFilesDialog::finishLoadingMetadata() {
-  killTimer(m_loadTimerId);
-
-  inpDirLine->setEnabled(true);
-  inpDirBrowseBtn->setEnabled(true);
-  outDirLine->setEnabled(true);
-  outDirBrowseBtn->setEnabled(true);
-  addToProjectBtn->setEnabled(true);
-  removeFromProjectBtn->setEnabled(true);
-  offProjectSelectAllBtn->setEnabled(true);
-  inProjectSelectAllBtn->setEnabled(true);
-  rtlLayoutCB->setEnabled(true);
-  forceFixDpi->setEnabled(true);
-  buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
+  m_numFilesToLoad = 0;
+  m_metadataCache->save();
+  setControlsEnabled(true);
 
   if (m_metadataLoadFailed) {
     progressBar->setValue(0);
@@ -471,6 +555,20 @@ void ProjectFilesDialog::finishLoadingMetadata() {
   accept();
 }
 
+void ProjectFilesDialog::setControlsEnabled(const bool enabled) {
+  inpDirLine->setEnabled(enabled);
+  inpDirBrowseBtn->setEnabled(enabled);
+  outDirLine->setEnabled(enabled);
+  outDirBrowseBtn->setEnabled(enabled);
+  addToProjectBtn->setEnabled(enabled);
+  removeFromProjectBtn->setEnabled(enabled);
+  offProjectSelectAllBtn->setEnabled(enabled);
+  inProjectSelectAllBtn->setEnabled(enabled);
+  rtlLayoutCB->setEnabled(enabled);
+  forceFixDpi->setEnabled(enabled);
+  buttonBox->button(QDialogButtonBox::Ok)->setEnabled(enabled);
+}
+
 void ProjectFilesDialog::setupIcons() {
   auto& iconProvider = IconProvider::getInstance();
   addToProjectBtn->setIcon(iconProvider.getIcon("right-arrow-inscribed"));
@@ -548,47 +646,32 @@ Qt::ItemFlags ProjectFilesDialog::FileList::flags(const QModelIndex& index) cons
   return m_items[index.row()].flags();
 }
 
-void ProjectFilesDialog::FileList::prepareForLoadingFiles() {
-  std::deque<int> itemIndexes;
-  const auto numItems = static_cast<int>(m_items.size());
-  for (int i = 0; i < numItems; ++i) {
-    itemIndexes.push_back(i);
+std::vector<int> ProjectFilesDialog::FileList::itemsToLoad() const {
+  std::vector<int> itemIndexes(m_items.size());
+  for (size_t i = 0; i < itemIndexes.size(); ++i) {
+    itemIndexes[i] = static_cast<int>(i);
   }
 
   std::sort(itemIndexes.begin(), itemIndexes.end(),
             [&](int lhs, int rhs) { return ItemVisualOrdering()(m_items[lhs], m_items[rhs]); });
-
-  m_itemsToLoad.swap(itemIndexes);
+  return itemIndexes;
 }
 
-ProjectFilesDialog::FileList::LoadStatus ProjectFilesDialog::FileList::loadNextFile() {
-  if (m_itemsToLoad.empty()) {
-    return NO_MORE_FILES;
-  }
-
-  const int itemIdx = m_itemsToLoad.front();
+bool ProjectFilesDialog::FileList::setLoadResult(const int itemIdx,
+                                                 const ImageMetadataLoader::Status status,
+                                                 std::vector<ImageMetadata> perPageMetadata) {
   Item& item = m_items[itemIdx];
-  std::vector<ImageMetadata> perPageMetadata;
-  const QString filePath(item.fileInfo().absoluteFilePath());
-  const ImageMetadataLoader::Status st = ImageMetadataLoader::load(
-      filePath, [&](const ImageMetadata& metadata) { perPageMetadata.push_back(metadata); });
-
-  LoadStatus status;
-
-  if (st == ImageMetadataLoader::LOADED) {
-    status = LOAD_OK;
+  const bool loaded = (status == ImageMetadataLoader::LOADED);
+  if (loaded) {
     item.perPageMetadata().swap(perPageMetadata);
     item.setStatus(Item::STATUS_LOAD_OK);
   } else {
-    status = LOAD_FAILED;
     item.setStatus(Item::STATUS_LOAD_FAILED);
   }
   const QModelIndex idx(index(itemIdx, 0));
   emit dataChanged(idx, idx);
-
-  m_itemsToLoad.pop_front();
-  return status;
-}  // ProjectFilesDialog::FileList::loadNextFile
+  return loaded;
+}
 
 /*================= ProjectFilesDialog::SortedFileList ===================*/
 
@@ -7,12 +7,15 @@
 #include <QDialog>
 #include <QSet>
 #include <QString>
+#include <QThreadPool>
 #include <memory>
 #include <vector>
 
 #include "ImageFileInfo.h"
 #include "ui_ProjectFilesDialog.h"
 
+class ImageMetadataCache;
+
 class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
   Q_OBJECT
  public:
@@ -53,6 +56,8 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
   class FileList;
   class SortedFileList;
   class ItemVisualOrdering;
+  class LoadMetadataTask;
+  class LoadResultEvent;
 
   void setInputDir(const QString& dir, bool autoAddFiles = true);
 
@@ -60,10 +65,14 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
 
   void startLoadingMetadata();
 
-  void timerEvent(QTimerEvent* event) override;
+  void customEvent(QEvent* event) override;
+
+  void cancelLoadingMetadata();
 
   void finishLoadingMetadata();
 
+  void setControlsEnabled(bool enabled);
+
   void setupIcons();
 
   QSet<QString> m_supportedExtensions;
@@ -71,7 +80,10 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
   std::unique_ptr<SortedFileList> m_offProjectFilesSorted;
   std::unique_ptr<FileList> m_inProjectFiles;
   std::unique_ptr<SortedFileList> m_inProjectFilesSorted;
-  int m_loadTimerId;
+  std::shared_ptr<ImageMetadataCache> m_metadataCache;
+  QThreadPool m_metadataLoadPool;
+  size_t m_numFilesToLoad;
+  size_t m_numFilesLoaded;
   bool m_metadataLoadFailed;
   bool m_autoOutDir;
 };
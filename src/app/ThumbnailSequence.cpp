@@ -11,6 +11,7 @@
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsView>
+#include <QScrollBar>
 #include <QStyleOptionGraphicsItem>
 #include <QtWidgets/QCheckBox>
 #include <QtWidgets/QMessageBox>
@@ -22,6 +23,7 @@
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
+#include <algorithm>
 #include <memory>
 
 #include "ColorSchemeManager.h"
@@ -33,9 +35,16 @@ using namespace ::boost::multi_index;
 using namespace ::boost::lambda;
 
 
+/**
+ * \brief A lightweight record of a page in the sequence.
+ *
+ * Only the pages in or near the visible area are backed by a CompositeItem.
+ * The rest are laid out based on the geometry they had when they were last
+ * in view, or an estimate if they have never been.
+ */
 class ThumbnailSequence::Item {
  public:
-  Item(const PageInfo& pageInfo, CompositeItem* compItem);
+  Item(const PageInfo& pageInfo, const QRectF& boundingRect, const QRectF& thumbRect);
 
   const PageId& pageId() const { return pageInfo.id(); }
 
@@ -47,10 +56,23 @@ class ThumbnailSequence::Item {
 
   void setSelectionLeader(bool selectionLeader) const;
 
+  QRectF sceneRect() const { return boundingRect.translated(pos); }
+
   PageInfo pageInfo;
+
+  /** The graphics item representing the page, or null if the page is out of view. */
   mutable CompositeItem* composite;
   mutable bool incompleteThumbnail;
 
+  /** The bounding rectangle of the composite item in its own coordinates. */
+  mutable QRectF boundingRect;
+
+  /** The rectangle of the thumbnail within the composite item. */
+  mutable QRectF thumbRect;
+
+  /** The position of the composite item in the scene. */
+  mutable QPointF pos;
+
  private:
   mutable bool m_isSelected;
   mutable bool m_isSelectionLeader;
@@ -203,7 +225,58 @@ class ThumbnailSequence::Impl {
 
   std::unique_ptr<LabelGroup> getLabelGroup(const PageInfo& pageInfo);
 
-  std::unique_ptr<CompositeItem> getCompositeItem(const Item* item, const PageInfo& info);
+  /**
+   * \brief Puts a thumbnail and a label of the item's page into the composite.
+   *
+   * Updates the geometry and the incompleteThumbnail flag of the item.
+   *
+   * \return Whether the geometry of the item has changed.
+   */
+  bool fillComposite(CompositeItem* composite, const Item* item);
+
+  /**
+   * \brief Updates the geometry and the incompleteThumbnail flag of an item
+   *        without materializing it.
+   */
+  void measure(const Item* item);
+
+  /**
+   * \brief Gives the item a composite placed in the scene.
+   *
+   * \return Whether the geometry of the item has changed.
+   */
+  bool materialize(const Item* item);
+
+  void dematerialize(const Item* item);
+
+  /**
+   * \brief Makes the estimated geometry of pages that haven't been materialized yet
+   *        match a placeholder thumbnail with a label of the given page.
+   */
+  void updateEstimatedGeometry(const PageInfo& pageInfo);
+
+  /**
+   * \brief Positions the items based on their current geometry.
+   *
+   * Only the materialized items are touched in the scene.
+   */
+  void layoutItems();
+
+  /**
+   * \brief Materializes the items in and around the visible area of the view
+   *        and recycles the ones far enough from it.
+   */
+  void updateMaterializedItems();
+
+  /**
+   * Returns the range of m_itemsByPos that may intersect the given vertical
+   * band of the scene.
+   */
+  std::pair<size_t, size_t> itemsInBand(double top, double bottom) const;
+
+  QRectF visibleSceneRect() const;
+
+  void scrollViewBy(double dy);
 
   void commitSceneRect();
 
@@ -214,6 +287,22 @@ class ThumbnailSequence::Impl {
   bool cancelingSelectionAccepted();
 
   static const int SPACING = 3;
+
+  /** The height of the area around the view to materialize items in, in view heights. */
+  static constexpr double PREFETCH_MARGIN = 1.0;
+
+  /**
+   * Materialized items are recycled once they are this many view heights away from the view.
+   * It's bigger than PREFETCH_MARGIN, so that scrolling back and forth doesn't rebuild them.
+   */
+  static constexpr double RECYCLE_MARGIN = 2.0;
+
+  /**
+   * Materializing items replaces the estimated geometry with the actual one,
+   * which changes the layout, which may bring more items into view.
+   */
+  static const int MAX_MATERIALIZATION_PASSES = 4;
+
   ThumbnailSequence& m_owner;
   QSizeF m_maxLogicalThumbSize;
   ViewMode m_viewMode;
@@ -233,6 +322,20 @@ class ThumbnailSequence::Impl {
   GraphicsScene m_graphicsScene;
   QRectF m_sceneRect;
   bool m_selectionMode;
+
+  /** Items in the order of their layout, which is also the order of their vertical positions. */
+  std::vector<const Item*> m_itemsByPos;
+
+  /** The extremes of the vertical extents of items relative to their positions. */
+  double m_minItemTop;
+  double m_maxItemBottom;
+
+  QRectF m_estimatedBoundingRect;
+  QRectF m_estimatedThumbRect;
+
+  /** Composites not representing any page, hidden, and waiting to be reused. */
+  std::vector<CompositeItem*> m_spareComposites;
+  bool m_updatingMaterializedItems;
 };
 
 
@@ -269,9 +372,14 @@ class ThumbnailSequence::LabelGroup : public QGraphicsItemGroup {
 
 class ThumbnailSequence::CompositeItem : public QGraphicsItemGroup {
  public:
-  CompositeItem(ThumbnailSequence::Impl& owner,
-                std::unique_ptr<QGraphicsItem> thumbnail,
-                std::unique_ptr<LabelGroup> labelGroup);
+  explicit CompositeItem(ThumbnailSequence::Impl& owner);
+
+  /**
+   * \brief Replaces the thumbnail and the label, making the item represent another page.
+   */
+  void setContent(std::unique_ptr<QGraphicsItem> thumbnail, std::unique_ptr<LabelGroup> labelGroup);
+
+  void clearContent();
 
   void setItem(const Item* item) { m_item = item; }
 
@@ -279,7 +387,8 @@ class ThumbnailSequence::CompositeItem : public QGraphicsItemGroup {
 
   bool incompleteThumbnail() const;
 
-  void updateSceneRect(QRectF& sceneRect);
+  /** The rectangle of the thumbnail in the coordinates of this item. */
+  QRectF thumbnailRect() const;
 
   void updateAppearence(bool selected, bool selectionLeader);
 
@@ -400,11 +509,8 @@ std::vector<PageRange> ThumbnailSequence::selectedRanges() const {
   return m_impl->selectedRanges();
 }
 
-void ThumbnailSequence::emitNewSelectionLeader(const PageInfo& pageInfo,
-                                               const CompositeItem* composite,
-                                               const SelectionFlags flags) {
-  const QRectF thumbRect(composite->mapToScene(composite->boundingRect()).boundingRect());
-  emit newSelectionLeader(pageInfo, thumbRect, flags);
+void ThumbnailSequence::emitNewSelectionLeader(const PageInfo& pageInfo, const Item* item, const SelectionFlags flags) {
+  emit newSelectionLeader(pageInfo, item->sceneRect(), flags);
 }
 
 const QSizeF& ThumbnailSequence::getMaxLogicalThumbSize() const {
@@ -442,9 +548,15 @@ ThumbnailSequence::Impl::Impl(ThumbnailSequence& owner, const QSizeF& maxLogical
       m_itemsInOrder(m_items.get<ItemsInOrderTag>()),
       m_selectedThenUnselected(m_items.get<SelectedThenUnselectedTag>()),
       m_selectionLeader(nullptr),
-      m_selectionMode(false) {
+      m_selectionMode(false),
+      m_minItemTop(0.0),
+      m_maxItemBottom(0.0),
+      m_updatingMaterializedItems(false) {
   m_graphicsScene.setContextMenuEventCallback(
       [&](QGraphicsSceneContextMenuEvent* evt) { this->sceneContextMenuEvent(evt); });
+  // There are only as many items in the scene as fit the view, plus the spare ones,
+  // so indexing them would cost more on scrolling than it would save.
+  m_graphicsScene.setItemIndexMethod(QGraphicsScene::NoIndex);
 }
 
 ThumbnailSequence::Impl::~Impl() {}
@@ -455,6 +567,8 @@ void ThumbnailSequence::Impl::setThumbnailFactory(std::shared_ptr<ThumbnailFacto
 
 void ThumbnailSequence::Impl::attachView(QGraphicsView* const view) {
   view->setScene(&m_graphicsScene);
+  QObject::connect(view->verticalScrollBar(), &QScrollBar::valueChanged, &m_graphicsScene,
+                   [this]() { updateMaterializedItems(); });
 }
 
 void ThumbnailSequence::Impl::reset(const PageSequence& pages,
@@ -478,12 +592,12 @@ void ThumbnailSequence::Impl::reset(const PageSequence& pages,
     return;
   }
 
+  updateEstimatedGeometry(pages.pageAt(0));
+
   const Item* someSelectedItem = nullptr;
   for (const PageInfo& pageInfo : pages) {
-    std::unique_ptr<CompositeItem> composite(getCompositeItem(0, pageInfo));
-    m_itemsInOrder.push_back(Item(pageInfo, composite.release()));
+    m_itemsInOrder.push_back(Item(pageInfo, m_estimatedBoundingRect, m_estimatedThumbRect));
     const Item* item = &m_itemsInOrder.back();
-    item->composite->setItem(item);
 
     const ImageId& imageId = pageInfo.id().imageId();
 
@@ -521,7 +635,7 @@ void ThumbnailSequence::Impl::reset(const PageSequence& pages,
   }
   if (m_selectionLeader) {
     m_selectionLeader->setSelectionLeader(true);
-    m_owner.emitNewSelectionLeader(selectionLeader, m_selectionLeader->composite, DEFAULT_SELECTION_FLAGS);
+    m_owner.emitNewSelectionLeader(selectionLeader, m_selectionLeader, DEFAULT_SELECTION_FLAGS);
   }
 }  // ThumbnailSequence::Impl::reset
 
@@ -576,7 +690,16 @@ void ThumbnailSequence::Impl::orderItems() {
 }
 
 void ThumbnailSequence::Impl::updateSceneItemsPos() {
+  layoutItems();
+  updateMaterializedItems();
+}
+
+void ThumbnailSequence::Impl::layoutItems() {
   m_sceneRect = QRectF(0.0, 0.0, 0.0, 0.0);
+  m_itemsByPos.clear();
+  m_itemsByPos.reserve(m_items.size());
+  m_minItemTop = 0.0;
+  m_maxItemBottom = 0.0;
 
   const int viewWidth = getGraphicsViewWidth();
   assert(viewWidth > 0);
@@ -593,7 +716,7 @@ void ThumbnailSequence::Impl::updateSceneItemsPos() {
     if (m_viewMode == MULTI_COLUMN) {
       // Determine how many items can fit into the current row.
       for (ItemsInOrder::iterator rowIt = ordIt; rowIt != ordEnd; ++rowIt) {
-        const double itemWidth = rowIt->composite->boundingRect().width();
+        const double itemWidth = rowIt->boundingRect.width();
         xOffset += itemWidth + SPACING;
         if (xOffset > viewWidth) {
           if (itemsInRow == 0) {
@@ -608,7 +731,7 @@ void ThumbnailSequence::Impl::updateSceneItemsPos() {
       }
     } else {
       itemsInRow = 1;
-      sumItemWidths = ordIt->composite->boundingRect().width();
+      sumItemWidths = ordIt->boundingRect.width();
     }
 
     // Split free space between the items in the current row.
@@ -616,11 +739,25 @@ void ThumbnailSequence::Impl::updateSceneItemsPos() {
     xOffset = adjSpacing;
     double nextYOffset = 0;
     for (; itemsInRow > 0; --itemsInRow, ++ordIt) {
-      CompositeItem* composite = ordIt->composite;
-      composite->setPos(xOffset, yOffset);
-      composite->updateSceneRect(m_sceneRect);
-      xOffset += composite->boundingRect().width() + adjSpacing;
-      nextYOffset = std::max(composite->boundingRect().height() + SPACING, nextYOffset);
+      const Item& item = *ordIt;
+      item.pos = QPointF(xOffset, yOffset);
+      if (item.composite) {
+        item.composite->setPos(item.pos);
+      }
+
+      // The scene is as wide as the thumbnails, and as high as the whole items.
+      const QRectF itemRect(item.sceneRect());
+      QRectF thumbRect(item.thumbRect.translated(item.pos));
+      thumbRect.setTop(itemRect.top());
+      thumbRect.setBottom(itemRect.bottom());
+      m_sceneRect |= thumbRect;
+
+      m_itemsByPos.push_back(&item);
+      m_minItemTop = std::min(m_minItemTop, item.boundingRect.top());
+      m_maxItemBottom = std::max(m_maxItemBottom, item.boundingRect.bottom());
+
+      xOffset += item.boundingRect.width() + adjSpacing;
+      nextYOffset = std::max(item.boundingRect.height() + SPACING, nextYOffset);
     }
 
     if (ordIt != ordEnd) {
@@ -629,21 +766,149 @@ void ThumbnailSequence::Impl::updateSceneItemsPos() {
   }
 
   commitSceneRect();
+}  // ThumbnailSequence::Impl::layoutItems
+
+std::pair<size_t, size_t> ThumbnailSequence::Impl::itemsInBand(const double top, const double bottom) const {
+  // The vertical positions of items don't decrease along m_itemsByPos.
+  const auto begin = std::partition_point(m_itemsByPos.begin(), m_itemsByPos.end(),
+                                          [&](const Item* item) { return item->pos.y() + m_maxItemBottom < top; });
+  const auto end = std::partition_point(begin, m_itemsByPos.end(),
+                                        [&](const Item* item) { return item->pos.y() + m_minItemTop <= bottom; });
+  return {static_cast<size_t>(begin - m_itemsByPos.begin()), static_cast<size_t>(end - m_itemsByPos.begin())};
 }
 
-void ThumbnailSequence::Impl::invalidateThumbnailImpl(const ItemsById::iterator idIt) {
-  CompositeItem* const newComposite = getCompositeItem(&*idIt, idIt->pageInfo).release();
-  CompositeItem* const oldComposite = idIt->composite;
-  const QSizeF oldSize(oldComposite->boundingRect().size());
-  const QSizeF newSize(newComposite->boundingRect().size());
-  const QPointF oldPos(newComposite->pos());
+QRectF ThumbnailSequence::Impl::visibleSceneRect() const {
+  if (m_graphicsScene.views().isEmpty()) {
+    return QRectF();
+  }
+  const QGraphicsView* view = m_graphicsScene.views().first();
+  return view->mapToScene(view->viewport()->rect()).boundingRect();
+}
+
+void ThumbnailSequence::Impl::scrollViewBy(const double dy) {
+  if (m_graphicsScene.views().isEmpty()) {
+    return;
+  }
+  QScrollBar* scrollBar = m_graphicsScene.views().first()->verticalScrollBar();
+  scrollBar->setValue(scrollBar->value() + qRound(dy));
+}
+
+void ThumbnailSequence::Impl::updateMaterializedItems() {
+  if (m_updatingMaterializedItems) {
+    // We are scrolling the view ourselves.
+    return;
+  }
+  QRectF visibleRect(visibleSceneRect());
+  if (visibleRect.isEmpty() || m_itemsByPos.empty()) {
+    return;
+  }
+
+  m_updatingMaterializedItems = true;
 
-  idIt->composite = newComposite;
-  idIt->incompleteThumbnail = newComposite->incompleteThumbnail();
-  delete oldComposite;
+  for (int pass = 0; pass < MAX_MATERIALIZATION_PASSES; ++pass) {
+    const double margin = visibleRect.height() * PREFETCH_MARGIN;
+    const std::pair<size_t, size_t> range(itemsInBand(visibleRect.top() - margin, visibleRect.bottom() + margin));
 
-  newComposite->updateAppearence(idIt->isSelected(), idIt->isSelectionLeader());
-  m_graphicsScene.addItem(newComposite);
+    // Keep the first item in view where it is on screen when the layout changes,
+    // so that the content doesn't jump as the estimated geometry gets replaced.
+    const std::pair<size_t, size_t> inView(itemsInBand(visibleRect.top(), visibleRect.bottom()));
+    const Item* anchor = (inView.first < inView.second) ? m_itemsByPos[inView.first] : nullptr;
+    const double anchorY = anchor ? anchor->pos.y() : 0.0;
+
+    bool geometryChanged = false;
+    for (size_t i = range.first; i < range.second; ++i) {
+      if (!m_itemsByPos[i]->composite) {
+        geometryChanged |= materialize(m_itemsByPos[i]);
+      }
+    }
+    if (!geometryChanged) {
+      break;
+    }
+
+    layoutItems();
+    if (anchor && (anchor->pos.y() != anchorY)) {
+      scrollViewBy(anchor->pos.y() - anchorY);
+    }
+    visibleRect = visibleSceneRect();
+  }
+
+  const double margin = visibleRect.height() * RECYCLE_MARGIN;
+  const std::pair<size_t, size_t> keep(itemsInBand(visibleRect.top() - margin, visibleRect.bottom() + margin));
+  for (size_t i = 0; i < m_itemsByPos.size(); ++i) {
+    if ((i < keep.first) || (i >= keep.second)) {
+      dematerialize(m_itemsByPos[i]);
+    }
+  }
+
+  m_updatingMaterializedItems = false;
+}  // ThumbnailSequence::Impl::updateMaterializedItems
+
+bool ThumbnailSequence::Impl::materialize(const Item* item) {
+  CompositeItem* composite;
+  if (!m_spareComposites.empty()) {
+    composite = m_spareComposites.back();
+    m_spareComposites.pop_back();
+  } else {
+    composite = new CompositeItem(*this);
+    m_graphicsScene.addItem(composite);
+  }
+
+  const bool geometryChanged = fillComposite(composite, item);
+  item->composite = composite;
+  composite->setPos(item->pos);
+  composite->show();
+  return geometryChanged;
+}
+
+void ThumbnailSequence::Impl::dematerialize(const Item* item) {
+  CompositeItem* composite = item->composite;
+  if (!composite) {
+    return;
+  }
+  item->composite = nullptr;
+
+  composite->hide();
+  composite->clearContent();
+  composite->setItem(nullptr);
+  m_spareComposites.push_back(composite);
+}
+
+bool ThumbnailSequence::Impl::fillComposite(CompositeItem* composite, const Item* item) {
+  composite->setContent(getThumbnail(item->pageInfo), getLabelGroup(item->pageInfo));
+  composite->setItem(item);
+  composite->updateAppearence(item->isSelected(), item->isSelectionLeader());
+  item->incompleteThumbnail = composite->incompleteThumbnail();
+
+  const QRectF boundingRect(composite->boundingRect());
+  const QRectF thumbRect(composite->thumbnailRect());
+  const bool geometryChanged = (boundingRect != item->boundingRect) || (thumbRect != item->thumbRect);
+  item->boundingRect = boundingRect;
+  item->thumbRect = thumbRect;
+  return geometryChanged;
+}
+
+void ThumbnailSequence::Impl::measure(const Item* item) {
+  CompositeItem composite(*this);
+  fillComposite(&composite, item);
+}
+
+void ThumbnailSequence::Impl::updateEstimatedGeometry(const PageInfo& pageInfo) {
+  CompositeItem composite(*this);
+  composite.setContent(std::make_unique<PlaceholderThumb>(m_maxLogicalThumbSize), getLabelGroup(pageInfo));
+  m_estimatedBoundingRect = composite.boundingRect();
+  m_estimatedThumbRect = composite.thumbnailRect();
+}
+
+void ThumbnailSequence::Impl::invalidateThumbnailImpl(const ItemsById::iterator idIt) {
+  const QRectF oldRect(idIt->sceneRect());
+
+  // Pages out of view get their new thumbnails once they come into view,
+  // unless we need to know whether a thumbnail is incomplete to order them.
+  if (idIt->composite) {
+    fillComposite(idIt->composite, &*idIt);
+  } else if (m_orderProvider) {
+    measure(&*idIt);
+  }
 
   ItemsInOrder::iterator afterOld(m_items.project<ItemsInOrderTag>(idIt));
   // Notice afterOld++ below.
@@ -655,31 +920,28 @@ void ThumbnailSequence::Impl::invalidateThumbnailImpl(const ItemsById::iterator
   // Move our item to its intended position.
   m_itemsInOrder.relocate(afterNew, m_itemsInOrder.begin());
 
-  updateSceneItemsPos();
+  layoutItems();
 
   // Possibly emit the newSelectionLeader() signal.
   if (m_selectionLeader == &*idIt) {
-    if ((oldSize != newSize) || (oldPos != idIt->composite->pos())) {
-      m_owner.emitNewSelectionLeader(idIt->pageInfo, idIt->composite, REDUNDANT_SELECTION);
+    if (oldRect != idIt->sceneRect()) {
+      m_owner.emitNewSelectionLeader(idIt->pageInfo, &*idIt, REDUNDANT_SELECTION);
     }
   }
+
+  updateMaterializedItems();
 }  // ThumbnailSequence::Impl::invalidateThumbnailImpl
 
 void ThumbnailSequence::Impl::invalidateAllThumbnails() {
-  // Recreate thumbnails now, whether a thumbnail is incomplete
-  // is taken into account when sorting.
-  ItemsInOrder::iterator ordIt(m_itemsInOrder.begin());
-  const ItemsInOrder::iterator ordEnd(m_itemsInOrder.end());
-  for (; ordIt != ordEnd; ++ordIt) {
-    CompositeItem* const oldComposite = ordIt->composite;
-    CompositeItem* const newComposite = getCompositeItem(&*ordIt, ordIt->pageInfo).release();
-
-    ordIt->composite = newComposite;
-    ordIt->incompleteThumbnail = newComposite->incompleteThumbnail();
-    delete oldComposite;
-
-    newComposite->updateAppearence(ordIt->isSelected(), ordIt->isSelectionLeader());
-    m_graphicsScene.addItem(newComposite);
+  // The thumbnails in view are recreated by updateSceneItemsPos().  The rest keep
+  // their geometry as an estimate until they come into view.  An exception is when
+  // there is an order provider, as whether a thumbnail is incomplete is taken
+  // into account when sorting.
+  for (const Item& item : m_itemsInOrder) {
+    dematerialize(&item);
+    if (m_orderProvider) {
+      measure(&item);
+    }
   }
 
   orderItems();
@@ -773,7 +1035,7 @@ bool ThumbnailSequence::Impl::setSelection(const PageId& pageId, const Selection
     flags |= SELECTION_CLEARED;
   }
 
-  m_owner.emitNewSelectionLeader(idIt->pageInfo, idIt->composite, flags);
+  m_owner.emitNewSelectionLeader(idIt->pageInfo, &*idIt, flags);
   return true;
 }  // ThumbnailSequence::Impl::setSelection
 
@@ -913,64 +1175,38 @@ void ThumbnailSequence::Impl::insert(const PageInfo& newPage, BeforeOrAfter befo
   ordIt = itemInsertPosition(m_itemsInOrder.begin(), m_itemsInOrder.end(), newPage.id(),
                              /*pageIncomplete=*/true, ordIt);
 
-  double offset = 0.0;
-  if (!m_items.empty()) {
-    if (ordIt != m_itemsInOrder.end()) {
-      offset = ordIt->composite->pos().y();
-    } else {
-      ItemsInOrder::iterator it(ordIt);
-      --it;
-      offset = it->composite->y() + it->composite->boundingRect().height() + SPACING;
-    }
+  if (m_items.empty()) {
+    updateEstimatedGeometry(newPage);
   }
-  std::unique_ptr<CompositeItem> composite(getCompositeItem(0, newPage));
-  composite->setPos(0.0, offset);
-  composite->updateSceneRect(m_sceneRect);
-
-  const QPointF posDelta(0.0, composite->boundingRect().height() + SPACING);
-
-  const Item item(newPage, composite.get());
-  const std::pair<ItemsInOrder::iterator, bool> ins(m_itemsInOrder.insert(ordIt, item));
-  composite->setItem(&*ins.first);
-  m_graphicsScene.addItem(composite.release());
-
-  const ItemsInOrder::iterator ordEnd(m_itemsInOrder.end());
-  for (; ordIt != ordEnd; ++ordIt) {
-    ordIt->composite->setPos(ordIt->composite->pos() + posDelta);
-    ordIt->composite->updateSceneRect(m_sceneRect);
+  const std::pair<ItemsInOrder::iterator, bool> ins(
+      m_itemsInOrder.insert(ordIt, Item(newPage, m_estimatedBoundingRect, m_estimatedThumbRect)));
+  if (m_orderProvider) {
+    measure(&*ins.first);
   }
 
-  commitSceneRect();
+  updateSceneItemsPos();
 }  // ThumbnailSequence::Impl::insert
 
 void ThumbnailSequence::Impl::removePages(const std::set<PageId>& pagesToRemove) {
-  m_sceneRect = QRectF(0, 0, 0, 0);
-
   const std::set<PageId>::const_iterator toRemoveEnd(pagesToRemove.end());
-  QPointF posDelta(0, 0);
 
   ItemsInOrder::iterator ordIt(m_itemsInOrder.begin());
   const ItemsInOrder::iterator ordEnd(m_itemsInOrder.end());
   while (ordIt != ordEnd) {
     if (pagesToRemove.find(ordIt->pageInfo.id()) == toRemoveEnd) {
       // Keeping this page.
-      if (posDelta != QPointF(0, 0)) {
-        ordIt->composite->setPos(ordIt->composite->pos() + posDelta);
-      }
-      ordIt->composite->updateSceneRect(m_sceneRect);
       ++ordIt;
     } else {
       // Removing this page.
       if (m_selectionLeader == &*ordIt) {
         m_selectionLeader = nullptr;
       }
-      posDelta.ry() -= ordIt->composite->boundingRect().height() + SPACING;
-      delete ordIt->composite;
+      dematerialize(&*ordIt);
       m_itemsInOrder.erase(ordIt++);
     }
   }
 
-  commitSceneRect();
+  updateSceneItemsPos();
 }
 
 bool ThumbnailSequence::Impl::multipleItemsSelected() const {
@@ -996,7 +1232,7 @@ QRectF ThumbnailSequence::Impl::selectionLeaderSceneRect() const {
   if (!m_selectionLeader) {
     return QRectF();
   }
-  return m_selectionLeader->composite->mapToScene(m_selectionLeader->composite->boundingRect()).boundingRect();
+  return m_selectionLeader->sceneRect();
 }
 
 std::set<PageId> ThumbnailSequence::Impl::selectedItems() const {
@@ -1038,8 +1274,7 @@ void ThumbnailSequence::Impl::contextMenuRequested(const PageInfo& pageInfo, con
 
 void ThumbnailSequence::Impl::sceneContextMenuEvent(QGraphicsSceneContextMenuEvent* evt) {
   if (!m_itemsInOrder.empty()) {
-    CompositeItem* composite = m_itemsInOrder.back().composite;
-    const QRectF lastThumbRect(composite->mapToScene(composite->boundingRect()).boundingRect());
+    const QRectF lastThumbRect(m_itemsInOrder.back().sceneRect());
     if (evt->scenePos().y() <= lastThumbRect.bottom()) {
       return;
     }
@@ -1071,14 +1306,14 @@ void ThumbnailSequence::Impl::selectItemWithControl(const ItemsById::iterator& i
     m_selectionLeader->setSelectionLeader(true);
     moveToSelected(m_selectionLeader);
 
-    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader->composite, flags);
+    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader, flags);
     return;
   }
 
   if (!multipleItemsSelected()) {
     // Clicked on the only selected item.
     flags |= REDUNDANT_SELECTION;
-    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader->composite, flags);
+    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader, flags);
     return;
   }
 
@@ -1118,7 +1353,7 @@ void ThumbnailSequence::Impl::selectItemWithControl(const ItemsById::iterator& i
   m_selectionLeader->setSelectionLeader(true);
   // No need to moveToSelected() as it was and remains selected.
 
-  m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader->composite, flags);
+  m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader, flags);
 }  // ThumbnailSequence::Impl::selectItemWithControl
 
 void ThumbnailSequence::Impl::selectItemWithShift(const ItemsById::iterator& idIt) {
@@ -1175,7 +1410,7 @@ void ThumbnailSequence::Impl::selectItemWithShift(const ItemsById::iterator& idI
   m_selectionLeader = &*idIt;
   m_selectionLeader->setSelectionLeader(true);
 
-  m_owner.emitNewSelectionLeader(idIt->pageInfo, idIt->composite, flags);
+  m_owner.emitNewSelectionLeader(idIt->pageInfo, &*idIt, flags);
 }  // ThumbnailSequence::Impl::selectItemWithShift
 
 void ThumbnailSequence::Impl::selectItemNoModifiers(const ItemsById::iterator& idIt) {
@@ -1195,7 +1430,7 @@ void ThumbnailSequence::Impl::selectItemNoModifiers(const ItemsById::iterator& i
   m_selectionLeader->setSelectionLeader(true);
   moveToSelected(m_selectionLeader);
 
-  m_owner.emitNewSelectionLeader(idIt->pageInfo, idIt->composite, flags);
+  m_owner.emitNewSelectionLeader(idIt->pageInfo, &*idIt, flags);
 }
 
 void ThumbnailSequence::Impl::clear() {
@@ -1207,6 +1442,12 @@ void ThumbnailSequence::Impl::clear() {
     delete it->composite;
     m_itemsInOrder.erase(it++);
   }
+  m_itemsByPos.clear();
+
+  for (CompositeItem* composite : m_spareComposites) {
+    delete composite;
+  }
+  m_spareComposites.clear();
 
   assert(m_graphicsScene.items().empty());
 
@@ -1355,16 +1596,6 @@ std::unique_ptr<ThumbnailSequence::LabelGroup> ThumbnailSequence::Impl::getLabel
                                       std::move(pixmapItemSelected));
 }  // ThumbnailSequence::Impl::getLabelGroup
 
-std::unique_ptr<ThumbnailSequence::CompositeItem> ThumbnailSequence::Impl::getCompositeItem(const Item* item,
-                                                                                            const PageInfo& pageInfo) {
-  std::unique_ptr<QGraphicsItem> thumb(getThumbnail(pageInfo));
-  std::unique_ptr<LabelGroup> labelGroup(getLabelGroup(pageInfo));
-
-  auto composite = std::make_unique<CompositeItem>(*this, std::move(thumb), std::move(labelGroup));
-  composite->setItem(item);
-  return composite;
-}
-
 void ThumbnailSequence::Impl::commitSceneRect() {
   if (m_sceneRect.isNull()) {
     m_graphicsScene.setSceneRect(QRectF(0.0, 0.0, 1.0, 1.0));
@@ -1395,10 +1626,12 @@ void ThumbnailSequence::Impl::setSelectionModeEnabled(bool enabled) {
 
 /*==================== ThumbnailSequence::Item ======================*/
 
-ThumbnailSequence::Item::Item(const PageInfo& pageInfo, CompositeItem* compItem)
+ThumbnailSequence::Item::Item(const PageInfo& pageInfo, const QRectF& boundingRect, const QRectF& thumbRect)
     : pageInfo(pageInfo),
-      composite(compItem),
-      incompleteThumbnail(compItem->incompleteThumbnail()),
+      composite(nullptr),
+      incompleteThumbnail(true),
+      boundingRect(boundingRect),
+      thumbRect(thumbRect),
       m_isSelected(false),
       m_isSelectionLeader(false) {}
 
@@ -1408,7 +1641,7 @@ void ThumbnailSequence::Item::setSelected(bool selected) const {
   m_isSelected = selected;
   m_isSelectionLeader = m_isSelectionLeader && selected;
 
-  if ((wasSelected != m_isSelected) || (wasSelectionLeader != m_isSelectionLeader)) {
+  if (composite && ((wasSelected != m_isSelected) || (wasSelectionLeader != m_isSelectionLeader))) {
     composite->updateAppearence(m_isSelected, m_isSelectionLeader);
     composite->update();
   }
@@ -1420,7 +1653,7 @@ void ThumbnailSequence::Item::setSelectionLeader(bool selectionLeader) const {
   m_isSelected = m_isSelected || selectionLeader;
   m_isSelectionLeader = selectionLeader;
 
-  if ((wasSelected != m_isSelected) || (wasSelectionLeader != m_isSelectionLeader)) {
+  if (composite && ((wasSelected != m_isSelected) || (wasSelectionLeader != m_isSelectionLeader))) {
     composite->updateAppearence(m_isSelected, m_isSelectionLeader);
     composite->update();
   }
@@ -1492,10 +1725,19 @@ void ThumbnailSequence::LabelGroup::updateAppearence(bool selected, bool selecti
 
 /*==================== ThumbnailSequence::CompositeItem =====================*/
 
-ThumbnailSequence::CompositeItem::CompositeItem(ThumbnailSequence::Impl& owner,
-                                                std::unique_ptr<QGraphicsItem> thumbnail,
-                                                std::unique_ptr<LabelGroup> labelGroup)
-    : m_owner(owner), m_item(0), m_thumb(thumbnail.get()), m_labelGroup(labelGroup.get()) {
+ThumbnailSequence::CompositeItem::CompositeItem(ThumbnailSequence::Impl& owner)
+    : m_owner(owner), m_item(nullptr), m_thumb(nullptr), m_labelGroup(nullptr) {
+  setCursor(Qt::PointingHandCursor);
+  setZValue(-1);
+}
+
+void ThumbnailSequence::CompositeItem::setContent(std::unique_ptr<QGraphicsItem> thumbnail,
+                                                  std::unique_ptr<LabelGroup> labelGroup) {
+  clearContent();
+
+  m_thumb = thumbnail.get();
+  m_labelGroup = labelGroup.get();
+
   const QSizeF thumbSize(thumbnail->boundingRect().size());
   const QSizeF labelSize(labelGroup->boundingRect().size());
 
@@ -1504,29 +1746,35 @@ ThumbnailSequence::CompositeItem::CompositeItem(ThumbnailSequence::Impl& owner,
   labelGroup->setPos(thumbnail->pos().x() + 0.5 * (thumbSize.width() - labelSize.width()),
                      thumbSize.height() + thumbLabelSpacing);
 
+  // addToGroup() preserves the scene position of an item, so a recycled
+  // composite has to be at the origin to take the children where they are.
+  const QPointF pos(this->pos());
+  setPos(0.0, 0.0);
   addToGroup(thumbnail.release());
   addToGroup(labelGroup.release());
+  setPos(pos);
+}
 
-  setCursor(Qt::PointingHandCursor);
-  setZValue(-1);
+void ThumbnailSequence::CompositeItem::clearContent() {
+  // Unlike deleting a child, removeFromGroup() updates our bounding rect.
+  if (m_thumb) {
+    removeFromGroup(m_thumb);
+    delete m_thumb;
+    m_thumb = nullptr;
+  }
+  if (m_labelGroup) {
+    removeFromGroup(m_labelGroup);
+    delete m_labelGroup;
+    m_labelGroup = nullptr;
+  }
 }
 
 bool ThumbnailSequence::CompositeItem::incompleteThumbnail() const {
   return dynamic_cast<IncompleteThumbnail*>(m_thumb) != 0;
 }
 
-void ThumbnailSequence::CompositeItem::updateSceneRect(QRectF& sceneRect) {
-  QRectF rect(m_thumb->boundingRect());
-  rect.translate(m_thumb->pos());
-  rect.translate(pos());
-
-  QRectF boundingRect(this->boundingRect());
-  boundingRect.translate(pos());
-
-  rect.setTop(boundingRect.top());
-  rect.setBottom(boundingRect.bottom());
-
-  sceneRect |= rect;
+QRectF ThumbnailSequence::CompositeItem::thumbnailRect() const {
+  return m_thumb->boundingRect().translated(m_thumb->pos());
 }
 
 void ThumbnailSequence::CompositeItem::updateAppearence(bool selected, bool selectionLeader) {
@@ -92,7 +92,11 @@ class ThumbnailSequence : public QObject {
   /**
    * \brief Updates position of all the thumbnails in the view.
    *
-   * \note This function doesn't update thumbnails appearance.
+   * Only the thumbnails in and around the visible area of the view
+   * exist as graphics items.  This also creates the ones that came into
+   * that area and recycles the ones far enough from it.
+   *
+   * \note This function doesn't update appearance of existing thumbnails.
    */
   void updateSceneItemsPos();
 
@@ -255,7 +259,7 @@ class ThumbnailSequence : public QObject {
   class LabelGroup;
   class CompositeItem;
 
-  void emitNewSelectionLeader(const PageInfo& pageInfo, const CompositeItem* composite, SelectionFlags flags);
+  void emitNewSelectionLeader(const PageInfo& pageInfo, const Item* item, SelectionFlags flags);
 
   std::unique_ptr<Impl> m_impl;
 };
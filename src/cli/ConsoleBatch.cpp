@@ -0,0 +1,339 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ConsoleBatch.h"
+
+#include <QCoreApplication>
+#include <QDomDocument>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <algorithm>
+#include <cassert>
+
+#include "FileNameDisambiguator.h"
+#include "LoadFileTask.h"
+#include "MemoryCostEstimator.h"
+#include "MemoryUsageMonitor.h"
+#include "OutOfMemoryHandler.h"
+#include "PageSelectionAccessor.h"
+#include "PageSelectionProvider.h"
+#include "ProjectPages.h"
+#include "ProjectReader.h"
+#include "ProjectWriter.h"
+#include "StageSequence.h"
+#include "Utils.h"
+#include "filters/deskew/Task.h"
+#include "filters/fix_orientation/Task.h"
+#include "filters/output/Task.h"
+#include "filters/page_layout/Task.h"
+#include "filters/page_split/Task.h"
+#include "filters/select_content/Task.h"
+#include "version.h"
+
+using namespace core;
+
+namespace {
+/**
+ * Blocks the caller until the requested amount of memory is available.
+ * A request is always granted if nothing is held, as waiting wouldn't help then.
+ */
+class MemoryGate {
+  DECLARE_NON_COPYABLE(MemoryGate)
+
+ public:
+  explicit MemoryGate(const size_t budget) : m_budget(budget), m_inUse(0) {}
+
+  void acquire(const size_t bytes) {
+    const QMutexLocker locker(&m_mutex);
+    while ((m_inUse > 0) && (m_inUse + bytes > m_budget)) {
+      m_released.wait(&m_mutex);
+    }
+    m_inUse += bytes;
+  }
+
+  void release(const size_t bytes) {
+    const QMutexLocker locker(&m_mutex);
+    m_inUse -= bytes;
+    m_released.wakeAll();
+  }
+
+ private:
+  QMutex m_mutex;
+  QWaitCondition m_released;
+  const size_t m_budget;
+  size_t m_inUse;
+};
+}  // namespace
+
+class ConsoleBatch::PageSelectionProviderImpl : public PageSelectionProvider {
+ public:
+  PageSequence allPages() const override { return m_pages ? m_pages->toPageSequence(PAGE_VIEW) : PageSequence(); }
+
+  // There is no notion of selection without a GUI.
+  std::set<PageId> selectedPages() const override { return std::set<PageId>(); }
+
+  std::vector<PageRange> selectedRanges() const override { return std::vector<PageRange>(); }
+
+  void setPages(const std::shared_ptr<ProjectPages>& pages) { m_pages = pages; }
+
+ private:
+  std::shared_ptr<ProjectPages> m_pages;
+};
+
+
+ConsoleBatch::ConsoleBatch() : m_selectionProvider(std::make_shared<PageSelectionProviderImpl>()), m_memoryBudget(0) {}
+
+ConsoleBatch::~ConsoleBatch() = default;
+
+bool ConsoleBatch::openProject(const QString& projectFile) {
+  QFile file(projectFile);
+  if (!file.open(QIODevice::ReadOnly)) {
+    m_errorString = QString("Unable to open the project file: %1").arg(projectFile);
+    return false;
+  }
+
+  QDomDocument doc;
+  if (!doc.setContent(&file)) {
+    m_errorString = QString("The project file is broken: %1").arg(projectFile);
+    return false;
+  }
+  file.close();
+
+  const ProjectReader reader(doc);
+  if (!reader.success()) {
+    if (!reader.getVersion().isNull() && (reader.getVersion().toInt() != PROJECT_VERSION)) {
+      m_errorString = "The project file is not compatible with the current application version.";
+    } else {
+      m_errorString = "Unable to interpret the project file.";
+    }
+    return false;
+  }
+  if (!reader.pages()->validateDpis()) {
+    // Fixing DPIs requires user interaction, which is what the GUI is for.
+    m_errorString = "The project contains images with missing or invalid DPI.";
+    return false;
+  }
+
+  const QString outDir = reader.outputDirectory();
+  if (!outDir.isEmpty()) {
+    Utils::maybeCreateCacheDir(outDir);
+  }
+
+  m_pages = reader.pages();
+  m_selectedPage = reader.selectedPage();
+  m_selectionProvider->setPages(m_pages);
+
+  std::shared_ptr<FileNameDisambiguator> disambiguator = reader.namingDisambiguator();
+  if (!disambiguator) {
+    disambiguator = std::make_shared<FileNameDisambiguator>();
+  }
+  m_outFileNameGen = OutputFileNameGenerator(disambiguator, outDir, m_pages->layoutDirection());
+  updateDisambiguationRecords(m_pages->toPageSequence(IMAGE_VIEW));
+
+  m_stages = std::make_shared<StageSequence>(m_pages, PageSelectionAccessor(m_selectionProvider));
+  reader.readFilterSettings(m_stages->filters());
+  reader.readStageDigests(m_stages->stageDigests());
+
+  m_thumbnailCache = Utils::createThumbnailCache(m_outFileNameGen.outDir());
+  return true;
+}  // ConsoleBatch::openProject
+
+bool ConsoleBatch::saveProject(const QString& projectFile) {
+  assert(m_stages);
+
+  const ProjectWriter writer(m_pages, m_selectedPage, m_outFileNameGen);
+  if (!writer.write(projectFile, m_stages->filters(), m_stages->stageDigests())) {
+    m_errorString = QString("Error saving the project file: %1").arg(projectFile);
+    return false;
+  }
+  return true;
+}
+
+PageSequence ConsoleBatch::pageSequence(const int lastFilterIdx) const {
+  assert(m_stages);
+  return m_pages->toPageSequence(m_stages->filterAt(lastFilterIdx)->getView());
+}
+
+std::vector<ConsoleBatch::PageResult> ConsoleBatch::process(const int lastFilterIdx,
+                                                            const int firstPage,
+                                                            const int lastPage,
+                                                            const int numThreads,
+                                                            const bool force) {
+  class Runnable : public QRunnable {
+   public:
+    Runnable(BackgroundTaskPtr task,
+             StageSequence::FilterPtr lastFilter,
+             PageResult& result,
+             MemoryGate& memoryGate,
+             const size_t admittedCost,
+             MemoryUsageMonitor& memoryUsageMonitor)
+        : m_task(std::move(task)),
+          m_lastFilter(std::move(lastFilter)),
+          m_result(result),
+          m_memoryGate(memoryGate),
+          m_admittedCost(admittedCost),
+          m_memoryUsageMonitor(memoryUsageMonitor) {
+      setAutoDelete(true);
+    }
+
+    void run() override {
+      const int monitorId = m_memoryUsageMonitor.taskStarted(m_task->memoryCost());
+      runTask();
+      m_result.peakMemory = m_memoryUsageMonitor.taskFinished(monitorId);
+      m_memoryGate.release(m_admittedCost);
+    }
+
+   private:
+    void runTask() {
+      try {
+        const FilterResultPtr result((*m_task)());
+        // A result without a filter means the image file couldn't be loaded.
+        if (!result || !result->filter()) {
+          m_result.errorString = "Unable to load the image file.";
+        } else if (result->filter() != m_lastFilter) {
+          // One of the earlier filters stopped the chain, see MainWindow::filterResult().
+          m_result.errorString = QString("Processing stopped at the %1 stage.").arg(result->filter()->getName());
+        } else {
+          m_result.success = true;
+        }
+      } catch (const std::bad_alloc&) {
+        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+        m_result.outOfMemory = true;
+        m_result.errorString = "Out of memory.";
+      } catch (const std::exception& e) {
+        m_result.errorString = QString::fromLocal8Bit(e.what());
+      }
+    }
+
+    BackgroundTaskPtr m_task;
+    StageSequence::FilterPtr m_lastFilter;
+    PageResult& m_result;
+    MemoryGate& m_memoryGate;
+    const size_t m_admittedCost;
+    MemoryUsageMonitor& m_memoryUsageMonitor;
+  };
+
+
+  assert(m_stages);
+  assert(lastFilterIdx >= 0 && lastFilterIdx < m_stages->count());
+
+  const PageSequence pages = pageSequence(lastFilterIdx);
+  std::vector<PageResult> results;
+  if ((firstPage > lastPage) || (firstPage < 0) || (lastPage >= static_cast<int>(pages.numPages()))) {
+    return results;
+  }
+
+  // Every runnable writes into its own pre-allocated slot, so no locking is needed.
+  results.resize(static_cast<size_t>(lastPage - firstPage + 1));
+
+  StageDigests& stageDigests = m_stages->stageDigests();
+  MemoryGate memoryGate(memoryBudget());
+  MemoryUsageMonitor memoryUsageMonitor;
+  const MemoryCostEstimator& estimator = MemoryCostEstimator::instance();
+  QThreadPool pool;
+  pool.setMaxThreadCount(std::max(1, numThreads));
+  for (int i = firstPage; i <= lastPage; ++i) {
+    const PageInfo& page = pages.pageAt(static_cast<size_t>(i));
+    PageResult& result = results[i - firstPage];
+    result.pageId = page.id();
+
+    for (int j = 0; j < m_stages->count(); ++j) {
+      m_stages->filterAt(j)->loadDefaultSettings(page);
+    }
+    if (!force && stageDigests.isUpToDate(*m_stages, lastFilterIdx, page, m_outFileNameGen)) {
+      result.success = true;
+      result.skipped = true;
+      continue;
+    }
+
+    const BackgroundTaskPtr task(createCompositeTask(page, lastFilterIdx));
+    // The calibration keeps improving as pages finish, so it's applied as late as possible.
+    const size_t admittedCost = estimator.calibrated(task->memoryCost());
+    memoryGate.acquire(admittedCost);
+    pool.start(
+        new Runnable(task, m_stages->filterAt(lastFilterIdx), result, memoryGate, admittedCost, memoryUsageMonitor));
+  }
+  pool.waitForDone();
+
+  for (int i = firstPage; i <= lastPage; ++i) {
+    const PageResult& result = results[i - firstPage];
+    if (result.success && !result.skipped) {
+      stageDigests.recordProcessed(*m_stages, lastFilterIdx, pages.pageAt(static_cast<size_t>(i)), m_outFileNameGen);
+    }
+  }
+
+  // Let the thumbnail cache and the filters deliver their queued notifications.
+  QCoreApplication::processEvents();
+  return results;
+}  // ConsoleBatch::process
+
+size_t ConsoleBatch::memoryBudget() const {
+  return (m_memoryBudget != 0) ? m_memoryBudget : MemoryCostEstimator::memoryBudget();
+}
+
+int ConsoleBatch::numFilters() const {
+  return m_stages ? m_stages->count() : 0;
+}
+
+int ConsoleBatch::findFilterIdx(const QString& stage) const {
+  if (!m_stages) {
+    return -1;
+  }
+
+  bool ok = false;
+  const int stageNumber = stage.toInt(&ok);
+  if (ok) {
+    return ((stageNumber >= 1) && (stageNumber <= m_stages->count())) ? stageNumber - 1 : -1;
+  }
+
+  const QString normalizedStage = stage.simplified().remove(' ');
+  for (int i = 0; i < m_stages->count(); ++i) {
+    const QString name = m_stages->filterAt(i)->getName().simplified().remove(' ');
+    if (name.compare(normalizedStage, Qt::CaseInsensitive) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+BackgroundTaskPtr ConsoleBatch::createCompositeTask(const PageInfo& page, const int lastFilterIdx) {
+  // This mirrors MainWindow::createCompositeTask() for the batch case.
+  std::shared_ptr<fix_orientation::Task> fixOrientationTask;
+  std::shared_ptr<page_split::Task> pageSplitTask;
+  std::shared_ptr<deskew::Task> deskewTask;
+  std::shared_ptr<select_content::Task> selectContentTask;
+  std::shared_ptr<page_layout::Task> pageLayoutTask;
+  std::shared_ptr<output::Task> outputTask;
+
+  if (lastFilterIdx >= m_stages->outputFilterIdx()) {
+    outputTask = m_stages->outputFilter()->createTask(page.id(), m_thumbnailCache, m_outFileNameGen, true, false);
+  }
+  if (lastFilterIdx >= m_stages->pageLayoutFilterIdx()) {
+    pageLayoutTask = m_stages->pageLayoutFilter()->createTask(page.id(), outputTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->selectContentFilterIdx()) {
+    selectContentTask = m_stages->selectContentFilter()->createTask(page.id(), pageLayoutTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->deskewFilterIdx()) {
+    deskewTask = m_stages->deskewFilter()->createTask(page.id(), selectContentTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->pageSplitFilterIdx()) {
+    pageSplitTask = m_stages->pageSplitFilter()->createTask(page, deskewTask, true, false);
+  }
+  if (lastFilterIdx >= m_stages->fixOrientationFilterIdx()) {
+    fixOrientationTask = m_stages->fixOrientationFilter()->createTask(page.id(), pageSplitTask, true);
+  }
+  assert(fixOrientationTask);
+  auto task = std::make_shared<LoadFileTask>(BackgroundTask::BATCH, page, m_thumbnailCache, m_pages, fixOrientationTask);
+  task->setMemoryCost(MemoryCostEstimator::estimate(page, *m_stages, lastFilterIdx));
+  return task;
+}  // ConsoleBatch::createCompositeTask
+
+void ConsoleBatch::updateDisambiguationRecords(const PageSequence& pages) {
+  for (const PageInfo& page : pages) {
+    m_outFileNameGen.disambiguator()->registerFile(page.imageId().filePath());
+  }
+}
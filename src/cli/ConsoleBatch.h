@@ -0,0 +1,122 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CLI_CONSOLEBATCH_H_
+#define SCANTAILOR_CLI_CONSOLEBATCH_H_
+
+#include <QString>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "BackgroundTask.h"
+#include "NonCopyable.h"
+#include "OutputFileNameGenerator.h"
+#include "PageId.h"
+#include "PageSequence.h"
+#include "SelectedPage.h"
+
+class ProjectPages;
+class StageSequence;
+class ThumbnailPixmapCache;
+
+/**
+ * \brief Runs the filter chain over a project without any GUI involvement.
+ *
+ * This is the headless counterpart of the batch processing mode of MainWindow.
+ * Tasks are constructed exactly the same way, but instead of going through
+ * WorkerThreadPool and the UI event loop, they are executed on a private
+ * thread pool and their results are only inspected for success.
+ */
+class ConsoleBatch {
+  DECLARE_NON_COPYABLE(ConsoleBatch)
+
+ public:
+  struct PageResult {
+    PageId pageId;
+    bool success = false;  // The page went through all the requested filters.
+    bool skipped = false;  // Nothing has changed since the page was last processed.
+    bool outOfMemory = false;
+    size_t peakMemory = 0;  // Attributed to the page by MemoryUsageMonitor, 0 if unknown.
+    QString errorString;
+  };
+
+  ConsoleBatch();
+
+  ~ConsoleBatch();
+
+  /**
+   * \brief Reads the project file and sets up the filters.
+   *
+   * \return true on success.  On failure, errorString() describes the problem.
+   */
+  bool openProject(const QString& projectFile);
+
+  /**
+   * \brief Writes the project, including the updated filter settings.
+   *
+   * \return true on success.  On failure, errorString() describes the problem.
+   */
+  bool saveProject(const QString& projectFile);
+
+  /**
+   * \brief Returns the page sequence the given filter operates on.
+   */
+  PageSequence pageSequence(int lastFilterIdx) const;
+
+  /**
+   * \brief Processes pages [firstPage, lastPage] of pageSequence(lastFilterIdx)
+   *        through filters [0, lastFilterIdx].
+   *
+   * Unless \p force is set, pages whose inputs haven't changed since they were
+   * last processed are skipped without loading their images, see StageDigests.
+   *
+   * A page is only started when its estimated memory cost fits into the memory budget
+   * together with the pages already being processed, see MemoryCostEstimator.
+   *
+   * \param numThreads The number of pages processed simultaneously.
+   * \return One entry per page, in page sequence order.
+   */
+  std::vector<PageResult> process(int lastFilterIdx, int firstPage, int lastPage, int numThreads, bool force = false);
+
+  /**
+   * \brief Sets the memory budget, in bytes, for the pages processed simultaneously.
+   *
+   * 0 means MemoryCostEstimator::memoryBudget(), which is also the default.
+   */
+  void setMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+
+  /**
+   * \brief The memory budget process() uses, in bytes.
+   */
+  size_t memoryBudget() const;
+
+  int numFilters() const;
+
+  /**
+   * \return The filter index for a 1-based stage number or a filter name,
+   *         or -1 if nothing matches.
+   */
+  int findFilterIdx(const QString& stage) const;
+
+  const QString& errorString() const { return m_errorString; }
+
+ private:
+  class PageSelectionProviderImpl;
+
+  BackgroundTaskPtr createCompositeTask(const PageInfo& page, int lastFilterIdx);
+
+  void updateDisambiguationRecords(const PageSequence& pages);
+
+  std::shared_ptr<ProjectPages> m_pages;
+  std::shared_ptr<StageSequence> m_stages;
+  std::shared_ptr<ThumbnailPixmapCache> m_thumbnailCache;
+  std::shared_ptr<PageSelectionProviderImpl> m_selectionProvider;
+  OutputFileNameGenerator m_outFileNameGen;
+  SelectedPage m_selectedPage;
+  size_t m_memoryBudget;
+  QString m_errorString;
+};
+
+
+#endif  // ifndef SCANTAILOR_CLI_CONSOLEBATCH_H_
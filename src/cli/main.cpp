@@ -0,0 +1,210 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <config.h>
+#include <core/Application.h>
+#include <core/ImageCache.h>
+#include <core/MemoryCostEstimator.h>
+#include <core/OutOfMemoryHandler.h>
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+
+#include "ConsoleBatch.h"
+#include "version.h"
+
+namespace {
+enum ExitCode { EXIT_OK = 0, EXIT_PAGES_FAILED = 1, EXIT_BAD_USAGE = 2, EXIT_PROJECT_ERROR = 3 };
+
+int fail(const QString& message, const int exitCode) {
+  std::fprintf(stderr, "scantailor-cli: %s\n", qPrintable(message));
+  return exitCode;
+}
+
+int defaultNumThreads() {
+  int numThreads = QThread::idealThreadCount();
+  // Restricting num of processors for 32-bit due to
+  // address space constraints.
+  if (sizeof(void*) <= 4) {
+    numThreads = std::min(numThreads, 2);
+  }
+  return std::max(numThreads, 1);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  // Filters own their option widgets, so a QApplication is still required.
+  // Without a display, let it run on the offscreen platform plugin.
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
+  Application app(argc, argv);
+
+  // This information is used by QSettings.
+  Application::setApplicationName(APPLICATION_NAME);
+  Application::setOrganizationName(ORGANIZATION_NAME);
+  Application::setApplicationVersion(VERSION);
+
+  QSettings::setDefaultFormat(QSettings::IniFormat);
+  if (app.isPortableVersion()) {
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, app.getPortableConfigPath());
+  }
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Processes a ScanTailor project without a GUI.");
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("project", "The project file to process.");
+
+  const QCommandLineOption stageOption(
+      QStringList{"s", "stage"}, "The last stage to run, either as a number [1..6] or as a name. Defaults to output.",
+      "stage", "6");
+  const QCommandLineOption firstPageOption(QStringList{"f", "first-page"},
+                                           "The 1-based number of the first page to process.", "number", "1");
+  const QCommandLineOption lastPageOption(QStringList{"l", "last-page"},
+                                          "The 1-based number of the last page to process. Defaults to the last page.",
+                                          "number");
+  const QCommandLineOption threadsOption(QStringList{"j", "threads"}, "The number of pages processed simultaneously.",
+                                         "number", QString::number(defaultNumThreads()));
+  const QCommandLineOption saveAsOption(QStringList{"o", "save-as"},
+                                        "Save the project to this file instead of overwriting the input one.", "file");
+  const QCommandLineOption noSaveOption("no-save", "Don't save the project after processing.");
+  const QCommandLineOption forceOption("force", "Process all the pages, including those unchanged since the last run.");
+  const QCommandLineOption memoryBudgetOption(
+      QStringList{"m", "memory-budget"},
+      "The memory, in MiB, the pages processed simultaneously may take together. Defaults to the application setting.",
+      "MiB");
+  parser.addOptions({stageOption, firstPageOption, lastPageOption, threadsOption, saveAsOption, noSaveOption,
+                     forceOption, memoryBudgetOption});
+
+  parser.process(app);
+
+  const QStringList positionalArgs = parser.positionalArguments();
+  if (positionalArgs.size() != 1) {
+    return fail("exactly one project file has to be specified.", EXIT_BAD_USAGE);
+  }
+  const QString projectFile = QFileInfo(positionalArgs.front()).absoluteFilePath();
+
+  OutOfMemoryHandler::instance().allocateEmergencyMemory(3 * 1024 * 1024);
+
+  ConsoleBatch batch;
+  if (!batch.openProject(projectFile)) {
+    return fail(batch.errorString(), EXIT_PROJECT_ERROR);
+  }
+
+  const int lastFilterIdx = batch.findFilterIdx(parser.value(stageOption));
+  if (lastFilterIdx < 0) {
+    return fail(QString("unknown stage: %1").arg(parser.value(stageOption)), EXIT_BAD_USAGE);
+  }
+
+  const int numPages = static_cast<int>(batch.pageSequence(lastFilterIdx).numPages());
+  bool ok = true;
+  const int firstPage = parser.value(firstPageOption).toInt(&ok);
+  if (!ok || (firstPage < 1) || (firstPage > numPages)) {
+    return fail(QString("first page is out of range [1..%1].").arg(numPages), EXIT_BAD_USAGE);
+  }
+  int lastPage = numPages;
+  if (parser.isSet(lastPageOption)) {
+    lastPage = parser.value(lastPageOption).toInt(&ok);
+    if (!ok || (lastPage < firstPage) || (lastPage > numPages)) {
+      return fail(QString("last page is out of range [%1..%2].").arg(firstPage).arg(numPages), EXIT_BAD_USAGE);
+    }
+  }
+  const int numThreads = parser.value(threadsOption).toInt(&ok);
+  if (!ok || (numThreads < 1)) {
+    return fail("the number of threads has to be a positive number.", EXIT_BAD_USAGE);
+  }
+  if (parser.isSet(memoryBudgetOption)) {
+    const int memoryBudgetMiB = parser.value(memoryBudgetOption).toInt(&ok);
+    if (!ok || (memoryBudgetMiB < 1)) {
+      return fail("the memory budget has to be a positive number.", EXIT_BAD_USAGE);
+    }
+    batch.setMemoryBudget(static_cast<size_t>(memoryBudgetMiB) * 1024 * 1024);
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  const std::vector<ConsoleBatch::PageResult> results
+      = batch.process(lastFilterIdx, firstPage - 1, lastPage - 1, numThreads, parser.isSet(forceOption));
+  const qint64 elapsedMs = timer.elapsed();
+
+  QJsonArray failedPages;
+  int numFailed = 0;
+  int numSkipped = 0;
+  bool outOfMemory = false;
+  size_t peakPageMemory = 0;
+  for (const ConsoleBatch::PageResult& result : results) {
+    peakPageMemory = std::max(peakPageMemory, result.peakMemory);
+    if (result.success) {
+      if (result.skipped) {
+        ++numSkipped;
+      }
+      continue;
+    }
+    ++numFailed;
+    outOfMemory |= result.outOfMemory;
+
+    QJsonObject pageObj;
+    pageObj["file"] = result.pageId.imageId().filePath();
+    pageObj["filePage"] = result.pageId.imageId().page();
+    pageObj["subPage"] = result.pageId.subPageAsString();
+    pageObj["error"] = result.errorString;
+    failedPages.append(pageObj);
+  }
+
+  bool saved = false;
+  QString saveError;
+  if (!parser.isSet(noSaveOption)) {
+    const QString saveAs = parser.isSet(saveAsOption) ? parser.value(saveAsOption) : projectFile;
+    saved = batch.saveProject(saveAs);
+    if (!saved) {
+      saveError = batch.errorString();
+    }
+  }
+
+  QJsonObject summary;
+  summary["project"] = projectFile;
+  summary["stage"] = lastFilterIdx + 1;
+  summary["firstPage"] = firstPage;
+  summary["lastPage"] = lastPage;
+  summary["threads"] = numThreads;
+  summary["processed"] = static_cast<int>(results.size()) - numFailed - numSkipped;
+  summary["skipped"] = numSkipped;
+  summary["failed"] = numFailed;
+  summary["failedPages"] = failedPages;
+  summary["outOfMemory"] = outOfMemory;
+  summary["saved"] = saved;
+  if (!saveError.isEmpty()) {
+    summary["saveError"] = saveError;
+  }
+  summary["elapsedMs"] = static_cast<double>(elapsedMs);
+
+  const ImageCache::Stats cacheStats = ImageCache::instance().stats();
+  QJsonObject cacheObj;
+  cacheObj["hits"] = static_cast<double>(cacheStats.hits);
+  cacheObj["misses"] = static_cast<double>(cacheStats.misses);
+  cacheObj["evictions"] = static_cast<double>(cacheStats.evictions);
+  summary["imageCache"] = cacheObj;
+
+  const double bytesPerMiB = 1024.0 * 1024.0;
+  QJsonObject memoryObj;
+  memoryObj["budgetMiB"] = static_cast<double>(batch.memoryBudget()) / bytesPerMiB;
+  memoryObj["peakPageMiB"] = static_cast<double>(peakPageMemory) / bytesPerMiB;
+  memoryObj["calibrationFactor"] = MemoryCostEstimator::instance().calibrationFactor();
+  summary["memory"] = memoryObj;
+  std::fputs(QJsonDocument(summary).toJson(QJsonDocument::Indented).constData(), stdout);
+
+  if (!saveError.isEmpty()) {
+    return fail(saveError, EXIT_PROJECT_ERROR);
+  }
+  return (numFailed == 0) ? EXIT_OK : EXIT_PAGES_FAILED;
+}  // main
@@ -10,6 +10,7 @@
 #include "PageView.h"
 
 class FilterUiInterface;
+class PageId;
 class PageInfo;
 class ProjectReader;
 class ProjectWriter;
@@ -46,6 +47,15 @@ class AbstractFilter : public std::enable_shared_from_this<AbstractFilter> {
   virtual void loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) = 0;
 
   virtual void loadDefaultSettings(const PageInfo& pageInfo) = 0;
+
+  /**
+   * \brief Saves the settings affecting the processing of a single page.
+   *
+   * Unlike saveSettings(), this includes the filter-wide settings the page
+   * depends on and uses 0 in place of numeric ids.  The result is only used
+   * to detect changes, see StageDigests.
+   */
+  virtual QDomElement savePageSettings(const PageId& pageId, QDomDocument& doc) const = 0;
 };
 
 
@@ -29,6 +29,10 @@ const QString ApplicationSettings::DEFAULT_LANGUAGE = QLocale::system().name();
 const QString ApplicationSettings::DEFAULT_UNITS = "mm";
 const QString ApplicationSettings::DEFAULT_PROFILE = "Default";
 const bool ApplicationSettings::DEFAULT_SHOW_CANCELING_SELECTION_QUESTION = true;
+const int ApplicationSettings::DEFAULT_IMAGE_CACHE_SIZE = (sizeof(void*) > 4) ? 1024 : 128;
+const int ApplicationSettings::DEFAULT_TIFF_ROWS_PER_STRIP = 0;
+const bool ApplicationSettings::DEFAULT_TIFF_DEFLATE_PREDICTOR = true;
+const int ApplicationSettings::DEFAULT_PROCESSING_MEMORY_BUDGET = 0;
 
 const QString ApplicationSettings::ROOT_KEY = "settings";
 const QString ApplicationSettings::OPENGL_STATE_KEY = "enable_opengl";
@@ -52,6 +56,10 @@ const QString ApplicationSettings::LANGUAGE_KEY = "language";
 const QString ApplicationSettings::UNITS_KEY = "units";
 const QString ApplicationSettings::CURRENT_PROFILE_KEY = "current_profile";
 const QString ApplicationSettings::SHOW_CANCELING_SELECTION_QUESTION_KEY = "selection_canceling_question";
+const QString ApplicationSettings::IMAGE_CACHE_SIZE_KEY = "image_cache_size";
+const QString ApplicationSettings::TIFF_ROWS_PER_STRIP_KEY = "tiff_rows_per_strip";
+const QString ApplicationSettings::TIFF_DEFLATE_PREDICTOR_KEY = "tiff_deflate_predictor";
+const QString ApplicationSettings::PROCESSING_MEMORY_BUDGET_KEY = "processing_memory_budget";
 
 QString ApplicationSettings::getKey(const QString& keyName) {
   return ApplicationSettings::ROOT_KEY + '/' + keyName;
@@ -235,3 +243,35 @@ bool ApplicationSettings::isCancelingSelectionQuestionEnabled() {
 void ApplicationSettings::setCancelingSelectionQuestionEnabled(bool enabled) {
   m_settings.setValue(getKey(SHOW_CANCELING_SELECTION_QUESTION_KEY), enabled);
 }
+
+int ApplicationSettings::getImageCacheSize() const {
+  return m_settings.value(getKey(IMAGE_CACHE_SIZE_KEY), DEFAULT_IMAGE_CACHE_SIZE).toInt();
+}
+
+void ApplicationSettings::setImageCacheSize(int value) {
+  m_settings.setValue(getKey(IMAGE_CACHE_SIZE_KEY), value);
+}
+
+int ApplicationSettings::getTiffRowsPerStrip() const {
+  return m_settings.value(getKey(TIFF_ROWS_PER_STRIP_KEY), DEFAULT_TIFF_ROWS_PER_STRIP).toInt();
+}
+
+void ApplicationSettings::setTiffRowsPerStrip(int value) {
+  m_settings.setValue(getKey(TIFF_ROWS_PER_STRIP_KEY), value);
+}
+
+bool ApplicationSettings::isTiffDeflatePredictorEnabled() const {
+  return m_settings.value(getKey(TIFF_DEFLATE_PREDICTOR_KEY), DEFAULT_TIFF_DEFLATE_PREDICTOR).toBool();
+}
+
+void ApplicationSettings::setTiffDeflatePredictorEnabled(bool enabled) {
+  m_settings.setValue(getKey(TIFF_DEFLATE_PREDICTOR_KEY), enabled);
+}
+
+int ApplicationSettings::getProcessingMemoryBudget() const {
+  return m_settings.value(getKey(PROCESSING_MEMORY_BUDGET_KEY), DEFAULT_PROCESSING_MEMORY_BUDGET).toInt();
+}
+
+void ApplicationSettings::setProcessingMemoryBudget(int value) {
+  m_settings.setValue(getKey(PROCESSING_MEMORY_BUDGET_KEY), value);
+}
@@ -104,6 +104,32 @@ class ApplicationSettings {
 
   void setCancelingSelectionQuestionEnabled(bool enabled);
 
+  int getImageCacheSize() const;
+
+  void setImageCacheSize(int value);
+
+  /**
+   * The number of rows in a strip of output TIFF files.  0 means choosing it automatically.
+   */
+  int getTiffRowsPerStrip() const;
+
+  void setTiffRowsPerStrip(int value);
+
+  /**
+   * Whether Deflate compressed grayscale and color TIFF files are written with the horizontal predictor.
+   */
+  bool isTiffDeflatePredictorEnabled() const;
+
+  void setTiffDeflatePredictorEnabled(bool enabled);
+
+  /**
+   * The memory, in MiB, pages being processed simultaneously may take together.
+   * 0 means half of the physical memory.
+   */
+  int getProcessingMemoryBudget() const;
+
+  void setProcessingMemoryBudget(int value);
+
  private:
   static inline QString getKey(const QString& keyName);
 
@@ -128,6 +154,10 @@ class ApplicationSettings {
   static const QString DEFAULT_UNITS;
   static const QString DEFAULT_PROFILE;
   static const bool DEFAULT_SHOW_CANCELING_SELECTION_QUESTION;
+  static const int DEFAULT_IMAGE_CACHE_SIZE;
+  static const int DEFAULT_TIFF_ROWS_PER_STRIP;
+  static const bool DEFAULT_TIFF_DEFLATE_PREDICTOR;
+  static const int DEFAULT_PROCESSING_MEMORY_BUDGET;
 
   static const QString ROOT_KEY;
   static const QString OPENGL_STATE_KEY;
@@ -151,6 +181,10 @@ class ApplicationSettings {
   static const QString UNITS_KEY;
   static const QString CURRENT_PROFILE_KEY;
   static const QString SHOW_CANCELING_SELECTION_QUESTION_KEY;
+  static const QString IMAGE_CACHE_SIZE_KEY;
+  static const QString TIFF_ROWS_PER_STRIP_KEY;
+  static const QString TIFF_DEFLATE_PREDICTOR_KEY;
+  static const QString PROCESSING_MEMORY_BUDGET_KEY;
 
   QSettings m_settings;
 };
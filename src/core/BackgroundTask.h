@@ -5,6 +5,7 @@
 #define SCANTAILOR_CORE_BACKGROUNDTASK_H_
 
 #include <QAtomicInt>
+#include <cstddef>
 #include <exception>
 #include <memory>
 
@@ -22,10 +23,21 @@ class BackgroundTask : public AbstractCommand<FilterResultPtr>, public TaskStatu
   };
 
 
-  explicit BackgroundTask(Type type) : m_type(type) {}
+  explicit BackgroundTask(Type type) : m_type(type), m_memoryCost(0) {}
 
   Type type() const { return m_type; }
 
+  /**
+   * \brief The nominal peak amount of memory, in bytes, running the task takes.
+   *
+   * WorkerThreadPool won't start a task that doesn't fit into its memory budget
+   * together with those already running.  Zero means unknown.
+   * \see MemoryCostEstimator
+   */
+  size_t memoryCost() const { return m_memoryCost; }
+
+  void setMemoryCost(size_t bytes) { m_memoryCost = bytes; }
+
   void cancel() override { m_cancelFlag.store(1); }
 
   bool isCancelled() const override { return m_cancelFlag.load() != 0; }
@@ -38,6 +50,7 @@ class BackgroundTask : public AbstractCommand<FilterResultPtr>, public TaskStatu
  private:
   QAtomicInt m_cancelFlag;
   const Type m_type;
+  size_t m_memoryCost;
 };
 
 
@@ -4,16 +4,20 @@
 #include "Despeckle.h"
 
 #include <BinaryImage.h>
+#include <ConnComp.h>
 #include <ConnectivityMap.h>
+#include <RunLengthComponents.h>
 
 #include <QDebug>
 #include <QImage>
+#include <QRect>
+#include <algorithm>
 #include <cmath>
-#include <unordered_map>
 
 #include "DebugImages.h"
 #include "Dpi.h"
 #include "FastQueue.h"
+#include "ParallelFor.h"
 #include "TaskStatus.h"
 
 /**
@@ -27,6 +31,16 @@
  *
  * The last step may be repeated until no new components are marked.
  * as non-garbage.
+ *
+ * Only the components whose Voronoi segments touch are considered close.
+ * The components themselves are kept as runs of pixels, and Voronoi diagrams
+ * are only built for the areas around the components that may be attached
+ * to others, that is around the ones that aren't big.  An area only has to cover
+ * the part of the Voronoi region of its component within the distance it may be
+ * attached by, so the buffers are of the size of such areas rather than of the image,
+ * and the areas of the small components close to each other share a diagram.  The connections
+ * found for the longest such distances over a range of levels can be kept
+ * for despeckling at any level from it.
  */
 
 using namespace imageproc;
@@ -67,9 +81,14 @@ struct Settings {
    */
   int bigObjectThreshold;
 
+  bool isBig(const ConnComp& comp) const {
+    return (comp.width() >= bigObjectThreshold) || (comp.height() >= bigObjectThreshold);
+  }
+
   static Settings get(Despeckle::Level level, const Dpi& dpi);
 
   static Settings get(double level, const Dpi& dpi);
+
 };
 
 Settings Settings::get(const Despeckle::Level level, const Dpi& dpi) {
@@ -114,6 +133,45 @@ Settings Settings::get(const double level, const Dpi& dpi) {
   return settings;
 }
 
+/**
+ * \brief Narrows down where a condition changes as the level grows.
+ *
+ * The condition has to only change once over [lo, hi], and does so between
+ * the levels \p lo and \p hi are left at, which are less than 1e-6 apart.
+ */
+template <typename Condition>
+void narrowLevelChange(double& lo, double& hi, const Condition& condition) {
+  const bool loValue = condition(lo);
+  while (hi - lo > 1e-6) {
+    const double midLevel = 0.5 * (lo + hi);
+    if (condition(midLevel) == loValue) {
+      lo = midLevel;
+    } else {
+      hi = midLevel;
+    }
+  }
+}
+
+/**
+ * \brief The longest connection a component may be attached by at any level
+ *        from [minLevel, maxLevel], or 0 if it's big at all of them.
+ */
+uint32_t maxAttachmentSqdist(const ConnComp& comp, const double minLevel, const double maxLevel, const Dpi& dpi) {
+  if (Settings::get(maxLevel, dpi).isBig(comp)) {
+    return 0;
+  }
+  // Higher levels have higher big object thresholds but allow shorter connections,
+  // so the connections are the longest at the lowest level the component isn't big at.
+  // Look for it between the levels it's big and isn't big at, and take the former.
+  double level = minLevel;
+  if (Settings::get(minLevel, dpi).isBig(comp)) {
+    double notBigLevel = maxLevel;
+    narrowLevelChange(level, notBigLevel,
+                      [&](const double midLevel) { return Settings::get(midLevel, dpi).isBig(comp); });
+  }
+  return static_cast<uint32_t>(comp.pixCount()) * Settings::get(level, dpi).pixelsToSqDist;
+}
+
 struct Component {
   static const uint32_t ANCHORED_TO_BIG = uint32_t(1) << 31;
   static const uint32_t ANCHORED_TO_SMALL = uint32_t(1) << 30;
@@ -127,6 +185,8 @@ struct Component {
 
   Component() : numPixels(0) {}
 
+  uint32_t pixelCount() const { return numPixels & ~TAG_MASK; }
+
   uint32_t anchoredToBig() const { return numPixels & ANCHORED_TO_BIG; }
 
   void setAnchoredToBig() { numPixels |= ANCHORED_TO_BIG; }
@@ -144,29 +204,6 @@ const uint32_t Component::ANCHORED_TO_BIG;
 const uint32_t Component::ANCHORED_TO_SMALL;
 const uint32_t Component::TAG_MASK;
 
-struct BoundingBox {
-  int top;
-  int left;
-  int bottom;
-  int right;
-
-  BoundingBox() {
-    top = left = std::numeric_limits<int>::max();
-    bottom = right = std::numeric_limits<int>::min();
-  }
-
-  int width() const { return right - left + 1; }
-
-  int height() const { return bottom - top + 1; }
-
-  void extend(int x, int y) {
-    top = std::min(top, y);
-    left = std::min(left, x);
-    bottom = std::max(bottom, y);
-    right = std::max(right, x);
-  }
-};
-
 struct Vector {
   int16_t x;
   int16_t y;
@@ -204,43 +241,9 @@ union Distance {
   }
 };
 
-/**
- * \brief A bidirectional association between two connected components.
- */
-struct Connection {
-  uint32_t lesserLabel;
-  uint32_t greaterLabel;
-
-  Connection(uint32_t lbl1, uint32_t lbl2) {
-    if (lbl1 < lbl2) {
-      lesserLabel = lbl1;
-      greaterLabel = lbl2;
-    } else {
-      lesserLabel = lbl2;
-      greaterLabel = lbl1;
-    }
-  }
 
-  bool operator<(const Connection& rhs) const {
-    if (lesserLabel < rhs.lesserLabel) {
-      return true;
-    } else if (lesserLabel > rhs.lesserLabel) {
-      return false;
-    } else {
-      return greaterLabel < rhs.greaterLabel;
-    }
-  }
-
-  bool operator==(const Connection& other) const {
-    return (lesserLabel == other.lesserLabel) && (greaterLabel == other.greaterLabel);
-  }
-
-  struct hash {
-    std::size_t operator()(const Connection& connection) const noexcept {
-      return std::hash<int>()(connection.lesserLabel) ^ std::hash<int>()(connection.greaterLabel << 1);
-    }
-  };
-};
+using Connection = Despeckle::ComponentGraph::Connection;
+using SecondPassConnections = Despeckle::ComponentGraph::SecondPassConnections;
 
 /**
  * \brief A directional assiciation between two connected components.
@@ -270,24 +273,6 @@ struct TargetSourceConn {
   }
 };
 
-/**
- * \brief If the association didn't exist, create it,
- *        otherwise the minimum distance.
- */
-void updateDistance(std::unordered_map<Connection, uint32_t, Connection::hash>& conns,
-                    uint32_t label1,
-                    uint32_t label2,
-                    uint32_t sqdist) {
-  using Connections = std::unordered_map<Connection, uint32_t, Connection::hash>;
-
-  const Connection conn(label1, label2);
-  auto it(conns.find(conn));
-  if (it == conns.end()) {
-    conns.insert(Connections::value_type(conn, sqdist));
-  } else if (sqdist < it->second) {
-    it->second = sqdist;
-  }
-}
 
 /**
  * \brief Tag the source component with ANCHORED_TO_SMALL, ANCHORED_TO_BIG
@@ -299,12 +284,14 @@ void tagSourceComponent(Component& source, const Component& target, uint32_t sqd
     return;
   }
 
-  if (sqdist > source.numPixels * settings.pixelsToSqDist) {
+  // The tags of either component must not affect the outcome,
+  // or it would depend on the order connections are visited in.
+  if (sqdist > source.pixelCount() * settings.pixelsToSqDist) {
     // Too far.
     return;
   }
 
-  if (target.numPixels >= settings.minRelativeParentWeight * source.numPixels) {
+  if (target.pixelCount() >= settings.minRelativeParentWeight * source.pixelCount()) {
     source.setAnchoredToBig();
   } else {
     source.setAnchoredToSmall();
@@ -325,6 +312,7 @@ bool canBeAttachedTo(const Component& comp, const Component& target, uint32_t sq
   return false;
 }
 
+
 void voronoi(ConnectivityMap& cmap, std::vector<Distance>& dist) {
   const int width = cmap.size().width() + 2;
   const int height = cmap.size().height() + 2;
@@ -609,91 +597,899 @@ void voronoiSpecial(ConnectivityMap& cmap, std::vector<Distance>& dist, const Di
   }
 }  // voronoiSpecial
 
+
+/**
+ * \brief Records the distance between two components, or lowers the one
+ *        already recorded if it was the last one added.
+ *
+ * Duplicates that don't come in a row are left for mergeConnections().
+ */
+void addConnection(std::vector<Connection>& conns, uint32_t label1, uint32_t label2, const uint32_t sqdist) {
+  if (label1 > label2) {
+    std::swap(label1, label2);
+  }
+  if (!conns.empty()) {
+    Connection& last = conns.back();
+    if ((last.label1 == label1) && (last.label2 == label2)) {
+      last.sqdist = std::min(last.sqdist, sqdist);
+      return;
+    }
+  }
+  conns.emplace_back(label1, label2, sqdist);
+}
+
+/**
+ * \brief Sorts the connections by labels and only leaves the shortest one for every pair.
+ */
+void mergeConnections(std::vector<Connection>& conns) {
+  std::sort(conns.begin(), conns.end(), [](const Connection& lhs, const Connection& rhs) {
+    if (lhs.label1 != rhs.label1) {
+      return lhs.label1 < rhs.label1;
+    } else if (lhs.label2 != rhs.label2) {
+      return lhs.label2 < rhs.label2;
+    } else {
+      return lhs.sqdist < rhs.sqdist;
+    }
+  });
+  conns.erase(std::unique(conns.begin(), conns.end(),
+                          [](const Connection& lhs, const Connection& rhs) {
+                            return (lhs.label1 == rhs.label1) && (lhs.label2 == rhs.label2);
+                          }),
+              conns.end());
+}
+
+/**
+ * \brief Finds the components whose bounding boxes intersect a rectangle.
+ *
+ * The image is split into square cells, each listing the components
+ * whose bounding boxes intersect it.
+ */
+class ComponentGrid {
+ public:
+  explicit ComponentGrid(const RunLengthComponents& runs);
+
+  /**
+   * \return The labels of the components whose bounding boxes intersect \p rect,
+   *         in ascending order.
+   */
+  std::vector<uint32_t> componentsIn(const QRect& rect) const;
+
+ private:
+  static const int CELL_SIZE = 64;
+
+  QRect cellsCovering(const QRect& rect) const;
+
+  const RunLengthComponents& m_runs;
+  int m_numCols;
+  // The labels of cell i are [m_cellOffsets[i], m_cellOffsets[i + 1]) in m_labels.
+  std::vector<uint32_t> m_cellOffsets;
+  std::vector<uint32_t> m_labels;
+};
+
+const int ComponentGrid::CELL_SIZE;
+
+ComponentGrid::ComponentGrid(const RunLengthComponents& runs)
+    : m_runs(runs), m_numCols((runs.size().width() + CELL_SIZE - 1) / CELL_SIZE) {
+  const int numRows = (runs.size().height() + CELL_SIZE - 1) / CELL_SIZE;
+  m_cellOffsets.resize(static_cast<size_t>(m_numCols) * numRows + 1, 0);
+
+  // Count the components of every cell first, and turn the counts into offsets.
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    const QRect cells(cellsCovering(runs.component(label).rect()));
+    for (int row = cells.top(); row <= cells.bottom(); ++row) {
+      for (int col = cells.left(); col <= cells.right(); ++col) {
+        ++m_cellOffsets[row * m_numCols + col + 1];
+      }
+    }
+  }
+  for (size_t i = 1; i < m_cellOffsets.size(); ++i) {
+    m_cellOffsets[i] += m_cellOffsets[i - 1];
+  }
+
+  m_labels.resize(m_cellOffsets.back());
+  std::vector<uint32_t> cellEnds(m_cellOffsets.begin(), m_cellOffsets.end() - 1);
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    const QRect cells(cellsCovering(runs.component(label).rect()));
+    for (int row = cells.top(); row <= cells.bottom(); ++row) {
+      for (int col = cells.left(); col <= cells.right(); ++col) {
+        m_labels[cellEnds[row * m_numCols + col]++] = label;
+      }
+    }
+  }
+}
+
+std::vector<uint32_t> ComponentGrid::componentsIn(const QRect& rect) const {
+  std::vector<uint32_t> labels;
+  const QRect cells(cellsCovering(rect));
+  for (int row = cells.top(); row <= cells.bottom(); ++row) {
+    for (int col = cells.left(); col <= cells.right(); ++col) {
+      const int cell = row * m_numCols + col;
+      for (uint32_t i = m_cellOffsets[cell]; i < m_cellOffsets[cell + 1]; ++i) {
+        if (m_runs.component(m_labels[i]).rect().intersects(rect)) {
+          labels.push_back(m_labels[i]);
+        }
+      }
+    }
+  }
+  std::sort(labels.begin(), labels.end());
+  labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+  return labels;
+}
+
+QRect ComponentGrid::cellsCovering(const QRect& rect) const {
+  return QRect(QPoint(rect.left() / CELL_SIZE, rect.top() / CELL_SIZE),
+               QPoint(rect.right() / CELL_SIZE, rect.bottom() / CELL_SIZE));
+}
+
+/**
+ * \brief Builds a map of the parts of some components inside a rectangle.
+ *
+ * The map is of the size of the rectangle, and the components are labeled
+ * by their positions in \p labels, starting from 1.
+ */
+ConnectivityMap labelWindow(const RunLengthComponents& runs, const std::vector<uint32_t>& labels, const QRect& rect) {
+  using Run = RunLengthComponents::Run;
+
+  ConnectivityMap cmap(rect.size());
+  uint32_t* const cmapData = cmap.data();
+  const int cmapStride = cmap.stride();
+  for (size_t i = 0; i < labels.size(); ++i) {
+    const auto windowLabel = static_cast<uint32_t>(i + 1);
+    const Run* const runsEnd = runs.runsEnd(labels[i]);
+    const Run* run = std::lower_bound(runs.runsBegin(labels[i]), runsEnd, rect.top(),
+                                      [](const Run& run, const int y) { return run.y < y; });
+    for (; (run != runsEnd) && (run->y <= rect.bottom()); ++run) {
+      const int begin = std::max(run->begin, rect.left());
+      const int end = std::min(run->end, rect.right() + 1);
+      if (begin < end) {
+        uint32_t* const cmapLine = cmapData + (run->y - rect.top()) * cmapStride - rect.left();
+        std::fill(cmapLine + begin, cmapLine + end, windowLabel);
+      }
+    }
+  }
+  cmap.setMaxLabel(static_cast<uint32_t>(labels.size()));
+  return cmap;
+}
+
+/**
+ * \brief Prepares a Voronoi diagram of a window for the second pass of voronoiSpecial().
+ *
+ * The pixels of the components not in \p unblocked neither spread nor get taken over,
+ * while the rest of their Voronoi regions may be taken over by the regions of the ones in it.
+ *
+ * \param labels The components in the window, as passed to labelWindow().
+ * \param unblocked The labels of the components that aren't blocked, in ascending order.
+ */
+void blockComponents(const ConnectivityMap& cmap,
+                     std::vector<Distance>& distanceMatrix,
+                     const std::vector<uint32_t>& labels,
+                     const std::vector<uint32_t>& unblocked) {
+  std::vector<uint8_t> windowUnblocked(labels.size() + 1, 1);
+  for (size_t i = 0; i < labels.size(); ++i) {
+    windowUnblocked[i + 1] = std::binary_search(unblocked.begin(), unblocked.end(), labels[i]) ? 1 : 0;
+  }
+
+  const int width = cmap.size().width();
+  const int height = cmap.size().height();
+  const uint32_t* const cmapData = cmap.data();
+  Distance* const distanceData = &distanceMatrix[0] + width + 3;
+  const Distance zeroDistance(Distance::zero());
+  const Distance specialDistance(Distance::special());
+  for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
+    for (int x = 0; x < width; ++x, ++offset) {
+      if (!windowUnblocked[cmapData[offset]]) {
+        if (distanceData[offset] == zeroDistance) {
+          distanceData[offset] = specialDistance;
+        } else {
+          // Note: x + 1 here is equivalent to x
+          // in voronoi() or voronoiSpecial().
+          distanceData[offset].reset(x + 1);
+        }
+      }
+    }
+  }
+}
+
 /**
- * Calculate the minimum distance between components from neighboring
- * Voronoi segments.
+ * \brief Clears the labels voronoi() and voronoiSpecial() leave in the padding lines
+ *        of a window that aren't the padding lines of the image.
+ *
+ * Otherwise voronoiDistances() would find connections across the edges of the window.
+ */
+void clearInnerPadding(ConnectivityMap& cmap, const QRect& window, const QSize& imageSize) {
+  const int stride = cmap.stride();
+  uint32_t* const cmapData = cmap.paddedData();
+  if (window.top() > 0) {
+    std::fill(cmapData, cmapData + stride, 0);
+  }
+  if (window.bottom() < imageSize.height() - 1) {
+    uint32_t* const lastLine = cmapData + (window.height() + 1) * stride;
+    std::fill(lastLine, lastLine + stride, 0);
+  }
+}
+
+/**
+ * \brief Calculates the minimum distances between some components and the ones
+ *        from neighboring Voronoi segments, within a window.
+ *
+ * Only the connections not longer than the longest one that matters for either
+ * of their components are added to \p conns.  The pixels they are found between,
+ * and the pixels of the region of a component within VERTICAL_SCALE_SQ times that
+ * distance from it, have to be closer to their components than to any pixel outside
+ * of the window, except for the parts of the edges that are the edges of the image.
+ * Otherwise a component outside might have taken them.
+ *
+ * \param maxSqdists For every label, the longest connection of the component that matters,
+ *        or 0 if its connections aren't looked for.
+ * \param covered For every label, cleared if the window is too small for the component.
  */
 void voronoiDistances(const ConnectivityMap& cmap,
                       const std::vector<Distance>& distanceMatrix,
-                      std::unordered_map<Connection, uint32_t, Connection::hash>& conns) {
+                      const QRect& window,
+                      const QSize& imageSize,
+                      const std::vector<uint32_t>& maxSqdists,
+                      std::vector<uint8_t>& covered,
+                      std::vector<Connection>& conns) {
   const int width = cmap.size().width();
   const int height = cmap.size().height();
+  const int cmapStride = cmap.stride();
+  const bool leftInside = window.left() > 0;
+  const bool rightInside = window.right() < imageSize.width() - 1;
+  const bool topInside = window.top() > 0;
+  const bool bottomInside = window.bottom() < imageSize.height() - 1;
 
-  const int offsets[] = {-cmap.stride(), -1, 1, cmap.stride()};
+  const int offsets[] = {-cmapStride, -1, 1, cmapStride};
+  const int dxs[] = {0, -1, 1, 0};
+  const int dys[] = {-1, 0, 0, 1};
 
   const uint32_t* const cmapData = cmap.data();
   const Distance* const distanceData = &distanceMatrix[0] + width + 3;
+
+  const auto matters = [&maxSqdists](const uint32_t label, const uint32_t sqdist) {
+    return (maxSqdists[label] != 0) && (sqdist <= maxSqdists[label]);
+  };
+  // The distances are to the neighbors of the pixels next to the edges,
+  // as the connections are found between neighbors.
+  const auto isCovered = [&](const int x, const int y, const uint32_t sqdist) {
+    const auto xSqdist = [](const int dx) { return static_cast<uint32_t>(dx * dx); };
+    const auto ySqdist = [](const int dy) { return static_cast<uint32_t>(VERTICAL_SCALE_SQ * dy * dy); };
+    return !((leftInside && (sqdist >= xSqdist(x))) || (rightInside && (sqdist >= xSqdist(width - 1 - x)))
+             || (topInside && (sqdist >= ySqdist(y))) || (bottomInside && (sqdist >= ySqdist(height - 1 - y))));
+  };
+
   for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
     for (int x = 0; x < width; ++x, ++offset) {
-      const uint32_t label = cmapData[offset];
-      assert(label != 0);
-
-      const int x1 = x + distanceData[offset].vec.x;
-      const int y1 = y + distanceData[offset].vec.y;
+      const uint32_t thisLabel = cmapData[offset];
+      assert(thisLabel != 0);
+      const uint32_t thisSqdist = distanceData[offset].sqdist();
+      if ((thisSqdist <= VERTICAL_SCALE_SQ * maxSqdists[thisLabel]) && !isCovered(x, y, thisSqdist)) {
+        covered[thisLabel] = 0;
+      }
 
-      for (int i : offsets) {
-        const int nbhOffset = offset + i;
+      for (int i = 0; i < 4; ++i) {
+        const int nbhOffset = offset + offsets[i];
         const uint32_t nbhLabel = cmapData[nbhOffset];
-        if ((nbhLabel == 0) || (nbhLabel == label)) {
+        if ((nbhLabel == 0) || (nbhLabel == thisLabel)) {
           // label 0 can be encountered in
           // padding lines.
           continue;
         }
 
-        const int x2 = x + distanceData[nbhOffset].vec.x;
-        const int y2 = y + distanceData[nbhOffset].vec.y;
-        const int dx = x1 - x2;
-        const int dy = y1 - y2;
-        const uint32_t sqdist = dx * dx + dy * dy;
-
-        updateDistance(conns, label, nbhLabel, sqdist);
+        // Both ends are measured from (x, y).
+        const int dx = distanceData[offset].vec.x - distanceData[nbhOffset].vec.x;
+        const int dy = distanceData[offset].vec.y - distanceData[nbhOffset].vec.y;
+        const uint32_t sqdist = static_cast<uint32_t>(dx * dx) + static_cast<uint32_t>(dy * dy);
+        if (!matters(thisLabel, sqdist) && !matters(nbhLabel, sqdist)) {
+          continue;
+        }
+        if (!isCovered(x, y, thisSqdist) || !isCovered(x + dxs[i], y + dys[i], distanceData[nbhOffset].sqdist())) {
+          // Either pixel might belong to a component outside of the window.
+          if (matters(thisLabel, sqdist)) {
+            covered[thisLabel] = 0;
+          }
+          if (matters(nbhLabel, sqdist)) {
+            covered[nbhLabel] = 0;
+          }
+          continue;
+        }
+        addConnection(conns, thisLabel, nbhLabel, sqdist);
       }
     }
   }
 }  // voronoiDistances
 
-void despeckleImpl(BinaryImage& image,
-                   const Dpi& dpi,
-                   const Settings& settings,
-                   const TaskStatus& status,
-                   DebugImages* const dbg) {
-  ConnectivityMap cmap(image, CONN8);
-  if (cmap.maxLabel() == 0) {
-    // Completely white image?
-    return;
+/**
+ * \brief Finds the connections of some components from the Voronoi diagram of a window.
+ *
+ * \param labels The components in the window, as passed to labelWindow().
+ * \param centers The components to find the connections of, in ascending order.
+ *        Their bounding boxes have to be inside the window.
+ * \param centerMaxSqdists For every one of \p centers, the longest connection of it that matters.
+ * \param conns The connections found are added here.
+ * \return The components the window is too small for, whose connections weren't added.
+ */
+std::vector<uint32_t> findConnectionsInDiagram(ConnectivityMap& cmap,
+                                               const std::vector<Distance>& distanceMatrix,
+                                               const QRect& window,
+                                               const QSize& imageSize,
+                                               const std::vector<uint32_t>& labels,
+                                               const std::vector<uint32_t>& centers,
+                                               const std::vector<uint32_t>& centerMaxSqdists,
+                                               std::vector<Connection>& conns) {
+  clearInnerPadding(cmap, window, imageSize);
+
+  std::vector<uint32_t> windowCenters;
+  std::vector<uint32_t> windowMaxSqdists(labels.size() + 1, 0);
+  std::vector<uint8_t> covered(labels.size() + 1, 0);
+  auto it = labels.begin();
+  for (size_t i = 0; i < centers.size(); ++i) {
+    it = std::lower_bound(it, labels.end(), centers[i]);
+    assert((it != labels.end()) && (*it == centers[i]));
+    windowCenters.push_back(static_cast<uint32_t>(it - labels.begin() + 1));
+    windowMaxSqdists[windowCenters.back()] = centerMaxSqdists[i];
+    covered[windowCenters.back()] = 1;
   }
 
-  status.throwIfCancelled();
+  std::vector<Connection> windowConns;
+  voronoiDistances(cmap, distanceMatrix, window, imageSize, windowMaxSqdists, covered, windowConns);
+  // The connections found are right, but a component the window is too small for
+  // might have more of them, so they are only kept for the other end.
+  for (const Connection& conn : windowConns) {
+    if (((conn.sqdist <= windowMaxSqdists[conn.label1]) && covered[conn.label1])
+        || ((conn.sqdist <= windowMaxSqdists[conn.label2]) && covered[conn.label2])) {
+      conns.emplace_back(labels[conn.label1 - 1], labels[conn.label2 - 1], conn.sqdist);
+    }
+  }
 
-  std::vector<Component> components(cmap.maxLabel() + 1);
-  std::vector<BoundingBox> boundingBoxes(cmap.maxLabel() + 1);
+  std::vector<uint32_t> uncovered;
+  for (size_t i = 0; i < centers.size(); ++i) {
+    if (!covered[windowCenters[i]]) {
+      uncovered.push_back(centers[i]);
+    }
+  }
+  return uncovered;
+}  // findConnectionsInDiagram
 
-  const int width = image.width();
-  const int height = image.height();
+/**
+ * \brief Finds the connections of some components from a Voronoi diagram of a window.
+ *
+ * \param centers The components to find the connections of, in ascending order.
+ *        Their bounding boxes have to be inside the window.
+ * \param maxSqdists For every label, the longest connection of the component that matters.
+ * \param unblocked If not null, the labels of the components, in ascending order, the Voronoi
+ *        regions of the rest are given up to, as in the second pass.
+ * \param conns The connections found are added here.
+ * \return The components the window is too small for, whose connections weren't added.
+ */
+std::vector<uint32_t> findConnectionsInWindow(const RunLengthComponents& runs,
+                                              const ComponentGrid& grid,
+                                              const QRect& window,
+                                              const std::vector<uint32_t>& centers,
+                                              const std::vector<uint32_t>& maxSqdists,
+                                              const std::vector<uint32_t>* const unblocked,
+                                              std::vector<Connection>& conns) {
+  const std::vector<uint32_t> labels(grid.componentsIn(window));
+  ConnectivityMap cmap(labelWindow(runs, labels, window));
+  std::vector<Distance> distanceMatrix;
+  voronoi(cmap, distanceMatrix);
+  if (unblocked) {
+    blockComponents(cmap, distanceMatrix, labels, *unblocked);
+    voronoiSpecial(cmap, distanceMatrix, Distance::special());
+  }
 
-  uint32_t* const cmapData = cmap.data();
+  std::vector<uint32_t> centerMaxSqdists;
+  for (const uint32_t label : centers) {
+    centerMaxSqdists.push_back(maxSqdists[label]);
+  }
+  return findConnectionsInDiagram(cmap, distanceMatrix, window, runs.size(), labels, centers, centerMaxSqdists,
+                                  conns);
+}  // findConnectionsInWindow
+
+/**
+ * \brief Finds the connections of a component from a Voronoi diagram of the area around it.
+ *
+ * The area is the bounding box of the component with a margin, which is doubled
+ * until the area is large enough.
+ */
+void findConnectionsAround(const RunLengthComponents& runs,
+                           const ComponentGrid& grid,
+                           const uint32_t label,
+                           int margin,
+                           const std::vector<uint32_t>& maxSqdists,
+                           const std::vector<uint32_t>* const unblocked,
+                           std::vector<Connection>& conns) {
+  const QRect imageRect(QPoint(0, 0), runs.size());
+  const QRect compRect(runs.component(label).rect());
+  const std::vector<uint32_t> centers{label};
+  while (true) {
+    const QRect window(compRect.adjusted(-margin, -margin, margin, margin).intersected(imageRect));
+    if (findConnectionsInWindow(runs, grid, window, centers, maxSqdists, unblocked, conns).empty()) {
+      return;
+    }
+    margin *= 2;
+  }
+}
+
+/**
+ * The components not larger than TILE_SIZE share the Voronoi diagram of the tile
+ * of the image their bounding boxes are centered in, extended by TILE_MARGIN.
+ */
+const int TILE_SIZE = 256;
+const int TILE_MARGIN = 32;
+
+/**
+ * \brief Finds the connections of the given components, in parallel.
+ *
+ * \param labels The components, in ascending order.
+ * \param maxSqdists For every label, the longest connection of the component that matters.
+ * \param unblocked See findConnectionsInWindow().
+ * \return The connections sorted by labels, with the shortest one for every pair.
+ */
+std::vector<Connection> findConnections(const RunLengthComponents& runs,
+                                        const std::vector<uint32_t>& labels,
+                                        const std::vector<uint32_t>& maxSqdists,
+                                        const std::vector<uint32_t>* const unblocked,
+                                        const TaskStatus& status) {
+  const QRect imageRect(QPoint(0, 0), runs.size());
+  const ComponentGrid grid(runs);
+
+  const int numTileCols = (imageRect.width() + TILE_SIZE - 1) / TILE_SIZE;
+  const int numTileRows = (imageRect.height() + TILE_SIZE - 1) / TILE_SIZE;
+  std::vector<std::vector<uint32_t>> tileLabels(static_cast<size_t>(numTileCols) * numTileRows);
+  std::vector<uint32_t> largeLabels;
+  for (const uint32_t label : labels) {
+    const QRect rect(runs.component(label).rect());
+    if ((rect.width() > TILE_SIZE) || (rect.height() > TILE_SIZE)) {
+      largeLabels.push_back(label);
+    } else {
+      const QPoint center(rect.center());
+      tileLabels[(center.y() / TILE_SIZE) * numTileCols + center.x() / TILE_SIZE].push_back(label);
+    }
+  }
+  tileLabels.erase(std::remove_if(tileLabels.begin(), tileLabels.end(),
+                                  [](const std::vector<uint32_t>& tile) { return tile.empty(); }),
+                   tileLabels.end());
+
+  const size_t numJobs = tileLabels.size() + largeLabels.size();
+  const int numTasks = std::max(1, std::min(parallelForMaxThreads() * 4, static_cast<int>(numJobs)));
+  std::vector<std::vector<Connection>> taskConns(numTasks);
+  parallelFor(numTasks, [&](const int task) {
+    std::vector<Connection>& localConns = taskConns[task];
+    // The jobs are dealt out in turn, as the ones close in the raster order
+    // tend to be alike, and so take about as long.
+    for (size_t job = task; job < numJobs; job += numTasks) {
+      status.throwIfCancelled();
+      if (job < tileLabels.size()) {
+        const std::vector<uint32_t>& tile = tileLabels[job];
+        QRect window;
+        for (const uint32_t label : tile) {
+          window |= runs.component(label).rect();
+        }
+        window = window.adjusted(-TILE_MARGIN, -TILE_MARGIN, TILE_MARGIN, TILE_MARGIN).intersected(imageRect);
+        for (const uint32_t label :
+             findConnectionsInWindow(runs, grid, window, tile, maxSqdists, unblocked, localConns)) {
+          findConnectionsAround(runs, grid, label, TILE_MARGIN * 2, maxSqdists, unblocked, localConns);
+        }
+      } else {
+        findConnectionsAround(runs, grid, largeLabels[job - tileLabels.size()], TILE_MARGIN, maxSqdists,
+                              unblocked, localConns);
+      }
+    }
+    mergeConnections(localConns);
+  });
+
+  std::vector<Connection> conns;
+  for (std::vector<Connection>& local : taskConns) {
+    conns.insert(conns.end(), local.begin(), local.end());
+    std::vector<Connection>().swap(local);
+  }
+  mergeConnections(conns);
+  return conns;
+}  // findConnections
 
-  // Count the number of pixels and a bounding rect of each component.
-  uint32_t* cmapLine = cmapData;
+/**
+ * \brief Builds a map of the components, with labels passed through \p remappingTable.
+ */
+ConnectivityMap labelComponents(const RunLengthComponents& runs,
+                                const std::vector<uint32_t>& remappingTable,
+                                const uint32_t maxLabel) {
+  using Run = RunLengthComponents::Run;
+
+  ConnectivityMap cmap(runs.size());
+  uint32_t* const cmapData = cmap.data();
   const int cmapStride = cmap.stride();
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      const uint32_t label = cmapLine[x];
-      ++components[label].numPixels;
-      boundingBoxes[label].extend(x, y);
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    for (const Run* run = runs.runsBegin(label); run != runs.runsEnd(label); ++run) {
+      uint32_t* const cmapLine = cmapData + run->y * cmapStride;
+      std::fill(cmapLine + run->begin, cmapLine + run->end, remappingTable[label]);
     }
-    cmapLine += cmapStride;
   }
+  cmap.setMaxLabel(maxLabel);
+  return cmap;
+}
 
-  status.throwIfCancelled();
+/**
+ * \brief Finds the components whose Voronoi segments touch, with the distances between them.
+ *
+ * Only the connections that may let a component be attached to another one are found.
+ * The Voronoi diagram doesn't depend on how the components are labeled, so unifying
+ * some of them later gives the same connections as unifying them before building
+ * the diagram would.
+ *
+ * \param maxSqdists For every label, the longest connection the component may be attached by,
+ *        or 0 for components that are always big.
+ */
+std::vector<Connection> findVoronoiConnections(const RunLengthComponents& runs,
+                                               const std::vector<uint32_t>& maxSqdists,
+                                               const TaskStatus& status) {
+  std::vector<uint32_t> labels;
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    if (maxSqdists[label] != 0) {
+      labels.push_back(label);
+    }
+  }
+  return findConnections(runs, labels, maxSqdists, nullptr, status);
+}
+
+/**
+ * \brief The connections of every component, to look them up by label.
+ */
+class ConnectionIndex {
+ public:
+  struct Neighbor {
+    uint32_t label;
+    uint32_t sqdist;
+  };
+
+  ConnectionIndex(uint32_t maxLabel, const std::vector<Connection>& conns);
+
+  const Neighbor* begin(uint32_t label) const { return m_neighbors.data() + m_offsets[label]; }
+
+  const Neighbor* end(uint32_t label) const { return m_neighbors.data() + m_offsets[label + 1]; }
+
+ private:
+  // The neighbors of label i are [m_offsets[i], m_offsets[i + 1]) in m_neighbors.
+  std::vector<uint32_t> m_offsets;
+  std::vector<Neighbor> m_neighbors;
+};
+
+ConnectionIndex::ConnectionIndex(const uint32_t maxLabel, const std::vector<Connection>& conns)
+    : m_offsets(maxLabel + 2, 0), m_neighbors(conns.size() * 2) {
+  for (const Connection& conn : conns) {
+    ++m_offsets[conn.label1 + 1];
+    ++m_offsets[conn.label2 + 1];
+  }
+  for (size_t i = 1; i < m_offsets.size(); ++i) {
+    m_offsets[i] += m_offsets[i - 1];
+  }
+
+  std::vector<uint32_t> ends(m_offsets.begin(), m_offsets.end() - 1);
+  for (const Connection& conn : conns) {
+    m_neighbors[ends[conn.label1]++] = Neighbor{conn.label2, conn.sqdist};
+    m_neighbors[ends[conn.label2]++] = Neighbor{conn.label1, conn.sqdist};
+  }
+}
+
+/**
+ * \brief Tells if findRetainedComponents() would tag a component as anchored
+ *        to smaller components but not to bigger ones.
+ *
+ * The big components are unified into one of the size of the image there.
+ */
+bool isAnchoredToSmallButNotBig(const RunLengthComponents& runs,
+                                const ConnectionIndex& index,
+                                const uint32_t label,
+                                const Settings& settings) {
+  const ConnComp& comp = runs.component(label);
+  if (settings.isBig(comp)) {
+    return false;
+  }
+
+  const auto numPixels = static_cast<uint32_t>(comp.pixCount());
+  const auto imageArea = static_cast<uint32_t>(runs.size().width() * runs.size().height());
+  bool anchoredToSmall = false;
+  for (const ConnectionIndex::Neighbor* nbh = index.begin(label); nbh != index.end(label); ++nbh) {
+    if (nbh->sqdist > numPixels * settings.pixelsToSqDist) {
+      continue;
+    }
+    const ConnComp& target = runs.component(nbh->label);
+    const uint32_t targetPixels = settings.isBig(target) ? imageArea : static_cast<uint32_t>(target.pixCount());
+    if (targetPixels >= settings.minRelativeParentWeight * numPixels) {
+      return false;
+    }
+    anchoredToSmall = true;
+  }
+  return anchoredToSmall;
+}
+
+/**
+ * \brief Finds the levels from [minLevel, maxLevel] around which a component starts
+ *        or stops being anchored to smaller components but not to bigger ones.
+ *
+ * \return The levels on either side of every change, less than 1e-6 apart, in ascending order.
+ */
+std::vector<double> findAnchoringChanges(const RunLengthComponents& runs,
+                                         const ConnectionIndex& index,
+                                         const uint32_t label,
+                                         const double minLevel,
+                                         const double maxLevel,
+                                         const Dpi& dpi) {
+  const ConnComp& comp = runs.component(label);
+  const auto numPixels = static_cast<uint32_t>(comp.pixCount());
+  const Settings minSettings(Settings::get(minLevel, dpi));
+  const Settings maxSettings(Settings::get(maxLevel, dpi));
+
+  // It only depends on the conditions below, each of which changes at most once
+  // as the level grows, so it may only change where they do.
+  std::vector<double> levels{minLevel, maxLevel};
+  const auto addChange = [&](const auto& condition) {
+    if (condition(minSettings) != condition(maxSettings)) {
+      double lo = minLevel;
+      double hi = maxLevel;
+      narrowLevelChange(lo, hi, [&](const double level) { return condition(Settings::get(level, dpi)); });
+      levels.push_back(lo);
+      levels.push_back(hi);
+    }
+  };
+  addChange([&](const Settings& settings) { return settings.isBig(comp); });
+  for (const ConnectionIndex::Neighbor* nbh = index.begin(label); nbh != index.end(label); ++nbh) {
+    const ConnComp& target = runs.component(nbh->label);
+    const uint32_t sqdist = nbh->sqdist;
+    addChange([&](const Settings& settings) { return sqdist <= numPixels * settings.pixelsToSqDist; });
+    addChange([&](const Settings& settings) { return settings.isBig(target); });
+    addChange([&](const Settings& settings) {
+      return target.pixCount() >= settings.minRelativeParentWeight * numPixels;
+    });
+  }
+  std::sort(levels.begin(), levels.end());
+
+  std::vector<double> changes;
+  bool prevAnchored = isAnchoredToSmallButNotBig(runs, index, label, minSettings);
+  for (size_t i = 1; i < levels.size(); ++i) {
+    const bool anchored = isAnchoredToSmallButNotBig(runs, index, label, Settings::get(levels[i], dpi));
+    if (anchored != prevAnchored) {
+      changes.push_back(levels[i - 1]);
+      changes.push_back(levels[i]);
+    }
+    prevAnchored = anchored;
+  }
+  return changes;
+}  // findAnchoringChanges
+
+/**
+ * \brief Looks up the connections of the second pass found ahead for a component.
+ *
+ * \param maxSqdist The longest distance the component may be attached by.
+ * \param isUnblocked Tells if a component is anchored to smaller components but not to bigger ones.
+ * \return The connections found with the candidates around anchored the same way,
+ *         or null if there are none.
+ */
+template <typename IsUnblocked>
+const SecondPassConnections::Variant* findSecondPassVariant(const SecondPassConnections& entry,
+                                                            const uint32_t maxSqdist,
+                                                            const IsUnblocked& isUnblocked) {
+  for (const SecondPassConnections::Variant& variant : entry.variants) {
+    if (variant.maxSqdist < maxSqdist) {
+      continue;
+    }
+    bool same = true;
+    auto unblocked = variant.unblocked.begin();
+    for (const uint32_t candidate : variant.candidates) {
+      const bool wasUnblocked = (unblocked != variant.unblocked.end()) && (*unblocked == candidate);
+      if (wasUnblocked) {
+        ++unblocked;
+      }
+      if (isUnblocked(candidate) != wasUnblocked) {
+        same = false;
+        break;
+      }
+    }
+    if (same) {
+      return &variant;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * \brief Finds the connections of the second pass for a component, for every set
+ *        of the components around anchored the same way that some level leaves.
+ *
+ * The higher the level, the shorter the connections that matter, and the smaller
+ * the area around the component the second pass has to be done for.
+ *
+ * \param everAnchored For every label, whether some level leaves the component anchored
+ *        to smaller components but not to bigger ones.
+ * \param anchoringChanges For every such label, what findAnchoringChanges() returns.
+ */
+SecondPassConnections findSecondPassVariants(const RunLengthComponents& runs,
+                                             const ComponentGrid& grid,
+                                             const ConnectionIndex& index,
+                                             const std::vector<uint8_t>& everAnchored,
+                                             const std::vector<std::vector<double>>& anchoringChanges,
+                                             const uint32_t label,
+                                             const double minLevel,
+                                             const double maxLevel,
+                                             const Dpi& dpi) {
+  const QRect imageRect(QPoint(0, 0), runs.size());
+  const QRect compRect(runs.component(label).rect());
+  const std::vector<uint32_t> centers{label};
+  const auto numPixels = static_cast<uint32_t>(runs.component(label).pixCount());
+
+  SecondPassConnections secondPass;
+  secondPass.label = label;
+  // Finds the connections at a level, unless the ones already found hold there.
+  const auto addVariant = [&](const double level) -> const SecondPassConnections::Variant* {
+    const Settings settings(Settings::get(level, dpi));
+    const uint32_t maxSqdist = numPixels * settings.pixelsToSqDist;
+    const SecondPassConnections::Variant* const found
+        = findSecondPassVariant(secondPass, maxSqdist, [&](const uint32_t candidate) {
+            return isAnchoredToSmallButNotBig(runs, index, candidate, settings);
+          });
+    if (found) {
+      return found;
+    }
+
+    // The pixels of its region up to VERTICAL_SCALE_SQ times the longest connection
+    // that matters away from it have to be inside, so smaller margins aren't tried.
+    const auto minMargin = static_cast<int>(std::ceil(std::sqrt(double(VERTICAL_SCALE_SQ) * maxSqdist)));
+    for (int margin = std::max(TILE_MARGIN, minMargin);; margin *= 2) {
+      const QRect window(compRect.adjusted(-margin, -margin, margin, margin).intersected(imageRect));
+      const std::vector<uint32_t> labels(grid.componentsIn(window));
+      SecondPassConnections::Variant variant;
+      for (const uint32_t nbhLabel : labels) {
+        if (everAnchored[nbhLabel]) {
+          variant.candidates.push_back(nbhLabel);
+          if (isAnchoredToSmallButNotBig(runs, index, nbhLabel, settings)) {
+            variant.unblocked.push_back(nbhLabel);
+          }
+        }
+      }
+      variant.maxSqdist = maxSqdist;
+
+      ConnectivityMap cmap(labelWindow(runs, labels, window));
+      std::vector<Distance> distanceMatrix;
+      voronoi(cmap, distanceMatrix);
+      blockComponents(cmap, distanceMatrix, labels, variant.unblocked);
+      voronoiSpecial(cmap, distanceMatrix, Distance::special());
+      if (findConnectionsInDiagram(cmap, distanceMatrix, window, runs.size(), labels, centers, {maxSqdist},
+                                   variant.connections)
+              .empty()) {
+        mergeConnections(variant.connections);
+        secondPass.variants.push_back(std::move(variant));
+        return &secondPass.variants.back();
+      }
+    }
+  };
+
+  // Between the levels the candidates change at, the connections stay the same.
+  // The windows at some of those levels have more candidates, which change
+  // at more levels, so that goes on until no more of them turn up.
+  std::vector<double> levels{minLevel, maxLevel};
+  levels.insert(levels.end(), anchoringChanges[label].begin(), anchoringChanges[label].end());
+  std::vector<uint32_t> candidates;
+  for (size_t numLevels = 0; numLevels != levels.size();) {
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+    numLevels = levels.size();
+    for (size_t i = 0; i < numLevels; ++i) {
+      const double level = levels[i];
+      if (!isAnchoredToSmallButNotBig(runs, index, label, Settings::get(level, dpi))) {
+        continue;
+      }
+      const SecondPassConnections::Variant* const variant = addVariant(level);
+      for (const uint32_t candidate : variant->candidates) {
+        const auto it = std::lower_bound(candidates.begin(), candidates.end(), candidate);
+        if ((it == candidates.end()) || (*it != candidate)) {
+          candidates.insert(it, candidate);
+          levels.insert(levels.end(), anchoringChanges[candidate].begin(), anchoringChanges[candidate].end());
+        }
+      }
+    }
+  }
+  return secondPass;
+}  // findSecondPassVariants
+
+/**
+ * \brief Finds the connections the second pass may find at any level from [minLevel, maxLevel].
+ *
+ * \param conns The connections found by findVoronoiConnections().
+ * \param maxSqdists For every label, the longest connection the component may be attached by
+ *        at any of the levels, as passed to findVoronoiConnections().
+ * \return The connections for every component some level leaves anchored to smaller components
+ *         but not to bigger ones, sorted by labels.
+ */
+std::vector<SecondPassConnections> findSecondPassConnections(const RunLengthComponents& runs,
+                                                             const std::vector<Connection>& conns,
+                                                             const std::vector<uint32_t>& maxSqdists,
+                                                             const double minLevel,
+                                                             const double maxLevel,
+                                                             const Dpi& dpi,
+                                                             const TaskStatus& status) {
+  const ConnectionIndex index(runs.maxLabel(), conns);
+  const uint32_t numLabels = runs.maxLabel() + 1;
+
+  std::vector<std::vector<double>> anchoringChanges(numLabels);
+  std::vector<uint8_t> everAnchored(numLabels, 0);
+  const int numTasks = parallelForMaxThreads() * 4;
+  parallelFor(numTasks, [&](const int task) {
+    status.throwIfCancelled();
+
+    const Settings minSettings(Settings::get(minLevel, dpi));
+    for (uint32_t label = task + 1; label < numLabels; label += numTasks) {
+      if (maxSqdists[label] == 0) {
+        // Always big.
+        continue;
+      }
+      anchoringChanges[label] = findAnchoringChanges(runs, index, label, minLevel, maxLevel, dpi);
+      if (!anchoringChanges[label].empty() || isAnchoredToSmallButNotBig(runs, index, label, minSettings)) {
+        everAnchored[label] = 1;
+      }
+    }
+  });
+
+  std::vector<uint32_t> labels;
+  for (uint32_t label = 1; label < numLabels; ++label) {
+    if (everAnchored[label]) {
+      labels.push_back(label);
+    }
+  }
+
+  const ComponentGrid grid(runs);
+  std::vector<SecondPassConnections> secondPass(labels.size());
+  parallelFor(numTasks, [&](const int task) {
+    for (size_t i = task; i < labels.size(); i += numTasks) {
+      status.throwIfCancelled();
+      secondPass[i] = findSecondPassVariants(runs, grid, index, everAnchored, anchoringChanges, labels[i], minLevel,
+                                             maxLevel, dpi);
+    }
+  });
+  return secondPass;
+}  // findSecondPassConnections
+
+/**
+ * \brief Finds the connections findSecondPassConnections() found for a component, if any.
+ */
+const SecondPassConnections* findSecondPassEntry(const std::vector<SecondPassConnections>& secondPass,
+                                                 const uint32_t label) {
+  const auto it = std::lower_bound(
+      secondPass.begin(), secondPass.end(), label,
+      [](const SecondPassConnections& entry, const uint32_t label) { return entry.label < label; });
+  return ((it != secondPass.end()) && (it->label == label)) ? &*it : nullptr;
+}
+
+/**
+ * \brief Decides which components are to be retained.
+ *
+ * \param voronoiConns The connections found by findVoronoiConnections().
+ * \param secondPass The connections of the second pass found by findSecondPassConnections(),
+ *        or null to find them here.
+ * \return For every label, whether the component is to be retained.
+ */
+std::vector<uint8_t> findRetainedComponents(const RunLengthComponents& runs,
+                                            const std::vector<Connection>& voronoiConns,
+                                            const std::vector<SecondPassConnections>* const secondPass,
+                                            const Settings& settings,
+                                            const TaskStatus& status,
+                                            DebugImages* const dbg) {
+  const uint32_t numLabels = runs.maxLabel() + 1;
+  const std::vector<ConnComp>& connComps = runs.components();
+  const QSize size(runs.size());
+
+  std::vector<Component> components(numLabels);
+  uint32_t numForegroundPixels = 0;
+  for (uint32_t label = 1; label < numLabels; ++label) {
+    components[label].numPixels = static_cast<uint32_t>(connComps[label].pixCount());
+    numForegroundPixels += components[label].numPixels;
+  }
+  components[0].numPixels = static_cast<uint32_t>(size.width() * size.height()) - numForegroundPixels;
 
   // Unify big components into one.
-  std::vector<uint32_t> remappingTable(components.size());
+  std::vector<uint32_t> remappingTable(numLabels);
   uint32_t unifiedBigComponent = 0;
   uint32_t nextAvailComponent = 1;
-  for (uint32_t label = 1; label <= cmap.maxLabel(); ++label) {
-    if ((boundingBoxes[label].width() < settings.bigObjectThreshold)
-        && (boundingBoxes[label].height() < settings.bigObjectThreshold)) {
+  for (uint32_t label = 1; label < numLabels; ++label) {
+    if (!settings.isBig(connComps[label])) {
       components[nextAvailComponent] = components[label];
       remappingTable[label] = nextAvailComponent;
       ++nextAvailComponent;
@@ -704,58 +1500,36 @@ void despeckleImpl(BinaryImage& image,
         components[unifiedBigComponent] = components[label];
         // Set numPixels to a large value so that canBeAttachedTo()
         // always allows attaching to any such component.
-        components[unifiedBigComponent].numPixels = width * height;
+        components[unifiedBigComponent].numPixels = size.width() * size.height();
       }
       remappingTable[label] = unifiedBigComponent;
     }
   }
   components.resize(nextAvailComponent);
-  std::vector<BoundingBox>().swap(boundingBoxes);  // We don't need them any more.
-  status.throwIfCancelled();
-
   const uint32_t maxLabel = nextAvailComponent - 1;
-  // Remapping individual pixels.
-  cmapLine = cmapData;
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      cmapLine[x] = remappingTable[cmapLine[x]];
-    }
-    cmapLine += cmapStride;
-  }
-  if (dbg) {
-    dbg->add(cmap.visualized(), "big_components_unified");
-  }
 
-  status.throwIfCancelled();
-  // Build a Voronoi diagram.
-  std::vector<Distance> distanceMatrix;
-  voronoi(cmap, distanceMatrix);
   if (dbg) {
-    dbg->add(cmap.visualized(), "voronoi");
+    dbg->add(labelComponents(runs, remappingTable, maxLabel).visualized(), "big_components_unified");
   }
 
   status.throwIfCancelled();
 
-  Distance* const distanceData = &distanceMatrix[0] + width + 3;
-
-  // Now build a bidirectional map of distances between neighboring
-  // connected components.
-
-  using Connections = std::unordered_map<Connection, uint32_t, Connection::hash>;  // conn -> sqdist
-  Connections conns;
-
-  voronoiDistances(cmap, distanceMatrix, conns);
-
-  status.throwIfCancelled();
+  std::vector<Connection> conns;
+  conns.reserve(voronoiConns.size());
+  for (const Connection& conn : voronoiConns) {
+    const uint32_t label1 = remappingTable[conn.label1];
+    const uint32_t label2 = remappingTable[conn.label2];
+    if (label1 != label2) {
+      conns.emplace_back(std::min(label1, label2), std::max(label1, label2), conn.sqdist);
+    }
+  }
 
   // Tag connected components with ANCHORED_TO_BIG or ANCHORED_TO_SMALL.
-  for (const Connections::value_type& pair : conns) {
-    const Connection conn(pair.first);
-    const uint32_t sqdist = pair.second;
-    Component& comp1 = components[conn.lesserLabel];
-    Component& comp2 = components[conn.greaterLabel];
-    tagSourceComponent(comp1, comp2, sqdist, settings);
-    tagSourceComponent(comp2, comp1, sqdist, settings);
+  for (const Connection& conn : conns) {
+    Component& comp1 = components[conn.label1];
+    Component& comp2 = components[conn.label2];
+    tagSourceComponent(comp1, comp2, conn.sqdist, settings);
+    tagSourceComponent(comp2, comp1, conn.sqdist, settings);
   }
 
   // Prevent it from growing when we compute the Voronoi diagram
@@ -776,53 +1550,57 @@ void despeckleImpl(BinaryImage& image,
     // Give such components a second chance.  Maybe they do have
     // big neighbors, but Voronoi regions from a smaller ones
     // block the path to the bigger ones.
+    std::vector<uint32_t> unblocked;
+    for (uint32_t label = 1; label < numLabels; ++label) {
+      if (components[remappingTable[label]].anchoredToSmallButNotBig()) {
+        unblocked.push_back(label);
+      }
+    }
 
-    const Distance zeroDistance(Distance::zero());
-    const Distance specialDistance(Distance::special());
-    for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
-      for (int x = 0; x < width; ++x, ++offset) {
-        const uint32_t label = cmapData[offset];
-        assert(label != 0);
-
-        const Component& comp = components[label];
-        if (!comp.anchoredToSmallButNotBig()) {
-          if (distanceData[offset] == zeroDistance) {
-            // Prevent this region from growing
-            // and from being taken over by another
-            // by another region.
-            distanceData[offset] = specialDistance;
-          } else {
-            // Allow this region to be taken over by others.
-            // Note: x + 1 here is equivalent to x
-            // in voronoi() or voronoiSpecial().
-            distanceData[offset].reset(x + 1);
+    // The connections found ahead only hold if all of these components were expected
+    // to be anchored this way.  The rest are found here.
+    const bool haveSecondPass
+        = secondPass && std::all_of(unblocked.begin(), unblocked.end(), [secondPass](const uint32_t label) {
+            return findSecondPassEntry(*secondPass, label) != nullptr;
+          });
+    std::vector<Connection> secondPassConns;
+    std::vector<uint32_t> secondPassLabels;
+    std::vector<uint32_t> maxSqdists(numLabels, 0);
+    for (const uint32_t label : unblocked) {
+      const uint32_t maxSqdist = components[remappingTable[label]].pixelCount() * settings.pixelsToSqDist;
+      const SecondPassConnections::Variant* const found
+          = haveSecondPass ? findSecondPassVariant(*findSecondPassEntry(*secondPass, label), maxSqdist,
+                                                   [&unblocked](const uint32_t candidate) {
+                                                     return std::binary_search(unblocked.begin(), unblocked.end(),
+                                                                               candidate);
+                                                   })
+                           : nullptr;
+      if (found) {
+        for (const Connection& conn : found->connections) {
+          if (conn.sqdist <= maxSqdist) {
+            secondPassConns.push_back(conn);
           }
         }
+      } else {
+        secondPassLabels.push_back(label);
+        maxSqdists[label] = maxSqdist;
       }
     }
-
-    status.throwIfCancelled();
-
-    // Calculate the Voronoi diagram again, but this time
-    // treat pixels with a special distance in such a way
-    // to prevent them from spreading but also preventing
-    // them from being overwritten.
-    voronoiSpecial(cmap, distanceMatrix, specialDistance);
-    if (dbg) {
-      dbg->add(cmap.visualized(), "voronoi_special");
+    if (!secondPassLabels.empty()) {
+      const std::vector<Connection> found(findConnections(runs, secondPassLabels, maxSqdists, &unblocked, status));
+      secondPassConns.insert(secondPassConns.end(), found.begin(), found.end());
     }
 
-    status.throwIfCancelled();
-
-    // We've got new connections.  Add them to the map.
-    voronoiDistances(cmap, distanceMatrix, conns);
+    // We've got new connections.  Add them to the list.
+    for (const Connection& conn : secondPassConns) {
+      const uint32_t label1 = remappingTable[conn.label1];
+      const uint32_t label2 = remappingTable[conn.label2];
+      conns.emplace_back(std::min(label1, label2), std::max(label1, label2), conn.sqdist);
+    }
   }
 
   status.throwIfCancelled();
 
-  // Clear the distance matrix.
-  std::vector<Distance>().swap(distanceMatrix);
-
   // Remove tags from components.
   for (Component& comp : components) {
     comp.clearTags();
@@ -830,23 +1608,18 @@ void despeckleImpl(BinaryImage& image,
   // Build a directional connection map and only include
   // good connections, that is those with a small enough
   // distance.
-  // While at it, clear the bidirectional connection map.
   std::vector<TargetSourceConn> targetSource;
-  while (!conns.empty()) {
-    const auto it(conns.begin());
-    const uint32_t label1 = it->first.lesserLabel;
-    const uint32_t label2 = it->first.greaterLabel;
-    const uint32_t sqdist = it->second;
-    const Component& comp1 = components[label1];
-    const Component& comp2 = components[label2];
-    if (canBeAttachedTo(comp1, comp2, sqdist, settings)) {
-      targetSource.emplace_back(label2, label1);
+  for (const Connection& conn : conns) {
+    const Component& comp1 = components[conn.label1];
+    const Component& comp2 = components[conn.label2];
+    if (canBeAttachedTo(comp1, comp2, conn.sqdist, settings)) {
+      targetSource.emplace_back(conn.label2, conn.label1);
     }
-    if (canBeAttachedTo(comp2, comp1, sqdist, settings)) {
-      targetSource.emplace_back(label1, label2);
+    if (canBeAttachedTo(comp2, comp1, conn.sqdist, settings)) {
+      targetSource.emplace_back(conn.label1, conn.label2);
     }
-    conns.erase(it);
   }
+  std::vector<Connection>().swap(conns);
 
   std::sort(targetSource.begin(), targetSource.end());
 
@@ -890,22 +1663,61 @@ void despeckleImpl(BinaryImage& image,
     }
   }
 
-  status.throwIfCancelled();
-  // Remove unmarked components from the binary image.
+  std::vector<uint8_t> retained(numLabels, 0);
+  for (uint32_t label = 1; label < numLabels; ++label) {
+    retained[label] = components[remappingTable[label]].anchoredToBig() ? 1 : 0;
+  }
+  return retained;
+}  // findRetainedComponents
+
+/**
+ * \brief Sets or clears the pixels of all the runs of a component.
+ */
+void paintComponent(BinaryImage& image, const RunLengthComponents& runs, const uint32_t label, const BWColor color) {
   const uint32_t msb = uint32_t(1) << 31;
-  uint32_t* imageLine = image.data();
+  uint32_t* const imageData = image.data();
   const int imageStride = image.wordsPerLine();
-  cmapLine = cmapData;
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      if (!components[cmapLine[x]].anchoredToBig()) {
+  for (const RunLengthComponents::Run* run = runs.runsBegin(label); run != runs.runsEnd(label); ++run) {
+    uint32_t* const imageLine = imageData + run->y * imageStride;
+    for (int x = run->begin; x < run->end; ++x) {
+      if (color == BLACK) {
+        imageLine[x >> 5] |= msb >> (x & 31);
+      } else {
         imageLine[x >> 5] &= ~(msb >> (x & 31));
       }
     }
-    imageLine += imageStride;
-    cmapLine += cmapStride;
   }
 }
+
+void despeckleImpl(BinaryImage& image, const Settings& settings, const TaskStatus& status, DebugImages* const dbg) {
+  const RunLengthComponents runs(image, CONN8);
+  if (runs.maxLabel() == 0) {
+    // Completely white image?
+    return;
+  }
+
+  status.throwIfCancelled();
+
+  std::vector<uint32_t> maxSqdists(runs.maxLabel() + 1, 0);
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    const ConnComp& comp = runs.component(label);
+    if (!settings.isBig(comp)) {
+      maxSqdists[label] = static_cast<uint32_t>(comp.pixCount()) * settings.pixelsToSqDist;
+    }
+  }
+  const std::vector<Connection> conns(findVoronoiConnections(runs, maxSqdists, status));
+  status.throwIfCancelled();
+
+  const std::vector<uint8_t> retained(findRetainedComponents(runs, conns, nullptr, settings, status, dbg));
+  status.throwIfCancelled();
+
+  // Remove unmarked components from the binary image.
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    if (!retained[label]) {
+      paintComponent(image, runs, label, WHITE);
+    }
+  }
+}  // despeckleImpl
 }  // namespace
 
 BinaryImage Despeckle::despeckle(const BinaryImage& src,
@@ -924,7 +1736,7 @@ void Despeckle::despeckleInPlace(BinaryImage& image,
                                  const TaskStatus& status,
                                  DebugImages* const dbg) {
   const Settings settings = Settings::get(level, dpi);
-  despeckleImpl(image, dpi, settings, status, dbg);
+  despeckleImpl(image, settings, status, dbg);
 }
 
 imageproc::BinaryImage Despeckle::despeckle(const imageproc::BinaryImage& src,
@@ -943,6 +1755,62 @@ void Despeckle::despeckleInPlace(imageproc::BinaryImage& image,
                                  const TaskStatus& status,
                                  DebugImages* dbg) {
   const Settings settings = Settings::get(level, dpi);
-  despeckleImpl(image, dpi, settings, status, dbg);
+  despeckleImpl(image, settings, status, dbg);
 }
 // Despeckle::despeckleInPlace
+
+Despeckle::ComponentGraph::ComponentGraph() : m_minLevel(0), m_maxLevel(0) {}
+
+Despeckle::ComponentGraph Despeckle::buildGraph(const BinaryImage& image,
+                                                const Dpi& dpi,
+                                                const double minLevel,
+                                                const double maxLevel,
+                                                const TaskStatus& status) {
+  ComponentGraph graph;
+  graph.m_components = RunLengthComponents(image, CONN8);
+  graph.m_dpi = dpi;
+  graph.m_minLevel = minLevel;
+  graph.m_maxLevel = maxLevel;
+
+  status.throwIfCancelled();
+
+  const RunLengthComponents& runs = graph.m_components;
+  if (runs.maxLabel() != 0) {
+    std::vector<uint32_t> maxSqdists(runs.maxLabel() + 1, 0);
+    for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+      maxSqdists[label] = maxAttachmentSqdist(runs.component(label), minLevel, maxLevel, dpi);
+    }
+    graph.m_connections = findVoronoiConnections(runs, maxSqdists, status);
+    status.throwIfCancelled();
+
+    graph.m_secondPassConnections
+        = findSecondPassConnections(runs, graph.m_connections, maxSqdists, minLevel, maxLevel, dpi, status);
+  }
+  return graph;
+}
+
+BinaryImage Despeckle::speckles(const ComponentGraph& graph,
+                                const double level,
+                                const TaskStatus& status,
+                                DebugImages* dbg) {
+  assert(graph.covers(level));
+
+  const RunLengthComponents& runs = graph.components();
+  BinaryImage speckles(runs.size(), WHITE);
+  if (runs.maxLabel() == 0) {
+    return speckles;
+  }
+
+  const Settings settings = Settings::get(level, graph.dpi());
+  const std::vector<uint8_t> retained(
+      findRetainedComponents(runs, graph.connections(), &graph.secondPassConnections(), settings, status, dbg));
+  status.throwIfCancelled();
+
+  for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+    if (!retained[label]) {
+      paintComponent(speckles, runs, label, BLACK);
+    }
+  }
+  return speckles;
+}
+
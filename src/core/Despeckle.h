@@ -4,7 +4,13 @@
 #ifndef SCANTAILOR_CORE_DESPECKLE_H_
 #define SCANTAILOR_CORE_DESPECKLE_H_
 
-class Dpi;
+#include <RunLengthComponents.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Dpi.h"
+
 class TaskStatus;
 class DebugImages;
 
@@ -16,6 +22,89 @@ class Despeckle {
  public:
   enum Level { CAUTIOUS, NORMAL, AGGRESSIVE };
 
+  /**
+   * \brief The connected components of an image with the distances between them.
+   *
+   * Holds what despeckling the image at any level from a range starts with,
+   * so that going from one level to another is a matter of re-evaluating
+   * the thresholds.  That includes the connections the second pass finds
+   * around the components some levels leave anchored to smaller ones
+   * but not to bigger ones.
+   */
+  class ComponentGraph {
+   public:
+    /**
+     * \brief A pair of components whose Voronoi segments touch,
+     *        with the squared distance between their closest pixels found.
+     */
+    struct Connection {
+      uint32_t label1;
+      uint32_t label2;
+      uint32_t sqdist;
+
+      Connection(uint32_t lbl1, uint32_t lbl2, uint32_t sqdist) : label1(lbl1), label2(lbl2), sqdist(sqdist) {}
+    };
+
+    /**
+     * \brief The connections the second pass finds for a component some levels leave
+     *        anchored to smaller components but not to bigger ones.
+     *
+     * They depend on which of the components around are anchored the same way,
+     * so they are kept for every set of those the levels leave.
+     */
+    struct SecondPassConnections {
+      struct Variant {
+        /** The labels of the components around that may be anchored the same way, in ascending order. */
+        std::vector<uint32_t> candidates;
+
+        /** The labels of the candidates that are, in ascending order. */
+        std::vector<uint32_t> unblocked;
+
+        /** The longest distance the component may be attached by the connections are found up to. */
+        uint32_t maxSqdist;
+
+        /** Sorted by labels. */
+        std::vector<Connection> connections;
+      };
+
+      uint32_t label;
+      std::vector<Variant> variants;
+    };
+
+    /**
+     * \brief Constructs a null graph, which covers no levels.
+     */
+    ComponentGraph();
+
+    bool isNull() const { return m_components.size().isEmpty(); }
+
+    /**
+     * \brief Checks if despeckle() may be called with the given level.
+     */
+    bool covers(double level) const { return !isNull() && (level >= m_minLevel) && (level <= m_maxLevel); }
+
+    const imageproc::RunLengthComponents& components() const { return m_components; }
+
+    const std::vector<Connection>& connections() const { return m_connections; }
+
+    /**
+     * \brief The connections of the second pass, sorted by labels.
+     */
+    const std::vector<SecondPassConnections>& secondPassConnections() const { return m_secondPassConnections; }
+
+    const Dpi& dpi() const { return m_dpi; }
+
+   private:
+    friend class Despeckle;
+
+    imageproc::RunLengthComponents m_components;
+    std::vector<Connection> m_connections;
+    std::vector<SecondPassConnections> m_secondPassConnections;
+    Dpi m_dpi;
+    double m_minLevel;
+    double m_maxLevel;
+  };
+
   /**
    * \brief Removes small speckles from a binary image.
    *
@@ -52,6 +141,33 @@ class Despeckle {
                                double level,
                                const TaskStatus& status,
                                DebugImages* dbg = nullptr);
+
+  /**
+   * \brief Builds a graph for despeckling an image at any level from [minLevel, maxLevel].
+   *
+   * Takes longer than despeckling the image once does, but then speckles()
+   * only has to re-evaluate the thresholds.
+   */
+  static ComponentGraph buildGraph(const imageproc::BinaryImage& image,
+                                   const Dpi& dpi,
+                                   double minLevel,
+                                   double maxLevel,
+                                   const TaskStatus& status);
+
+  /**
+   * \brief Finds the speckles despeckling the image a graph was built for would remove.
+   *
+   * \param graph The graph of the image.
+   * \param level Despeckling aggressiveness.  Must be covered by the graph.
+   * \param dbg An optional sink for debugging images.
+   * \param status For asynchronous task cancellation.
+   * \return An image of the same size as the one the graph was built for,
+   *         with only the speckles being black.
+   */
+  static imageproc::BinaryImage speckles(const ComponentGraph& graph,
+                                         double level,
+                                         const TaskStatus& status,
+                                         DebugImages* dbg = nullptr);
 };
 
 
@@ -17,6 +17,11 @@ class FilterData {
  public:
   explicit FilterData(const QImage& image);
 
+  /**
+   * \brief Constructs from an image and its already computed grayscale version.
+   */
+  FilterData(const QImage& image, const imageproc::GrayImage& grayImage);
+
   FilterData(const FilterData& other, const ImageTransformation& xform);
 
   FilterData(const FilterData& other);
@@ -0,0 +1,161 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ImageCache.h"
+
+#include <QFileInfo>
+
+#include "ApplicationSettings.h"
+
+using namespace imageproc;
+
+ImageCache::ImageCache()
+    : m_bytesUsed(0),
+      m_byteBudget(static_cast<size_t>(ApplicationSettings::getInstance().getImageCacheSize()) * 1024 * 1024),
+      m_hits(0),
+      m_misses(0),
+      m_evictions(0) {}
+
+ImageCache& ImageCache::instance() {
+  static ImageCache object;
+  return object;
+}
+
+ImageCache::Entry ImageCache::loadImpl(const ImageId& imageId, const VirtualFunction<QImage>& loader) {
+  // Taken before decoding, so that a file modified while being decoded
+  // won't be cached under its new stamp.
+  const FileStamp stamp = fileStampOf(imageId);
+
+  bool cacheResult = false;
+  {
+    const QMutexLocker locker(&m_mutex);
+
+    while (m_pendingLoads.find(imageId) != m_pendingLoads.end()) {
+      m_loadFinished.wait(&m_mutex);
+    }
+
+    const auto it = m_index.find(imageId);
+    if (it != m_index.end()) {
+      if (it->second->stamp == stamp) {
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return m_lru.front().entry;
+      }
+      // The file has changed on disk.
+      removeLocked(imageId);
+    }
+
+    ++m_misses;
+    if ((m_byteBudget != 0) && (stamp.size >= 0)) {
+      m_pendingLoads.insert(imageId);
+      cacheResult = true;
+    }
+  }
+
+  // Wakes up the waiters even if the loader throws.
+  struct PendingLoadGuard {
+    ImageCache* cache;
+    const ImageId* imageId;
+
+    ~PendingLoadGuard() {
+      if (cache) {
+        const QMutexLocker locker(&cache->m_mutex);
+        cache->m_pendingLoads.erase(*imageId);
+        cache->m_loadFinished.wakeAll();
+      }
+    }
+  } pendingLoadGuard{cacheResult ? this : nullptr, &imageId};
+
+  Entry entry;
+  entry.image = loader();
+  if (entry.image.isNull()) {
+    return entry;
+  }
+  entry.grayImage = GrayImage(entry.image);
+
+  if (cacheResult) {
+    const size_t cost = costOf(entry);
+    const QMutexLocker locker(&m_mutex);
+    if (cost <= m_byteBudget) {
+      m_lru.push_front(Node{imageId, stamp, entry, cost});
+      m_index[imageId] = m_lru.begin();
+      m_bytesUsed += cost;
+      evictLocked();
+    }
+  }
+  return entry;
+}  // ImageCache::loadImpl
+
+void ImageCache::remove(const ImageId& imageId) {
+  const QMutexLocker locker(&m_mutex);
+  removeLocked(imageId);
+}
+
+void ImageCache::clear() {
+  const QMutexLocker locker(&m_mutex);
+  m_lru.clear();
+  m_index.clear();
+  m_bytesUsed = 0;
+}
+
+void ImageCache::setByteBudget(const size_t bytes) {
+  const QMutexLocker locker(&m_mutex);
+  m_byteBudget = bytes;
+  evictLocked();
+}
+
+ImageCache::Stats ImageCache::stats() const {
+  const QMutexLocker locker(&m_mutex);
+
+  Stats stats;
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  stats.evictions = m_evictions;
+  stats.numEntries = m_lru.size();
+  stats.bytesUsed = m_bytesUsed;
+  stats.byteBudget = m_byteBudget;
+  return stats;
+}
+
+ImageCache::FileStamp ImageCache::fileStampOf(const ImageId& imageId) {
+  FileStamp stamp;
+  const QFileInfo fileInfo(imageId.filePath());
+  if (fileInfo.exists()) {
+    stamp.size = fileInfo.size();
+    stamp.lastModified = fileInfo.lastModified();
+  }
+  return stamp;
+}
+
+size_t ImageCache::costOf(const Entry& entry) {
+  const QImage& image = entry.image;
+  const QImage& grayImage = entry.grayImage.toQImage();
+
+  size_t cost = static_cast<size_t>(image.bytesPerLine()) * image.height();
+  // For grayscale sources both refer to the same data.
+  if (grayImage.constBits() != image.constBits()) {
+    cost += static_cast<size_t>(grayImage.bytesPerLine()) * grayImage.height();
+  }
+  return cost;
+}
+
+void ImageCache::removeLocked(const ImageId& imageId) {
+  const auto it = m_index.find(imageId);
+  if (it == m_index.end()) {
+    return;
+  }
+
+  m_bytesUsed -= it->second->cost;
+  m_lru.erase(it->second);
+  m_index.erase(it);
+}
+
+void ImageCache::evictLocked() {
+  while (!m_lru.empty() && (m_bytesUsed > m_byteBudget)) {
+    const Node& node = m_lru.back();
+    m_bytesUsed -= node.cost;
+    m_index.erase(node.imageId);
+    m_lru.pop_back();
+    ++m_evictions;
+  }
+}
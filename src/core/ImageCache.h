@@ -0,0 +1,132 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_IMAGECACHE_H_
+#define SCANTAILOR_CORE_IMAGECACHE_H_
+
+#include <GrayImage.h>
+
+#include <QDateTime>
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ImageId.h"
+#include "NonCopyable.h"
+#include "VirtualFunction.h"
+
+/**
+ * \brief A process-wide cache of decoded source images.
+ *
+ * Every (re)run of the filter chain starts from LoadFileTask, which used
+ * to decode the source file and build its grayscale version each time.
+ * This cache keeps the decoded image together with its grayscale version
+ * for the most recently used source images, within a byte budget.
+ * An entry is only reused while the size and the modification time
+ * of the underlying file stay unchanged.
+ *
+ * All the methods are thread-safe.
+ */
+class ImageCache {
+  DECLARE_NON_COPYABLE(ImageCache)
+
+ public:
+  struct Entry {
+    QImage image;
+    imageproc::GrayImage grayImage;
+  };
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t numEntries = 0;
+    size_t bytesUsed = 0;
+    size_t byteBudget = 0;
+  };
+
+  static ImageCache& instance();
+
+  /**
+   * \brief Returns the cached image or decodes it with \p loader.
+   *
+   * \p loader will be called like this: QImage image = loader();
+   * It's expected to return an image already converted to the format
+   * the filters work with.  If it returns a null image, nothing is cached.
+   * Concurrent requests for the same image wait for a single decode.
+   */
+  template <typename Loader>
+  Entry load(const ImageId& imageId, Loader loader);
+
+  void remove(const ImageId& imageId);
+
+  void clear();
+
+  /**
+   * \brief Sets the maximum amount of memory the cached images may take.
+   *
+   * Setting it to zero disables caching.
+   */
+  void setByteBudget(size_t bytes);
+
+  Stats stats() const;
+
+ private:
+  struct FileStamp {
+    qint64 size = -1;
+    QDateTime lastModified;
+
+    bool operator==(const FileStamp& other) const {
+      return (size == other.size) && (lastModified == other.lastModified);
+    }
+
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+  };
+
+  struct Node {
+    ImageId imageId;
+    FileStamp stamp;
+    Entry entry;
+    size_t cost;
+  };
+
+  using LruList = std::list<Node>;
+
+  ImageCache();
+
+  Entry loadImpl(const ImageId& imageId, const VirtualFunction<QImage>& loader);
+
+  static FileStamp fileStampOf(const ImageId& imageId);
+
+  static size_t costOf(const Entry& entry);
+
+  /** Must be called with m_mutex locked. */
+  void removeLocked(const ImageId& imageId);
+
+  /** Must be called with m_mutex locked. */
+  void evictLocked();
+
+  mutable QMutex m_mutex;
+  QWaitCondition m_loadFinished;
+  LruList m_lru;  // Most recently used at the front.
+  std::unordered_map<ImageId, LruList::iterator> m_index;
+  std::unordered_set<ImageId> m_pendingLoads;
+  size_t m_bytesUsed;
+  size_t m_byteBudget;
+  uint64_t m_hits;
+  uint64_t m_misses;
+  uint64_t m_evictions;
+};
+
+
+template <typename Loader>
+ImageCache::Entry ImageCache::load(const ImageId& imageId, Loader loader) {
+  return loadImpl(imageId, ProxyFunction<Loader, QImage>(loader));
+}
+
+#endif  // ifndef SCANTAILOR_CORE_IMAGECACHE_H_
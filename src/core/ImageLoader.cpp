@@ -5,9 +5,12 @@
 
 #include <QFile>
 #include <QImage>
+#include <QRect>
 #include <QtGui/QImageReader>
+#include <algorithm>
 
 #include "ImageId.h"
+#include "ImageMetadata.h"
 #include "TiffReader.h"
 
 QImage ImageLoader::load(const ImageId& imageId) {
@@ -36,3 +39,67 @@ QImage ImageLoader::load(QIODevice& ioDev, const int pageNum) {
   QImageReader(&ioDev).read(&image);
   return image;
 }
+
+QImage ImageLoader::load(const ImageId& imageId, const QRect& roi, const int reductionFactor) {
+  QFile file(imageId.filePath());
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QImage();
+  }
+  return load(file, imageId.zeroBasedPage(), roi, reductionFactor);
+}
+
+QImage ImageLoader::load(QIODevice& ioDev, const int pageNum, const QRect& roi, const int reductionFactor) {
+  if (TiffReader::canRead(ioDev)) {
+    return TiffReader::readImage(ioDev, pageNum, roi, reductionFactor);
+  }
+
+  if (pageNum != 0) {
+    // Qt can only load the first page of multi-page images.
+    return QImage();
+  }
+
+  QImageReader reader(&ioDev);
+  const QRect fullRect(QPoint(0, 0), reader.size());
+  QRect region(fullRect);
+  if (!roi.isNull()) {
+    region = fullRect.isEmpty() ? roi : roi.intersected(fullRect);
+    if (region.isEmpty()) {
+      return QImage();
+    }
+    reader.setClipRect(region);
+  }
+
+  const int factor = std::max(1, reductionFactor);
+  if ((factor > 1) && !region.isEmpty()) {
+    // The JPEG plugin does that while decoding, others scale the decoded image.
+    reader.setScaledSize(QSize((region.width() + factor - 1) / factor, (region.height() + factor - 1) / factor));
+  }
+
+  QImage image;
+  if (!reader.read(&image)) {
+    return QImage();
+  }
+  if (!region.isEmpty() && (image.width() != region.width())) {
+    image.setDotsPerMeterX(qRound(image.dotsPerMeterX() * image.width() / double(region.width())));
+    image.setDotsPerMeterY(qRound(image.dotsPerMeterY() * image.height() / double(region.height())));
+  }
+  return image;
+}
+
+QSize ImageLoader::readSize(const ImageId& imageId) {
+  QFile file(imageId.filePath());
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QSize();
+  }
+
+  if (TiffReader::canRead(file)) {
+    return TiffReader::readPageMetadata(file, imageId.zeroBasedPage()).size();
+  }
+
+  if (imageId.zeroBasedPage() != 0) {
+    // Qt can only load the first page of multi-page images.
+    return QSize();
+  }
+  // Image plugins read just the header for that.
+  return QImageReader(&file).size();
+}
@@ -8,6 +8,8 @@ class ImageId;
 class QImage;
 class QString;
 class QIODevice;
+class QRect;
+class QSize;
 
 class ImageLoader {
  public:
@@ -16,6 +18,30 @@ class ImageLoader {
   static QImage load(const ImageId& imageId);
 
   static QImage load(QIODevice& ioDev, int pageNum);
+
+  /**
+   * \brief Loads a region of the image, optionally at a reduced resolution.
+   *
+   * TIFF files only get the affected strips or tiles decoded, other formats
+   * are clipped and scaled by their Qt image plugins, which may do it
+   * while decoding.  The resolution of the result is adjusted accordingly.
+   *
+   * \param roi The region to load, in full resolution pixels.
+   *        A null rectangle stands for the whole image.
+   * \param reductionFactor The ratio of the size of the region to the size of the result.
+   */
+  static QImage load(const ImageId& imageId, const QRect& roi, int reductionFactor);
+
+  static QImage load(QIODevice& ioDev, int pageNum, const QRect& roi, int reductionFactor);
+
+  /**
+   * \brief Reads the size of a page without decoding it.
+   *
+   * Only the directory of the requested page is read from multi-page TIFF files.
+   *
+   * \return The size of the page, or an empty size in case of failure.
+   */
+  static QSize readSize(const ImageId& imageId);
 };
 
 
@@ -0,0 +1,163 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ImageMetadataCache.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#include "Application.h"
+#include "AtomicFileOverwriter.h"
+
+namespace {
+const quint32 MAGIC = 0x494d4443;  // "IMDC"
+const quint32 VERSION = 1;
+
+const qint64 SECS_PER_DAY = 24 * 60 * 60;
+
+/** Entries not used for this long are dropped on save. */
+const qint64 MAX_UNUSED_SECS = 90 * SECS_PER_DAY;
+
+qint64 currentSecsSinceEpoch() {
+  return QDateTime::currentMSecsSinceEpoch() / 1000;
+}
+
+qint64 modificationTime(const QFileInfo& fileInfo) {
+  return fileInfo.lastModified().toMSecsSinceEpoch();
+}
+}  // namespace
+
+ImageMetadataCache::ImageMetadataCache(const QString& filePath) : m_filePath(filePath), m_modified(false) {
+  loadFile();
+}
+
+ImageMetadataCache::~ImageMetadataCache() = default;
+
+QString ImageMetadataCache::defaultFilePath() {
+  auto* app = static_cast<Application*>(qApp);
+  if (app->isPortableVersion()) {
+    return app->getPortableConfigPath() + "/image_metadata.dat";
+  } else {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/image_metadata.dat";
+  }
+}
+
+bool ImageMetadataCache::lookup(const QFileInfo& fileInfo, std::vector<ImageMetadata>& perPageMetadata) {
+  const QMutexLocker locker(&m_mutex);
+
+  const auto it = m_entries.find(fileInfo.absoluteFilePath());
+  if (it == m_entries.end()) {
+    return false;
+  }
+  Entry& entry = it->second;
+  if ((entry.fileSize != fileInfo.size()) || (entry.fileModified != modificationTime(fileInfo))) {
+    return false;
+  }
+
+  // Not marking every lookup as a modification saves rewriting the file every time.
+  const qint64 now = currentSecsSinceEpoch();
+  if (now - entry.lastUsed > SECS_PER_DAY) {
+    entry.lastUsed = now;
+    m_modified = true;
+  }
+
+  perPageMetadata = entry.perPageMetadata;
+  return true;
+}
+
+void ImageMetadataCache::store(const QFileInfo& fileInfo, const std::vector<ImageMetadata>& perPageMetadata) {
+  Entry entry{fileInfo.size(), modificationTime(fileInfo), currentSecsSinceEpoch(), perPageMetadata};
+
+  const QMutexLocker locker(&m_mutex);
+  m_entries[fileInfo.absoluteFilePath()] = std::move(entry);
+  m_modified = true;
+}
+
+bool ImageMetadataCache::save() {
+  const QMutexLocker locker(&m_mutex);
+  if (!m_modified) {
+    return true;
+  }
+
+  const qint64 now = currentSecsSinceEpoch();
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (now - it->second.lastUsed > MAX_UNUSED_SECS) {
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* device = overwriter.startWriting(m_filePath);
+  if (!device) {
+    return false;
+  }
+
+  QDataStream stream(device);
+  stream.setVersion(QDataStream::Qt_5_6);
+  stream << MAGIC << VERSION << static_cast<quint32>(m_entries.size());
+  for (const auto& pathAndEntry : m_entries) {
+    const Entry& entry = pathAndEntry.second;
+    stream << pathAndEntry.first << entry.fileSize << entry.fileModified << entry.lastUsed
+           << static_cast<quint32>(entry.perPageMetadata.size());
+    for (const ImageMetadata& metadata : entry.perPageMetadata) {
+      stream << static_cast<qint32>(metadata.size().width()) << static_cast<qint32>(metadata.size().height())
+             << static_cast<qint32>(metadata.dpi().horizontal()) << static_cast<qint32>(metadata.dpi().vertical());
+    }
+  }
+
+  if ((stream.status() != QDataStream::Ok) || !overwriter.commit()) {
+    return false;
+  }
+  m_modified = false;
+  return true;
+}  // ImageMetadataCache::save
+
+void ImageMetadataCache::loadFile() {
+  QFile file(m_filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return;
+  }
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_6);
+
+  quint32 magic = 0;
+  quint32 version = 0;
+  quint32 numEntries = 0;
+  stream >> magic >> version >> numEntries;
+  if ((stream.status() != QDataStream::Ok) || (magic != MAGIC) || (version != VERSION)) {
+    return;
+  }
+
+  for (quint32 i = 0; i < numEntries; ++i) {
+    QString path;
+    Entry entry{0, 0, 0, {}};
+    quint32 numPages = 0;
+    stream >> path >> entry.fileSize >> entry.fileModified >> entry.lastUsed >> numPages;
+    if (stream.status() != QDataStream::Ok) {
+      break;
+    }
+
+    for (quint32 page = 0; page < numPages && stream.status() == QDataStream::Ok; ++page) {
+      qint32 width = 0;
+      qint32 height = 0;
+      qint32 xDpi = 0;
+      qint32 yDpi = 0;
+      stream >> width >> height >> xDpi >> yDpi;
+      entry.perPageMetadata.emplace_back(QSize(width, height), Dpi(xDpi, yDpi));
+    }
+    if (stream.status() != QDataStream::Ok) {
+      // A truncated file.  What was read before is still good.
+      break;
+    }
+    m_entries[path] = std::move(entry);
+  }
+}  // ImageMetadataCache::loadFile
@@ -0,0 +1,81 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_IMAGEMETADATACACHE_H_
+#define SCANTAILOR_CORE_IMAGEMETADATACACHE_H_
+
+#include <foundation/Hashes.h>
+
+#include <QMutex>
+#include <QString>
+#include <unordered_map>
+#include <vector>
+
+#include "ImageMetadata.h"
+#include "NonCopyable.h"
+
+class QFileInfo;
+
+/**
+ * \brief Remembers the metadata of image files across sessions.
+ *
+ * An entry is keyed by the absolute path of a file and is only served while
+ * the size and the modification time of the file are the same as they were
+ * when it was stored.  Entries not used for a long time are dropped on save().
+ *
+ * All the methods are thread-safe.
+ */
+class ImageMetadataCache {
+  DECLARE_NON_COPYABLE(ImageMetadataCache)
+
+ public:
+  /**
+   * \brief Loads the cache from a file.
+   *
+   * A missing or unreadable file results in an empty cache.
+   */
+  explicit ImageMetadataCache(const QString& filePath);
+
+  ~ImageMetadataCache();
+
+  /**
+   * \brief The file the application keeps its cache in.
+   */
+  static QString defaultFilePath();
+
+  /**
+   * \brief Looks up the metadata of every page of an image file.
+   *
+   * \return true if an up-to-date entry was found.
+   */
+  bool lookup(const QFileInfo& fileInfo, std::vector<ImageMetadata>& perPageMetadata);
+
+  void store(const QFileInfo& fileInfo, const std::vector<ImageMetadata>& perPageMetadata);
+
+  /**
+   * \brief Writes the cache to the file, if anything has changed.
+   *
+   * \return true on success.
+   */
+  bool save();
+
+ private:
+  struct Entry {
+    qint64 fileSize;
+    qint64 fileModified;
+    qint64 lastUsed;
+    std::vector<ImageMetadata> perPageMetadata;
+  };
+
+  using Entries = std::unordered_map<QString, Entry, hashes::hash<QString>>;
+
+  void loadFile();
+
+  QString m_filePath;
+  QMutex m_mutex;
+  Entries m_entries;
+  bool m_modified;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_IMAGEMETADATACACHE_H_
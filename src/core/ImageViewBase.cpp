@@ -3,6 +3,7 @@
 
 #include "ImageViewBase.h"
 
+#include <DownscalePyramid.h>
 #include <PolygonUtils.h>
 #include <Transform.h>
 
@@ -248,9 +249,7 @@ QImage ImageViewBase::createDownscaledImage(const QImage& image) {
     return image;
   }
 
-  QTransform xform;
-  xform.scale((double) dW / oW, (double) dH / oH);
-  return transform(image, xform, QRect(0, 0, dW, dH), OutsidePixels::assumeColor(Qt::white));
+  return DownscalePyramid::shared(image)->scaledTo(QSize(dW, dH));
 }
 
 QRectF ImageViewBase::maxViewportRect() const {
@@ -16,6 +16,7 @@
 #include "FilterData.h"
 #include "FilterOptionsWidget.h"
 #include "FilterUiInterface.h"
+#include "ImageCache.h"
 #include "ImageLoader.h"
 #include "ProjectPages.h"
 #include "ThumbnailPixmapCache.h"
@@ -55,7 +56,23 @@ LoadFileTask::LoadFileTask(Type type,
 LoadFileTask::~LoadFileTask() = default;
 
 FilterResultPtr LoadFileTask::operator()() {
-  QImage image = ImageLoader::load(m_imageId);
+  const ImageCache::Entry cached = ImageCache::instance().load(m_imageId, [this]() {
+    QImage image = ImageLoader::load(m_imageId);
+    if (!image.isNull()) {
+      convertToSupportedFormat(image);
+      overrideDpi(image);
+    }
+    return image;
+  });
+  QImage image = cached.image;
+  GrayImage grayImage = cached.grayImage;
+  if (!image.isNull() && (Dpm(image) != Dpm(m_imageMetadata.dpi()))) {
+    // The DPI was changed after the image got cached.
+    overrideDpi(image);
+    const Dpm dpm(image);
+    grayImage.setDotsPerMeterX(dpm.horizontal());
+    grayImage.setDotsPerMeterY(dpm.vertical());
+  }
 
   try {
     throwIfCancelled();
@@ -63,11 +80,9 @@ FilterResultPtr LoadFileTask::operator()() {
     if (image.isNull()) {
       return std::make_shared<ErrorResult>(m_imageId.filePath());
     } else {
-      convertToSupportedFormat(image);
       updateImageSizeIfChanged(image);
-      overrideDpi(image);
       m_thumbnailCache->ensureThumbnailExists(m_imageId, image);
-      return m_nextTask->process(*this, FilterData(image));
+      return m_nextTask->process(*this, FilterData(image, grayImage));
     }
   } catch (const CancelledException&) {
     return nullptr;
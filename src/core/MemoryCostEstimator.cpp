@@ -0,0 +1,135 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "MemoryCostEstimator.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "ApplicationSettings.h"
+#include "ImageMetadata.h"
+#include "PageInfo.h"
+#include "StageSequence.h"
+#include "SystemMemory.h"
+#include "filters/output/Filter.h"
+#include "filters/output/Params.h"
+#include "filters/output/RenderParams.h"
+
+namespace {
+// The decoded source image with its grayscale version, plus the downscaled
+// and binarized images the analysis stages work on.
+const double ANALYSIS_BYTES_PER_SOURCE_PIXEL = 8.0;
+
+// Per output pixel: the transformed grayscale or color image, a binarized
+// version of it and a few full-size masks.
+const double BW_BYTES_PER_OUTPUT_PIXEL = 6.0;
+const double COLOR_BYTES_PER_OUTPUT_PIXEL = 14.0;
+// Picture detection and the mixed image itself.
+const double MIXED_EXTRA_BYTES_PER_OUTPUT_PIXEL = 8.0;
+// The foreground and background layers.
+const double SPLIT_EXTRA_BYTES_PER_OUTPUT_PIXEL = 5.0;
+// The dewarped image and the distortion model grids.
+const double DEWARPING_EXTRA_BYTES_PER_OUTPUT_PIXEL = 6.0;
+
+// Small images still have a fixed overhead.
+const size_t MIN_COST = 16 * 1024 * 1024;
+
+// Limits for the calibration factor, so that a few odd pages can't
+// make the estimates meaningless.
+const double MIN_CALIBRATION_FACTOR = 0.25;
+const double MAX_CALIBRATION_FACTOR = 4.0;
+// How fast the factor goes down when the estimates prove too high.
+// It goes up immediately, as underestimating is what causes trouble.
+const double CALIBRATION_DECAY = 0.1;
+}  // namespace
+
+MemoryCostEstimator::MemoryCostEstimator() : m_calibrationFactor(1.0) {}
+
+MemoryCostEstimator& MemoryCostEstimator::instance() {
+  static MemoryCostEstimator object;
+  return object;
+}
+
+size_t MemoryCostEstimator::estimate(const PageInfo& page, const StageSequence& stages, const int lastFilterIdx) {
+  if (lastFilterIdx < stages.outputFilterIdx()) {
+    return estimate(page.metadata(), nullptr);
+  }
+  const output::Params params(stages.outputFilter()->pageParams(page.id()));
+  return estimate(page.metadata(), &params);
+}
+
+size_t MemoryCostEstimator::estimate(const ImageMetadata& metadata, const output::Params* outputParams) {
+  const double numSourcePixels = double(metadata.size().width()) * metadata.size().height();
+  double cost = numSourcePixels * ANALYSIS_BYTES_PER_SOURCE_PIXEL;
+
+  if (outputParams) {
+    double scale = 1.0;
+    const Dpi& sourceDpi = metadata.dpi();
+    const Dpi& outputDpi = outputParams->outputDpi();
+    if (!sourceDpi.isNull() && !outputDpi.isNull()) {
+      scale = (double(outputDpi.horizontal()) / sourceDpi.horizontal())
+              * (double(outputDpi.vertical()) / sourceDpi.vertical());
+    }
+    const double numOutputPixels = numSourcePixels * scale;
+
+    const output::RenderParams renderParams(outputParams->colorParams(), outputParams->splittingOptions());
+    double bytesPerOutputPixel = renderParams.binaryOutput() ? BW_BYTES_PER_OUTPUT_PIXEL : COLOR_BYTES_PER_OUTPUT_PIXEL;
+    if (renderParams.mixedOutput()) {
+      bytesPerOutputPixel += MIXED_EXTRA_BYTES_PER_OUTPUT_PIXEL;
+    }
+    if (renderParams.splitOutput()) {
+      bytesPerOutputPixel += SPLIT_EXTRA_BYTES_PER_OUTPUT_PIXEL;
+    }
+    if (outputParams->dewarpingOptions().dewarpingMode() != output::OFF) {
+      bytesPerOutputPixel += DEWARPING_EXTRA_BYTES_PER_OUTPUT_PIXEL;
+    }
+    cost += numOutputPixels * bytesPerOutputPixel;
+  }
+
+  if (cost >= double(std::numeric_limits<size_t>::max())) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return std::max(static_cast<size_t>(cost), MIN_COST);
+}  // MemoryCostEstimator::estimate
+
+size_t MemoryCostEstimator::memoryBudget() {
+  const int budgetMiB = ApplicationSettings::getInstance().getProcessingMemoryBudget();
+  if (budgetMiB > 0) {
+    return static_cast<size_t>(budgetMiB) * 1024 * 1024;
+  }
+
+  const size_t physicalMemory = SystemMemory::totalPhysicalMemory();
+  if (physicalMemory == 0) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return physicalMemory / 2;
+}
+
+size_t MemoryCostEstimator::calibrated(const size_t nominalCost) const {
+  const double cost = nominalCost * calibrationFactor();
+  if (cost >= double(std::numeric_limits<size_t>::max())) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return static_cast<size_t>(cost);
+}
+
+void MemoryCostEstimator::recordUsage(const size_t nominalCost, const size_t actualUsage) {
+  if ((nominalCost == 0) || (actualUsage == 0)) {
+    return;
+  }
+  const double ratio = double(actualUsage) / nominalCost;
+
+  const QMutexLocker locker(&m_mutex);
+  double factor = m_calibrationFactor;
+  if (ratio > factor) {
+    factor = ratio;
+  } else {
+    factor += (ratio - factor) * CALIBRATION_DECAY;
+  }
+  m_calibrationFactor = std::min(std::max(factor, MIN_CALIBRATION_FACTOR), MAX_CALIBRATION_FACTOR);
+}
+
+double MemoryCostEstimator::calibrationFactor() const {
+  const QMutexLocker locker(&m_mutex);
+  return m_calibrationFactor;
+}
@@ -0,0 +1,87 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_MEMORYCOSTESTIMATOR_H_
+#define SCANTAILOR_CORE_MEMORYCOSTESTIMATOR_H_
+
+#include <QMutex>
+#include <cstddef>
+
+#include "NonCopyable.h"
+
+class ImageMetadata;
+class PageInfo;
+class StageSequence;
+
+namespace output {
+class Params;
+}
+
+/**
+ * \brief Estimates the peak amount of memory processing a page takes.
+ *
+ * The nominal estimate is derived from the number of source pixels, and,
+ * when the output stage is involved, from the output resolution, the color mode
+ * and the options that make the output stage keep additional full-size images
+ * around.  It's only meant for deciding how many pages may be processed
+ * simultaneously, so it errs on the high side.
+ *
+ * The actual usage observed by MemoryUsageMonitor is fed back through
+ * recordUsage(), and calibrated() scales nominal estimates accordingly.
+ *
+ * All the methods are thread-safe.
+ */
+class MemoryCostEstimator {
+  DECLARE_NON_COPYABLE(MemoryCostEstimator)
+
+ public:
+  /**
+   * \brief The estimator calibrated by the tasks of the application.
+   */
+  static MemoryCostEstimator& instance();
+
+  /**
+   * \brief Makes an estimator with a calibration of its own, starting at 1.
+   */
+  MemoryCostEstimator();
+
+  /**
+   * \brief The nominal cost of processing a page through filters [0, lastFilterIdx].
+   */
+  static size_t estimate(const PageInfo& page, const StageSequence& stages, int lastFilterIdx);
+
+  /**
+   * \brief The nominal cost of processing a page, with \p outputParams being null
+   *        if the output stage is not involved.
+   */
+  static size_t estimate(const ImageMetadata& metadata, const output::Params* outputParams);
+
+  /**
+   * \brief The memory budget, in bytes, for pages processed simultaneously.
+   *
+   * Comes from ApplicationSettings::getProcessingMemoryBudget().
+   */
+  static size_t memoryBudget();
+
+  /**
+   * \brief Converts a nominal cost into the expected actual one.
+   */
+  size_t calibrated(size_t nominalCost) const;
+
+  /**
+   * \brief Adjusts the calibration from the actual peak usage of a task.
+   */
+  void recordUsage(size_t nominalCost, size_t actualUsage);
+
+  /**
+   * \brief The ratio of actual to nominal costs calibrated() applies.
+   */
+  double calibrationFactor() const;
+
+ private:
+  mutable QMutex m_mutex;
+  double m_calibrationFactor;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_MEMORYCOSTESTIMATOR_H_
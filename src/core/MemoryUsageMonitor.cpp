@@ -0,0 +1,130 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "MemoryUsageMonitor.h"
+
+#include <QThread>
+#include <algorithm>
+#include <utility>
+
+#include "ImageCache.h"
+#include "MemoryCostEstimator.h"
+#include "SystemMemory.h"
+
+namespace {
+const unsigned long SAMPLING_INTERVAL_MS = 50;
+}
+
+class MemoryUsageMonitor::Sampler : public QThread {
+ public:
+  explicit Sampler(MemoryUsageMonitor& owner) : m_owner(owner) {}
+
+ protected:
+  void run() override { m_owner.samplerLoop(); }
+
+ private:
+  MemoryUsageMonitor& m_owner;
+};
+
+
+MemoryUsageMonitor::MemoryUsageMonitor() : MemoryUsageMonitor(&measureTaskMemory, MemoryCostEstimator::instance()) {}
+
+MemoryUsageMonitor::MemoryUsageMonitor(std::function<size_t()> measureMemory, MemoryCostEstimator& estimator)
+    : m_measureMemory(std::move(measureMemory)),
+      m_estimator(estimator),
+      m_sampler(std::make_unique<Sampler>(*this)),
+      m_nextTaskId(0),
+      m_baseline(0),
+      m_stopping(false) {
+  m_sampler->start(QThread::LowPriority);
+}
+
+MemoryUsageMonitor::~MemoryUsageMonitor() {
+  {
+    const QMutexLocker locker(&m_mutex);
+    m_stopping = true;
+    m_wakeSampler.wakeAll();
+  }
+  m_sampler->wait();
+}
+
+int MemoryUsageMonitor::taskStarted(const size_t nominalCost) {
+  const QMutexLocker locker(&m_mutex);
+  if (m_runningTasks.empty()) {
+    // Whatever the process took by now isn't attributed to the tasks.
+    m_baseline = m_measureMemory();
+  }
+  const int taskId = m_nextTaskId++;
+  m_runningTasks[taskId] = RunningTask{nominalCost, 0, 0};
+  m_wakeSampler.wakeAll();
+  return taskId;
+}
+
+size_t MemoryUsageMonitor::taskFinished(const int taskId) {
+  const size_t memory = m_measureMemory();
+
+  RunningTask task{0, 0, 0};
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = m_runningTasks.find(taskId);
+    if (it == m_runningTasks.end()) {
+      return 0;
+    }
+    sampleLocked(memory);
+    task = it->second;
+    m_runningTasks.erase(it);
+
+    // Whether the memory of the task gets released or stays with the allocator,
+    // it's not to be attributed to the tasks still running.
+    m_baseline += task.currentUsage;
+  }
+
+  m_estimator.recordUsage(task.nominalCost, task.peakUsage);
+  return task.peakUsage;
+}
+
+void MemoryUsageMonitor::samplerLoop() {
+  QMutexLocker locker(&m_mutex);
+  while (!m_stopping) {
+    if (m_runningTasks.empty()) {
+      m_wakeSampler.wait(&m_mutex);
+      continue;
+    }
+
+    locker.unlock();
+    const size_t memory = m_measureMemory();
+    locker.relock();
+    sampleLocked(memory);
+
+    m_wakeSampler.wait(&m_mutex, SAMPLING_INTERVAL_MS);
+  }
+}
+
+size_t MemoryUsageMonitor::measureTaskMemory() {
+  const size_t residentSetSize = SystemMemory::currentResidentSetSize();
+  if (residentSetSize == 0) {
+    return 0;
+  }
+  // Cached images stay around after the tasks that loaded them finish.
+  const size_t cachedImages = ImageCache::instance().stats().bytesUsed;
+  return residentSetSize - std::min(residentSetSize, cachedImages);
+}
+
+void MemoryUsageMonitor::sampleLocked(const size_t memory) {
+  if ((memory == 0) || m_runningTasks.empty()) {
+    return;
+  }
+  const size_t excess = (memory > m_baseline) ? memory - m_baseline : 0;
+
+  double totalCost = 0;
+  for (const auto& idAndTask : m_runningTasks) {
+    totalCost += idAndTask.second.nominalCost;
+  }
+
+  for (auto& idAndTask : m_runningTasks) {
+    RunningTask& task = idAndTask.second;
+    const double share = (totalCost > 0) ? task.nominalCost / totalCost : 1.0 / m_runningTasks.size();
+    task.currentUsage = static_cast<size_t>(excess * share);
+    task.peakUsage = std::max(task.peakUsage, task.currentUsage);
+  }
+}
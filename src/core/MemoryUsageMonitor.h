@@ -0,0 +1,89 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_MEMORYUSAGEMONITOR_H_
+#define SCANTAILOR_CORE_MEMORYUSAGEMONITOR_H_
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include "NonCopyable.h"
+
+class MemoryCostEstimator;
+class QThread;
+
+/**
+ * \brief Measures the actual peak memory usage of running tasks.
+ *
+ * While there are tasks running, the memory they may have taken is sampled
+ * periodically.  That's the resident set size of the process, less the images
+ * held by ImageCache, which outlive the tasks.  Whatever it exceeds a baseline by,
+ * is split among the running tasks in proportion to their nominal costs.
+ * The peak of its share a task gets is reported to MemoryCostEstimator
+ * once it finishes.
+ *
+ * The baseline is taken when a task starts with no others running.  When a task
+ * finishes, the baseline is raised by what that task was last attributed, as
+ * the allocator may keep that memory rather than return it to the system.
+ *
+ * All the methods are thread-safe.
+ */
+class MemoryUsageMonitor {
+  DECLARE_NON_COPYABLE(MemoryUsageMonitor)
+
+ public:
+  MemoryUsageMonitor();
+
+  /**
+   * \param measureMemory Returns the amount of memory, in bytes, the process
+   *        currently takes, not counting what shouldn't be attributed to tasks.
+   *        It's called from a separate thread as well.  Zero means unknown.
+   * \param estimator Where the peak memory usage of tasks is reported to.
+   */
+  MemoryUsageMonitor(std::function<size_t()> measureMemory, MemoryCostEstimator& estimator);
+
+  ~MemoryUsageMonitor();
+
+  /**
+   * \return An identifier to pass to taskFinished().
+   */
+  int taskStarted(size_t nominalCost);
+
+  /**
+   * \return The peak memory usage attributed to the task, or 0 if unknown.
+   */
+  size_t taskFinished(int taskId);
+
+ private:
+  class Sampler;
+
+  struct RunningTask {
+    size_t nominalCost;
+    size_t currentUsage;
+    size_t peakUsage;
+  };
+
+  static size_t measureTaskMemory();
+
+  void samplerLoop();
+
+  /** Must be called with m_mutex locked. */
+  void sampleLocked(size_t memory);
+
+  const std::function<size_t()> m_measureMemory;
+  MemoryCostEstimator& m_estimator;
+  QMutex m_mutex;
+  QWaitCondition m_wakeSampler;
+  std::unordered_map<int, RunningTask> m_runningTasks;
+  std::unique_ptr<QThread> m_sampler;
+  int m_nextTaskId;
+  size_t m_baseline;
+  bool m_stopping;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_MEMORYUSAGEMONITOR_H_
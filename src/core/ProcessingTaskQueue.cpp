@@ -30,19 +30,19 @@ BackgroundTaskPtr ProcessingTaskQueue::takeForProcessing() {
   return nullptr;
 }
 
-void ProcessingTaskQueue::processingFinished(const BackgroundTaskPtr& task) {
+PageInfo ProcessingTaskQueue::processingFinished(const BackgroundTaskPtr& task) {
   auto it(m_queue.begin());
   const auto end(m_queue.end());
 
   for (;; ++it) {
     if (it == end) {
       // Task not found.
-      return;
+      return PageInfo();
     }
 
     if (!it->takenForProcessing) {
       // There is no point in looking further.
-      return;
+      return PageInfo();
     }
 
     if (it->task == task) {
@@ -51,7 +51,8 @@ void ProcessingTaskQueue::processingFinished(const BackgroundTaskPtr& task) {
   }
 
 
-  const bool removingSelectedPage = (m_selectedPage.id() == it->pageInfo.id());
+  const PageInfo finishedPage(it->pageInfo);
+  const bool removingSelectedPage = (m_selectedPage.id() == finishedPage.id());
 
   auto nextIt(it);
   ++nextIt;
@@ -69,6 +70,7 @@ void ProcessingTaskQueue::processingFinished(const BackgroundTaskPtr& task) {
       m_selectedPage = m_pageToSelectWhenDone;
     }
   }
+  return finishedPage;
 }  // ProcessingTaskQueue::processingFinished
 
 PageInfo ProcessingTaskQueue::selectedPage() const {
@@ -27,7 +27,11 @@ class ProcessingTaskQueue {
    */
   BackgroundTaskPtr takeForProcessing();
 
-  void processingFinished(const BackgroundTaskPtr& task);
+  /**
+   * Removes a finished task from the queue and returns the page it was
+   * processing, or a null PageInfo if the task wasn't found.
+   */
+  PageInfo processingFinished(const BackgroundTaskPtr& task);
 
   /**
    * \brief Returns the page to be visually selected.
@@ -9,6 +9,7 @@
 #include "AbstractFilter.h"
 #include "FileNameDisambiguator.h"
 #include "ProjectPages.h"
+#include "StageDigests.h"
 #include "XmlUnmarshaller.h"
 #include "version.h"
 
@@ -70,6 +71,11 @@ void ProjectReader::readFilterSettings(const std::vector<FilterPtr>& filters) co
   }
 }
 
+void ProjectReader::readStageDigests(StageDigests& digests) const {
+  QDomElement projectEl(m_doc.documentElement());
+  digests.load(*this, projectEl.namedItem("stage-digests").toElement());
+}
+
 void ProjectReader::processDirectories(const QDomElement& dirsEl) {
   const QString dirTagName("directory");
 
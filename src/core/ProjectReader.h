@@ -21,6 +21,7 @@ class QDomElement;
 class ProjectPages;
 class FileNameDisambiguator;
 class AbstractFilter;
+class StageDigests;
 
 class ProjectReader {
  public:
@@ -32,6 +33,8 @@ class ProjectReader {
 
   void readFilterSettings(const std::vector<FilterPtr>& filters) const;
 
+  void readStageDigests(StageDigests& digests) const;
+
   bool success() const { return (m_pages != nullptr); }
 
   const QString& outputDirectory() const { return m_outDir; }
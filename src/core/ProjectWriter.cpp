@@ -16,6 +16,7 @@
 #include "PageInfo.h"
 #include "PageView.h"
 #include "ProjectPages.h"
+#include "StageDigests.h"
 #include "version.h"
 
 #ifndef Q_MOC_RUN
@@ -64,7 +65,9 @@ ProjectWriter::ProjectWriter(const std::shared_ptr<ProjectPages>& pageSequence,
 
 ProjectWriter::~ProjectWriter() = default;
 
-bool ProjectWriter::write(const QString& filePath, const std::vector<FilterPtr>& filters) const {
+bool ProjectWriter::write(const QString& filePath,
+                          const std::vector<FilterPtr>& filters,
+                          const StageDigests& digests) const {
   QDomDocument doc;
   QDomElement rootEl(doc.createElement("project"));
   doc.appendChild(rootEl);
@@ -86,6 +89,7 @@ bool ProjectWriter::write(const QString& filePath, const std::vector<FilterPtr>&
   for (; it != end; ++it) {
     filtersEl.appendChild((*it)->saveSettings(*this, doc));
   }
+  rootEl.appendChild(digests.toXml(*this, doc, "stage-digests"));
 
   QFile file(filePath);
   if (file.open(QIODevice::WriteOnly)) {
@@ -26,6 +26,7 @@
 class AbstractFilter;
 class ProjectPages;
 class PageInfo;
+class StageDigests;
 class QDomDocument;
 class QDomElement;
 
@@ -41,7 +42,7 @@ class ProjectWriter {
 
   ~ProjectWriter();
 
-  bool write(const QString& filePath, const std::vector<FilterPtr>& filters) const;
+  bool write(const QString& filePath, const std::vector<FilterPtr>& filters, const StageDigests& digests) const;
 
   /**
    * \p out will be called like this: out(ImageId, numeric_image_id)
@@ -0,0 +1,222 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "StageDigests.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
+#include <QFileInfo>
+#include <algorithm>
+
+#include "AbstractFilter.h"
+#include "ApplicationSettings.h"
+#include "OutputFileNameGenerator.h"
+#include "PageInfo.h"
+#include "ProjectReader.h"
+#include "ProjectWriter.h"
+#include "StageSequence.h"
+#include "filters/output/Utils.h"
+#include "version.h"
+
+void StageDigests::clear() {
+  const QMutexLocker locker(&m_mutex);
+  m_digests.clear();
+}
+
+void StageDigests::load(const ProjectReader& reader, const QDomElement& digestsEl) {
+  const QMutexLocker locker(&m_mutex);
+  m_digests.clear();
+
+  const QString pageTagName("page");
+  const QString stageTagName("stage");
+  QDomNode pageNode(digestsEl.firstChild());
+  for (; !pageNode.isNull(); pageNode = pageNode.nextSibling()) {
+    if (!pageNode.isElement() || (pageNode.nodeName() != pageTagName)) {
+      continue;
+    }
+    const QDomElement pageEl(pageNode.toElement());
+
+    bool ok = true;
+    const int id = pageEl.attribute("id").toInt(&ok);
+    if (!ok) {
+      continue;
+    }
+    const PageId pageId(reader.pageId(id));
+    if (pageId.isNull()) {
+      continue;
+    }
+
+    std::vector<QByteArray> digests;
+    QDomNode stageNode(pageEl.firstChild());
+    for (; !stageNode.isNull(); stageNode = stageNode.nextSibling()) {
+      if (!stageNode.isElement() || (stageNode.nodeName() != stageTagName)) {
+        continue;
+      }
+      const QDomElement stageEl(stageNode.toElement());
+
+      const int idx = stageEl.attribute("idx").toInt(&ok);
+      if (!ok || (idx < 0)) {
+        continue;
+      }
+      if (idx >= static_cast<int>(digests.size())) {
+        digests.resize(static_cast<size_t>(idx + 1));
+      }
+      digests[idx] = QByteArray::fromBase64(stageEl.attribute("digest").toLatin1());
+    }
+
+    if (!digests.empty()) {
+      m_digests[pageId] = std::move(digests);
+    }
+  }
+}  // StageDigests::load
+
+QDomElement StageDigests::toXml(const ProjectWriter& writer, QDomDocument& doc, const QString& name) const {
+  const QMutexLocker locker(&m_mutex);
+
+  QDomElement digestsEl(doc.createElement(name));
+  writer.enumPages([&](const PageId& pageId, const int numericId) {
+    const auto it = m_digests.find(pageId);
+    if (it == m_digests.end()) {
+      return;
+    }
+
+    QDomElement pageEl(doc.createElement("page"));
+    pageEl.setAttribute("id", numericId);
+    for (size_t idx = 0; idx < it->second.size(); ++idx) {
+      const QByteArray& digest = it->second[idx];
+      if (digest.isEmpty()) {
+        continue;
+      }
+      QDomElement stageEl(doc.createElement("stage"));
+      stageEl.setAttribute("idx", static_cast<int>(idx));
+      stageEl.setAttribute("digest", QString::fromLatin1(digest.toBase64()));
+      pageEl.appendChild(stageEl);
+    }
+    digestsEl.appendChild(pageEl);
+  });
+  return digestsEl;
+}
+
+bool StageDigests::isUpToDate(const StageSequence& stages,
+                              const int lastFilterIdx,
+                              const PageInfo& page,
+                              const OutputFileNameGenerator& outFileNameGen) const {
+  QByteArray storedDigest;
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = m_digests.find(page.id());
+    if ((it == m_digests.end()) || (lastFilterIdx >= static_cast<int>(it->second.size()))) {
+      return false;
+    }
+    storedDigest = it->second[lastFilterIdx];
+  }
+
+  if (storedDigest.isEmpty()) {
+    return false;
+  }
+  return storedDigest == calcDigest(stages, lastFilterIdx, page, outFileNameGen);
+}
+
+void StageDigests::recordProcessed(const StageSequence& stages,
+                                   const int lastFilterIdx,
+                                   const PageInfo& page,
+                                   const OutputFileNameGenerator& outFileNameGen) {
+  std::vector<QByteArray> digests(static_cast<size_t>(lastFilterIdx + 1));
+  for (int idx = 0; idx <= lastFilterIdx; ++idx) {
+    digests[idx] = calcDigest(stages, idx, page, outFileNameGen);
+  }
+
+  // The digests of the following stages, if any, are dropped, as those stages
+  // may now produce a different result.
+  const QMutexLocker locker(&m_mutex);
+  m_digests[page.id()] = std::move(digests);
+}
+
+void StageDigests::remove(const PageId& pageId) {
+  const QMutexLocker locker(&m_mutex);
+  m_digests.erase(pageId);
+}
+
+QByteArray StageDigests::calcDigest(const StageSequence& stages,
+                                    const int filterIdx,
+                                    const PageInfo& page,
+                                    const OutputFileNameGenerator& outFileNameGen) {
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  // Processing algorithms may change between versions.
+  hash.addData(QByteArray(VERSION));
+
+  const ImageId& imageId = page.imageId();
+  addFileToHash(hash, imageId.filePath());
+  hash.addData(QByteArray::number(imageId.page()));
+  hash.addData(QByteArray::number(page.id().subPage()));
+
+  const ImageMetadata& metadata = page.metadata();
+  hash.addData(QByteArray::number(metadata.size().width()) + 'x' + QByteArray::number(metadata.size().height()));
+  hash.addData(QByteArray::number(metadata.dpi().horizontal()) + 'x' + QByteArray::number(metadata.dpi().vertical()));
+
+  QDomDocument doc;
+  for (int idx = 0; idx <= filterIdx; ++idx) {
+    addElementToHash(hash, stages.filterAt(idx)->savePageSettings(page.id(), doc));
+  }
+
+  if (filterIdx >= stages.outputFilterIdx()) {
+    const ApplicationSettings& settings = ApplicationSettings::getInstance();
+    hash.addData(QByteArray::number(settings.getTiffBwCompression()));
+    hash.addData(QByteArray::number(settings.getTiffColorCompression()));
+
+    // Output files removed or overwritten by someone else have to be regenerated.
+    const QString outFilePath(outFileNameGen.filePathFor(page.id()));
+    const QString outFileName(QFileInfo(outFilePath).fileName());
+    const QString& outDir = outFileNameGen.outDir();
+    addFileToHash(hash, outFilePath);
+    addFileToHash(hash, QDir(output::Utils::foregroundDir(outDir)).absoluteFilePath(outFileName));
+    addFileToHash(hash, QDir(output::Utils::backgroundDir(outDir)).absoluteFilePath(outFileName));
+    addFileToHash(hash, QDir(output::Utils::originalBackgroundDir(outDir)).absoluteFilePath(outFileName));
+  }
+  return hash.result();
+}  // StageDigests::calcDigest
+
+void StageDigests::addElementToHash(QCryptographicHash& hash, const QDomElement& el) {
+  hash.addData(el.tagName().toUtf8());
+  hash.addData("\0(", 2);
+
+  const QDomNamedNodeMap attributes(el.attributes());
+  std::vector<std::pair<QString, QString>> sortedAttributes;
+  sortedAttributes.reserve(static_cast<size_t>(attributes.count()));
+  for (int i = 0; i < attributes.count(); ++i) {
+    const QDomAttr attr(attributes.item(i).toAttr());
+    sortedAttributes.emplace_back(attr.name(), attr.value());
+  }
+  std::sort(sortedAttributes.begin(), sortedAttributes.end());
+  for (const auto& attr : sortedAttributes) {
+    hash.addData(attr.first.toUtf8());
+    hash.addData("\0=", 2);
+    hash.addData(attr.second.toUtf8());
+    hash.addData("\0;", 2);
+  }
+
+  QDomNode node(el.firstChild());
+  for (; !node.isNull(); node = node.nextSibling()) {
+    if (node.isElement()) {
+      addElementToHash(hash, node.toElement());
+    } else if (node.isText()) {
+      hash.addData(node.nodeValue().toUtf8());
+      hash.addData("\0;", 2);
+    }
+  }
+  hash.addData("\0)", 2);
+}
+
+void StageDigests::addFileToHash(QCryptographicHash& hash, const QString& filePath) {
+  const QFileInfo fileInfo(filePath);
+  hash.addData(filePath.toUtf8());
+  hash.addData("\0", 1);
+  if (fileInfo.exists()) {
+    hash.addData(QByteArray::number(fileInfo.size()));
+    hash.addData("\0", 1);
+    hash.addData(QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()));
+  }
+  hash.addData("\0;", 2);
+}
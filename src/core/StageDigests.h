@@ -0,0 +1,89 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_STAGEDIGESTS_H_
+#define SCANTAILOR_CORE_STAGEDIGESTS_H_
+
+#include <QByteArray>
+#include <QMutex>
+#include <unordered_map>
+#include <vector>
+
+#include "NonCopyable.h"
+#include "PageId.h"
+
+class StageSequence;
+class PageInfo;
+class OutputFileNameGenerator;
+class ProjectReader;
+class ProjectWriter;
+class QCryptographicHash;
+class QDomDocument;
+class QDomElement;
+class QString;
+
+/**
+ * \brief Remembers what every page was last processed from.
+ *
+ * A digest of a stage covers everything the processing of a page up to
+ * and including that stage depends on: the source file, the image metadata,
+ * the settings of this and all the preceding stages and, for the output
+ * stage, the output files themselves.  A batch run may skip a page whose
+ * digest hasn't changed since it was last processed, without even loading
+ * its image file.
+ *
+ * The digests are stored in the project file.  All the methods are thread-safe.
+ */
+class StageDigests {
+  DECLARE_NON_COPYABLE(StageDigests)
+
+ public:
+  StageDigests() = default;
+
+  void clear();
+
+  void load(const ProjectReader& reader, const QDomElement& digestsEl);
+
+  QDomElement toXml(const ProjectWriter& writer, QDomDocument& doc, const QString& name) const;
+
+  /**
+   * \brief Checks whether the page was processed up to \p lastFilterIdx
+   *        with exactly the inputs it has now.
+   */
+  bool isUpToDate(const StageSequence& stages,
+                  int lastFilterIdx,
+                  const PageInfo& page,
+                  const OutputFileNameGenerator& outFileNameGen) const;
+
+  /**
+   * \brief Records the current inputs of stages [0, lastFilterIdx]
+   *        for a page that has just been processed successfully.
+   */
+  void recordProcessed(const StageSequence& stages,
+                       int lastFilterIdx,
+                       const PageInfo& page,
+                       const OutputFileNameGenerator& outFileNameGen);
+
+  void remove(const PageId& pageId);
+
+  static QByteArray calcDigest(const StageSequence& stages,
+                               int filterIdx,
+                               const PageInfo& page,
+                               const OutputFileNameGenerator& outFileNameGen);
+
+ private:
+  /**
+   * \brief Hashes an element in a way that doesn't depend on the order of its attributes.
+   *
+   * QDom doesn't preserve the order the attributes were set in.
+   */
+  static void addElementToHash(QCryptographicHash& hash, const QDomElement& el);
+
+  static void addFileToHash(QCryptographicHash& hash, const QString& filePath);
+
+  mutable QMutex m_mutex;
+  std::unordered_map<PageId, std::vector<QByteArray>> m_digests;  // Indexed by filter index.
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_STAGEDIGESTS_H_
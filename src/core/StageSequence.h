@@ -9,6 +9,7 @@
 
 #include "AbstractFilter.h"
 #include "NonCopyable.h"
+#include "StageDigests.h"
 #include "filters/deskew/Filter.h"
 #include "filters/fix_orientation/Filter.h"
 #include "filters/output/Filter.h"
@@ -65,6 +66,8 @@ class StageSequence {
 
   int outputFilterIdx() const { return m_outputFilterIdx; }
 
+  StageDigests& stageDigests() const { return *m_stageDigests; }
+
  private:
   std::shared_ptr<fix_orientation::Filter> m_fixOrientationFilter;
   std::shared_ptr<page_split::Filter> m_pageSplitFilter;
@@ -73,6 +76,7 @@ class StageSequence {
   std::shared_ptr<page_layout::Filter> m_pageLayoutFilter;
   std::shared_ptr<output::Filter> m_outputFilter;
   std::vector<FilterPtr> m_filters;
+  std::unique_ptr<StageDigests> m_stageDigests;
   int m_fixOrientationFilterIdx;
   int m_pageSplitFilterIdx;
   int m_deskewFilterIdx;
@@ -3,26 +3,27 @@
 
 #include "ThumbnailPixmapCache.h"
 
-#include <GrayImage.h>
-#include <Scale.h>
+#include <DownscalePyramid.h>
 
 #include <QCoreApplication>
 #include <QCryptographicHash>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
 #include <QThread>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
 
-#include "AtomicFileOverwriter.h"
 #include "ImageId.h"
 #include "ImageLoader.h"
 #include "OutOfMemoryHandler.h"
 #include "RelinkablePath.h"
+#include "ThumbnailStore.h"
 
 using namespace ::boost;
 using namespace ::boost::multi_index;
@@ -139,8 +140,19 @@ class ThumbnailPixmapCache::Impl : public QThread {
 
   void backgroundProcessing();
 
-  static QImage loadSaveThumbnail(const ImageId& imageId, const QString& thumbDir, const QSize& maxThumbSize);
+  static QImage loadSaveThumbnail(const ImageId& imageId,
+                                  ThumbnailStore& store,
+                                  const QString& thumbDir,
+                                  const QSize& maxThumbSize);
 
+  static std::shared_ptr<ThumbnailStore> openStore(const QString& thumbDir);
+
+  /**
+   * \brief The path of a thumbnail stored as a separate file.
+   *
+   * That's how thumbnails were stored before ThumbnailStore.
+   * Such files are only read, to move them to the store, and removed.
+   */
   static QString getThumbFilePath(const ImageId& imageId, const QString& thumbDir, const QSize& maxThumbSize);
 
   static QImage makeThumbnail(const QImage& image, const QSize& maxThumbSize);
@@ -191,6 +203,12 @@ class ThumbnailPixmapCache::Impl : public QThread {
   RemoveQueue::iterator m_endOfLoadedItems;
 
   QString m_thumbDir;
+
+  /**
+   * Replaced when the thumbnail directory changes, while the threads
+   * still working with the old one keep it alive.
+   */
+  std::shared_ptr<ThumbnailStore> m_store;
   QSize m_maxThumbSize;
   int m_maxCachedPixmaps;
 
@@ -308,6 +326,7 @@ ThumbnailPixmapCache::Impl::Impl(const QString& thumbDir,
   // as otherwise when loading a project from a different machine,
   // a whole bunch of bogus directories would be created.
   QDir().mkdir(m_thumbDir);
+  m_store = openStore(m_thumbDir);
 
   m_backgroundLoader.moveToThread(this);
 }
@@ -335,6 +354,7 @@ void ThumbnailPixmapCache::Impl::setThumbDir(const QString& thumbDir) {
   }
 
   m_thumbDir = thumbDir;
+  m_store = openStore(m_thumbDir);
 
   for (const Item& item : m_loadQueue) {
     // This trick will make all queued tasks to expire.
@@ -372,11 +392,12 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
 
   if (loadNow) {
     const QString thumbDir(m_thumbDir);
+    const std::shared_ptr<ThumbnailStore> store(m_store);
     const QSize maxThumbSize(m_maxThumbSize);
 
     locker.unlock();
 
-    pixmap = QPixmap::fromImage(loadSaveThumbnail(imageId, thumbDir, maxThumbSize));
+    pixmap = QPixmap::fromImage(loadSaveThumbnail(imageId, *store, thumbDir, maxThumbSize));
     if (pixmap.isNull()) {
       return LOAD_FAILED;
     }
@@ -441,22 +462,15 @@ void ThumbnailPixmapCache::Impl::ensureThumbnailExists(const ImageId& imageId, c
   }
 
   QMutexLocker locker(&m_mutex);
-  const QString thumbDir(m_thumbDir);
+  const std::shared_ptr<ThumbnailStore> store(m_store);
   const QSize maxThumbSize(m_maxThumbSize);
   locker.unlock();
 
-  const QString thumbFilePath(getThumbFilePath(imageId, thumbDir, m_maxThumbSize));
-  if (QFile::exists(thumbFilePath)) {
+  if (store->contains(imageId, maxThumbSize)) {
     return;
   }
 
-  const QImage thumbnail(makeThumbnail(image, maxThumbSize));
-
-  AtomicFileOverwriter overwriter;
-  QIODevice* iodev = overwriter.startWriting(thumbFilePath);
-  if (iodev && thumbnail.save(iodev, "PNG")) {
-    overwriter.commit();
-  }
+  store->save(imageId, maxThumbSize, makeThumbnail(image, maxThumbSize));
 }
 
 void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& imageId, const QImage& image) {
@@ -469,24 +483,12 @@ void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& imageId, const
   }
 
   QMutexLocker locker(&m_mutex);
-  const QString thumbDir(m_thumbDir);
+  const std::shared_ptr<ThumbnailStore> store(m_store);
   const QSize maxThumbSize(m_maxThumbSize);
   locker.unlock();
 
-  const QString thumbFilePath(getThumbFilePath(imageId, thumbDir, m_maxThumbSize));
-  const QImage thumbnail(makeThumbnail(image, maxThumbSize));
-  bool thumbWritten = false;
-
   // Note that we may be called from multiple threads at the same time.
-  AtomicFileOverwriter overwriter;
-  QIODevice* iodev = overwriter.startWriting(thumbFilePath);
-  if (iodev && thumbnail.save(iodev, "PNG")) {
-    thumbWritten = overwriter.commit();
-  } else {
-    overwriter.abort();
-  }
-
-  if (!thumbWritten) {
+  if (!store->save(imageId, maxThumbSize, makeThumbnail(image, maxThumbSize))) {
     return;
   }
 
@@ -534,6 +536,7 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
       LoadQueue::iterator lqIt;
       ImageId imageId;
       QString thumbDir;
+      std::shared_ptr<ThumbnailStore> store;
       QSize maxThumbSize;
 
       {
@@ -574,9 +577,10 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
 
         // Copy those while holding the mutex.
         thumbDir = m_thumbDir;
+        store = m_store;
         maxThumbSize = m_maxThumbSize;
       }  // mutex scope
-      const QImage image(loadSaveThumbnail(imageId, thumbDir, maxThumbSize));
+      const QImage image(loadSaveThumbnail(imageId, *store, thumbDir, maxThumbSize));
 
       const ThumbnailLoadResult::Status status
           = image.isNull() ? ThumbnailLoadResult::LOAD_FAILED : ThumbnailLoadResult::LOADED;
@@ -588,25 +592,53 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
 }  // ThumbnailPixmapCache::Impl::backgroundProcessing
 
 QImage ThumbnailPixmapCache::Impl::loadSaveThumbnail(const ImageId& imageId,
+                                                     ThumbnailStore& store,
                                                      const QString& thumbDir,
                                                      const QSize& maxThumbSize) {
-  const QString thumbFilePath(getThumbFilePath(imageId, thumbDir, maxThumbSize));
-
-  QImage image(ImageLoader::load(thumbFilePath, 0));
+  QImage image(store.load(imageId, maxThumbSize));
   if (!image.isNull()) {
     return image;
   }
 
-  image = ImageLoader::load(imageId);
+  const QFileInfo thumbFileInfo(getThumbFilePath(imageId, thumbDir, maxThumbSize));
+  if (thumbFileInfo.exists()) {
+    // The store takes a thumbnail as made from the source as it is now,
+    // which is only true if it was written after the source was.
+    const QDateTime sourceModified(QFileInfo(imageId.filePath()).lastModified());
+    if (!sourceModified.isValid() || (thumbFileInfo.lastModified() >= sourceModified)) {
+      image = ImageLoader::load(thumbFileInfo.filePath(), 0);
+    }
+    if (image.isNull() || store.save(imageId, maxThumbSize, image)) {
+      QFile::remove(thumbFileInfo.filePath());
+    }
+    if (!image.isNull()) {
+      return image;
+    }
+  }
+
+  // There is no point in decoding the source at more than about
+  // twice the thumbnail resolution.
+  int reductionFactor = 1;
+  const QSize size(ImageLoader::readSize(imageId));
+  if (!size.isEmpty()) {
+    reductionFactor = std::max(1, std::min(size.width() / (2 * maxThumbSize.width()),
+                                           size.height() / (2 * maxThumbSize.height())));
+  }
+
+  image = (reductionFactor > 1) ? ImageLoader::load(imageId, QRect(), reductionFactor) : ImageLoader::load(imageId);
   if (image.isNull()) {
     return QImage();
   }
 
   const QImage thumbnail(makeThumbnail(image, maxThumbSize));
-  thumbnail.save(thumbFilePath, "PNG");
+  store.save(imageId, maxThumbSize, thumbnail);
   return thumbnail;
 }
 
+std::shared_ptr<ThumbnailStore> ThumbnailPixmapCache::Impl::openStore(const QString& thumbDir) {
+  return std::make_shared<ThumbnailStore>(QDir(thumbDir).absoluteFilePath("thumbnails.dat"));
+}
+
 QString ThumbnailPixmapCache::Impl::getThumbFilePath(const ImageId& imageId,
                                                      const QString& thumbDir,
                                                      const QSize& maxThumbSize) {
@@ -639,12 +671,10 @@ QImage ThumbnailPixmapCache::Impl::makeThumbnail(const QImage& image, const QSiz
 
   QSize toSize(image.size());
   toSize.scale(maxThumbSize, Qt::KeepAspectRatio);
+  toSize = toSize.expandedTo(QSize(1, 1)).boundedTo(image.size());
 
-  if ((image.format() == QImage::Format_Indexed8) && image.isGrayscale()) {
-    // This will be faster than QImage::scale().
-    return scaleToGray(GrayImage(image), toSize);
-  }
-  return image.scaled(toSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+  // This will be faster than QImage::scaled(), for color images as well.
+  return DownscalePyramid::shared(image)->scaledTo(toSize);
 }
 
 void ThumbnailPixmapCache::Impl::queuedToInProgress(const LoadQueue::iterator& lqIt) {
@@ -0,0 +1,482 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ThumbnailStore.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QImage>
+#include <QLockFile>
+#include <QSize>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "AtomicFileOverwriter.h"
+#include "ImageId.h"
+
+namespace {
+const int MAGIC_SIZE = 8;
+const char FILE_MAGIC[MAGIC_SIZE] = {'S', 'T', 'T', 'H', 'U', 'M', 'B', 'S'};
+const quint32 FILE_VERSION = 1;
+const int VERSION_SIZE = 4;
+const qint64 FILE_HEADER_SIZE = MAGIC_SIZE + VERSION_SIZE;
+
+const quint32 RECORD_MAGIC = 0x54485231;
+
+// Superseded records are dropped when opening the file once they take
+// more space than this, and more than the live ones.
+const qint64 MIN_GARBAGE_TO_COMPACT = 4 * 1024 * 1024;
+
+// How long to wait for other processes to finish with the file.
+const int LOCK_TIMEOUT_MS = 5000;
+
+// The fastest zlib compression.  Thumbnails are small, so it's
+// decompression speed that matters.
+const int COMPRESSION_LEVEL = 1;
+
+/**
+ * \brief Precedes the key and the compressed pixels of a record.
+ *
+ * Stored in little-endian byte order.
+ */
+struct RecordHeader {
+  static const int SIZE = 32;
+
+  quint32 magic;
+  quint32 keySize;
+  qint64 sourceModified;
+  qint32 width;
+  qint32 height;
+  qint32 format;
+  quint32 dataSize;
+
+  qint64 recordSize() const { return SIZE + qint64(keySize) + dataSize; }
+
+  void write(uchar* dst) const {
+    qToLittleEndian<quint32>(magic, dst);
+    qToLittleEndian<quint32>(keySize, dst + 4);
+    qToLittleEndian<qint64>(sourceModified, dst + 8);
+    qToLittleEndian<qint32>(width, dst + 16);
+    qToLittleEndian<qint32>(height, dst + 20);
+    qToLittleEndian<qint32>(format, dst + 24);
+    qToLittleEndian<quint32>(dataSize, dst + 28);
+  }
+
+  static RecordHeader read(const uchar* src) {
+    RecordHeader header{};
+    header.magic = qFromLittleEndian<quint32>(src);
+    header.keySize = qFromLittleEndian<quint32>(src + 4);
+    header.sourceModified = qFromLittleEndian<qint64>(src + 8);
+    header.width = qFromLittleEndian<qint32>(src + 16);
+    header.height = qFromLittleEndian<qint32>(src + 20);
+    header.format = qFromLittleEndian<qint32>(src + 24);
+    header.dataSize = qFromLittleEndian<quint32>(src + 28);
+    return header;
+  }
+};
+
+/**
+ * \brief Converts a thumbnail to one of the formats the store keeps pixels in.
+ */
+QImage toStorableFormat(const QImage& image) {
+  switch (image.format()) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+      return image;
+    default:
+      break;
+  }
+
+  if ((image.depth() <= 8) && image.isGrayscale()) {
+    return image.convertToFormat(QImage::Format_Grayscale8);
+  }
+  return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+}
+
+bool isStorableFormat(const int format) {
+  return (format == QImage::Format_Grayscale8) || (format == QImage::Format_RGB32)
+         || (format == QImage::Format_ARGB32);
+}
+
+int bytesPerPixel(const QImage::Format format) {
+  return (format == QImage::Format_Grayscale8) ? 1 : 4;
+}
+
+bool writeVersion(QFile& file, const quint32 version) {
+  uchar buffer[VERSION_SIZE];
+  qToLittleEndian<quint32>(version, buffer);
+  return file.seek(MAGIC_SIZE) && (file.write(reinterpret_cast<const char*>(buffer), VERSION_SIZE) == VERSION_SIZE)
+         && file.flush();
+}
+}  // namespace
+
+ThumbnailStore::ThumbnailStore(const QString& filePath)
+    : m_filePath(filePath), m_file(filePath), m_mapped(nullptr), m_mappedSize(0), m_fileSize(0), m_liveBytes(0) {}
+
+ThumbnailStore::~ThumbnailStore() {
+  closeFile();
+}
+
+bool ThumbnailStore::contains(const ImageId& imageId, const QSize& maxThumbSize) const {
+  ensureOpen();
+  const QString key(makeKey(imageId, maxThumbSize));
+  const qint64 sourceModified = cachedSourceModificationTime(imageId);
+
+  const QMutexLocker locker(&m_mutex);
+  const auto it = m_index.find(key);
+  return (it != m_index.end()) && ((sourceModified == 0) || (it->second.sourceModified == sourceModified));
+}
+
+QImage ThumbnailStore::load(const ImageId& imageId, const QSize& maxThumbSize) const {
+  ensureOpen();
+  const QString key(makeKey(imageId, maxThumbSize));
+  const qint64 sourceModified = cachedSourceModificationTime(imageId);
+
+  RecordHeader header{};
+  QByteArray compressed;
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = m_index.find(key);
+    if (it == m_index.end()) {
+      return QImage();
+    }
+    const Entry& entry = it->second;
+    // If the source is gone, there is no way to tell if the thumbnail is outdated,
+    // and it's better than nothing.
+    if ((sourceModified != 0) && (entry.sourceModified != sourceModified)) {
+      return QImage();
+    }
+
+    QByteArray headerBuffer;
+    const uchar* headerData = recordDataLocked(entry.offset, RecordHeader::SIZE, headerBuffer);
+    if (!headerData) {
+      return QImage();
+    }
+    header = RecordHeader::read(headerData);
+    const uchar* data
+        = recordDataLocked(entry.offset + RecordHeader::SIZE + header.keySize, header.dataSize, compressed);
+    if (!data) {
+      return QImage();
+    }
+    if (data != reinterpret_cast<const uchar*>(compressed.constData())) {
+      // The mapping goes away once another process replaces the file, so it's not to be used unlocked.
+      compressed = QByteArray(reinterpret_cast<const char*>(data), static_cast<int>(header.dataSize));
+    }
+  }
+
+  const QByteArray pixels(qUncompress(compressed));
+  const auto format = static_cast<QImage::Format>(header.format);
+  const int lineSize = header.width * bytesPerPixel(format);
+  if (pixels.size() != lineSize * header.height) {
+    return QImage();
+  }
+
+  QImage image(header.width, header.height, format);
+  if (image.isNull()) {
+    return QImage();
+  }
+  for (int y = 0; y < header.height; ++y) {
+    memcpy(image.scanLine(y), pixels.constData() + y * lineSize, static_cast<size_t>(lineSize));
+  }
+  return image;
+}  // ThumbnailStore::load
+
+bool ThumbnailStore::save(const ImageId& imageId, const QSize& maxThumbSize, const QImage& thumbnail) {
+  if (thumbnail.isNull()) {
+    return false;
+  }
+  ensureOpen();
+
+  const QImage image(toStorableFormat(thumbnail));
+  const int lineSize = image.width() * bytesPerPixel(image.format());
+  QByteArray pixels(lineSize * image.height(), Qt::Uninitialized);
+  for (int y = 0; y < image.height(); ++y) {
+    memcpy(pixels.data() + y * lineSize, image.constScanLine(y), static_cast<size_t>(lineSize));
+  }
+  const QByteArray data(qCompress(pixels, COMPRESSION_LEVEL));
+
+  const QString key(makeKey(imageId, maxThumbSize));
+  const QByteArray keyUtf8(key.toUtf8());
+
+  RecordHeader header{};
+  header.magic = RECORD_MAGIC;
+  header.keySize = static_cast<quint32>(keyUtf8.size());
+  header.sourceModified = sourceModificationTime(imageId);
+  header.width = image.width();
+  header.height = image.height();
+  header.format = image.format();
+  header.dataSize = static_cast<quint32>(data.size());
+
+  QByteArray record(RecordHeader::SIZE, Qt::Uninitialized);
+  header.write(reinterpret_cast<uchar*>(record.data()));
+  record += keyUtf8;
+  record += data;
+
+  // Other processes may be appending to the same file.
+  QLockFile lock(lockFilePath());
+  if (!lock.tryLock(LOCK_TIMEOUT_MS)) {
+    return false;
+  }
+
+  const QMutexLocker locker(&m_mutex);
+  // The thumbnail was made from the file as it is now.
+  m_sourceModified[imageId.filePath()] = header.sourceModified;
+  if (!m_file.isOpen() || !syncWithFileLocked()) {
+    return false;
+  }
+  if (!m_file.seek(m_fileSize) || (m_file.write(record) != record.size()) || !m_file.flush()) {
+    // Don't leave a partial record behind.
+    m_file.resize(m_fileSize);
+    return false;
+  }
+
+  Entry& entry = m_index[key];
+  m_liveBytes -= entry.size;
+  entry.offset = m_fileSize;
+  entry.size = record.size();
+  entry.sourceModified = header.sourceModified;
+  m_liveBytes += entry.size;
+  m_fileSize += record.size();
+  return true;
+}  // ThumbnailStore::save
+
+QString ThumbnailStore::makeKey(const ImageId& imageId, const QSize& maxThumbSize) {
+  return QString::number(maxThumbSize.width()) + QChar('x') + QString::number(maxThumbSize.height()) + QChar(':')
+         + QString::number(imageId.page()) + QChar(':') + imageId.filePath();
+}
+
+QString ThumbnailStore::lockFilePath() const {
+  return m_filePath + QLatin1String(".lock");
+}
+
+qint64 ThumbnailStore::sourceModificationTime(const ImageId& imageId) {
+  const QDateTime modified(QFileInfo(imageId.filePath()).lastModified());
+  return modified.isValid() ? modified.toMSecsSinceEpoch() : 0;
+}
+
+qint64 ThumbnailStore::cachedSourceModificationTime(const ImageId& imageId) const {
+  {
+    const QMutexLocker locker(&m_mutex);
+    const auto it = m_sourceModified.find(imageId.filePath());
+    if (it != m_sourceModified.end()) {
+      return it->second;
+    }
+  }
+
+  const qint64 sourceModified = sourceModificationTime(imageId);
+
+  // Unless save() has recorded a newer one meanwhile.
+  const QMutexLocker locker(&m_mutex);
+  return m_sourceModified.emplace(imageId.filePath(), sourceModified).first->second;
+}
+
+void ThumbnailStore::ensureOpen() const {
+  // Opening changes the store, but not what it holds as seen from outside.
+  std::call_once(m_openFlag, [this]() { const_cast<ThumbnailStore*>(this)->open(); });
+}
+
+void ThumbnailStore::open() {
+  QLockFile lock(lockFilePath());
+  if (!lock.tryLock(LOCK_TIMEOUT_MS)) {
+    return;
+  }
+
+  const QMutexLocker locker(&m_mutex);
+  if (!openFile()) {
+    return;
+  }
+
+  const qint64 garbage = m_fileSize - FILE_HEADER_SIZE - m_liveBytes;
+  if ((garbage > MIN_GARBAGE_TO_COMPACT) && (garbage > m_liveBytes)) {
+    compact();
+    if (!m_file.isOpen()) {
+      openFile();
+    }
+  }
+}
+
+bool ThumbnailStore::openFile() {
+  // Unbuffered, as other processes may change the file behind our back.
+  if (!m_file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+    return false;
+  }
+
+  char magic[MAGIC_SIZE];
+  uchar version[VERSION_SIZE];
+  const bool validHeader = (m_file.read(magic, MAGIC_SIZE) == MAGIC_SIZE)
+                           && (memcmp(magic, FILE_MAGIC, MAGIC_SIZE) == 0)
+                           && (m_file.read(reinterpret_cast<char*>(version), VERSION_SIZE) == VERSION_SIZE)
+                           && (qFromLittleEndian<quint32>(version) == FILE_VERSION);
+  if (!validHeader) {
+    // A new file, or one we don't understand.  Either way, start from scratch.
+    qToLittleEndian<quint32>(FILE_VERSION, version);
+    if (!m_file.resize(0) || (m_file.write(FILE_MAGIC, MAGIC_SIZE) != MAGIC_SIZE)
+        || (m_file.write(reinterpret_cast<const char*>(version), VERSION_SIZE) != VERSION_SIZE) || !m_file.flush()) {
+      m_file.close();
+      return false;
+    }
+  }
+
+  m_fileSize = m_file.size();
+  // If mapping fails, records are read from the file.
+  m_mapped = m_file.map(0, m_fileSize);
+  m_mappedSize = m_mapped ? m_fileSize : 0;
+
+  m_index.clear();
+  m_liveBytes = 0;
+  const qint64 validSize = indexRecords(FILE_HEADER_SIZE);
+  if (validSize < m_fileSize) {
+    // The tail is broken, likely by a crash while writing.
+    // The mapping has to go before the file can be truncated.
+    if (m_mapped) {
+      m_file.unmap(m_mapped);
+      m_mapped = nullptr;
+      m_mappedSize = 0;
+    }
+    m_file.resize(validSize);
+    m_fileSize = validSize;
+    m_mapped = m_file.map(0, m_fileSize);
+    m_mappedSize = m_mapped ? m_fileSize : 0;
+  }
+  return true;
+}  // ThumbnailStore::openFile
+
+void ThumbnailStore::closeFile() {
+  if (m_mapped) {
+    m_file.unmap(m_mapped);
+    m_mapped = nullptr;
+    m_mappedSize = 0;
+  }
+  m_file.close();
+  m_index.clear();
+  m_fileSize = 0;
+  m_liveBytes = 0;
+}
+
+bool ThumbnailStore::syncWithFileLocked() {
+  QByteArray versionBuffer;
+  const uchar* version = recordDataLocked(MAGIC_SIZE, VERSION_SIZE, versionBuffer);
+  const qint64 fileSize = m_file.size();
+  if (!version || (qFromLittleEndian<quint32>(version) != FILE_VERSION) || (fileSize < m_fileSize)) {
+    // Replaced by another process that compacted it.
+    closeFile();
+    return openFile();
+  }
+
+  if (fileSize > m_fileSize) {
+    // Appended to by other processes.
+    const qint64 indexedSize = m_fileSize;
+    m_fileSize = fileSize;
+    const qint64 validSize = indexRecords(indexedSize);
+    if (validSize < m_fileSize) {
+      // Left broken by a process that crashed while appending.
+      // Only the part past the mapping is cut off.
+      if (!m_file.resize(validSize)) {
+        return false;
+      }
+      m_fileSize = validSize;
+    }
+  }
+  return true;
+}  // ThumbnailStore::syncWithFileLocked
+
+qint64 ThumbnailStore::indexRecords(const qint64 from) {
+  qint64 offset = from;
+  while (offset + RecordHeader::SIZE <= m_fileSize) {
+    QByteArray headerBuffer;
+    const uchar* headerData = recordDataLocked(offset, RecordHeader::SIZE, headerBuffer);
+    if (!headerData) {
+      break;
+    }
+    const RecordHeader header(RecordHeader::read(headerData));
+    if ((header.magic != RECORD_MAGIC) || !isStorableFormat(header.format) || (header.width <= 0)
+        || (header.height <= 0) || (offset + header.recordSize() > m_fileSize)) {
+      break;
+    }
+
+    QByteArray keyBuffer;
+    const uchar* keyData = recordDataLocked(offset + RecordHeader::SIZE, header.keySize, keyBuffer);
+    if (!keyData) {
+      break;
+    }
+    const QString key(QString::fromUtf8(reinterpret_cast<const char*>(keyData), static_cast<int>(header.keySize)));
+
+    // Later records supersede earlier ones.
+    Entry& entry = m_index[key];
+    m_liveBytes -= entry.size;
+    entry.offset = offset;
+    entry.size = header.recordSize();
+    entry.sourceModified = header.sourceModified;
+    m_liveBytes += entry.size;
+
+    offset += header.recordSize();
+  }
+  return offset;
+}  // ThumbnailStore::indexRecords
+
+bool ThumbnailStore::compact() {
+  std::vector<Entry> entries;
+  entries.reserve(m_index.size());
+  for (const auto& keyAndEntry : m_index) {
+    entries.push_back(keyAndEntry.second);
+  }
+  // Keeping the records in their original order.
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& lhs, const Entry& rhs) { return lhs.offset < rhs.offset; });
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* iodev = overwriter.startWriting(m_filePath);
+  if (!iodev) {
+    return false;
+  }
+
+  QByteArray fileHeader(FILE_MAGIC, MAGIC_SIZE);
+  uchar version[VERSION_SIZE];
+  qToLittleEndian<quint32>(FILE_VERSION, version);
+  fileHeader.append(reinterpret_cast<const char*>(version), VERSION_SIZE);
+  if (iodev->write(fileHeader) != fileHeader.size()) {
+    return false;
+  }
+
+  for (const Entry& entry : entries) {
+    QByteArray buffer;
+    const uchar* data = recordDataLocked(entry.offset, entry.size, buffer);
+    if (!data || (iodev->write(reinterpret_cast<const char*>(data), entry.size) != entry.size)) {
+      return false;
+    }
+  }
+
+  // Other processes having the file open will find out it's been replaced
+  // before appending to it.
+  if (!writeVersion(m_file, 0)) {
+    return false;
+  }
+
+  // The file can't be replaced while open under Windows.
+  closeFile();
+  if (!overwriter.commit()) {
+    // The file stays, so it has to be valid again.
+    QFile file(m_filePath);
+    if (file.open(QIODevice::ReadWrite)) {
+      writeVersion(file, FILE_VERSION);
+    }
+    return false;
+  }
+  return true;
+}  // ThumbnailStore::compact
+
+const uchar* ThumbnailStore::recordDataLocked(const qint64 offset, const qint64 size, QByteArray& buffer) const {
+  if (offset + size <= m_mappedSize) {
+    return m_mapped + offset;
+  }
+
+  // Appended since the file was mapped.
+  buffer.resize(static_cast<int>(size));
+  if (!m_file.seek(offset) || (m_file.read(buffer.data(), size) != size)) {
+    return nullptr;
+  }
+  return reinterpret_cast<const uchar*>(buffer.constData());
+}
@@ -0,0 +1,155 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_CORE_THUMBNAILSTORE_H_
+#define SCANTAILOR_CORE_THUMBNAILSTORE_H_
+
+#include <foundation/Hashes.h>
+
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <mutex>
+#include <unordered_map>
+
+#include "NonCopyable.h"
+
+class ImageId;
+class QImage;
+class QSize;
+
+/**
+ * \brief Keeps all the thumbnails of a project in a single file.
+ *
+ * Thumbnails are appended to the file, and the file is indexed once, when opened.
+ * A thumbnail is keyed by the image it was made from and the maximum thumbnail size,
+ * and is only served while the modification time of the source file is the same
+ * as it was when the thumbnail was made.  A newer thumbnail of the same image
+ * supersedes the older one, and the superseded ones are dropped when opening
+ * the file if there are enough of them.
+ *
+ * The file is opened on first use rather than by the constructor, as waiting
+ * for other processes and compacting the file may take a while, and stores
+ * are created on the GUI thread.  The modification time of a source file is
+ * looked up once, and then only when saving a thumbnail of it, so a source
+ * changed by another program is noticed once the store is created again.
+ *
+ * Pixels are stored zlib-compressed at the fastest level.  The part of the file
+ * that existed when it was opened is memory-mapped, so loading those thumbnails
+ * involves no file operations.
+ *
+ * The file may be shared with other processes, like a GUI and a batch run
+ * working on the same project.  Opening, compacting and appending to it happen
+ * under a lock file.  Before appending, a store catches up with the records
+ * appended by others, and reopens the file if another process replaced it
+ * while compacting.
+ *
+ * All the methods are thread-safe.
+ */
+class ThumbnailStore {
+  DECLARE_NON_COPYABLE(ThumbnailStore)
+
+ public:
+  /**
+   * \brief Creates a store of the file, which is created on first use if it doesn't exist.
+   *
+   * If the file can't be opened or created, the store works without it,
+   * that is it holds nothing and save() fails.
+   */
+  explicit ThumbnailStore(const QString& filePath);
+
+  ~ThumbnailStore();
+
+  const QString& filePath() const { return m_filePath; }
+
+  /**
+   * \brief Checks if there is an up-to-date thumbnail of an image.
+   */
+  bool contains(const ImageId& imageId, const QSize& maxThumbSize) const;
+
+  /**
+   * \return The thumbnail, or a null image if there is no up-to-date one.
+   */
+  QImage load(const ImageId& imageId, const QSize& maxThumbSize) const;
+
+  /**
+   * \brief Stores a thumbnail of an image, superseding the existing one, if any.
+   *
+   * \return true on success.
+   */
+  bool save(const ImageId& imageId, const QSize& maxThumbSize, const QImage& thumbnail);
+
+ private:
+  struct Entry {
+    qint64 offset;
+    qint64 size;
+    qint64 sourceModified;
+  };
+
+  using Index = std::unordered_map<QString, Entry, hashes::hash<QString>>;
+
+  static QString makeKey(const ImageId& imageId, const QSize& maxThumbSize);
+
+  static qint64 sourceModificationTime(const ImageId& imageId);
+
+  /**
+   * \brief Same as sourceModificationTime(), but only asks the file system once per file.
+   */
+  qint64 cachedSourceModificationTime(const ImageId& imageId) const;
+
+  /**
+   * \brief Opens the file, and compacts it if needed, unless it has already been done.
+   */
+  void ensureOpen() const;
+
+  void open();
+
+  QString lockFilePath() const;
+
+  bool openFile();
+
+  void closeFile();
+
+  /**
+   * \brief Picks up the changes other processes made to the file.
+   *
+   * Must be called with both the lock file and m_mutex locked.
+   *
+   * \return false if the file can't be appended to.
+   */
+  bool syncWithFileLocked();
+
+  /**
+   * \brief Adds the records from \p from to the end of the file to the index.
+   *
+   * \return The offset past the last valid record.
+   */
+  qint64 indexRecords(qint64 from);
+
+  /**
+   * \brief Rewrites the file without the superseded records.
+   *
+   * Leaves the file closed if it got as far as replacing it.
+   */
+  bool compact();
+
+  /**
+   * \return The bytes of a record, either mapped or read into \p buffer.
+   *         Must be called with m_mutex locked.
+   */
+  const uchar* recordDataLocked(qint64 offset, qint64 size, QByteArray& buffer) const;
+
+  QString m_filePath;
+  mutable std::once_flag m_openFlag;
+  mutable QMutex m_mutex;
+  mutable QFile m_file;
+  uchar* m_mapped;
+  qint64 m_mappedSize;
+  qint64 m_fileSize;
+  qint64 m_liveBytes;
+  Index m_index;
+  mutable std::unordered_map<QString, qint64, hashes::hash<QString>> m_sourceModified;
+};
+
+
+#endif  // ifndef SCANTAILOR_CORE_THUMBNAILSTORE_H_
@@ -9,10 +9,15 @@
 #include <QDebug>
 #include <QIODevice>
 #include <QImage>
+#include <QRect>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
 #include "Dpm.h"
+#include "Grayscale.h"
 #include "ImageMetadata.h"
 #include "NonCopyable.h"
 
@@ -142,6 +147,76 @@ bool TiffReader::TiffInfo::mapsToBinaryOrIndexed8() const {
   return false;
 }
 
+/**
+ * Averages blocks of factor x factor pixels of a region, fed to it row by row
+ * in the ABGR format of the libtiff RGBA interface.
+ */
+class TiffReader::RowReducer {
+  DECLARE_NON_COPYABLE(RowReducer)
+
+ public:
+  RowReducer(QImage& dst, int srcWidth, int factor)
+      : m_dst(dst), m_srcWidth(srcWidth), m_factor(factor), m_sums(dst.width() * 4, 0), m_numRows(0), m_dstY(0) {}
+
+  void addRow(const uint32* src) {
+    uint32_t* sum = m_sums.data();
+    for (int x = 0; x < m_srcWidth; x += m_factor, sum += 4) {
+      const int blockEnd = std::min(x + m_factor, m_srcWidth);
+      for (int i = x; i < blockEnd; ++i) {
+        const uint32 abgr = src[i];
+        sum[0] += TIFFGetR(abgr);
+        sum[1] += TIFFGetG(abgr);
+        sum[2] += TIFFGetB(abgr);
+        sum[3] += TIFFGetA(abgr);
+      }
+    }
+    if (++m_numRows == m_factor) {
+      flush();
+    }
+  }
+
+  /**
+   * Emits the last, possibly incomplete, row of blocks.
+   */
+  void finish() {
+    if (m_numRows > 0) {
+      flush();
+    }
+  }
+
+ private:
+  void flush() {
+    if (m_dstY < m_dst.height()) {
+      uint8_t* const line = m_dst.scanLine(m_dstY);
+      const uint32_t* sum = m_sums.data();
+      for (int x = 0; x < m_dst.width(); ++x, sum += 4) {
+        const auto count = static_cast<uint32_t>(m_numRows * std::min(m_factor, m_srcWidth - x * m_factor));
+        const uint32_t half = count / 2;
+        const uint32_t r = (sum[0] + half) / count;
+        const uint32_t g = (sum[1] + half) / count;
+        const uint32_t b = (sum[2] + half) / count;
+        const uint32_t a = (sum[3] + half) / count;
+        if (m_dst.format() == QImage::Format_Indexed8) {
+          line[x] = static_cast<uint8_t>(r);
+        } else {
+          reinterpret_cast<QRgb*>(line)[x] = qRgba(r, g, b, a);
+        }
+      }
+      ++m_dstY;
+    }
+    std::fill(m_sums.begin(), m_sums.end(), 0);
+    m_numRows = 0;
+  }
+
+  QImage& m_dst;
+  const int m_srcWidth;
+  const int m_factor;
+  std::vector<uint32_t> m_sums;  // RGBA sums for every destination pixel.
+  int m_numRows;
+  int m_dstY;
+};
+
+
 static tsize_t deviceRead(thandle_t context, tdata_t data, tsize_t size) {
   auto* dev = (QIODevice*) context;
   return (tsize_t) dev->read(static_cast<char*>(data), size);
@@ -230,6 +305,32 @@ ImageMetadataLoader::Status TiffReader::readMetadata(QIODevice& device,
   return ImageMetadataLoader::LOADED;
 }
 
+ImageMetadata TiffReader::readPageMetadata(QIODevice& device, const int pageNum) {
+  if (!device.isReadable()) {
+    return ImageMetadata();
+  }
+  if (device.isSequential()) {
+    // libtiff needs to be able to seek.
+    return ImageMetadata();
+  }
+
+  if (!checkHeader(TiffHeader(readHeader(device)))) {
+    return ImageMetadata();
+  }
+
+  TiffHandle tif(TIFFClientOpen("file", "rBm", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
+                                &deviceSize, &deviceMap, &deviceUnmap));
+  if (!tif.handle()) {
+    return ImageMetadata();
+  }
+
+  // Only the offsets of the preceding directories are followed.
+  if (!TIFFSetDirectory(tif.handle(), (uint16) pageNum)) {
+    return ImageMetadata();
+  }
+  return currentPageMetadata(tif);
+}
+
 static void convertAbgrToArgb(const uint32* src, uint32* dst, int count) {
   for (int i = 0; i < count; ++i) {
     const uint32 srcWord = src[i];
@@ -273,7 +374,7 @@ QImage TiffReader::readImage(QIODevice& device, const int pageNum) {
 
   if (info.mapsToBinaryOrIndexed8()) {
     // Common case optimization.
-    image = extractBinaryOrIndexed8Image(tif, info);
+    image = extractBinaryOrIndexed8Image(tif, info, 0, info.height);
   } else {
     // General case.
     image = QImage(info.width, info.height, info.samplesPerPixel == 3 ? QImage::Format_RGB32 : QImage::Format_ARGB32);
@@ -318,6 +419,234 @@ QImage TiffReader::readImage(QIODevice& device, const int pageNum) {
   return image;
 }  // TiffReader::readImage
 
+QImage TiffReader::readImage(QIODevice& device, const int pageNum, const QRect& roi, const int reductionFactor) {
+  if (!device.isReadable()) {
+    return QImage();
+  }
+  if (device.isSequential()) {
+    // libtiff needs to be able to seek.
+    return QImage();
+  }
+
+  TiffHeader header(readHeader(device));
+  if (!checkHeader(header)) {
+    return QImage();
+  }
+
+  TiffHandle tif(TIFFClientOpen("file", "rBm", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
+                                &deviceSize, &deviceMap, &deviceUnmap));
+  if (!tif.handle()) {
+    return QImage();
+  }
+
+  if (!TIFFSetDirectory(tif.handle(), (uint16) pageNum)) {
+    return QImage();
+  }
+
+  const ImageMetadata metadata(currentPageMetadata(tif));
+  const QRect fullRect(QPoint(0, 0), metadata.size());
+  const QRect fullRegion(roi.isNull() ? fullRect : roi.intersected(fullRect));
+  if (fullRegion.isEmpty()) {
+    return QImage();
+  }
+
+  int factor = std::max(1, reductionFactor);
+  QRect region(fullRegion);
+  if (factor > 1) {
+    if (!selectReducedSubfile(tif, pageNum, fullRect.width(), factor)) {
+      return QImage();
+    }
+
+    uint32 width = 0;
+    uint32 height = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGELENGTH, &height);
+    if ((width == 0) || (height == 0)) {
+      return QImage();
+    }
+    if (int(width) != fullRect.width()) {
+      // Map the region into the subfile and reduce what's left to reduce.
+      const double xscale = double(fullRect.width()) / width;
+      const double yscale = double(fullRect.height()) / height;
+      const int left = int(std::floor(fullRegion.left() / xscale));
+      const int top = int(std::floor(fullRegion.top() / yscale));
+      const int right = int(std::ceil((fullRegion.right() + 1) / xscale));
+      const int bottom = int(std::ceil((fullRegion.bottom() + 1) / yscale));
+      region = QRect(left, top, right - left, bottom - top).intersected(QRect(0, 0, width, height));
+      factor = std::max(1, int(factor / xscale + 0.001));
+    }
+  }
+
+  const TiffInfo info(tif, header);
+  QImage image(readRegion(tif, info, region, factor));
+  if (image.isNull()) {
+    return QImage();
+  }
+
+  if (!metadata.dpi().isNull()) {
+    const Dpm dpm(metadata.dpi());
+    image.setDotsPerMeterX(qRound(dpm.horizontal() * image.width() / double(fullRegion.width())));
+    image.setDotsPerMeterY(qRound(dpm.vertical() * image.height() / double(fullRegion.height())));
+  }
+  return image;
+}  // TiffReader::readImage
+
+bool TiffReader::selectReducedSubfile(const TiffHandle& tif,
+                                      const int pageNum,
+                                      const int fullWidth,
+                                      const int reductionFactor) {
+  struct Subfile {
+    int width;
+    toff_t subIfdOffset;  // Zero for top-level directories.
+    int dirIndex;
+  };
+
+  std::vector<Subfile> subfiles;
+  const auto isReduced = [&tif]() {
+    uint32 subfileType = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_SUBFILETYPE, &subfileType);
+    return (subfileType & FILETYPE_REDUCEDIMAGE) != 0;
+  };
+  const auto currentWidth = [&tif]() {
+    uint32 width = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+    return int(width);
+  };
+
+  uint16 numSubIfds = 0;
+  toff_t* subIfdOffsets = nullptr;
+  if (TIFFGetField(tif.handle(), TIFFTAG_SUBIFD, &numSubIfds, &subIfdOffsets) && (numSubIfds > 0)) {
+    // The array belongs to the current directory, which we are about to leave.
+    const std::vector<toff_t> offsets(subIfdOffsets, subIfdOffsets + numSubIfds);
+    for (const toff_t offset : offsets) {
+      if (TIFFSetSubDirectory(tif.handle(), offset) && isReduced()) {
+        subfiles.push_back(Subfile{currentWidth(), offset, -1});
+      }
+    }
+    if (!TIFFSetDirectory(tif.handle(), (uint16) pageNum)) {
+      return false;
+    }
+  }
+
+  // Reduced versions may also follow the page as top-level directories.
+  for (int dirIndex = pageNum + 1; TIFFReadDirectory(tif.handle()) && isReduced(); ++dirIndex) {
+    subfiles.push_back(Subfile{currentWidth(), 0, dirIndex});
+  }
+
+  // The smallest subfile that doesn't need upscaling.
+  const Subfile* best = nullptr;
+  for (const Subfile& subfile : subfiles) {
+    if ((subfile.width <= 0) || (subfile.width * reductionFactor < fullWidth)) {
+      continue;
+    }
+    if (!best || (subfile.width < best->width)) {
+      best = &subfile;
+    }
+  }
+
+  if (!best) {
+    return TIFFSetDirectory(tif.handle(), (uint16) pageNum) != 0;
+  } else if (best->dirIndex < 0) {
+    return TIFFSetSubDirectory(tif.handle(), best->subIfdOffset) != 0;
+  } else {
+    return TIFFSetDirectory(tif.handle(), (uint16) best->dirIndex) != 0;
+  }
+}  // TiffReader::selectReducedSubfile
+
+QImage TiffReader::readRegion(const TiffHandle& tif, const TiffInfo& info, const QRect& region, const int reductionFactor) {
+  if ((reductionFactor == 1) && info.mapsToBinaryOrIndexed8() && !TIFFIsTiled(tif.handle())) {
+    // Keep the format a full read would produce.
+    QImage image(extractBinaryOrIndexed8Image(tif, info, region.top(), region.height()));
+    if (image.isNull() || (region.width() == info.width)) {
+      return image;
+    }
+    return image.copy(region.left(), 0, region.width(), region.height());
+  }
+  return readRgbaRegion(tif, info, region, reductionFactor);
+}
+
+QImage TiffReader::readRgbaRegion(const TiffHandle& tif,
+                                  const TiffInfo& info,
+                                  const QRect& region,
+                                  const int reductionFactor) {
+  char errorMessage[1024];
+  if (!TIFFRGBAImageOK(tif.handle(), errorMessage)) {
+    return QImage();
+  }
+
+  const bool grayscale = (info.samplesPerPixel == 1)
+                         && ((info.photometric == PHOTOMETRIC_MINISBLACK) || (info.photometric == PHOTOMETRIC_MINISWHITE));
+  QImage::Format format = QImage::Format_ARGB32;
+  if (grayscale) {
+    format = QImage::Format_Indexed8;
+  } else if (info.samplesPerPixel == 3) {
+    format = QImage::Format_RGB32;
+  }
+
+  QImage image((region.width() + reductionFactor - 1) / reductionFactor,
+               (region.height() + reductionFactor - 1) / reductionFactor, format);
+  if (image.isNull()) {
+    throw std::bad_alloc();
+  }
+  if (grayscale) {
+    image.setColorTable(imageproc::createGrayscalePalette());
+  }
+
+  // Strips and tiles are decoded one band of rows at a time.
+  const bool tiled = TIFFIsTiled(tif.handle()) != 0;
+  uint32 blockWidth = info.width;
+  uint32 blockHeight = info.height;
+  if (tiled) {
+    TIFFGetField(tif.handle(), TIFFTAG_TILEWIDTH, &blockWidth);
+    TIFFGetField(tif.handle(), TIFFTAG_TILELENGTH, &blockHeight);
+  } else {
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &blockHeight);
+    blockHeight = std::min<uint32>(blockHeight, info.height);
+  }
+  if ((blockWidth == 0) || (blockHeight == 0)) {
+    return QImage();
+  }
+
+  const int regionWidth = region.width();
+  TiffBuffer<uint32> raster(tsize_t(blockWidth) * blockHeight);
+  std::vector<uint32> band(size_t(regionWidth) * blockHeight);
+  RowReducer reducer(image, regionWidth, reductionFactor);
+
+  // Rasters returned by the libtiff RGBA interface are bottom-up.
+  for (int bandTop = region.top() / blockHeight * blockHeight; bandTop <= region.bottom(); bandTop += blockHeight) {
+    const int bandHeight = std::min<int>(blockHeight, info.height - bandTop);
+    if (tiled) {
+      for (int col = region.left() / blockWidth * blockWidth; col <= region.right(); col += blockWidth) {
+        if (!TIFFReadRGBATile(tif.handle(), col, bandTop, raster.data())) {
+          return QImage();
+        }
+        const int x0 = std::max(col, region.left());
+        const int x1 = std::min<int>(col + blockWidth, region.right() + 1);
+        for (int i = 0; i < bandHeight; ++i) {
+          const uint32* src = raster.data() + size_t(blockHeight - 1 - i) * blockWidth + (x0 - col);
+          memcpy(&band[size_t(i) * regionWidth + (x0 - region.left())], src, (x1 - x0) * sizeof(uint32));
+        }
+      }
+    } else {
+      if (!TIFFReadRGBAStrip(tif.handle(), bandTop, raster.data())) {
+        return QImage();
+      }
+      for (int i = 0; i < bandHeight; ++i) {
+        const uint32* src = raster.data() + size_t(bandHeight - 1 - i) * info.width + region.left();
+        memcpy(&band[size_t(i) * regionWidth], src, regionWidth * sizeof(uint32));
+      }
+    }
+
+    const int y0 = std::max(bandTop, region.top());
+    const int y1 = std::min(bandTop + bandHeight, region.bottom() + 1);
+    for (int y = y0; y < y1; ++y) {
+      reducer.addRow(&band[size_t(y - bandTop) * regionWidth]);
+    }
+  }
+  reducer.finish();
+  return image;
+}  // TiffReader::readRgbaRegion
+
 TiffReader::TiffHeader TiffReader::readHeader(QIODevice& device) {
   unsigned char data[4];
   if (device.peek((char*) data, sizeof(data)) != sizeof(data)) {
@@ -372,7 +701,10 @@ Dpi TiffReader::getDpi(float xres, float yres, unsigned resUnit) {
   return Dpi();
 }
 
-QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info) {
+QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif,
+                                                const TiffInfo& info,
+                                                const int firstRow,
+                                                const int numRows) {
   QImage::Format format = QImage::Format_Indexed8;
   if (info.bitsPerSample == 1) {
     // Because we specify B option when opening, we can
@@ -380,7 +712,7 @@ QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const Tif
     format = QImage::Format_Mono;
   }
 
-  QImage image(info.width, info.height, format);
+  QImage image(info.width, numRows, format);
   if (image.isNull()) {
     throw std::bad_alloc();
   }
@@ -427,21 +759,21 @@ QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const Tif
   }
 
   if ((info.bitsPerSample == 1) || (info.bitsPerSample == 8)) {
-    readLines(tif, image);
+    readLines(tif, image, firstRow);
   } else {
-    readAndUnpackLines(tif, info, image);
+    readAndUnpackLines(tif, info, image, firstRow);
   }
   return image;
 }  // TiffReader::extractBinaryOrIndexed8Image
 
-void TiffReader::readLines(const TiffHandle& tif, QImage& image) {
+void TiffReader::readLines(const TiffHandle& tif, QImage& image, const int firstRow) {
   const int height = image.height();
   for (int y = 0; y < height; ++y) {
-    TIFFReadScanline(tif.handle(), image.scanLine(y), y);
+    TIFFReadScanline(tif.handle(), image.scanLine(y), firstRow + y);
   }
 }
 
-void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image) {
+void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image, const int firstRow) {
   TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
 
   const int width = image.width();
@@ -450,7 +782,7 @@ void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info,
   const unsigned dstMask = (1 << bitsPerSample) - 1;
 
   for (int y = 0; y < height; ++y) {
-    TIFFReadScanline(tif.handle(), buf.data(), y);
+    TIFFReadScanline(tif.handle(), buf.data(), firstRow + y);
 
     unsigned accum = 0;
     int bitsInAccum = 0;
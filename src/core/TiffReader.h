@@ -9,6 +9,7 @@
 
 class QIODevice;
 class QImage;
+class QRect;
 class ImageMetadata;
 class Dpi;
 
@@ -19,6 +20,15 @@ class TiffReader {
   static ImageMetadataLoader::Status readMetadata(QIODevice& device,
                                                   const VirtualFunction<void, const ImageMetadata&>& out);
 
+  /**
+   * \brief Reads the metadata of a single page.
+   *
+   * Unlike readMetadata(), this doesn't parse the directories of other pages.
+   *
+   * \return The metadata of the page, with an empty size in case of failure.
+   */
+  static ImageMetadata readPageMetadata(QIODevice& device, int pageNum);
+
   /**
    * \brief Reads the image from io device to QImage.
    *
@@ -30,6 +40,27 @@ class TiffReader {
    */
   static QImage readImage(QIODevice& device, int pageNum = 0);
 
+  /**
+   * \brief Reads a region of the image, optionally at a reduced resolution.
+   *
+   * Only the strips or tiles intersecting the region are decoded.  When reducing
+   * the resolution, a reduced-resolution subfile of the page is used if there is
+   * a suitable one.  The rest of the reduction is done by averaging blocks of pixels.
+   * Grayscale and bitonal images are returned as grayscale Indexed8 images
+   * in that case.
+   *
+   * \param device The device to read from.  This device must be
+   *        opened for reading and must be seekable.
+   * \param pageNum A zero-based page number within a multi-page
+   *        TIFF file.
+   * \param roi The region to read, in full resolution pixels.  It gets clipped
+   *        to the image.  A null rectangle stands for the whole image.
+   * \param reductionFactor Each pixel of the result will correspond to
+   *        about reductionFactor x reductionFactor pixels of the region.
+   * \return The resulting image, or a null image in case of failure.
+   */
+  static QImage readImage(QIODevice& device, int pageNum, const QRect& roi, int reductionFactor = 1);
+
  private:
   class TiffHeader;
   class TiffHandle;
@@ -39,6 +70,8 @@ class TiffReader {
   template <typename T>
   class TiffBuffer;
 
+  class RowReducer;
+
   static TiffHeader readHeader(QIODevice& device);
 
   static bool checkHeader(const TiffHeader& header);
@@ -47,11 +80,25 @@ class TiffReader {
 
   static Dpi getDpi(float xres, float yres, unsigned resUnit);
 
-  static QImage extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info);
+  /**
+   * \brief Switches to the reduced-resolution subfile of the current page best suited
+   *        for the given reduction, if there is one.
+   *
+   * Both SubIFDs and reduced-resolution directories following the page are considered.
+   *
+   * \return false if neither a subfile nor the page itself could be selected.
+   */
+  static bool selectReducedSubfile(const TiffHandle& tif, int pageNum, int fullWidth, int reductionFactor);
+
+  static QImage readRegion(const TiffHandle& tif, const TiffInfo& info, const QRect& region, int reductionFactor);
+
+  static QImage readRgbaRegion(const TiffHandle& tif, const TiffInfo& info, const QRect& region, int reductionFactor);
+
+  static QImage extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info, int firstRow, int numRows);
 
-  static void readLines(const TiffHandle& tif, QImage& image);
+  static void readLines(const TiffHandle& tif, QImage& image, int firstRow);
 
-  static void readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image);
+  static void readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image, int firstRow);
 };
 
 
@@ -7,13 +7,17 @@
 #include <Grayscale.h>
 #include <tiffio.h>
 
+#include <QBuffer>
 #include <QDebug>
 #include <QtCore/QFile>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 
 #include "ApplicationSettings.h"
 #include "Dpm.h"
+#include "ParallelFor.h"
 
 /**
  * m_reverseBitsLUT[byte] gives the same byte, but with bit order reversed.
@@ -35,6 +39,29 @@ const uint8_t TiffWriter::m_reverseBitsLUT[256]
        0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff};
 
 
+namespace {
+/**
+ * The approximate amount of uncompressed data in an automatically sized strip.
+ * Small enough for a page to split into plenty of strips to compress in parallel,
+ * large enough for the per-strip overhead not to matter.
+ */
+const int TARGET_STRIP_BYTES = 256 * 1024;
+
+bool isDeflate(const uint16 compression) {
+  return (compression == COMPRESSION_DEFLATE) || (compression == COMPRESSION_ADOBE_DEFLATE);
+}
+}  // namespace
+
+struct TiffWriter::StripFormat {
+  uint32 width;
+  uint16 bitsPerSample;
+  uint16 samplesPerPixel;
+  uint16 photometric;
+  uint16 compression;
+  uint16 predictor;
+};
+
+
 class TiffWriter::TiffHandle {
  public:
   explicit TiffHandle(TIFF* handle) : m_handle(handle) {}
@@ -190,6 +217,12 @@ void TiffWriter::setDpm(const TiffHandle& tif, const Dpm& dpm) {
   TIFFSetField(tif.handle(), TIFFTAG_RESOLUTIONUNIT, unit);
 }
 
+void TiffWriter::setPredictor(const TiffHandle& tif, const uint16 compression) {
+  if (isDeflate(compression) && ApplicationSettings::getInstance().isTiffDeflatePredictorEnabled()) {
+    TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+  }
+}
+
 bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage& image) {
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(1));
 
@@ -222,8 +255,12 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
   }
 
   if (image.format() == QImage::Format_Indexed8) {
-    TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION,
-                 uint16(ApplicationSettings::getInstance().getTiffColorCompression()));
+    const auto compression = uint16(ApplicationSettings::getInstance().getTiffColorCompression());
+    TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, compression);
+    if (photometric == PHOTOMETRIC_MINISBLACK) {
+      // Differencing palette indices makes no sense.
+      setPredictor(tif, compression);
+    }
   } else {
     TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(ApplicationSettings::getInstance().getTiffBwCompression()));
   }
@@ -250,12 +287,13 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
   }
 
   if (image.format() == QImage::Format_Indexed8) {
-    return write8bitLines(tif, image);
+    return writeStrips(tif, image, image.width(), &copyLine);
   } else {
+    const int bpl = (image.width() + 7) / 8;
     if (image.format() == QImage::Format_MonoLSB) {
-      return writeBinaryLinesReversed(tif, image);
+      return writeStrips(tif, image, bpl, &copyBinaryLineReversed);
     } else {
-      return writeBinaryLinesAsIs(tif, image);
+      return writeStrips(tif, image, bpl, &copyLine);
     }
   }
 }  // TiffWriter::writeBitonalOrIndexed8Image
@@ -263,123 +301,170 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
 bool TiffWriter::writeRGB32Image(const TiffHandle& tif, const QImage& image) {
   assert(image.format() == QImage::Format_RGB32);
 
+  const auto compression = uint16(ApplicationSettings::getInstance().getTiffColorCompression());
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(3));
-  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(ApplicationSettings::getInstance().getTiffColorCompression()));
+  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, compression);
   TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
   TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-
-  const int width = image.width();
-  const int height = image.height();
-
-  std::vector<uint8_t> tmpLine(width * 3);
-
-  // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
-
-  for (int y = 0; y < height; ++y) {
-    const auto* pSrc = (const uint32_t*) image.scanLine(y);
-    uint8_t* pDst = &tmpLine[0];
-    for (int x = 0; x < width; ++x) {
-      const uint32_t ARGB = *pSrc;
-      pDst[0] = static_cast<uint8_t>(ARGB >> 16);
-      pDst[1] = static_cast<uint8_t>(ARGB >> 8);
-      pDst[2] = static_cast<uint8_t>(ARGB);
-      ++pSrc;
-      pDst += 3;
-    }
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
-  }
-  return true;
-}  // TiffWriter::writeRGB32Image
+  setPredictor(tif, compression);
+  return writeStrips(tif, image, image.width() * 3, &packRGB32Line);
+}
 
 bool TiffWriter::writeARGB32Image(const TiffHandle& tif, const QImage& image) {
   assert(image.format() == QImage::Format_ARGB32);
 
+  const auto compression = uint16(ApplicationSettings::getInstance().getTiffColorCompression());
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(4));
-  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(ApplicationSettings::getInstance().getTiffColorCompression()));
+  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, compression);
   TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
   TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  setPredictor(tif, compression);
+  return writeStrips(tif, image, image.width() * 4, &packARGB32Line);
+}
 
-  const int width = image.width();
-  const int height = image.height();
-
-  std::vector<uint8_t> tmpLine(width * 4);
+bool TiffWriter::writeStrips(const TiffHandle& tif,
+                             const QImage& image,
+                             const int bytesPerLine,
+                             const PackLineFunc packLine) {
+  StripFormat format{};
+  TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &format.width);
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_BITSPERSAMPLE, &format.bitsPerSample);
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, &format.samplesPerPixel);
+  TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &format.photometric);
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_COMPRESSION, &format.compression);
+  format.predictor = PREDICTOR_NONE;
+  if (isDeflate(format.compression)) {
+    TIFFGetField(tif.handle(), TIFFTAG_PREDICTOR, &format.predictor);
+  }
+  if (format.compression == COMPRESSION_JPEG) {
+    // The strips are compressed by separate libtiff instances, so they
+    // have to carry their own tables rather than share a JPEGTables field.
+    TIFFSetField(tif.handle(), TIFFTAG_JPEGTABLESMODE, 0);
+  }
 
-  // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
+  const int height = image.height();
+  const int rowsPerStrip = chooseRowsPerStrip(format, bytesPerLine, height);
+  TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rowsPerStrip));
+
+  const int numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+  std::vector<QByteArray> strips(static_cast<size_t>(numStrips));
+  parallelFor(numStrips, [&](const int strip) {
+    const int top = strip * rowsPerStrip;
+    const int numRows = std::min(rowsPerStrip, height - top);
+    // Encoding may modify the data in place, so it's packed
+    // into a temporary buffer even when no conversion is required.
+    std::vector<uint8_t> data(static_cast<size_t>(bytesPerLine) * numRows);
+    for (int i = 0; i < numRows; ++i) {
+      packLine(image, top + i, &data[static_cast<size_t>(bytesPerLine) * i]);
+    }
+    strips[strip] = encodeStrip(format, numRows, data);
+  });
 
-  for (int y = 0; y < height; ++y) {
-    const auto* pSrc = (const uint32_t*) image.scanLine(y);
-    uint8_t* pDst = &tmpLine[0];
-    for (int x = 0; x < width; ++x) {
-      const uint32_t ARGB = *pSrc;
-      pDst[0] = static_cast<uint8_t>(ARGB >> 16);
-      pDst[1] = static_cast<uint8_t>(ARGB >> 8);
-      pDst[2] = static_cast<uint8_t>(ARGB);
-      pDst[3] = static_cast<uint8_t>(ARGB >> 24);
-      ++pSrc;
-      pDst += 4;
+  for (int strip = 0; strip < numStrips; ++strip) {
+    QByteArray& data = strips[strip];
+    if (data.isNull()) {
+      return false;
     }
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
+    if (TIFFWriteRawStrip(tif.handle(), uint32(strip), data.data(), data.size()) == -1) {
       return false;
     }
+    // Release the memory as we go.
+    data = QByteArray();
   }
   return true;
-}  // TiffWriter::writeARGB32Image
+}  // TiffWriter::writeStrips
 
-bool TiffWriter::write8bitLines(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
+int TiffWriter::chooseRowsPerStrip(const StripFormat& format, const int bytesPerLine, const int height) {
+  int rowsPerStrip = ApplicationSettings::getInstance().getTiffRowsPerStrip();
+  if (rowsPerStrip <= 0) {
+    rowsPerStrip = std::max(1, TARGET_STRIP_BYTES / std::max(1, bytesPerLine));
+  }
+  if (format.compression == COMPRESSION_JPEG) {
+    // Strips must consist of whole MCU rows.
+    rowsPerStrip = (rowsPerStrip + 15) / 16 * 16;
+  }
+  return std::max(1, std::min(rowsPerStrip, height));
+}
 
-  // TIFFWriteScanline() can actually modify the data you pass it,
-  // so we have to use a temporary buffer even when no coversion
-  // is required.
-  std::vector<uint8_t> tmpLine(width, 0);
+QByteArray TiffWriter::encodeStrip(const StripFormat& format, const int numRows, std::vector<uint8_t>& data) {
+  if (format.compression == COMPRESSION_NONE) {
+    return QByteArray(reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size()));
+  }
 
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* srcLine = image.scanLine(y);
-    memcpy(&tmpLine[0], srcLine, tmpLine.size());
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
+  // Compress the strip as a single strip image and extract it from the result.
+  QBuffer buffer;
+  buffer.open(QIODevice::ReadWrite);
+  const TiffHandle tif(TIFFClientOpen("strip", "wBm", &buffer, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
+                                      &deviceSize, &deviceMap, &deviceUnmap));
+  if (!tif.handle()) {
+    return QByteArray();
   }
-  return true;
-}
 
-bool TiffWriter::writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image) {
+  TIFFSetField(tif.handle(), TIFFTAG_IMAGEWIDTH, format.width);
+  TIFFSetField(tif.handle(), TIFFTAG_IMAGELENGTH, uint32(numRows));
+  TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(numRows));
+  TIFFSetField(tif.handle(), TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+  TIFFSetField(tif.handle(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, format.bitsPerSample);
+  TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, format.samplesPerPixel);
+  TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, format.photometric);
+  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, format.compression);
+  if (format.predictor != PREDICTOR_NONE) {
+    TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, format.predictor);
+  }
+  if (format.compression == COMPRESSION_JPEG) {
+    TIFFSetField(tif.handle(), TIFFTAG_JPEGTABLESMODE, 0);
+  }
+
+  if (TIFFWriteEncodedStrip(tif.handle(), 0, data.data(), static_cast<tmsize_t>(data.size())) == -1) {
+    return QByteArray();
+  }
+
+  uint64* offsets = nullptr;
+  uint64* byteCounts = nullptr;
+  if (!TIFFGetField(tif.handle(), TIFFTAG_STRIPOFFSETS, &offsets)
+      || !TIFFGetField(tif.handle(), TIFFTAG_STRIPBYTECOUNTS, &byteCounts)) {
+    return QByteArray();
+  }
+  return buffer.data().mid(static_cast<int>(offsets[0]), static_cast<int>(byteCounts[0]));
+}  // TiffWriter::encodeStrip
+
+void TiffWriter::packRGB32Line(const QImage& image, const int y, uint8_t* dst) {
+  // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
+  const auto* src = reinterpret_cast<const uint32_t*>(image.scanLine(y));
   const int width = image.width();
-  const int height = image.height();
-  // TIFFWriteScanline() can actually modify the data you pass it,
-  // so we have to use a temporary buffer even when no coversion
-  // is required.
-  const int bpl = (width + 7) / 8;
-  std::vector<uint8_t> tmpLine(bpl, 0);
-
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* srcLine = image.scanLine(y);
-    memcpy(&tmpLine[0], srcLine, bpl);
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
+  for (int x = 0; x < width; ++x) {
+    const uint32_t ARGB = src[x];
+    dst[0] = static_cast<uint8_t>(ARGB >> 16);
+    dst[1] = static_cast<uint8_t>(ARGB >> 8);
+    dst[2] = static_cast<uint8_t>(ARGB);
+    dst += 3;
   }
-  return true;
 }
 
-bool TiffWriter::writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image) {
+void TiffWriter::packARGB32Line(const QImage& image, const int y, uint8_t* dst) {
+  // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
+  const auto* src = reinterpret_cast<const uint32_t*>(image.scanLine(y));
   const int width = image.width();
-  const int height = image.height();
+  for (int x = 0; x < width; ++x) {
+    const uint32_t ARGB = src[x];
+    dst[0] = static_cast<uint8_t>(ARGB >> 16);
+    dst[1] = static_cast<uint8_t>(ARGB >> 8);
+    dst[2] = static_cast<uint8_t>(ARGB);
+    dst[3] = static_cast<uint8_t>(ARGB >> 24);
+    dst += 4;
+  }
+}
 
-  const int bpl = (width + 7) / 8;
-  std::vector<uint8_t> tmpLine(bpl, 0);
+void TiffWriter::copyLine(const QImage& image, const int y, uint8_t* dst) {
+  const int bpl = (image.format() == QImage::Format_Indexed8) ? image.width() : (image.width() + 7) / 8;
+  memcpy(dst, image.scanLine(y), static_cast<size_t>(bpl));
+}
 
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* srcLine = image.scanLine(y);
-    for (int i = 0; i < bpl; ++i) {
-      tmpLine[i] = m_reverseBitsLUT[srcLine[i]];
-    }
-    if (TIFFWriteScanline(tif.handle(), &tmpLine[0], y) == -1) {
-      return false;
-    }
+void TiffWriter::copyBinaryLineReversed(const QImage& image, const int y, uint8_t* dst) {
+  const uint8_t* src = image.scanLine(y);
+  const int bpl = (image.width() + 7) / 8;
+  for (int i = 0; i < bpl; ++i) {
+    dst[i] = m_reverseBitsLUT[src[i]];
   }
-  return true;
 }
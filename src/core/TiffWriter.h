@@ -8,7 +8,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
+class QByteArray;
 class QIODevice;
 class QString;
 class QImage;
@@ -38,19 +40,46 @@ class TiffWriter {
  private:
   class TiffHandle;
 
+  struct StripFormat;
+
+  /**
+   * Converts line \p y of an image to the layout libtiff expects and stores it at \p dst.
+   */
+  using PackLineFunc = void (*)(const QImage& image, int y, uint8_t* dst);
+
   static void setDpm(const TiffHandle& tif, const Dpm& dpm);
 
+  static void setPredictor(const TiffHandle& tif, uint16 compression);
+
   static bool writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage& image);
 
   static bool writeRGB32Image(const TiffHandle& tif, const QImage& image);
 
   static bool writeARGB32Image(const TiffHandle& tif, const QImage& image);
 
-  static bool write8bitLines(const TiffHandle& tif, const QImage& image);
+  /**
+   * \brief Writes the pixel data of an image strip by strip.
+   *
+   * All the fields describing the pixel data have to be set beforehand.
+   * Strips are packed and compressed in parallel, each by its own libtiff
+   * instance, and then written to \p tif sequentially as raw strips.
+   */
+  static bool writeStrips(const TiffHandle& tif, const QImage& image, int bytesPerLine, PackLineFunc packLine);
+
+  static int chooseRowsPerStrip(const StripFormat& format, int bytesPerLine, int height);
+
+  /**
+   * \return The compressed strip or a null array on failure.
+   */
+  static QByteArray encodeStrip(const StripFormat& format, int numRows, std::vector<uint8_t>& data);
+
+  static void packRGB32Line(const QImage& image, int y, uint8_t* dst);
+
+  static void packARGB32Line(const QImage& image, int y, uint8_t* dst);
 
-  static bool writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image);
+  static void copyLine(const QImage& image, int y, uint8_t* dst);
 
-  static bool writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image);
+  static void copyBinaryLineReversed(const QImage& image, int y, uint8_t* dst);
 
   static const uint8_t m_reverseBitsLUT[256];
 };
@@ -4,9 +4,13 @@
 #include "WorkerThreadPool.h"
 
 #include <QCoreApplication>
-#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include <limits>
 #include <utility>
 
+#include "MemoryCostEstimator.h"
 #include "OutOfMemoryHandler.h"
 
 class WorkerThreadPool::TaskResultEvent : public QEvent {
@@ -24,51 +28,84 @@ class WorkerThreadPool::TaskResultEvent : public QEvent {
 };
 
 
-WorkerThreadPool::WorkerThreadPool(QObject* parent) : QObject(parent), m_pool(new QThreadPool(this)) {
+class WorkerThreadPool::Worker : public QThread {
+ public:
+  explicit Worker(WorkerThreadPool& owner) : m_owner(owner) {}
+
+ protected:
+  void run() override { m_owner.workerLoop(); }
+
+ private:
+  WorkerThreadPool& m_owner;
+};
+
+
+WorkerThreadPool::WorkerThreadPool(QObject* parent)
+    : QObject(parent),
+      m_numThreads(1),
+      m_numLiveWorkers(0),
+      m_numIdleWorkers(0),
+      m_numRunningTasks(0),
+      m_memoryInUse(0),
+      m_memoryBudget(std::numeric_limits<size_t>::max()),
+      m_shuttingDown(false) {
   updateNumberOfThreads();
 }
 
-WorkerThreadPool::~WorkerThreadPool() = default;
+WorkerThreadPool::~WorkerThreadPool() {
+  shutdown();
+}
 
 void WorkerThreadPool::shutdown() {
-  m_pool->waitForDone();
+  // Running tasks will recruit their helpers elsewhere from now on.
+  setParallelForExecutor(nullptr);
+
+  {
+    const QMutexLocker locker(&m_mutex);
+    m_shuttingDown = true;
+    m_workAvailable.wakeAll();
+  }
+
+  for (const std::unique_ptr<QThread>& worker : m_workers) {
+    worker->wait();
+  }
+  m_workers.clear();
 }
 
 bool WorkerThreadPool::hasSpareCapacity() const {
-  return m_pool->activeThreadCount() < m_pool->maxThreadCount();
+  const QMutexLocker locker(&m_mutex);
+  const size_t numPending = m_numRunningTasks + m_interactiveLane.size() + m_batchLane.size();
+  return numPending < static_cast<size_t>(m_numThreads);
 }
 
 void WorkerThreadPool::submitTask(const BackgroundTaskPtr& task) {
-  class Runnable : public QRunnable {
-   public:
-    Runnable(WorkerThreadPool& owner, BackgroundTaskPtr task) : m_owner(owner), m_task(std::move(task)) {
-      setAutoDelete(true);
-    }
-
-    void run() override {
-      if (m_task->isCancelled()) {
-        return;
-      }
-
-      try {
-        const FilterResultPtr result((*m_task)());
-        if (result) {
-          QCoreApplication::postEvent(&m_owner, new TaskResultEvent(m_task, result));
-        }
-      } catch (const std::bad_alloc&) {
-        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
-      }
-    }
+  updateNumberOfThreads();
+  startWorkers();
 
-   private:
-    WorkerThreadPool& m_owner;
-    BackgroundTaskPtr m_task;
-  };
+  const QMutexLocker locker(&m_mutex);
+  if (task->type() == BackgroundTask::INTERACTIVE) {
+    m_interactiveLane.push_back(task);
+  } else {
+    m_batchLane.push_back(task);
+  }
+  m_workAvailable.wakeOne();
+}
 
+bool WorkerThreadPool::tryStart(QRunnable* runnable) {
+  const QMutexLocker locker(&m_mutex);
+  // Only hand it to a worker that is going to pick it up right away.
+  if (m_shuttingDown || (static_cast<size_t>(m_numIdleWorkers) <= m_helpers.size())) {
+    return false;
+  }
+  m_helpers.push_back(runnable);
+  m_workAvailable.wakeOne();
+  return true;
+}
 
-  updateNumberOfThreads();
-  m_pool->start(new Runnable(*this, task));
-}  // WorkerThreadPool::submitTask
+int WorkerThreadPool::maxThreadCount() const {
+  const QMutexLocker locker(&m_mutex);
+  return m_numThreads;
+}
 
 void WorkerThreadPool::customEvent(QEvent* event) {
   if (auto* evt = dynamic_cast<TaskResultEvent*>(event)) {
@@ -77,7 +114,7 @@ void WorkerThreadPool::customEvent(QEvent* event) {
 }
 
 void WorkerThreadPool::updateNumberOfThreads() {
-  int maxThreads = QThread::idealThreadCount();
+  int maxThreads = std::max(1, QThread::idealThreadCount());
   // Restricting num of processors for 32-bit due to
   // address space constraints.
   if (sizeof(void*) <= 4) {
@@ -85,6 +122,133 @@ void WorkerThreadPool::updateNumberOfThreads() {
   }
 
   int numThreads = m_settings.value("settings/batch_processing_threads", maxThreads).toInt();
-  numThreads = std::min(numThreads, maxThreads);
-  m_pool->setMaxThreadCount(numThreads);
+  numThreads = std::max(1, std::min(numThreads, maxThreads));
+
+  const size_t memoryBudget = MemoryCostEstimator::memoryBudget();
+
+  const QMutexLocker locker(&m_mutex);
+  if (numThreads < m_numThreads) {
+    // Let the surplus workers quit.
+    m_workAvailable.wakeAll();
+  }
+  m_numThreads = numThreads;
+  m_memoryBudget = memoryBudget;
+}
+
+void WorkerThreadPool::startWorkers() {
+  // Reap the workers that quit after the number of threads was reduced.
+  m_workers.erase(std::remove_if(m_workers.begin(), m_workers.end(),
+                                 [](const std::unique_ptr<QThread>& worker) { return worker->isFinished(); }),
+                  m_workers.end());
+
+  int numNewWorkers = 0;
+  {
+    const QMutexLocker locker(&m_mutex);
+    m_shuttingDown = false;
+    numNewWorkers = m_numThreads - m_numLiveWorkers;
+    m_numLiveWorkers += std::max(0, numNewWorkers);
+  }
+
+  for (int i = 0; i < numNewWorkers; ++i) {
+    m_workers.push_back(std::make_unique<Worker>(*this));
+    m_workers.back()->start();
+  }
+  setParallelForExecutor(this);
+}
+
+void WorkerThreadPool::workerLoop() {
+  QMutexLocker locker(&m_mutex);
+  while (true) {
+    // Helpers come first, as running tasks are waiting for them.
+    if (!m_helpers.empty()) {
+      QRunnable* const helper = m_helpers.front();
+      m_helpers.pop_front();
+      locker.unlock();
+      helper->run();
+      if (helper->autoDelete()) {
+        delete helper;
+      }
+      locker.relock();
+      continue;
+    }
+
+    const BackgroundTaskPtr task(takeAdmissibleTaskLocked());
+    if (task) {
+      const size_t cost = MemoryCostEstimator::instance().calibrated(task->memoryCost());
+      ++m_numRunningTasks;
+      m_memoryInUse += cost;
+      locker.unlock();
+      runTask(task);
+      locker.relock();
+      --m_numRunningTasks;
+      m_memoryInUse -= cost;
+      // Tasks that didn't fit may fit now.
+      m_workAvailable.wakeAll();
+      continue;
+    }
+
+    if ((m_shuttingDown && m_interactiveLane.empty() && m_batchLane.empty()) || (m_numLiveWorkers > m_numThreads)) {
+      --m_numLiveWorkers;
+      break;
+    }
+
+    ++m_numIdleWorkers;
+    m_workAvailable.wait(&m_mutex);
+    --m_numIdleWorkers;
+  }
+}  // WorkerThreadPool::workerLoop
+
+BackgroundTaskPtr WorkerThreadPool::takeAdmissibleTaskLocked() {
+  const auto isCancelled = [](const BackgroundTaskPtr& task) { return task->isCancelled(); };
+  const auto dropCancelled = [&isCancelled](std::deque<BackgroundTaskPtr>& lane) {
+    lane.erase(std::remove_if(lane.begin(), lane.end(), isCancelled), lane.end());
+  };
+  dropCancelled(m_interactiveLane);
+  dropCancelled(m_batchLane);
+
+  // The user is waiting for interactive tasks, and there is only one
+  // of them that isn't cancelled at any time, so they bypass the limits.
+  if (!m_interactiveLane.empty()) {
+    BackgroundTaskPtr task(std::move(m_interactiveLane.front()));
+    m_interactiveLane.pop_front();
+    return task;
+  }
+
+  if (m_numRunningTasks >= m_numThreads) {
+    return nullptr;
+  }
+  // The first task that fits.  Should none of them fit while nothing is running,
+  // the first one is started anyway, as waiting won't free any memory.
+  const MemoryCostEstimator& estimator = MemoryCostEstimator::instance();
+  for (auto it = m_batchLane.begin(); it != m_batchLane.end(); ++it) {
+    if ((m_numRunningTasks == 0) || (m_memoryInUse + estimator.calibrated((*it)->memoryCost()) <= m_memoryBudget)) {
+      BackgroundTaskPtr task(std::move(*it));
+      m_batchLane.erase(it);
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void WorkerThreadPool::runTask(const BackgroundTaskPtr& task) {
+  if (task->isCancelled()) {
+    return;
+  }
+
+  // Reports the usage even if the task throws.
+  struct MonitorGuard {
+    MemoryUsageMonitor& monitor;
+    const int taskId;
+
+    ~MonitorGuard() { monitor.taskFinished(taskId); }
+  } monitorGuard{m_memoryUsageMonitor, m_memoryUsageMonitor.taskStarted(task->memoryCost())};
+
+  try {
+    const FilterResultPtr result((*task)());
+    if (result) {
+      QCoreApplication::postEvent(this, new TaskResultEvent(task, result));
+    }
+  } catch (const std::bad_alloc&) {
+    OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+  }
 }
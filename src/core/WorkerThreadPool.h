@@ -4,16 +4,37 @@
 #ifndef SCANTAILOR_CORE_WORKERTHREADPOOL_H_
 #define SCANTAILOR_CORE_WORKERTHREADPOOL_H_
 
+#include <QMutex>
 #include <QObject>
 #include <QSettings>
+#include <QWaitCondition>
+#include <cstddef>
+#include <deque>
 #include <memory>
+#include <vector>
 
 #include "BackgroundTask.h"
 #include "FilterResult.h"
-
-class QThreadPool;
-
-class WorkerThreadPool : public QObject {
+#include "MemoryUsageMonitor.h"
+#include "ParallelFor.h"
+
+class QThread;
+
+/**
+ * \brief Runs background tasks on a set of worker threads.
+ *
+ * Tasks go into one of two lanes, interactive tasks always being started
+ * before batch ones.  A batch task is only started if the number of running tasks
+ * is below the configured number of threads and its BackgroundTask::memoryCost(),
+ * as calibrated by MemoryCostEstimator, fits into the memory budget together
+ * with the tasks already running.  The actual memory usage of the tasks
+ * is measured to keep the calibration up to date.
+ *
+ * There is one worker per configured thread.  Workers not busy with a task serve
+ * as parallelFor() helpers, picking up loop iterations of the tasks that are running,
+ * so that the tasks together never use more threads than configured.
+ */
+class WorkerThreadPool : public QObject, public ParallelForExecutor {
   Q_OBJECT
  public:
   explicit WorkerThreadPool(QObject* parent = nullptr);
@@ -32,18 +53,57 @@ class WorkerThreadPool : public QObject {
 
   void submitTask(const BackgroundTaskPtr& task);
 
+  bool tryStart(QRunnable* runnable) override;
+
+  int maxThreadCount() const override;
+
  signals:
 
   void taskResult(const BackgroundTaskPtr& task, const FilterResultPtr& result);
 
  private:
   class TaskResultEvent;
+  class Worker;
 
   void customEvent(QEvent* event) override;
 
+  /**
+   * \brief Re-reads the number of threads and the memory budget from the settings.
+   */
   void updateNumberOfThreads();
 
-  QThreadPool* m_pool;
+  /**
+   * \brief Starts as many workers as there are threads configured.
+   *
+   * Surplus workers left by reducing the number of threads quit once idle.
+   */
+  void startWorkers();
+
+  void workerLoop();
+
+  /**
+   * \brief Takes the next task that may be started from one of the lanes.
+   *
+   * Must be called with m_mutex locked.  Cancelled tasks are dropped along the way.
+   */
+  BackgroundTaskPtr takeAdmissibleTaskLocked();
+
+  void runTask(const BackgroundTaskPtr& task);
+
+  mutable QMutex m_mutex;
+  QWaitCondition m_workAvailable;
+  std::deque<BackgroundTaskPtr> m_interactiveLane;
+  std::deque<BackgroundTaskPtr> m_batchLane;
+  std::deque<QRunnable*> m_helpers;
+  std::vector<std::unique_ptr<QThread>> m_workers;
+  int m_numThreads;
+  int m_numLiveWorkers;
+  int m_numIdleWorkers;
+  int m_numRunningTasks;
+  size_t m_memoryInUse;
+  size_t m_memoryBudget;
+  bool m_shuttingDown;
+  MemoryUsageMonitor m_memoryUsageMonitor;
   QSettings m_settings;
 };
 
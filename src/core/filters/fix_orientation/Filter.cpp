@@ -58,6 +58,16 @@ QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc)
   return filterEl;
 }
 
+QDomElement Filter::savePageSettings(const PageId& pageId, QDomDocument& doc) const {
+  QDomElement filterEl(doc.createElement("fix-orientation"));
+  writeParams(doc, filterEl, pageId.imageId(), 0);
+
+  QDomElement imageSettingsEl(doc.createElement("image-settings"));
+  writeImageParams(doc, imageSettingsEl, pageId, 0);
+  filterEl.appendChild(imageSettingsEl);
+  return filterEl;
+}
+
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
@@ -13,6 +13,12 @@
 using namespace imageproc;
 
 namespace output {
+namespace {
+// The range of levels of the despeckling slider in OptionsWidget.
+const double MIN_SLIDER_LEVEL = 1.0;
+const double MAX_SLIDER_LEVEL = 3.0;
+}  // namespace
+
 DespeckleState::DespeckleState(const QImage& output,
                                const imageproc::BinaryImage& speckles,
                                const double level,
@@ -41,6 +47,16 @@ DespeckleState DespeckleState::redespeckle(const double level, const TaskStatus&
     return newState;
   }
 
+  if ((!m_componentGraph || !m_componentGraph->covers(level)) && (level >= MIN_SLIDER_LEVEL)
+      && (level <= MAX_SLIDER_LEVEL)) {
+    newState.m_componentGraph = std::make_shared<const Despeckle::ComponentGraph>(
+        Despeckle::buildGraph(m_everythingBW, m_dpi, MIN_SLIDER_LEVEL, MAX_SLIDER_LEVEL, status));
+  }
+  if (newState.m_componentGraph && newState.m_componentGraph->covers(level)) {
+    newState.m_speckles = Despeckle::speckles(*newState.m_componentGraph, level, status, dbg);
+    return newState;
+  }
+
   newState.m_speckles = Despeckle::despeckle(m_everythingBW, m_dpi, level, status, dbg);
 
   status.throwIfCancelled();
@@ -8,7 +8,9 @@
 #include <BinaryImage.h>
 
 #include <QImage>
+#include <memory>
 
+#include "Despeckle.h"
 #include "DespeckleLevel.h"
 #include "Dpi.h"
 
@@ -67,6 +69,13 @@ class DespeckleState {
    * m_everythingBW.
    */
   double m_despeckleLevel;
+
+  /**
+   * The components of m_everythingBW with the distances between them,
+   * built by the first redespeckle() call and shared by the states derived
+   * from that one.  Makes subsequent level changes cheap.
+   */
+  std::shared_ptr<const Despeckle::ComponentGraph> m_componentGraph;
 };
 
 
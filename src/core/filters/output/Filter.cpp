@@ -55,6 +55,16 @@ QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc)
   return filterEl;
 }
 
+QDomElement Filter::savePageSettings(const PageId& pageId, QDomDocument& doc) const {
+  QDomElement filterEl(doc.createElement("output"));
+  writePageSettings(doc, filterEl, pageId, 0);
+  return filterEl;
+}
+
+Params Filter::pageParams(const PageId& pageId) const {
+  return m_settings->getParams(pageId);
+}
+
 void Filter::writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
   const Params params(m_settings->getParams(pageId));
 
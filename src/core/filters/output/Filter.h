@@ -26,6 +26,7 @@ class OptionsWidget;
 class Task;
 class CacheDrivenTask;
 class Settings;
+class Params;
 
 class Filter : public AbstractFilter {
   DECLARE_NON_COPYABLE(Filter)
@@ -50,6 +51,10 @@ class Filter : public AbstractFilter {
 
   void loadDefaultSettings(const PageInfo& pageInfo) override;
 
+  QDomElement savePageSettings(const PageId& pageId, QDomDocument& doc) const override;
+
+  Params pageParams(const PageId& pageId) const;
+
   std::shared_ptr<Task> createTask(const PageId& pageId,
                                    std::shared_ptr<ThumbnailPixmapCache> thumbnailCache,
                                    const OutputFileNameGenerator& outFileNameGen,
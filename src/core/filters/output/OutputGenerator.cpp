@@ -19,6 +19,7 @@
 #include <InfluenceMap.h>
 #include <Morphology.h>
 #include <OrthogonalRotation.h>
+#include <ParallelBands.h>
 #include <PolygonRasterizer.h>
 #include <PolynomialSurface.h>
 #include <RasterDewarper.h>
@@ -177,6 +178,8 @@ class OutputGenerator::Processor {
 
   void morphologicalSmoothInPlace(BinaryImage& binImg) const;
 
+  void morphologicalSmoothBandInPlace(BinaryImage& binImg) const;
+
   BinaryImage binarize(const QImage& image) const;
 
   BinaryImage binarize(const QImage& image, const BinaryImage& mask) const;
@@ -1130,7 +1133,11 @@ QImage smoothToGrayscale(const QImage& src, const Dpi& dpi) {
     window = 11;
     degree = 2;
   }
-  return savGolFilter(src, QSize(window, window), degree, degree);
+  // The filter only looks at the rows within window / 2 of the output one,
+  // and the border rows are treated based on the distance to the border.
+  return processGrayInBands(src, window, [window, degree](const QImage& band) {
+    return savGolFilter(band, QSize(window, window), degree, degree);
+  });
 }
 
 QSize from300dpi(const QSize& size, const Dpi& targetDpi) {
@@ -2104,6 +2111,19 @@ BinaryThreshold OutputGenerator::Processor::calcBinarizationThreshold(const QIma
 }
 
 void OutputGenerator::Processor::morphologicalSmoothInPlace(BinaryImage& binImg) const {
+  // A hit-miss replacement only looks at the pixels covered by its pattern,
+  // so a W x H pattern applied in all the 4 directions can't propagate
+  // changes further than 2 * (W - 1) + 2 * (H - 1) rows.
+  // Summed over the patterns applied by morphologicalSmoothBandInPlace().
+  const int halo = 8 + 14 + 20 + 20 + 14 + 8;
+  processBinaryInBands(binImg, halo, [this](BinaryImage& band) { morphologicalSmoothBandInPlace(band); });
+
+  if (m_dbg) {
+    m_dbg->add(binImg, "edges_smoothed");
+  }
+}
+
+void OutputGenerator::Processor::morphologicalSmoothBandInPlace(BinaryImage& binImg) const {
   // When removing black noise, remove small ones first.
 
   {
@@ -2181,11 +2201,7 @@ void OutputGenerator::Processor::morphologicalSmoothInPlace(BinaryImage& binImg)
           "XXX";
     hitMissReplaceAllDirections(binImg, pattern, 3, 3);
   }
-
-  if (m_dbg) {
-    m_dbg->add(binImg, "edges_smoothed");
-  }
-}
+}  // OutputGenerator::Processor::morphologicalSmoothBandInPlace
 
 BinaryImage OutputGenerator::Processor::binarize(const QImage& image) const {
   if ((image.format() == QImage::Format_Mono) || (image.format() == QImage::Format_MonoLSB)) {
@@ -2199,16 +2215,19 @@ BinaryImage OutputGenerator::Processor::binarize(const QImage& image) const {
   switch (binarizationMethod) {
     case OTSU: {
       GrayscaleHistogram hist(image);
-      const BinaryThreshold bwThresh(BinaryThreshold::otsuThreshold(hist));
+      const BinaryThreshold bwThresh(adjustThreshold(BinaryThreshold::otsuThreshold(hist)));
 
-      binarized = BinaryImage(image, adjustThreshold(bwThresh));
+      binarized = binarizeInBands(image, 0, [bwThresh](const QImage& band) { return BinaryImage(band, bwThresh); });
       break;
     }
     case SAUVOLA: {
       QSize windowsSize = QSize(blackWhiteOptions.getWindowSize(), blackWhiteOptions.getWindowSize());
       double sauvolaCoef = blackWhiteOptions.getSauvolaCoef();
 
-      binarized = binarizeSauvola(image, windowsSize, sauvolaCoef);
+      // Unlike Wolf's method, Sauvola's one doesn't depend on any global statistics.
+      binarized = binarizeInBands(image, windowsSize.height(), [windowsSize, sauvolaCoef](const QImage& band) {
+        return binarizeSauvola(band, windowsSize, sauvolaCoef);
+      });
       break;
     }
     case WOLF: {
@@ -4,6 +4,7 @@
 #include "Filter.h"
 
 #include <OrderByDeviationProvider.h>
+#include <XmlMarshaller.h>
 #include <filters/output/CacheDrivenTask.h>
 #include <filters/output/Task.h>
 
@@ -94,6 +95,16 @@ QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc)
   return filterEl;
 }
 
+QDomElement Filter::savePageSettings(const PageId& pageId, QDomDocument& doc) const {
+  QDomElement filterEl(doc.createElement("page-layout"));
+
+  // The margins of every page depend on the size of the largest one.
+  filterEl.appendChild(XmlMarshaller(doc).sizeF(m_settings->getAggregateHardSizeMM(), "aggregate-hard-size"));
+
+  writePageSettings(doc, filterEl, pageId, 0);
+  return filterEl;
+}
+
 void Filter::writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
   const std::unique_ptr<Params> params(m_settings->getPageParams(pageId));
   if (!params) {
@@ -63,6 +63,8 @@ class Filter : public AbstractFilter {
 
   void loadDefaultSettings(const PageInfo& pageInfo) override;
 
+  QDomElement savePageSettings(const PageId& pageId, QDomDocument& doc) const override;
+
   void setContentBox(const PageId& pageId, const ImageTransformation& xform, const QRectF& contentRect);
 
   void invalidateContentBox(const PageId& pageId);
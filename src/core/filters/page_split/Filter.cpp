@@ -59,6 +59,14 @@ QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc)
   return filterEl;
 }
 
+QDomElement Filter::savePageSettings(const PageId& pageId, QDomDocument& doc) const {
+  QDomElement filterEl(doc.createElement("page-split"));
+  filterEl.setAttribute("defaultLayoutType", layoutTypeToString(m_settings->defaultLayoutType()));
+
+  writeImageSettings(doc, filterEl, pageId.imageId(), 0);
+  return filterEl;
+}
+
 void Filter::loadSettings(const ProjectReader& reader, const QDomElement& filtersEl) {
   m_settings->clear();
 
@@ -57,6 +57,8 @@ class Filter : public AbstractFilter {
 
   void loadDefaultSettings(const PageInfo& pageInfo) override;
 
+  QDomElement savePageSettings(const PageId& pageId, QDomDocument& doc) const override;
+
   std::shared_ptr<Task> createTask(const PageInfo& pageInfo,
                                    std::shared_ptr<deskew::Task> nextTask,
                                    bool batchProcessing,
@@ -83,6 +83,17 @@ QDomElement Filter::saveSettings(const ProjectWriter& writer, QDomDocument& doc)
   return filterEl;
 }
 
+QDomElement Filter::savePageSettings(const PageId& pageId, QDomDocument& doc) const {
+  QDomElement filterEl(doc.createElement("select-content"));
+
+  filterEl.appendChild(XmlMarshaller(doc).sizeF(m_settings->pageDetectionBox(), "page-detection-box"));
+  filterEl.setAttribute("pageDetectionTolerance",
+                        foundation::Utils::doubleToString(m_settings->pageDetectionTolerance()));
+
+  writePageSettings(doc, filterEl, pageId, 0);
+  return filterEl;
+}
+
 void Filter::writePageSettings(QDomDocument& doc, QDomElement& filterEl, const PageId& pageId, int numericId) const {
   const std::unique_ptr<Params> params(m_settings->getPageParams(pageId));
   if (!params) {
@@ -59,6 +59,8 @@ class Filter : public AbstractFilter {
 
   void loadDefaultSettings(const PageInfo& pageInfo) override;
 
+  QDomElement savePageSettings(const PageId& pageId, QDomDocument& doc) const override;
+
   std::shared_ptr<Task> createTask(const PageId& pageId,
                                    std::shared_ptr<page_layout::Task> nextTask,
                                    bool batch,
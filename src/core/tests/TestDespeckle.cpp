@@ -0,0 +1,444 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <BinaryImage.h>
+#include <ConnectivityMap.h>
+#include <Despeckle.h>
+#include <Dpi.h>
+#include <FastQueue.h>
+#include <NullTaskStatus.h>
+#include <RasterOp.h>
+
+#include <QRect>
+#include <QtGlobal>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace Tests {
+using namespace imageproc;
+
+namespace {
+/**
+ * \brief The despeckling algorithm as it was before components were kept as runs.
+ *
+ * The tags of a component don't count as its pixels when tagging, or the result
+ * would depend on the order of a hash map.  The second pass only adds the connections
+ * of the components it's done for.  The pixels none of their Voronoi regions reach
+ * keep the distances reset() gives them, which would make up connections 0 or 1 long
+ * between the other components in areas closed off by their pixels.
+ */
+namespace reference {
+const int VERTICAL_SCALE_SQ = 4;
+
+struct Settings {
+  double minRelativeParentWeight;
+  uint32_t pixelsToSqDist;
+  int bigObjectThreshold;
+};
+
+Settings settingsFor(const double level, const Dpi& dpi) {
+  const double dpiFactor = std::min(dpi.horizontal(), dpi.vertical()) / 300.0;
+  Settings settings{};
+  settings.minRelativeParentWeight = (0.05 * level + 0.075) * dpiFactor;
+  settings.pixelsToSqDist = static_cast<uint32_t>(std::pow(0.25 * std::pow(level, 2) - 4.25 * level + 14, 2));
+  settings.bigObjectThreshold = qRound((5 * level + 2) * dpiFactor);
+  return settings;
+}
+
+const uint32_t ANCHORED_TO_BIG = uint32_t(1) << 31;
+const uint32_t ANCHORED_TO_SMALL = uint32_t(1) << 30;
+const uint32_t TAG_MASK = ANCHORED_TO_BIG | ANCHORED_TO_SMALL;
+
+union Distance {
+  struct {
+    int16_t x;
+    int16_t y;
+  } vec;
+  uint32_t raw;
+
+  static Distance zero() {
+    Distance dist{};
+    dist.raw = 0;
+    return dist;
+  }
+
+  static Distance special() {
+    Distance dist{};
+    dist.vec.x = dist.vec.y = std::numeric_limits<int16_t>::max();
+    return dist;
+  }
+
+  bool operator==(const Distance& other) const { return raw == other.raw; }
+
+  bool operator!=(const Distance& other) const { return raw != other.raw; }
+
+  void reset(int x) {
+    vec.x = static_cast<int16_t>(std::numeric_limits<int16_t>::max() - x);
+    vec.y = 0;
+  }
+
+  uint32_t sqdist() const { return static_cast<uint32_t>(vec.x * vec.x + VERTICAL_SCALE_SQ * vec.y * vec.y); }
+};
+
+using Connections = std::map<std::pair<uint32_t, uint32_t>, uint32_t>;
+
+/**
+ * \brief Propagates the distances through the map in four directions.
+ *
+ * \param special If not null, pixels at this distance neither spread nor get overwritten,
+ *        and the first pass doesn't start from scratch.
+ */
+void voronoi(ConnectivityMap& cmap, std::vector<Distance>& dist, const Distance* special) {
+  const int width = cmap.size().width() + 2;
+  const int height = cmap.size().height() + 2;
+  if (!special) {
+    dist.assign(width * height, Distance::zero());
+  }
+
+  std::vector<uint32_t> sqdists(width * 2, 0);
+  uint32_t* prevSqdistLine = &sqdists[0];
+  uint32_t* thisSqdistLine = &sqdists[width];
+  Distance* distLine = &dist[0];
+  uint32_t* cmapLine = cmap.paddedData();
+
+  const auto fixed = [special](const Distance& d) { return special && (d == *special); };
+  const auto relax = [&](const int x, const int from, const uint32_t sqdist, const int dx, const int dy) {
+    if (!fixed(distLine[from]) && (sqdist < thisSqdistLine[x])) {
+      thisSqdistLine[x] = sqdist;
+      distLine[x] = distLine[from];
+      distLine[x].vec.x = static_cast<int16_t>(distLine[x].vec.x + dx);
+      distLine[x].vec.y = static_cast<int16_t>(distLine[x].vec.y + dy);
+      cmapLine[x] = cmapLine[from];
+    }
+  };
+  const auto fromLeft = [&](const int x) { return thisSqdistLine[x - 1] + 1 - 2 * distLine[x - 1].vec.x; };
+  const auto fromRight = [&](const int x) { return thisSqdistLine[x + 1] + 1 + 2 * distLine[x + 1].vec.x; };
+
+  distLine[0].reset(0);
+  prevSqdistLine[0] = distLine[0].sqdist();
+  for (int x = 1; x < width; ++x) {
+    distLine[x].vec.x = static_cast<int16_t>(distLine[x - 1].vec.x - 1);
+    prevSqdistLine[x] = prevSqdistLine[x - 1] - (int(distLine[x - 1].vec.x) << 1) + 1;
+  }
+
+  // Top to bottom.
+  for (int y = 1; y < (special ? height - 1 : height); ++y) {
+    distLine += width;
+    cmapLine += width;
+    distLine[0].reset(0);
+    distLine[width - 1].reset(width - 1);
+    thisSqdistLine[0] = distLine[0].sqdist();
+    thisSqdistLine[width - 1] = distLine[width - 1].sqdist();
+    for (int x = 1; x < width - 1; ++x) {
+      if (special) {
+        if (fixed(distLine[x])) {
+          continue;
+        }
+        thisSqdistLine[x] = distLine[x].sqdist();
+        relax(x, x - 1, fromLeft(x), -1, 0);
+        relax(x, x - width, prevSqdistLine[x] + VERTICAL_SCALE_SQ - 2 * VERTICAL_SCALE_SQ * distLine[x - width].vec.y,
+              0, -1);
+      } else if (cmapLine[x]) {
+        thisSqdistLine[x] = 0;
+      } else {
+        const uint32_t sqdistLeft = fromLeft(x);
+        const uint32_t sqdistTop
+            = prevSqdistLine[x] + VERTICAL_SCALE_SQ - 2 * VERTICAL_SCALE_SQ * distLine[x - width].vec.y;
+        thisSqdistLine[x] = ~uint32_t(0);
+        if (sqdistLeft < sqdistTop) {
+          relax(x, x - 1, sqdistLeft, -1, 0);
+        } else {
+          relax(x, x - width, sqdistTop, 0, -1);
+        }
+      }
+    }
+    for (int x = width - 2; x >= 1; --x) {
+      if (!fixed(distLine[x])) {
+        relax(x, x + 1, fromRight(x), 1, 0);
+      }
+    }
+    std::swap(thisSqdistLine, prevSqdistLine);
+  }
+
+  // Bottom to top.
+  for (int y = height - 2; y >= 1; --y) {
+    distLine -= width;
+    cmapLine -= width;
+    distLine[0].reset(0);
+    distLine[width - 1].reset(width - 1);
+    thisSqdistLine[0] = distLine[0].sqdist();
+    thisSqdistLine[width - 1] = distLine[width - 1].sqdist();
+    for (int x = width - 2; x >= 1; --x) {
+      if (fixed(distLine[x])) {
+        continue;
+      }
+      thisSqdistLine[x] = distLine[x].sqdist();
+      relax(x, x + 1, fromRight(x), 1, 0);
+      relax(x, x + width, prevSqdistLine[x] + VERTICAL_SCALE_SQ + 2 * VERTICAL_SCALE_SQ * distLine[x + width].vec.y, 0,
+            1);
+    }
+    for (int x = 1; x < width - 1; ++x) {
+      if (!fixed(distLine[x])) {
+        relax(x, x - 1, fromLeft(x), -1, 0);
+      }
+    }
+    std::swap(thisSqdistLine, prevSqdistLine);
+  }
+}  // voronoi
+
+void voronoiDistances(const ConnectivityMap& cmap, const std::vector<Distance>& dist, Connections& conns) {
+  const int width = cmap.size().width();
+  const int height = cmap.size().height();
+  const int offsets[] = {-cmap.stride(), -1, 1, cmap.stride()};
+  const uint32_t* const cmapData = cmap.data();
+  const Distance* const distData = &dist[0] + width + 3;
+  for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
+    for (int x = 0; x < width; ++x, ++offset) {
+      const uint32_t label = cmapData[offset];
+      for (int i : offsets) {
+        const uint32_t nbhLabel = cmapData[offset + i];
+        if ((nbhLabel == 0) || (nbhLabel == label)) {
+          continue;
+        }
+        // Both ends are measured from (x, y), as they always were.
+        const int dx = distData[offset].vec.x - distData[offset + i].vec.x;
+        const int dy = distData[offset].vec.y - distData[offset + i].vec.y;
+        const uint32_t sqdist = static_cast<uint32_t>(dx * dx) + static_cast<uint32_t>(dy * dy);
+        const auto key = std::make_pair(std::min(label, nbhLabel), std::max(label, nbhLabel));
+        const auto it = conns.find(key);
+        if (it == conns.end()) {
+          conns[key] = sqdist;
+        } else {
+          it->second = std::min(it->second, sqdist);
+        }
+      }
+    }
+  }
+}
+
+void tag(uint32_t& source, const uint32_t target, const uint32_t sqdist, const Settings& settings) {
+  const uint32_t sourcePixels = source & ~TAG_MASK;
+  if ((source & ANCHORED_TO_BIG) || (sqdist > sourcePixels * settings.pixelsToSqDist)) {
+    return;
+  }
+  source |= ((target & ~TAG_MASK) >= settings.minRelativeParentWeight * sourcePixels) ? ANCHORED_TO_BIG
+                                                                                       : ANCHORED_TO_SMALL;
+}
+
+bool canBeAttachedTo(const uint32_t comp, const uint32_t target, const uint32_t sqdist, const Settings& settings) {
+  return (sqdist <= comp * settings.pixelsToSqDist) && (target >= comp * settings.minRelativeParentWeight);
+}
+
+BinaryImage despeckle(const BinaryImage& src, const Dpi& dpi, const double level) {
+  const Settings settings = settingsFor(level, dpi);
+  BinaryImage image(src);
+  ConnectivityMap cmap(image, CONN8);
+  if (cmap.maxLabel() == 0) {
+    return image;
+  }
+  const int width = image.width();
+  const int height = image.height();
+
+  std::vector<uint32_t> numPixels(cmap.maxLabel() + 1, 0);
+  std::vector<QRect> rects(cmap.maxLabel() + 1);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const uint32_t label = cmap.data()[y * cmap.stride() + x];
+      ++numPixels[label];
+      rects[label] |= QRect(x, y, 1, 1);
+    }
+  }
+
+  std::vector<uint32_t> remap(numPixels.size(), 0);
+  uint32_t big = 0;
+  uint32_t next = 1;
+  for (uint32_t label = 1; label <= cmap.maxLabel(); ++label) {
+    if ((rects[label].width() < settings.bigObjectThreshold) && (rects[label].height() < settings.bigObjectThreshold)) {
+      numPixels[next] = numPixels[label];
+      remap[label] = next++;
+    } else {
+      if (big == 0) {
+        big = next++;
+        numPixels[big] = width * height;
+      }
+      remap[label] = big;
+    }
+  }
+  numPixels.resize(next);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint32_t& label = cmap.data()[y * cmap.stride() + x];
+      label = remap[label];
+    }
+  }
+
+  std::vector<Distance> dist;
+  voronoi(cmap, dist, nullptr);
+  Connections conns;
+  voronoiDistances(cmap, dist, conns);
+
+  std::vector<uint32_t> comps(numPixels);
+  for (const auto& conn : conns) {
+    tag(comps[conn.first.first], comps[conn.first.second], conn.second, settings);
+    tag(comps[conn.first.second], comps[conn.first.first], conn.second, settings);
+  }
+  comps[big] |= ANCHORED_TO_BIG;
+
+  const auto anchoredToSmallButNotBig = [&](const uint32_t label) {
+    return (comps[label] & TAG_MASK) == ANCHORED_TO_SMALL;
+  };
+  bool secondPass = false;
+  for (uint32_t label = 0; label < next; ++label) {
+    secondPass |= anchoredToSmallButNotBig(label);
+  }
+  if (secondPass) {
+    const Distance special(Distance::special());
+    Distance* const distData = &dist[0] + width + 3;
+    for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
+      for (int x = 0; x < width; ++x, ++offset) {
+        if (!anchoredToSmallButNotBig(cmap.data()[offset])) {
+          if (distData[offset] == Distance::zero()) {
+            distData[offset] = special;
+          } else {
+            distData[offset].reset(x + 1);
+          }
+        }
+      }
+    }
+    voronoi(cmap, dist, &special);
+    Connections secondPassConns;
+    voronoiDistances(cmap, dist, secondPassConns);
+    for (const auto& conn : secondPassConns) {
+      if (anchoredToSmallButNotBig(conn.first.first) || anchoredToSmallButNotBig(conn.first.second)) {
+        const auto it = conns.find(conn.first);
+        if (it == conns.end()) {
+          conns.insert(conn);
+        } else {
+          it->second = std::min(it->second, conn.second);
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<uint32_t>> sources(next);
+  for (const auto& conn : conns) {
+    const uint32_t label1 = conn.first.first;
+    const uint32_t label2 = conn.first.second;
+    if (canBeAttachedTo(numPixels[label1], numPixels[label2], conn.second, settings)) {
+      sources[label2].push_back(label1);
+    }
+    if (canBeAttachedTo(numPixels[label2], numPixels[label1], conn.second, settings)) {
+      sources[label1].push_back(label2);
+    }
+  }
+
+  std::vector<bool> retained(next, false);
+  FastQueue<uint32_t> queue;
+  queue.push(big);
+  while (!queue.empty()) {
+    const uint32_t label = queue.front();
+    queue.pop();
+    if (!retained[label]) {
+      retained[label] = true;
+      for (const uint32_t source : sources[label]) {
+        queue.push(source);
+      }
+    }
+  }
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      if (!retained[cmap.data()[y * cmap.stride() + x]]) {
+        image.setPixel(x, y, WHITE);
+      }
+    }
+  }
+  return image;
+}  // despeckle
+}  // namespace reference
+
+/**
+ * \brief A page of text-like glyphs, some with holes, among specks and dust.
+ */
+BinaryImage syntheticPage(const int width, const int height, std::mt19937& rng) {
+  BinaryImage page(width, height, WHITE);
+  const auto fill = [&](const int left, const int top, const int w, const int h, const int density) {
+    for (int y = std::max(top, 0); y < std::min(top + h, height); ++y) {
+      for (int x = std::max(left, 0); x < std::min(left + w, width); ++x) {
+        if (int(rng() % 100) < density) {
+          page.setPixel(x, y, BLACK);
+        }
+      }
+    }
+  };
+
+  for (int line = 8; line + 30 < height; line += 36) {
+    for (int x = 6 + rng() % 10; x + 20 < width; x += 16 + rng() % 12) {
+      const int w = 6 + rng() % 12;
+      const int h = 14 + rng() % 14;
+      fill(x, line, w, h, 100);
+      if (rng() % 2) {
+        // A counter, like in 'o'.
+        page.fill(QRect(x + 2, line + 3, w - 4, h - 6), WHITE);
+      }
+      if (rng() % 4 == 0) {
+        // A dot above the glyph, like in 'i'.
+        fill(x + w / 2, line - 5, 2 + rng() % 2, 2 + rng() % 2, 100);
+      }
+    }
+  }
+
+  const int numSpecks = width * height / 400;
+  for (int i = 0; i < numSpecks; ++i) {
+    const int size = (rng() % 8 == 0) ? 3 + rng() % 6 : 1 + rng() % 3;
+    fill(rng() % width, rng() % height, size, size, 70);
+  }
+  return page;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(DespeckleTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_same_as_reference) {
+  std::mt19937 rng(2019);
+  const double levels[] = {1.0, 1.5, 2.0, 2.5, 3.0};
+  for (int i = 0; i < 6; ++i) {
+    const BinaryImage page(syntheticPage(200 + rng() % 200, 150 + rng() % 200, rng));
+    const Dpi dpi = (i % 2 == 0) ? Dpi(300, 300) : Dpi(600, 600);
+    for (const double level : levels) {
+      const BinaryImage control(reference::despeckle(page, dpi, level));
+      BOOST_REQUIRE(control != page);
+      BOOST_CHECK(Despeckle::despeckle(page, dpi, level, NullTaskStatus()) == control);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_graph_same_as_despeckle) {
+  std::mt19937 rng(300);
+  const double levels[] = {1.0, 1.3, 1.7, 2.0, 2.4, 2.8, 3.0};
+  for (int i = 0; i < 4; ++i) {
+    const BinaryImage page(syntheticPage(200 + rng() % 200, 150 + rng() % 200, rng));
+    const Dpi dpi = (i % 2 == 0) ? Dpi(300, 300) : Dpi(600, 600);
+    const Despeckle::ComponentGraph graph(Despeckle::buildGraph(page, dpi, 1.0, 3.0, NullTaskStatus()));
+    for (const double level : levels) {
+      BinaryImage control(Despeckle::despeckle(page, dpi, level, NullTaskStatus()));
+      rasterOp<RopSubtract<RopSrc, RopDst>>(control, page);
+      BOOST_CHECK(Despeckle::speckles(graph, level, NullTaskStatus()) == control);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_white_page) {
+  const BinaryImage page(100, 100, WHITE);
+  BOOST_CHECK(Despeckle::despeckle(page, Dpi(300, 300), 2.0, NullTaskStatus()) == page);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
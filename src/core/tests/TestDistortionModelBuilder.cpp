@@ -0,0 +1,94 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <DistortionModel.h>
+#include <DistortionModelBuilder.h>
+#include <imageproc/tests/Utils.h>
+
+#include <QLineF>
+#include <QPointF>
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace Tests {
+using namespace dewarping;
+using imageproc::tests::utils::TestParallelForExecutor;
+
+namespace {
+/**
+ * Lines of text on a page bent like in a book, with a pixel of noise.
+ */
+DistortionModelBuilder makeBuilder() {
+  const double pi = 3.14159265358979323846;
+  const double width = 1000;
+
+  DistortionModelBuilder builder(Vec2d(0, 1));
+  builder.setVerticalBounds(QLineF(0, 0, 0, 1400), QLineF(width, 0, width, 1400));
+
+  srand(1);
+  for (int line = 0; line < 12; ++line) {
+    const double bend = 20.0 + 3.0 * line;
+    std::vector<QPointF> polyline;
+    for (int x = 20; x <= 980; x += 20) {
+      const double noise = (rand() % 201 - 100) / 100.0;
+      polyline.emplace_back(x, 100.0 + 100.0 * line - bend * std::sin(pi * x / width) + noise);
+    }
+    builder.addHorizontalCurve(polyline);
+  }
+  return builder;
+}
+
+std::vector<QPointF> makePolyline(const double y, const double bend) {
+  const double pi = 3.14159265358979323846;
+  std::vector<QPointF> polyline;
+  for (int x = 20; x <= 980; x += 20) {
+    polyline.emplace_back(x, y - bend * std::sin(pi * x / 1000.0));
+  }
+  return polyline;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(DistortionModelBuilderTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_parallel_search_selects_same_pair) {
+  DistortionModel sequentialModel;
+  {
+    const TestParallelForExecutor sequential(1);
+    sequentialModel = makeBuilder().tryBuildModel();
+  }
+  BOOST_REQUIRE(sequentialModel.isValid());
+
+  // The outcome mustn't depend on which candidates happen to finish first.
+  for (int i = 0; i < 5; ++i) {
+    DistortionModel parallelModel;
+    {
+      const TestParallelForExecutor parallel(8, true);
+      parallelModel = makeBuilder().tryBuildModel();
+    }
+    BOOST_REQUIRE(parallelModel.isValid());
+    BOOST_CHECK(parallelModel.topCurve().polyline() == sequentialModel.topCurve().polyline());
+    BOOST_CHECK(parallelModel.bottomCurve().polyline() == sequentialModel.bottomCurve().polyline());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_pairs_crossing_near_bounds_are_rejected) {
+  DistortionModelBuilder builder(Vec2d(0, 1));
+  builder.setVerticalBounds(QLineF(0, 0, 0, 1000), QLineF(1000, 0, 1000, 1000));
+
+  // The arched curve is above the straight one by its centroid, but below it near both bounds.
+  // Their ends still form a convex quadrilateral, so only the separation of the ends rejects them.
+  builder.addHorizontalCurve(makePolyline(520, 60));
+  builder.addHorizontalCurve(makePolyline(500, 0));
+  BOOST_CHECK(!builder.tryBuildModel().isValid());
+
+  // Once there is a curve clear of both, it makes a model with either of them.
+  builder.addHorizontalCurve(makePolyline(800, 10));
+  const DistortionModel model(builder.tryBuildModel());
+  BOOST_REQUIRE(model.isValid());
+  BOOST_CHECK(model.bottomCurve().polyline().front().y() > 700);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,149 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageCache.h>
+#include <ImageId.h>
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QTemporaryDir>
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+
+namespace Tests {
+namespace {
+bool writeFile(const QString& path, const QByteArray& data) {
+  QFile file(path);
+  return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && (file.write(data) == data.size());
+}
+
+/**
+ * Stands for decoding a source file, counting how many times it happens.
+ */
+class CountingLoader {
+ public:
+  explicit CountingLoader(int& numLoads, const QRgb color = 0xff336699) : m_numLoads(numLoads), m_color(color) {}
+
+  QImage operator()() const {
+    ++m_numLoads;
+    QImage image(100, 100, QImage::Format_RGB32);
+    image.fill(m_color);
+    return image;
+  }
+
+ private:
+  int& m_numLoads;
+  QRgb m_color;
+};
+
+// A 100x100 RGB32 image together with its grayscale version.
+const size_t ENTRY_COST = 100 * 100 * 4 + 100 * 100;
+
+/**
+ * Gives every test an empty cache with room for two images, and temporary source files.
+ */
+struct ImageCacheFixture {
+  ImageCacheFixture() {
+    ImageCache::instance().clear();
+    ImageCache::instance().setByteBudget(2 * ENTRY_COST);
+  }
+
+  ~ImageCacheFixture() { ImageCache::instance().clear(); }
+
+  ImageId sourceFile(const QString& name) const {
+    const QString path(QDir(dir.path()).absoluteFilePath(name));
+    BOOST_REQUIRE(writeFile(path, "source file"));
+    return ImageId(path);
+  }
+
+  QTemporaryDir dir;
+};
+}  // namespace
+
+BOOST_FIXTURE_TEST_SUITE(ImageCacheTestSuite, ImageCacheFixture)
+
+BOOST_AUTO_TEST_CASE(test_hit) {
+  ImageCache& cache = ImageCache::instance();
+  const ImageId imageId(sourceFile("1.png"));
+  const ImageCache::Stats before(cache.stats());
+
+  int numLoads = 0;
+  const ImageCache::Entry first(cache.load(imageId, CountingLoader(numLoads)));
+  const ImageCache::Entry second(cache.load(imageId, CountingLoader(numLoads)));
+  BOOST_CHECK_EQUAL(numLoads, 1);
+  BOOST_REQUIRE(!second.image.isNull());
+  BOOST_CHECK(second.image == first.image);
+  BOOST_CHECK(second.grayImage.toQImage() == first.grayImage.toQImage());
+
+  const ImageCache::Stats after(cache.stats());
+  BOOST_CHECK_EQUAL(after.misses - before.misses, 1u);
+  BOOST_CHECK_EQUAL(after.hits - before.hits, 1u);
+  BOOST_CHECK_EQUAL(after.numEntries, 1u);
+  BOOST_CHECK_EQUAL(after.bytesUsed, ENTRY_COST);
+}
+
+BOOST_AUTO_TEST_CASE(test_least_recently_used_is_evicted) {
+  ImageCache& cache = ImageCache::instance();
+  const ImageId imageId1(sourceFile("1.png"));
+  const ImageId imageId2(sourceFile("2.png"));
+  const ImageId imageId3(sourceFile("3.png"));
+  const ImageCache::Stats before(cache.stats());
+
+  int numLoads1 = 0;
+  int numLoads2 = 0;
+  int numLoads3 = 0;
+  cache.load(imageId1, CountingLoader(numLoads1));
+  cache.load(imageId2, CountingLoader(numLoads2));
+  // Makes the second image the least recently used one.
+  cache.load(imageId1, CountingLoader(numLoads1));
+  cache.load(imageId3, CountingLoader(numLoads3));
+  BOOST_CHECK_EQUAL(cache.stats().evictions - before.evictions, 1u);
+  BOOST_CHECK_EQUAL(cache.stats().bytesUsed, 2 * ENTRY_COST);
+
+  cache.load(imageId1, CountingLoader(numLoads1));
+  cache.load(imageId3, CountingLoader(numLoads3));
+  BOOST_CHECK_EQUAL(numLoads1, 1);
+  BOOST_CHECK_EQUAL(numLoads3, 1);
+  cache.load(imageId2, CountingLoader(numLoads2));
+  BOOST_CHECK_EQUAL(numLoads2, 2);
+
+  // Shrinking the budget evicts right away, and a zero budget disables caching.
+  cache.setByteBudget(ENTRY_COST);
+  BOOST_CHECK_EQUAL(cache.stats().numEntries, 1u);
+  cache.setByteBudget(0);
+  BOOST_CHECK_EQUAL(cache.stats().numEntries, 0u);
+  cache.load(imageId2, CountingLoader(numLoads2));
+  cache.load(imageId2, CountingLoader(numLoads2));
+  BOOST_CHECK_EQUAL(numLoads2, 4);
+  BOOST_CHECK_EQUAL(cache.stats().bytesUsed, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_invalidation) {
+  ImageCache& cache = ImageCache::instance();
+  const ImageId imageId(sourceFile("1.png"));
+
+  int numLoads = 0;
+  cache.load(imageId, CountingLoader(numLoads, 0xff000000));
+
+  // The file has changed on disk, so the old image mustn't be served.
+  BOOST_REQUIRE(writeFile(imageId.filePath(), "a different source file"));
+  const ImageCache::Entry changed(cache.load(imageId, CountingLoader(numLoads, 0xffffffff)));
+  BOOST_CHECK_EQUAL(numLoads, 2);
+  BOOST_CHECK_EQUAL(changed.image.pixel(0, 0), 0xffffffffu);
+  BOOST_CHECK_EQUAL(cache.stats().numEntries, 1u);
+
+  cache.remove(imageId);
+  BOOST_CHECK_EQUAL(cache.stats().numEntries, 0u);
+  cache.load(imageId, CountingLoader(numLoads));
+  BOOST_CHECK_EQUAL(numLoads, 3);
+
+  // Files that don't exist are never cached.
+  const ImageId missing(QDir(dir.path()).absoluteFilePath("missing.png"));
+  cache.load(missing, CountingLoader(numLoads));
+  cache.load(missing, CountingLoader(numLoads));
+  BOOST_CHECK_EQUAL(numLoads, 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,63 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageMetadataCache.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests {
+namespace {
+bool writeFile(const QString& path, const QByteArray& data) {
+  QFile file(path);
+  return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && (file.write(data) == data.size());
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(ImageMetadataCacheTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_persists_across_sessions) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString cachePath(QDir(dir.path()).absoluteFilePath("cache/image_metadata.dat"));
+  const QString imagePath(QDir(dir.path()).absoluteFilePath("image.tif"));
+  BOOST_REQUIRE(writeFile(imagePath, "not really a tiff"));
+
+  const std::vector<ImageMetadata> pages{ImageMetadata(QSize(2480, 3508), Dpi(300, 300)),
+                                         ImageMetadata(QSize(1240, 1754), Dpi(150, 150))};
+  {
+    ImageMetadataCache cache(cachePath);
+    std::vector<ImageMetadata> found;
+    BOOST_CHECK(!cache.lookup(QFileInfo(imagePath), found));
+    cache.store(QFileInfo(imagePath), pages);
+    BOOST_CHECK(cache.lookup(QFileInfo(imagePath), found));
+    BOOST_CHECK(found == pages);
+    BOOST_REQUIRE(cache.save());
+  }
+
+  ImageMetadataCache cache(cachePath);
+  std::vector<ImageMetadata> found;
+  BOOST_REQUIRE(cache.lookup(QFileInfo(imagePath), found));
+  BOOST_CHECK(found == pages);
+}
+
+BOOST_AUTO_TEST_CASE(test_changed_file_is_not_served) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString imagePath(QDir(dir.path()).absoluteFilePath("image.png"));
+  BOOST_REQUIRE(writeFile(imagePath, "short"));
+
+  ImageMetadataCache cache(QDir(dir.path()).absoluteFilePath("image_metadata.dat"));
+  cache.store(QFileInfo(imagePath), {ImageMetadata(QSize(100, 200), Dpi(600, 600))});
+
+  BOOST_REQUIRE(writeFile(imagePath, "somewhat longer"));
+  std::vector<ImageMetadata> found;
+  BOOST_CHECK(!cache.lookup(QFileInfo(imagePath), found));
+  BOOST_CHECK(!cache.lookup(QFileInfo(QDir(dir.path()).absoluteFilePath("missing.png")), found));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
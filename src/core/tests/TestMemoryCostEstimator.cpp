@@ -0,0 +1,93 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageMetadata.h>
+#include <MemoryCostEstimator.h>
+#include <MemoryUsageMonitor.h>
+#include <filters/output/Params.h>
+
+#include <QSize>
+#include <atomic>
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+
+namespace Tests {
+namespace {
+const size_t MiB = 1024 * 1024;
+}
+
+BOOST_AUTO_TEST_SUITE(MemoryCostEstimatorTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_nominal_estimates) {
+  const ImageMetadata metadata(QSize(4000, 3000), Dpi(300, 300));
+  BOOST_CHECK_EQUAL(MemoryCostEstimator::estimate(metadata, nullptr), size_t(96000000));
+  BOOST_CHECK_EQUAL(MemoryCostEstimator::estimate(ImageMetadata(QSize(100, 100), Dpi(300, 300)), nullptr), 16 * MiB);
+
+  // Twice the source resolution makes 4 times as many output pixels.
+  output::Params params;
+  params.setOutputDpi(Dpi(600, 600));
+  BOOST_CHECK_EQUAL(MemoryCostEstimator::estimate(metadata, &params), size_t(96000000 + 48000000 * 6));
+
+  output::ColorParams colorParams;
+  colorParams.setColorMode(output::COLOR_GRAYSCALE);
+  params.setColorParams(colorParams);
+  BOOST_CHECK_EQUAL(MemoryCostEstimator::estimate(metadata, &params), size_t(96000000 + 48000000 * 14));
+
+  colorParams.setColorMode(output::MIXED);
+  params.setColorParams(colorParams);
+  params.setDewarpingOptions(output::DewarpingOptions(output::AUTO));
+  BOOST_CHECK_EQUAL(MemoryCostEstimator::estimate(metadata, &params),
+                    size_t(96000000) + size_t(48000000) * (14 + 8 + 6));
+}
+
+BOOST_AUTO_TEST_CASE(test_calibration) {
+  MemoryCostEstimator estimator;
+  BOOST_CHECK_EQUAL(estimator.calibrationFactor(), 1.0);
+
+  // Underestimates are corrected right away.
+  estimator.recordUsage(100 * MiB, 250 * MiB);
+  BOOST_CHECK_CLOSE(estimator.calibrationFactor(), 2.5, 1e-9);
+  BOOST_CHECK_EQUAL(estimator.calibrated(100 * MiB), 250 * MiB);
+
+  // Overestimates only gradually.
+  estimator.recordUsage(100 * MiB, 50 * MiB);
+  BOOST_CHECK_CLOSE(estimator.calibrationFactor(), 2.3, 1e-9);
+
+  // Unknown usage doesn't count.
+  estimator.recordUsage(0, 50 * MiB);
+  estimator.recordUsage(100 * MiB, 0);
+  BOOST_CHECK_CLOSE(estimator.calibrationFactor(), 2.3, 1e-9);
+
+  estimator.recordUsage(100 * MiB, 1000 * MiB);
+  BOOST_CHECK_EQUAL(estimator.calibrationFactor(), 4.0);
+  for (int i = 0; i < 200; ++i) {
+    estimator.recordUsage(100 * MiB, 1 * MiB);
+  }
+  BOOST_CHECK_EQUAL(estimator.calibrationFactor(), 0.25);
+}
+
+BOOST_AUTO_TEST_CASE(test_monitor_attributes_only_task_memory) {
+  // The memory of the process only ever grows here, as if the allocator kept
+  // whatever the tasks release.  The sampling thread may see a stale value,
+  // but never one making a task look bigger than it is.
+  std::atomic<size_t> memory(1000 * MiB);
+  MemoryCostEstimator estimator;
+  MemoryUsageMonitor monitor([&memory]() { return memory.load(); }, estimator);
+
+  const int task1 = monitor.taskStarted(100 * MiB);
+  memory += 100 * MiB;
+  const int task2 = monitor.taskStarted(100 * MiB);
+  memory += 100 * MiB;
+  BOOST_CHECK_EQUAL(monitor.taskFinished(task1), 100 * MiB);
+
+  // What the first task took stays with the process, but isn't attributed to the others.
+  const int task3 = monitor.taskStarted(100 * MiB);
+  memory += 100 * MiB;
+  BOOST_CHECK_EQUAL(monitor.taskFinished(task2), 100 * MiB);
+  BOOST_CHECK_EQUAL(monitor.taskFinished(task3), 100 * MiB);
+
+  BOOST_CHECK_EQUAL(estimator.calibrationFactor(), 1.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,208 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <FileNameDisambiguator.h>
+#include <ImageId.h>
+#include <ImageInfo.h>
+#include <ImageMetadata.h>
+#include <OutputFileNameGenerator.h>
+#include <PageInfo.h>
+#include <PageSelectionAccessor.h>
+#include <PageSelectionProvider.h>
+#include <ProjectPages.h>
+#include <ProjectReader.h>
+#include <ProjectWriter.h>
+#include <SelectedPage.h>
+#include <StageDigests.h>
+#include <StageSequence.h>
+
+#include <QApplication>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QSize>
+#include <QTemporaryDir>
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace Tests {
+namespace {
+bool writeFile(const QString& path, const QByteArray& data) {
+  QFile file(path);
+  return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && (file.write(data) == data.size());
+}
+
+QDomDocument readXml(const QString& path) {
+  QDomDocument doc;
+  QFile file(path);
+  BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+  BOOST_REQUIRE(doc.setContent(&file));
+  return doc;
+}
+
+/**
+ * Filters own their option widgets, so they can't be created without a QApplication.
+ */
+void ensureApplication() {
+  if (QApplication::instance()) {
+    return;
+  }
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  static int argc = 1;
+  static char argv0[] = "test";
+  static char* argv[] = {argv0, nullptr};
+  static QApplication app(argc, argv);
+}
+
+class PageSelectionProviderImpl : public PageSelectionProvider {
+ public:
+  explicit PageSelectionProviderImpl(std::shared_ptr<ProjectPages> pages) : m_pages(std::move(pages)) {}
+
+  PageSequence allPages() const override { return m_pages->toPageSequence(PAGE_VIEW); }
+
+  std::set<PageId> selectedPages() const override { return std::set<PageId>(); }
+
+  std::vector<PageRange> selectedRanges() const override { return std::vector<PageRange>(); }
+
+ private:
+  std::shared_ptr<ProjectPages> m_pages;
+};
+
+std::shared_ptr<StageSequence> makeStages(const std::shared_ptr<ProjectPages>& pages) {
+  auto stages = std::make_shared<StageSequence>(
+      pages, PageSelectionAccessor(std::make_shared<PageSelectionProviderImpl>(pages)));
+  for (const PageInfo& page : pages->toPageSequence(PAGE_VIEW)) {
+    for (int i = 0; i < stages->count(); ++i) {
+      stages->filterAt(i)->loadDefaultSettings(page);
+    }
+  }
+  return stages;
+}
+
+/**
+ * A project of a single source file, with the default settings for all the filters.
+ */
+struct ProjectFixture {
+  ProjectFixture() {
+    ensureApplication();
+    BOOST_REQUIRE(dir.isValid());
+    imagePath = QDir(dir.path()).absoluteFilePath("page.png");
+    BOOST_REQUIRE(writeFile(imagePath, "source file"));
+
+    const ImageInfo image(ImageId(imagePath), ImageMetadata(QSize(2000, 3000), Dpi(300, 300)), 1, false, false);
+    pages = std::make_shared<ProjectPages>(std::vector<ImageInfo>{image}, Qt::LeftToRight);
+    page = pages->toPageSequence(PAGE_VIEW).pageAt(0);
+    stages = makeStages(pages);
+    outFileNameGen = OutputFileNameGenerator(std::make_shared<FileNameDisambiguator>(),
+                                             QDir(dir.path()).absoluteFilePath("out"), Qt::LeftToRight);
+  }
+
+  QString saveProject() const {
+    const QString projectPath(QDir(dir.path()).absoluteFilePath("project.ScanTailor"));
+    const ProjectWriter writer(pages, SelectedPage(), outFileNameGen);
+    BOOST_REQUIRE(writer.write(projectPath, stages->filters(), stages->stageDigests()));
+    return projectPath;
+  }
+
+  bool isUpToDate(const int lastFilterIdx) const {
+    return stages->stageDigests().isUpToDate(*stages, lastFilterIdx, page, outFileNameGen);
+  }
+
+  void recordProcessed(const int lastFilterIdx) {
+    stages->stageDigests().recordProcessed(*stages, lastFilterIdx, page, outFileNameGen);
+  }
+
+  QTemporaryDir dir;
+  QString imagePath;
+  std::shared_ptr<ProjectPages> pages;
+  PageInfo page;
+  std::shared_ptr<StageSequence> stages;
+  OutputFileNameGenerator outFileNameGen;
+};
+}  // namespace
+
+BOOST_FIXTURE_TEST_SUITE(StageDigestsTestSuite, ProjectFixture)
+
+BOOST_AUTO_TEST_CASE(test_digests_are_stable) {
+  const int deskewIdx = stages->deskewFilterIdx();
+  BOOST_CHECK(!isUpToDate(deskewIdx));
+  recordProcessed(deskewIdx);
+  for (int idx = 0; idx <= deskewIdx; ++idx) {
+    BOOST_CHECK(isUpToDate(idx));
+  }
+  BOOST_CHECK(!isUpToDate(deskewIdx + 1));
+
+  // Filters with the same settings make the same digests.
+  const std::shared_ptr<StageSequence> otherStages(makeStages(pages));
+  for (int idx = 0; idx < stages->count(); ++idx) {
+    BOOST_CHECK(StageDigests::calcDigest(*stages, idx, page, outFileNameGen)
+                == StageDigests::calcDigest(*otherStages, idx, page, outFileNameGen));
+  }
+
+  // The digests and the settings they were made from survive saving and loading the project.
+  const ProjectReader reader(readXml(saveProject()));
+  BOOST_REQUIRE(reader.success());
+  const std::shared_ptr<StageSequence> loadedStages(makeStages(reader.pages()));
+  reader.readFilterSettings(loadedStages->filters());
+  reader.readStageDigests(loadedStages->stageDigests());
+  const PageInfo loadedPage(reader.pages()->toPageSequence(PAGE_VIEW).pageAt(0));
+  BOOST_REQUIRE(loadedPage.id() == page.id());
+  BOOST_CHECK(loadedStages->stageDigests().isUpToDate(*loadedStages, deskewIdx, loadedPage, outFileNameGen));
+  BOOST_CHECK(!loadedStages->stageDigests().isUpToDate(*loadedStages, deskewIdx + 1, loadedPage, outFileNameGen));
+}
+
+BOOST_AUTO_TEST_CASE(test_changed_inputs_invalidate_digests) {
+  const int outputIdx = stages->outputFilterIdx();
+
+  // A different source file.
+  recordProcessed(outputIdx);
+  BOOST_REQUIRE(isUpToDate(outputIdx));
+  BOOST_REQUIRE(writeFile(imagePath, "a different source file"));
+  BOOST_CHECK(!isUpToDate(0));
+  BOOST_CHECK(!isUpToDate(outputIdx));
+
+  // Different image metadata.
+  recordProcessed(outputIdx);
+  const PageInfo resampledPage(page.id(), ImageMetadata(QSize(2000, 3000), Dpi(600, 600)), 1, false, false);
+  BOOST_CHECK(!stages->stageDigests().isUpToDate(*stages, 0, resampledPage, outFileNameGen));
+
+  // An output file replaced by someone else only affects the output stage.
+  recordProcessed(outputIdx);
+  BOOST_REQUIRE(QDir().mkpath(outFileNameGen.outDir()));
+  BOOST_REQUIRE(writeFile(outFileNameGen.filePathFor(page.id()), "output file"));
+  BOOST_CHECK(isUpToDate(outputIdx - 1));
+  BOOST_CHECK(!isUpToDate(outputIdx));
+
+  // Different settings of the first stage affect all the stages.
+  recordProcessed(outputIdx);
+  QDomDocument doc(readXml(saveProject()));
+  const QDomElement projectEl(doc.documentElement());
+  const QString imageId(projectEl.namedItem("images").firstChildElement("image").attribute("id"));
+  BOOST_REQUIRE(!imageId.isEmpty());
+  QDomElement imageEl(doc.createElement("image"));
+  imageEl.setAttribute("id", imageId);
+  QDomElement rotationEl(doc.createElement("rotation"));
+  rotationEl.setAttribute("degrees", 90);
+  imageEl.appendChild(rotationEl);
+  projectEl.namedItem("filters").namedItem("fix-orientation").appendChild(imageEl);
+  ProjectReader(doc).readFilterSettings(stages->filters());
+  BOOST_CHECK(!isUpToDate(0));
+  BOOST_CHECK(!isUpToDate(outputIdx));
+
+  // Processing up to an earlier stage drops the digests of the following ones.
+  recordProcessed(outputIdx);
+  recordProcessed(1);
+  BOOST_CHECK(isUpToDate(1));
+  BOOST_CHECK(!isUpToDate(2));
+  BOOST_CHECK(!isUpToDate(outputIdx));
+
+  stages->stageDigests().remove(page.id());
+  BOOST_CHECK(!isUpToDate(0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,282 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageId.h>
+#include <ThumbnailStore.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSize>
+#include <QTemporaryDir>
+#include <QThread>
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+namespace Tests {
+namespace {
+QImage makeImage(const QSize& size, const QImage::Format format, const int seed) {
+  QImage image(size, format);
+  for (int y = 0; y < size.height(); ++y) {
+    uchar* line = image.scanLine(y);
+    for (int x = 0; x < size.width(); ++x) {
+      const int v = (x * 7 + y * 13 + seed) & 0xff;
+      if (format == QImage::Format_Grayscale8) {
+        line[x] = static_cast<uchar>(v);
+      } else {
+        reinterpret_cast<QRgb*>(line)[x] = qRgb(v, 255 - v, seed & 0xff);
+      }
+    }
+  }
+  return image;
+}
+
+/**
+ * \brief Makes an image that doesn't compress, so that it takes a known amount of space in the store.
+ */
+QImage makeNoise(const QSize& size, const int seed) {
+  std::mt19937 rng(seed);
+  QImage image(size, QImage::Format_RGB32);
+  for (int y = 0; y < size.height(); ++y) {
+    auto* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+    for (int x = 0; x < size.width(); ++x) {
+      line[x] = 0xff000000 | (rng() & 0x00ffffff);
+    }
+  }
+  return image;
+}
+
+bool writeFile(const QString& filePath, const QByteArray& content) {
+  QFile file(filePath);
+  return file.open(QIODevice::WriteOnly) && (file.write(content) == content.size());
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(ThumbnailStoreTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId gray(QDir(dir.path()).absoluteFilePath("gray.tif"));
+  const ImageId color(QDir(dir.path()).absoluteFilePath("color.tif"), 3);
+  const QImage grayThumb(makeImage(QSize(100, 160), QImage::Format_Grayscale8, 1));
+  const QImage colorThumb(makeImage(QSize(250, 120), QImage::Format_RGB32, 2));
+
+  {
+    ThumbnailStore store(storePath);
+    BOOST_CHECK(!store.contains(gray, maxSize));
+    BOOST_REQUIRE(store.save(gray, maxSize, grayThumb));
+    BOOST_REQUIRE(store.save(color, maxSize, colorThumb));
+    BOOST_CHECK(store.contains(gray, maxSize));
+    BOOST_CHECK(!store.contains(gray, QSize(120, 80)));
+    BOOST_CHECK(store.load(gray, maxSize) == grayThumb);
+  }
+
+  // Reopened, so that the records come from the mapped file.
+  ThumbnailStore store(storePath);
+  BOOST_CHECK(store.load(gray, maxSize) == grayThumb);
+  BOOST_CHECK(store.load(color, maxSize) == colorThumb);
+  BOOST_CHECK(store.load(ImageId(color.filePath(), 2), maxSize).isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_newer_supersedes_older) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId imageId(QDir(dir.path()).absoluteFilePath("image.tif"));
+  const QImage oldThumb(makeImage(QSize(50, 60), QImage::Format_RGB32, 3));
+  const QImage newThumb(makeImage(QSize(60, 50), QImage::Format_RGB32, 4));
+
+  {
+    ThumbnailStore store(storePath);
+    BOOST_REQUIRE(store.save(imageId, maxSize, oldThumb));
+    BOOST_REQUIRE(store.save(imageId, maxSize, newThumb));
+    BOOST_CHECK(store.load(imageId, maxSize) == newThumb);
+  }
+
+  ThumbnailStore store(storePath);
+  BOOST_CHECK(store.load(imageId, maxSize) == newThumb);
+}
+
+BOOST_AUTO_TEST_CASE(test_broken_tail_is_dropped) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId first(QDir(dir.path()).absoluteFilePath("first.tif"));
+  const ImageId second(QDir(dir.path()).absoluteFilePath("second.tif"));
+  const QImage firstThumb(makeImage(QSize(40, 40), QImage::Format_Grayscale8, 5));
+
+  qint64 sizeAfterFirst = 0;
+  {
+    ThumbnailStore store(storePath);
+    BOOST_REQUIRE(store.save(first, maxSize, firstThumb));
+    sizeAfterFirst = QFile(storePath).size();
+    BOOST_REQUIRE(store.save(second, maxSize, makeImage(QSize(40, 40), QImage::Format_RGB32, 6)));
+  }
+
+  // As if writing the second record was interrupted.
+  {
+    QFile file(storePath);
+    BOOST_REQUIRE(file.resize(file.size() - 10));
+  }
+
+  {
+    ThumbnailStore store(storePath);
+    BOOST_CHECK(store.load(first, maxSize) == firstThumb);
+    BOOST_CHECK(!store.contains(second, maxSize));
+  }
+  BOOST_CHECK_EQUAL(QFile(storePath).size(), sizeAfterFirst);
+}
+
+BOOST_AUTO_TEST_CASE(test_outdated_thumbnail_is_rejected) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId imageId(QDir(dir.path()).absoluteFilePath("image.tif"));
+  const QImage oldThumb(makeImage(QSize(50, 60), QImage::Format_RGB32, 7));
+  const QImage newThumb(makeImage(QSize(50, 60), QImage::Format_RGB32, 8));
+  BOOST_REQUIRE(writeFile(imageId.filePath(), "old"));
+
+  ThumbnailStore oldStore(storePath);
+  BOOST_REQUIRE(oldStore.save(imageId, maxSize, oldThumb));
+  BOOST_CHECK(oldStore.load(imageId, maxSize) == oldThumb);
+
+  // Rewriting the source until its modification time changes,
+  // however coarse the file system keeps it.
+  const QDateTime modified(QFileInfo(imageId.filePath()).lastModified());
+  for (int i = 0; (i < 300) && (QFileInfo(imageId.filePath()).lastModified() == modified); ++i) {
+    QThread::msleep(10);
+    BOOST_REQUIRE(writeFile(imageId.filePath(), "new"));
+  }
+  BOOST_REQUIRE(QFileInfo(imageId.filePath()).lastModified() != modified);
+
+  // A store looks up the modification time once.
+  BOOST_CHECK(oldStore.load(imageId, maxSize) == oldThumb);
+
+  {
+    ThumbnailStore store(storePath);
+    BOOST_CHECK(!store.contains(imageId, maxSize));
+    BOOST_CHECK(store.load(imageId, maxSize).isNull());
+    BOOST_REQUIRE(store.save(imageId, maxSize, newThumb));
+  }
+
+  ThumbnailStore store(storePath);
+  BOOST_CHECK(store.contains(imageId, maxSize));
+  BOOST_CHECK(store.load(imageId, maxSize) == newThumb);
+}
+
+BOOST_AUTO_TEST_CASE(test_superseded_records_are_compacted) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId kept(QDir(dir.path()).absoluteFilePath("kept.tif"));
+  const ImageId redone(QDir(dir.path()).absoluteFilePath("redone.tif"));
+  const QImage keptThumb(makeImage(QSize(40, 30), QImage::Format_Grayscale8, 9));
+  // About 192 KiB a record compressed, so 30 of them leave enough garbage to be compacted.
+  const QSize noiseSize(256, 256);
+
+  {
+    ThumbnailStore store(storePath);
+    BOOST_REQUIRE(store.save(kept, maxSize, keptThumb));
+    for (int i = 0; i < 30; ++i) {
+      BOOST_REQUIRE(store.save(redone, maxSize, makeNoise(noiseSize, i)));
+    }
+  }
+  const qint64 sizeBefore = QFile(storePath).size();
+
+  qint64 sizeAfter = 0;
+  {
+    ThumbnailStore store(storePath);
+    // The file is only opened on first use.
+    BOOST_CHECK_EQUAL(QFile(storePath).size(), sizeBefore);
+    BOOST_CHECK(store.load(kept, maxSize) == keptThumb);
+    sizeAfter = QFile(storePath).size();
+    BOOST_CHECK(sizeAfter < sizeBefore / 10);
+    BOOST_CHECK(store.load(redone, maxSize) == makeNoise(noiseSize, 29));
+  }
+
+  // Compacted files are reopened as they are, and still appended to.
+  const ImageId added(QDir(dir.path()).absoluteFilePath("added.tif"));
+  const QImage addedThumb(makeImage(QSize(30, 40), QImage::Format_RGB32, 10));
+  {
+    ThumbnailStore store(storePath);
+    BOOST_CHECK(!store.contains(added, maxSize));
+    BOOST_CHECK_EQUAL(QFile(storePath).size(), sizeAfter);
+    BOOST_REQUIRE(store.save(added, maxSize, addedThumb));
+  }
+
+  ThumbnailStore store(storePath);
+  BOOST_CHECK(store.load(kept, maxSize) == keptThumb);
+  BOOST_CHECK(store.load(redone, maxSize) == makeNoise(noiseSize, 29));
+  BOOST_CHECK(store.load(added, maxSize) == addedThumb);
+}
+
+BOOST_AUTO_TEST_CASE(test_stores_sharing_a_file) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId first(QDir(dir.path()).absoluteFilePath("first.tif"));
+  const ImageId second(QDir(dir.path()).absoluteFilePath("second.tif"));
+  const ImageId third(QDir(dir.path()).absoluteFilePath("third.tif"));
+  const QImage firstThumb(makeImage(QSize(40, 40), QImage::Format_Grayscale8, 11));
+  const QImage secondThumb(makeImage(QSize(40, 40), QImage::Format_RGB32, 12));
+  const QImage thirdThumb(makeImage(QSize(40, 40), QImage::Format_RGB32, 13));
+
+  {
+    // Like a GUI and a batch run working on the same project.
+    ThumbnailStore store1(storePath);
+    ThumbnailStore store2(storePath);
+    BOOST_REQUIRE(store1.save(first, maxSize, firstThumb));
+    BOOST_REQUIRE(store2.save(second, maxSize, secondThumb));
+    // Appending picks up what the other one appended.
+    BOOST_CHECK(store2.load(first, maxSize) == firstThumb);
+    BOOST_REQUIRE(store1.save(third, maxSize, thirdThumb));
+    BOOST_CHECK(store1.load(second, maxSize) == secondThumb);
+  }
+
+  ThumbnailStore store(storePath);
+  BOOST_CHECK(store.load(first, maxSize) == firstThumb);
+  BOOST_CHECK(store.load(second, maxSize) == secondThumb);
+  BOOST_CHECK(store.load(third, maxSize) == thirdThumb);
+}
+
+BOOST_AUTO_TEST_CASE(test_file_compacted_by_another_store) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString storePath(QDir(dir.path()).absoluteFilePath("thumbnails.dat"));
+  const QSize maxSize(250, 160);
+  const ImageId redone(QDir(dir.path()).absoluteFilePath("redone.tif"));
+  const ImageId added(QDir(dir.path()).absoluteFilePath("added.tif"));
+  const QImage addedThumb(makeImage(QSize(30, 40), QImage::Format_RGB32, 14));
+  const QSize noiseSize(256, 256);
+
+  ThumbnailStore store1(storePath);
+  for (int i = 0; i < 30; ++i) {
+    BOOST_REQUIRE(store1.save(redone, maxSize, makeNoise(noiseSize, i)));
+  }
+
+  {
+    // Compacts the file, unless the system doesn't let it replace an open one.
+    ThumbnailStore store2(storePath);
+    BOOST_CHECK(store2.load(redone, maxSize) == makeNoise(noiseSize, 29));
+  }
+
+  BOOST_REQUIRE(store1.save(added, maxSize, addedThumb));
+  BOOST_CHECK(store1.load(redone, maxSize) == makeNoise(noiseSize, 29));
+
+  ThumbnailStore store3(storePath);
+  BOOST_CHECK(store3.load(redone, maxSize) == makeNoise(noiseSize, 29));
+  BOOST_CHECK(store3.load(added, maxSize) == addedThumb);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
@@ -0,0 +1,311 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ImageId.h>
+#include <ImageLoader.h>
+#include <TiffReader.h>
+#include <tiffio.h>
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace Tests {
+namespace {
+/**
+ * The pixels of a TIFF directory, 8 bits per sample.
+ */
+struct Raster {
+  int width;
+  int height;
+  int samplesPerPixel;
+  std::vector<uint8_t> data;
+
+  Raster(const int width, const int height, const int samplesPerPixel)
+      : width(width), height(height), samplesPerPixel(samplesPerPixel), data(width * height * samplesPerPixel) {}
+
+  uint8_t& at(const int x, const int y, const int c) { return data[(y * width + x) * samplesPerPixel + c]; }
+
+  uint8_t at(const int x, const int y, const int c) const { return data[(y * width + x) * samplesPerPixel + c]; }
+
+  const uint8_t* line(const int y) const { return &data[y * width * samplesPerPixel]; }
+};
+
+Raster randomRaster(const int width, const int height, const int samplesPerPixel) {
+  Raster raster(width, height, samplesPerPixel);
+  for (uint8_t& value : raster.data) {
+    value = static_cast<uint8_t>(rand() % 256);
+  }
+  return raster;
+}
+
+Raster crop(const Raster& src, const QRect& rect) {
+  Raster dst(rect.width(), rect.height(), src.samplesPerPixel);
+  for (int y = 0; y < rect.height(); ++y) {
+    for (int x = 0; x < rect.width(); ++x) {
+      for (int c = 0; c < src.samplesPerPixel; ++c) {
+        dst.at(x, y, c) = src.at(rect.left() + x, rect.top() + y, c);
+      }
+    }
+  }
+  return dst;
+}
+
+/**
+ * Averages blocks of factor x factor pixels, the last ones being possibly incomplete.
+ */
+Raster downscale(const Raster& src, const int factor) {
+  Raster dst((src.width + factor - 1) / factor, (src.height + factor - 1) / factor, src.samplesPerPixel);
+  for (int y = 0; y < dst.height; ++y) {
+    for (int x = 0; x < dst.width; ++x) {
+      for (int c = 0; c < src.samplesPerPixel; ++c) {
+        int sum = 0;
+        int count = 0;
+        for (int sy = y * factor; sy < std::min((y + 1) * factor, src.height); ++sy) {
+          for (int sx = x * factor; sx < std::min((x + 1) * factor, src.width); ++sx) {
+            sum += src.at(sx, sy, c);
+            ++count;
+          }
+        }
+        dst.at(x, y, c) = static_cast<uint8_t>((sum + count / 2) / count);
+      }
+    }
+  }
+  return dst;
+}
+
+Raster invert(Raster raster) {
+  for (uint8_t& value : raster.data) {
+    value = static_cast<uint8_t>(255 - value);
+  }
+  return raster;
+}
+
+Raster fromImage(const QImage& image, const int samplesPerPixel) {
+  Raster raster(image.width(), image.height(), samplesPerPixel);
+  for (int y = 0; y < image.height(); ++y) {
+    for (int x = 0; x < image.width(); ++x) {
+      const QRgb rgb = image.pixel(x, y);
+      raster.at(x, y, 0) = static_cast<uint8_t>(qRed(rgb));
+      if (samplesPerPixel == 3) {
+        raster.at(x, y, 1) = static_cast<uint8_t>(qGreen(rgb));
+        raster.at(x, y, 2) = static_cast<uint8_t>(qBlue(rgb));
+      }
+    }
+  }
+  return raster;
+}
+
+bool fuzzyEqual(const Raster& raster1, const Raster& raster2, const int tolerance) {
+  if ((raster1.width != raster2.width) || (raster1.height != raster2.height)
+      || (raster1.samplesPerPixel != raster2.samplesPerPixel)) {
+    return false;
+  }
+  for (size_t i = 0; i < raster1.data.size(); ++i) {
+    if (std::abs(int(raster1.data[i]) - int(raster2.data[i])) > tolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+enum Layout { STRIPS, TILES };
+
+/**
+ * Writes the current directory.  Strips and tiles are deliberately
+ * not aligned with the regions read by the tests.
+ */
+void writeDirectory(TIFF* tif, const Raster& raster, const Layout layout, const uint32 subfileType = 0) {
+  TIFFSetField(tif, TIFFTAG_SUBFILETYPE, subfileType);
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, raster.width);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, raster.height);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, raster.samplesPerPixel);
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, raster.samplesPerPixel == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+
+  if (layout == STRIPS) {
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 7);
+    for (int y = 0; y < raster.height; ++y) {
+      BOOST_REQUIRE(TIFFWriteScanline(tif, const_cast<uint8_t*>(raster.line(y)), y, 0) >= 0);
+    }
+  } else {
+    const int tileSize = 16;
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, tileSize);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, tileSize);
+    std::vector<uint8_t> tile(tileSize * tileSize * raster.samplesPerPixel);
+    for (int tileY = 0; tileY < raster.height; tileY += tileSize) {
+      for (int tileX = 0; tileX < raster.width; tileX += tileSize) {
+        std::fill(tile.begin(), tile.end(), 0);
+        for (int y = tileY; y < std::min(tileY + tileSize, raster.height); ++y) {
+          for (int x = tileX; x < std::min(tileX + tileSize, raster.width); ++x) {
+            for (int c = 0; c < raster.samplesPerPixel; ++c) {
+              tile[((y - tileY) * tileSize + (x - tileX)) * raster.samplesPerPixel + c] = raster.at(x, y, c);
+            }
+          }
+        }
+        BOOST_REQUIRE(TIFFWriteTile(tif, tile.data(), tileX, tileY, 0, 0) >= 0);
+      }
+    }
+  }
+  BOOST_REQUIRE(TIFFWriteDirectory(tif));
+}
+
+QImage readImage(const QString& path, const int pageNum, const QRect& roi = QRect(), const int reductionFactor = 0) {
+  QFile file(path);
+  BOOST_REQUIRE(file.open(QIODevice::ReadOnly));
+  if (reductionFactor == 0) {
+    return TiffReader::readImage(file, pageNum);
+  }
+  return TiffReader::readImage(file, pageNum, roi, reductionFactor);
+}
+
+/**
+ * Checks reading regions of a page against decoding all of it and then cropping and downscaling.
+ */
+void checkRegionsAgainstFullDecode(const QString& path, const int pageNum, const Raster& written) {
+  const Raster full(fromImage(readImage(path, pageNum), written.samplesPerPixel));
+  BOOST_REQUIRE(fuzzyEqual(full, written, 0));
+
+  const QRect fullRect(0, 0, written.width, written.height);
+  const QRect rois[]
+      = {QRect(), QRect(3, 5, 37, 29), QRect(17, 1, 1, 40), QRect(0, 33, 71, 9), QRect(50, 40, 100, 100)};
+  const int factors[] = {1, 2, 3, 5};
+  for (const QRect& roi : rois) {
+    const QRect region(roi.isNull() ? fullRect : roi.intersected(fullRect));
+    for (const int factor : factors) {
+      const QImage image(readImage(path, pageNum, roi, factor));
+      BOOST_REQUIRE(!image.isNull());
+      BOOST_CHECK(fuzzyEqual(fromImage(image, written.samplesPerPixel), downscale(crop(full, region), factor), 0));
+    }
+  }
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(TiffReaderTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_regions_of_strips) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString path(QDir(dir.path()).absoluteFilePath("strips.tif"));
+  const Raster gray(randomRaster(71, 43, 1));
+  const Raster color(randomRaster(66, 50, 3));
+  {
+    TIFF* tif = TIFFOpen(path.toLocal8Bit().constData(), "w");
+    BOOST_REQUIRE(tif);
+    writeDirectory(tif, gray, STRIPS);
+    writeDirectory(tif, color, STRIPS);
+    TIFFClose(tif);
+  }
+
+  checkRegionsAgainstFullDecode(path, 0, gray);
+  checkRegionsAgainstFullDecode(path, 1, color);
+}
+
+BOOST_AUTO_TEST_CASE(test_regions_of_tiles) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString path(QDir(dir.path()).absoluteFilePath("tiles.tif"));
+  const Raster gray(randomRaster(71, 43, 1));
+  const Raster color(randomRaster(66, 50, 3));
+  {
+    TIFF* tif = TIFFOpen(path.toLocal8Bit().constData(), "w");
+    BOOST_REQUIRE(tif);
+    writeDirectory(tif, gray, TILES);
+    writeDirectory(tif, color, TILES);
+    TIFFClose(tif);
+  }
+
+  checkRegionsAgainstFullDecode(path, 0, gray);
+  checkRegionsAgainstFullDecode(path, 1, color);
+}
+
+BOOST_AUTO_TEST_CASE(test_reduced_subfiles) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString path(QDir(dir.path()).absoluteFilePath("subfiles.tif"));
+
+  // Reduced subfiles are made different from their pages, so that reading the wrong one gets noticed.
+  // Page 0 has a SubIFD reduced 2 times, while page 1 is followed by a directory reduced 4 times.
+  const Raster page0(randomRaster(90, 64, 1));
+  const Raster page0Reduced(invert(downscale(page0, 2)));
+  const Raster page1(randomRaster(100, 60, 3));
+  const Raster page1Reduced(invert(downscale(page1, 4)));
+  {
+    TIFF* tif = TIFFOpen(path.toLocal8Bit().constData(), "w");
+    BOOST_REQUIRE(tif);
+    // The next directory written becomes the SubIFD.
+    toff_t subIfdOffsets[1] = {0};
+    TIFFSetField(tif, TIFFTAG_SUBIFD, 1, subIfdOffsets);
+    writeDirectory(tif, page0, STRIPS);
+    writeDirectory(tif, page0Reduced, TILES, FILETYPE_REDUCEDIMAGE);
+    writeDirectory(tif, page1, TILES);
+    writeDirectory(tif, page1Reduced, STRIPS, FILETYPE_REDUCEDIMAGE);
+    TIFFClose(tif);
+  }
+
+  // Without reduction, the pages themselves are read.
+  BOOST_CHECK(fuzzyEqual(fromImage(readImage(path, 0), 1), page0, 0));
+  const QRect roi(5, 3, 31, 22);
+  BOOST_CHECK(fuzzyEqual(fromImage(readImage(path, 0, roi, 1), 1), crop(page0, roi), 0));
+  BOOST_CHECK(fuzzyEqual(fromImage(readImage(path, 1, QRect(), 1), 3), page1, 0));
+
+  // The regions are mapped to the subfile pixels covering them.
+  BOOST_CHECK(fuzzyEqual(fromImage(readImage(path, 0, roi, 2), 1), crop(page0Reduced, QRect(2, 1, 16, 12)), 0));
+  BOOST_CHECK(fuzzyEqual(fromImage(readImage(path, 1, roi, 4), 3), crop(page1Reduced, QRect(1, 0, 8, 7)), 0));
+
+  // What the subfile doesn't reduce is reduced by averaging.
+  const Raster page1ReducedDecoded(fromImage(readImage(path, 2), 3));
+  BOOST_REQUIRE(fuzzyEqual(page1ReducedDecoded, page1Reduced, 0));
+  BOOST_CHECK(fuzzyEqual(fromImage(readImage(path, 1, roi, 8), 3),
+                         downscale(crop(page1ReducedDecoded, QRect(1, 0, 8, 7)), 2), 0));
+
+  // Only the directory of the requested page is looked at.
+  BOOST_CHECK(ImageLoader::readSize(ImageId(path, 1)) == QSize(90, 64));
+  BOOST_CHECK(ImageLoader::readSize(ImageId(path, 2)) == QSize(100, 60));
+  BOOST_CHECK(ImageLoader::readSize(ImageId(path, 4)).isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(test_image_loader_regions) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString tiffPath(QDir(dir.path()).absoluteFilePath("page.tif"));
+  const Raster color(randomRaster(66, 50, 3));
+  {
+    TIFF* tif = TIFFOpen(tiffPath.toLocal8Bit().constData(), "w");
+    BOOST_REQUIRE(tif);
+    writeDirectory(tif, color, TILES);
+    TIFFClose(tif);
+  }
+
+  const QRect roi(3, 5, 37, 29);
+  const QImage fromTiff(ImageLoader::load(ImageId(tiffPath), roi, 3));
+  BOOST_REQUIRE(!fromTiff.isNull());
+  BOOST_CHECK(fuzzyEqual(fromImage(fromTiff, 3), downscale(crop(color, roi), 3), 0));
+
+  // Other formats are clipped and scaled by Qt.
+  const QString pngPath(QDir(dir.path()).absoluteFilePath("page.png"));
+  QImage full(readImage(tiffPath, 0));
+  full.setDotsPerMeterX(12000);
+  full.setDotsPerMeterY(6000);
+  BOOST_REQUIRE(full.save(pngPath));
+  BOOST_CHECK(ImageLoader::readSize(ImageId(pngPath)) == full.size());
+
+  const QImage fromPng(ImageLoader::load(ImageId(pngPath), roi, 3));
+  const QImage expected(full.copy(roi).scaled(QSize(13, 10), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+  BOOST_REQUIRE(fromPng.size() == expected.size());
+  BOOST_CHECK(fuzzyEqual(fromImage(fromPng, 3), fromImage(expected, 3), 1));
+  BOOST_CHECK_EQUAL(fromPng.dotsPerMeterX(), qRound(12000 * 13 / 37.0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
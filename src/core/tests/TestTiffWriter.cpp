@@ -0,0 +1,234 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ApplicationSettings.h>
+#include <TiffWriter.h>
+#include <imageproc/tests/Utils.h>
+#include <tiffio.h>
+
+#include <QDir>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QVector>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace Tests {
+using imageproc::tests::utils::TestParallelForExecutor;
+
+namespace {
+/**
+ * Restores the TIFF settings of ApplicationSettings changed by a test.
+ */
+class TiffSettingsGuard {
+ public:
+  TiffSettingsGuard()
+      : m_settings(ApplicationSettings::getInstance()),
+        m_bwCompression(m_settings.getTiffBwCompression()),
+        m_colorCompression(m_settings.getTiffColorCompression()),
+        m_rowsPerStrip(m_settings.getTiffRowsPerStrip()),
+        m_deflatePredictor(m_settings.isTiffDeflatePredictorEnabled()) {}
+
+  ~TiffSettingsGuard() {
+    m_settings.setTiffBwCompression(m_bwCompression);
+    m_settings.setTiffColorCompression(m_colorCompression);
+    m_settings.setTiffRowsPerStrip(m_rowsPerStrip);
+    m_settings.setTiffDeflatePredictorEnabled(m_deflatePredictor);
+  }
+
+ private:
+  ApplicationSettings& m_settings;
+  const int m_bwCompression;
+  const int m_colorCompression;
+  const int m_rowsPerStrip;
+  const bool m_deflatePredictor;
+};
+
+QImage randomImage(const int width, const int height, const QImage::Format format) {
+  QImage image(width, height, format);
+  for (int y = 0; y < height; ++y) {
+    uint8_t* line = image.scanLine(y);
+    for (int i = 0; i < image.bytesPerLine(); ++i) {
+      line[i] = static_cast<uint8_t>(rand() % 256);
+    }
+  }
+  if (format == QImage::Format_Indexed8) {
+    QVector<QRgb> grayTable(256);
+    for (int i = 0; i < 256; ++i) {
+      grayTable[i] = qRgb(i, i, i);
+    }
+    image.setColorTable(grayTable);
+  } else if ((format == QImage::Format_Mono) || (format == QImage::Format_MonoLSB)) {
+    image.setColorTable({qRgb(0, 0, 0), qRgb(255, 255, 255)});
+    // Uncompressed lines are stored as they are, including the bits past the right edge.
+    const int numEdgeBits = width % 8;
+    if (numEdgeBits != 0) {
+      const auto mask = static_cast<uint8_t>((format == QImage::Format_Mono) ? 0xff00 >> numEdgeBits
+                                                                             : 0xff >> (8 - numEdgeBits));
+      for (int y = 0; y < height; ++y) {
+        image.scanLine(y)[width / 8] &= mask;
+      }
+    }
+  }
+  return image;
+}
+
+/**
+ * The samples of a line the way they are stored in a TIFF file: RGB(A) or gray bytes,
+ * or the bits of palette indices, most significant bit first.
+ */
+std::vector<uint8_t> expectedLine(const QImage& image, const int y) {
+  std::vector<uint8_t> line;
+  const int width = image.width();
+  switch (image.format()) {
+    case QImage::Format_Mono:
+    case QImage::Format_MonoLSB:
+      line.resize(static_cast<size_t>((width + 7) / 8), 0);
+      for (int x = 0; x < width; ++x) {
+        if (image.pixelIndex(x, y) != 0) {
+          line[x / 8] |= static_cast<uint8_t>(0x80 >> (x % 8));
+        }
+      }
+      break;
+    case QImage::Format_Indexed8:
+      line.assign(image.scanLine(y), image.scanLine(y) + width);
+      break;
+    default:
+      for (int x = 0; x < width; ++x) {
+        const QRgb rgb = image.pixel(x, y);
+        line.push_back(static_cast<uint8_t>(qRed(rgb)));
+        line.push_back(static_cast<uint8_t>(qGreen(rgb)));
+        line.push_back(static_cast<uint8_t>(qBlue(rgb)));
+        if (image.hasAlphaChannel()) {
+          line.push_back(static_cast<uint8_t>(qAlpha(rgb)));
+        }
+      }
+  }
+  return line;
+}
+
+/**
+ * Decodes a file written by TiffWriter with libtiff and compares it with \p image.
+ *
+ * \return The maximum difference between the samples, or -1 if the layouts don't match.
+ */
+int compareWithFile(const QString& path, const QImage& image, const int expectedRowsPerStrip) {
+  TIFF* tif = TIFFOpen(path.toLocal8Bit().constData(), "r");
+  BOOST_REQUIRE(tif);
+
+  uint32 width = 0;
+  uint32 height = 0;
+  uint32 rowsPerStrip = 0;
+  TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+  TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+  const auto numStrips = static_cast<int>(TIFFNumberOfStrips(tif));
+
+  int maxDiff = -1;
+  if ((int(width) == image.width()) && (int(height) == image.height()) && (int(rowsPerStrip) == expectedRowsPerStrip)
+      && (numStrips == (image.height() + expectedRowsPerStrip - 1) / expectedRowsPerStrip)) {
+    maxDiff = 0;
+    std::vector<uint8_t> line(static_cast<size_t>(TIFFScanlineSize(tif)));
+    for (int y = 0; y < image.height(); ++y) {
+      const std::vector<uint8_t> expected(expectedLine(image, y));
+      if ((line.size() != expected.size()) || (TIFFReadScanline(tif, line.data(), uint32(y), 0) < 0)) {
+        maxDiff = -1;
+        break;
+      }
+      for (size_t i = 0; i < line.size(); ++i) {
+        maxDiff = std::max(maxDiff, std::abs(int(line[i]) - int(expected[i])));
+      }
+    }
+  }
+  TIFFClose(tif);
+  return maxDiff;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(TiffWriterTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_lossless_round_trip) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString path(QDir(dir.path()).absoluteFilePath("image.tif"));
+  const TiffSettingsGuard settingsGuard;
+  const TestParallelForExecutor executor(8, true);
+  ApplicationSettings& settings = ApplicationSettings::getInstance();
+
+  srand(1);
+  const QImage images[] = {randomImage(61, 47, QImage::Format_RGB32), randomImage(61, 47, QImage::Format_ARGB32),
+                           randomImage(61, 47, QImage::Format_Indexed8)};
+  const int compressions[] = {COMPRESSION_NONE, COMPRESSION_LZW, COMPRESSION_ADOBE_DEFLATE, COMPRESSION_PACKBITS};
+  for (const QImage& image : images) {
+    for (const int compression : compressions) {
+      for (const bool predictor : {false, true}) {
+        // The default strips of about 256 KiB hold all the rows of these images.
+        for (const int rowsPerStrip : {0, 1, 7}) {
+          settings.setTiffColorCompression(compression);
+          settings.setTiffDeflatePredictorEnabled(predictor);
+          settings.setTiffRowsPerStrip(rowsPerStrip);
+          BOOST_REQUIRE(TiffWriter::writeImage(path, image));
+          BOOST_CHECK_EQUAL(compareWithFile(path, image, (rowsPerStrip == 0) ? image.height() : rowsPerStrip), 0);
+        }
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_bitonal_round_trip) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString path(QDir(dir.path()).absoluteFilePath("image.tif"));
+  const TiffSettingsGuard settingsGuard;
+  const TestParallelForExecutor executor(8, true);
+  ApplicationSettings& settings = ApplicationSettings::getInstance();
+
+  srand(1);
+  const QImage images[] = {randomImage(61, 47, QImage::Format_Mono), randomImage(61, 47, QImage::Format_MonoLSB)};
+  const int compressions[] = {COMPRESSION_NONE, COMPRESSION_CCITTFAX4, COMPRESSION_LZW};
+  for (const QImage& image : images) {
+    for (const int compression : compressions) {
+      for (const int rowsPerStrip : {0, 7}) {
+        settings.setTiffBwCompression(compression);
+        settings.setTiffRowsPerStrip(rowsPerStrip);
+        BOOST_REQUIRE(TiffWriter::writeImage(path, image));
+        BOOST_CHECK_EQUAL(compareWithFile(path, image, (rowsPerStrip == 0) ? image.height() : rowsPerStrip), 0);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_jpeg_strips_are_whole_mcu_rows) {
+  if (!TIFFIsCODECConfigured(COMPRESSION_JPEG)) {
+    BOOST_TEST_MESSAGE("libtiff is built without JPEG support");
+    return;
+  }
+
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString path(QDir(dir.path()).absoluteFilePath("image.tif"));
+  const TiffSettingsGuard settingsGuard;
+  const TestParallelForExecutor executor(8, true);
+  ApplicationSettings& settings = ApplicationSettings::getInstance();
+
+  // Smooth enough to survive lossy compression almost unchanged.
+  QImage image(70, 50, QImage::Format_RGB32);
+  for (int y = 0; y < image.height(); ++y) {
+    for (int x = 0; x < image.width(); ++x) {
+      image.setPixel(x, y, qRgb(2 * x, 3 * y, 100 + x + y));
+    }
+  }
+
+  settings.setTiffColorCompression(COMPRESSION_JPEG);
+  settings.setTiffRowsPerStrip(7);
+  BOOST_REQUIRE(TiffWriter::writeImage(path, image));
+  const int maxDiff = compareWithFile(path, image, 16);
+  BOOST_CHECK(maxDiff >= 0);
+  BOOST_CHECK(maxDiff <= 8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace Tests
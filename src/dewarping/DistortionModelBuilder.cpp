@@ -6,12 +6,16 @@
 #include <QDebug>
 #include <QImage>
 #include <QPainter>
+#include <algorithm>
+#include <atomic>
 #include <boost/foreach.hpp>
+#include <cmath>
 
 #include "CylindricalSurfaceDewarper.h"
 #include "DebugImages.h"
 #include "DistortionModel.h"
 #include "LineBoundedByRect.h"
+#include "ParallelFor.h"
 #include "SidesOfLine.h"
 #include "ToLineProjector.h"
 #include "spfit/ConstraintSet.h"
@@ -51,22 +55,52 @@ struct DistortionModelBuilder::RansacModel {
 
 class DistortionModelBuilder::RansacAlgo {
  public:
-  explicit RansacAlgo(const std::vector<TracedCurve>& allCurves) : m_allCurves(allCurves) {}
-
-  void buildAndAssessModel(const TracedCurve* topCurve, const TracedCurve* bottomCurve);
-
-  RansacModel& bestModel() { return m_bestModel; }
+  RansacAlgo(const std::vector<TracedCurve>& allCurves, const Vec2d& downDirection)
+      : m_allCurves(allCurves), m_unitDownDirection(downDirection / std::sqrt(downDirection.squaredNorm())) {}
+
+  /**
+   * Queues a pair of curves for assessCandidates().  Pairs already queued,
+   * pairs that can't form a valid model and pairs whose ends aren't
+   * far enough apart are dropped right away.
+   */
+  void addCandidate(const TracedCurve* topCurve, const TracedCurve* bottomCurve);
+
+  /**
+   * Assesses the queued candidates in parallel.  Among the ones with
+   * the lowest error, the one queued first becomes the best model,
+   * no matter which of them finished first.
+   */
+  void assessCandidates();
 
   const RansacModel& bestModel() const { return m_bestModel; }
 
  private:
+  /**
+   * \return The total error of the model, or NumericTraits<double>::max() if
+   *         the model couldn't be built or its error was found to exceed \p errorBound.
+   */
+  double assessModel(const TracedCurve* topCurve,
+                     const TracedCurve* bottomCurve,
+                     const std::atomic<double>& errorBound) const;
+
   double calcReferenceHeight(const CylindricalSurfaceDewarper& dewarper, const QPointF& loc);
 
+  /**
+   * The minimum distance between the ends of the top and the bottom curve,
+   * measured downwards.
+   */
+  static const double MIN_END_SEPARATION;
+
   RansacModel m_bestModel;
   const std::vector<TracedCurve>& m_allCurves;
+  Vec2d m_unitDownDirection;
+  std::vector<std::pair<const TracedCurve*, const TracedCurve*>> m_candidates;
 };
 
 
+const double DistortionModelBuilder::RansacAlgo::MIN_END_SEPARATION = 1.0;
+
+
 class DistortionModelBuilder::BadCurve : public std::exception {
  public:
   const char* what() const noexcept override { return "Bad curve"; }
@@ -144,14 +178,14 @@ DistortionModel DistortionModelBuilder::tryBuildModel(DebugImages* dbg, const QI
   std::sort(orderedCurves.begin(), orderedCurves.end());
 
   // Select the best pair using RANSAC.
-  RansacAlgo ransac(orderedCurves);
+  RansacAlgo ransac(orderedCurves, m_downDirection);
 
   // First let's try to combine each of the 3 top-most lines
   // with each of the 3 bottom-most ones.
   for (int i = 0; i < std::min<int>(3, numCurves); ++i) {
     for (int j = std::max<int>(0, numCurves - 3); j < numCurves; ++j) {
       if (i < j) {
-        ransac.buildAndAssessModel(&orderedCurves[i], &orderedCurves[j]);
+        ransac.addCandidate(&orderedCurves[i], &orderedCurves[j]);
       }
     }
   }
@@ -165,9 +199,10 @@ DistortionModel DistortionModelBuilder::tryBuildModel(DebugImages* dbg, const QI
       std::swap(i, j);
     }
     if (i < j) {
-      ransac.buildAndAssessModel(&orderedCurves[i], &orderedCurves[j]);
+      ransac.addCandidate(&orderedCurves[i], &orderedCurves[j]);
     }
   }
+  ransac.assessCandidates();
 
   if (dbg && dbgBackground) {
     dbg->add(visualizeTrimmedPolylines(*dbgBackground, orderedCurves), "trimmed_polylines");
@@ -398,8 +433,14 @@ XSpline DistortionModelBuilder::fitExtendedSpline(const std::vector<QPointF>& po
 
 /*============================== RansacAlgo ============================*/
 
-void DistortionModelBuilder::RansacAlgo::buildAndAssessModel(const TracedCurve* topCurve,
-                                                             const TracedCurve* bottomCurve) try {
+void DistortionModelBuilder::RansacAlgo::addCandidate(const TracedCurve* topCurve, const TracedCurve* bottomCurve) {
+  const std::pair<const TracedCurve*, const TracedCurve*> candidate(topCurve, bottomCurve);
+  if (std::find(m_candidates.begin(), m_candidates.end(), candidate) != m_candidates.end()) {
+    // A repeated pair would get the same error, and the first one wins ties anyway.
+    return;
+  }
+
+  // Checking the geometry of the endpoints is much cheaper than building a dewarper.
   DistortionModel model;
   model.setTopCurve(Curve(topCurve->extendedPolyline));
   model.setBottomCurve(Curve(bottomCurve->extendedPolyline));
@@ -407,6 +448,49 @@ void DistortionModelBuilder::RansacAlgo::buildAndAssessModel(const TracedCurve*
     return;
   }
 
+  // The curves are ordered by their centroids, which doesn't stop them from
+  // touching or crossing near the bounds.  A dewarper built from such a pair
+  // would squeeze the page to nothing there, or turn it upside down.
+  const std::vector<QPointF>& topPolyline = topCurve->extendedPolyline;
+  const std::vector<QPointF>& bottomPolyline = bottomCurve->extendedPolyline;
+  const double frontSeparation = Vec2d(bottomPolyline.front() - topPolyline.front()).dot(m_unitDownDirection);
+  const double backSeparation = Vec2d(bottomPolyline.back() - topPolyline.back()).dot(m_unitDownDirection);
+  if ((frontSeparation < MIN_END_SEPARATION) || (backSeparation < MIN_END_SEPARATION)) {
+    return;
+  }
+  m_candidates.push_back(candidate);
+}
+
+void DistortionModelBuilder::RansacAlgo::assessCandidates() {
+  // The lowest error of the models assessed so far.  Whichever models that is,
+  // a model whose partial error already exceeds it can't be the best one,
+  // so giving up on it doesn't depend on the order the models are assessed in.
+  std::atomic<double> errorBound(m_bestModel.totalError);
+
+  std::vector<double> errors(m_candidates.size());
+  parallelFor(static_cast<int>(m_candidates.size()), [&](const int i) {
+    const double error = assessModel(m_candidates[i].first, m_candidates[i].second, errorBound);
+    errors[i] = error;
+
+    double bound = errorBound.load();
+    while ((error < bound) && !errorBound.compare_exchange_weak(bound, error)) {
+      // bound has been reloaded, try again.
+    }
+  });
+
+  for (size_t i = 0; i < m_candidates.size(); ++i) {
+    if (errors[i] < m_bestModel.totalError) {
+      m_bestModel.topCurve = m_candidates[i].first;
+      m_bestModel.bottomCurve = m_candidates[i].second;
+      m_bestModel.totalError = errors[i];
+    }
+  }
+  m_candidates.clear();
+}
+
+double DistortionModelBuilder::RansacAlgo::assessModel(const TracedCurve* topCurve,
+                                                       const TracedCurve* bottomCurve,
+                                                       const std::atomic<double>& errorBound) const try {
   const double depthPerception = 2.0;  // Doesn't matter much here.
   const CylindricalSurfaceDewarper dewarper(topCurve->extendedPolyline, bottomCurve->extendedPolyline, depthPerception);
 
@@ -463,16 +547,17 @@ void DistortionModelBuilder::RansacAlgo::buildAndAssessModel(const TracedCurve*
       // Strictly vertical line?
       error += 1000;
     }
-  }
 
-  if (error < m_bestModel.totalError) {
-    m_bestModel.topCurve = topCurve;
-    m_bestModel.bottomCurve = bottomCurve;
-    m_bestModel.totalError = error;
+    // Errors only accumulate, so this model is already worse than another one.
+    if (error > errorBound.load(std::memory_order_relaxed)) {
+      return NumericTraits<double>::max();
+    }
   }
-}  // DistortionModelBuilder::RansacAlgo::buildAndAssessModel
+  return error;
+}  // DistortionModelBuilder::RansacAlgo::assessModel
 catch (const std::runtime_error&) {
   // Probably CylindricalSurfaceDewarper didn't like something.
+  return NumericTraits<double>::max();
 }
 
 #if 0
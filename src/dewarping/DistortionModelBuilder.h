@@ -65,6 +65,11 @@ class DistortionModelBuilder {
   /**
    * \brief Tries to build a distortion model based on information provided so far.
    *
+   * The model is made of two of the curves.  A pair of curves is only considered if,
+   * at both ends, the lower one is at least a pixel below the upper one.  Curves
+   * are ordered by their centroids, so a pair crossing twice has its ends swapped
+   * and would give an upside-down model.
+   *
    * \return A DistortionModel that may be invalid.
    * \see DistortionModel::isValid()
    */
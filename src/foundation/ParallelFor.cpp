@@ -0,0 +1,139 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ParallelFor.h"
+
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "NonCopyable.h"
+
+namespace {
+class Job {
+  DECLARE_NON_COPYABLE(Job)
+
+ public:
+  Job(const int count, const VirtualFunction<void, int>& body)
+      : m_body(body), m_count(count), m_nextIndex(0), m_failed(false), m_numHelpers(0) {}
+
+  void work() {
+    while (!m_failed.load(std::memory_order_relaxed)) {
+      const int i = m_nextIndex.fetch_add(1, std::memory_order_relaxed);
+      if (i >= m_count) {
+        break;
+      }
+
+      try {
+        m_body(i);
+      } catch (...) {
+        const QMutexLocker locker(&m_mutex);
+        if (!m_error) {
+          m_error = std::current_exception();
+        }
+        m_failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void helperStarting() {
+    const QMutexLocker locker(&m_mutex);
+    ++m_numHelpers;
+  }
+
+  void helperFinished() {
+    const QMutexLocker locker(&m_mutex);
+    --m_numHelpers;
+    m_helperFinished.wakeAll();
+  }
+
+  void waitForHelpers() {
+    const QMutexLocker locker(&m_mutex);
+    while (m_numHelpers > 0) {
+      m_helperFinished.wait(&m_mutex);
+    }
+  }
+
+  void rethrowIfFailed() const {
+    if (m_error) {
+      std::rethrow_exception(m_error);
+    }
+  }
+
+ private:
+  const VirtualFunction<void, int>& m_body;
+  const int m_count;
+  std::atomic<int> m_nextIndex;
+  std::atomic<bool> m_failed;
+  QMutex m_mutex;
+  QWaitCondition m_helperFinished;
+  int m_numHelpers;
+  std::exception_ptr m_error;
+};
+
+
+class Helper : public QRunnable {
+ public:
+  explicit Helper(Job& job) : m_job(job) { setAutoDelete(true); }
+
+  void run() override {
+    m_job.work();
+    m_job.helperFinished();
+  }
+
+ private:
+  Job& m_job;
+};
+
+
+QReadWriteLock executorLock;
+ParallelForExecutor* executor = nullptr;
+}  // namespace
+
+void setParallelForExecutor(ParallelForExecutor* const newExecutor) {
+  const QWriteLocker locker(&executorLock);
+  executor = newExecutor;
+}
+
+void parallelForImpl(const int count, const VirtualFunction<void, int>& body) {
+  if (count <= 0) {
+    return;
+  }
+  if (count == 1) {
+    body(0);
+    return;
+  }
+
+  Job job(count, body);
+
+  {
+    const QReadLocker locker(&executorLock);
+    QThreadPool* const pool = QThreadPool::globalInstance();
+    const int maxThreads = executor ? executor->maxThreadCount() : pool->maxThreadCount();
+    const int maxHelpers = std::min(count, maxThreads) - 1;
+    for (int i = 0; i < maxHelpers; ++i) {
+      job.helperStarting();
+      auto* helper = new Helper(job);
+      if (!(executor ? executor->tryStart(helper) : pool->tryStart(helper))) {
+        // No idle threads left.  Ownership isn't taken in this case.
+        delete helper;
+        job.helperFinished();
+        break;
+      }
+    }
+  }
+
+  job.work();
+  job.waitForHelpers();
+  job.rethrowIfFailed();
+}
+
+int parallelForMaxThreads() {
+  const QReadLocker locker(&executorLock);
+  return std::max(1, executor ? executor->maxThreadCount() : QThreadPool::globalInstance()->maxThreadCount());
+}
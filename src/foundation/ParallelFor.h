@@ -0,0 +1,74 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_FOUNDATION_PARALLELFOR_H_
+#define SCANTAILOR_FOUNDATION_PARALLELFOR_H_
+
+#include "VirtualFunction.h"
+
+class QRunnable;
+
+/**
+ * \brief Supplies the threads helping parallelFor() callers.
+ *
+ * Without an executor installed, idle threads of the global QThreadPool are used.
+ */
+class ParallelForExecutor {
+ public:
+  virtual ~ParallelForExecutor() = default;
+
+  /**
+   * \brief Runs \p runnable on an idle thread, if there is one.
+   *
+   * The runnable must never be queued behind busy threads.  The ownership
+   * rules are those of QThreadPool::tryStart().
+   *
+   * \return true if the runnable was started.
+   */
+  virtual bool tryStart(QRunnable* runnable) = 0;
+
+  /**
+   * \brief The maximum number of threads that may work on a parallelFor() call,
+   *        including the calling one.
+   */
+  virtual int maxThreadCount() const = 0;
+};
+
+/**
+ * \brief Makes parallelFor() recruit its helpers from \p executor.
+ *
+ * Passing nullptr restores the default.  Once this function returns,
+ * the previous executor won't be asked to start anything anymore.
+ */
+void setParallelForExecutor(ParallelForExecutor* executor);
+
+/**
+ * \brief Calls body(i) for every i in [0, count), possibly in parallel.
+ *
+ * The calling thread takes part in the work, while idle threads of
+ * the current ParallelForExecutor are recruited to help.  Nothing is ever queued
+ * behind busy threads, so nested or concurrent calls can't deadlock,
+ * they just degrade to running on the calling thread.
+ *
+ * If a call to \p body throws, the indices not yet started are skipped
+ * and the first exception is rethrown once the running calls finish.
+ *
+ * \p body will be called like this: body(i);
+ */
+template <typename Body>
+void parallelFor(int count, Body body);
+
+void parallelForImpl(int count, const VirtualFunction<void, int>& body);
+
+/**
+ * \brief The maximum number of threads parallelFor() would use, including the calling one.
+ */
+int parallelForMaxThreads();
+
+
+template <typename Body>
+void parallelFor(const int count, Body body) {
+  parallelForImpl(count, ProxyFunction<Body, void, int>(body));
+}
+
+#endif  // ifndef SCANTAILOR_FOUNDATION_PARALLELFOR_H_
@@ -6,8 +6,7 @@
 #include <QDebug>
 
 void PerformanceTimer::print(const char* prefix) {
-  const clock_t now = clock();
-  const double sec = double(now - m_start) / CLOCKS_PER_SEC;
+  const double sec = elapsedSec();
   if (sec > 10.0) {
     qDebug() << prefix << (long) sec << " sec";
   } else if (sec > 0.01) {
@@ -16,3 +15,7 @@ void PerformanceTimer::print(const char* prefix) {
     qDebug() << prefix << (long) (sec * 1000000) << " usec";
   }
 }
+
+double PerformanceTimer::elapsedSec() const {
+  return std::chrono::duration<double>(Clock::now() - m_start).count();
+}
@@ -4,16 +4,26 @@
 #ifndef SCANTAILOR_FOUNDATION_PERFORMANCETIMER_H_
 #define SCANTAILOR_FOUNDATION_PERFORMANCETIMER_H_
 
-#include <ctime>
+#include <chrono>
 
+/**
+ * \brief Measures wall-clock time, as many of the algorithms run on several threads.
+ */
 class PerformanceTimer {
  public:
-  PerformanceTimer() : m_start(clock()) {}
+  PerformanceTimer() : m_start(Clock::now()) {}
 
   void print(const char* prefix = "");
 
+  /**
+   * \brief The time passed since construction, in seconds.
+   */
+  double elapsedSec() const;
+
  private:
-  const clock_t m_start;
+  using Clock = std::chrono::steady_clock;
+
+  const Clock::time_point m_start;
 };
 
 
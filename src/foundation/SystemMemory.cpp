@@ -0,0 +1,82 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "SystemMemory.h"
+
+#include <QtGlobal>
+#include <limits>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+// windows.h has to come first.
+#include <psapi.h>
+#elif defined(Q_OS_MACOS)
+#include <mach/mach.h>
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#else
+#include <unistd.h>
+
+#include <cstdio>
+#endif
+
+size_t SystemMemory::totalPhysicalMemory() {
+  unsigned long long bytes = 0;
+#if defined(Q_OS_WIN)
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (GlobalMemoryStatusEx(&status)) {
+    bytes = status.ullTotalPhys;
+  }
+#elif defined(Q_OS_MACOS)
+  int64_t memSize = 0;
+  size_t length = sizeof(memSize);
+  if (sysctlbyname("hw.memsize", &memSize, &length, nullptr, 0) == 0) {
+    bytes = static_cast<unsigned long long>(memSize);
+  }
+#else
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long pageSize = sysconf(_SC_PAGESIZE);
+  if ((pages > 0) && (pageSize > 0)) {
+    bytes = static_cast<unsigned long long>(pages) * static_cast<unsigned long long>(pageSize);
+  }
+#endif
+  // More than a 32-bit process can address is as good as unlimited.
+  if (bytes > std::numeric_limits<size_t>::max()) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return static_cast<size_t>(bytes);
+}
+
+size_t SystemMemory::currentResidentSetSize() {
+#if defined(Q_OS_WIN)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return static_cast<size_t>(counters.WorkingSetSize);
+  }
+  return 0;
+#elif defined(Q_OS_MACOS)
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+    return static_cast<size_t>(info.resident_size);
+  }
+  return 0;
+#else
+  // The second field is the number of resident pages.
+  FILE* const file = std::fopen("/proc/self/statm", "r");
+  if (!file) {
+    return 0;
+  }
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  const int numFields = std::fscanf(file, "%lu %lu", &size, &resident);
+  std::fclose(file);
+
+  const long pageSize = sysconf(_SC_PAGESIZE);
+  if ((numFields != 2) || (pageSize <= 0)) {
+    return 0;
+  }
+  return static_cast<size_t>(resident) * static_cast<size_t>(pageSize);
+#endif
+}
@@ -0,0 +1,29 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_FOUNDATION_SYSTEMMEMORY_H_
+#define SCANTAILOR_FOUNDATION_SYSTEMMEMORY_H_
+
+#include <cstddef>
+
+class SystemMemory {
+ public:
+  /**
+   * \brief The amount of physical memory installed, in bytes.
+   *
+   * \return The amount of memory or 0, if it couldn't be determined.
+   */
+  static size_t totalPhysicalMemory();
+
+  /**
+   * \brief The amount of physical memory the current process occupies, in bytes.
+   *
+   * \return The amount of memory or 0, if it couldn't be determined.
+   */
+  static size_t currentResidentSetSize();
+
+  SystemMemory() = delete;
+};
+
+
+#endif  // ifndef SCANTAILOR_FOUNDATION_SYSTEMMEMORY_H_
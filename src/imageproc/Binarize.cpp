@@ -4,14 +4,192 @@
 #include "Binarize.h"
 
 #include <QDebug>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
 
 #include "BinaryImage.h"
 #include "Grayscale.h"
-#include "IntegralImage.h"
+#include "NonCopyable.h"
 
 namespace imageproc {
+namespace {
+/**
+ * \brief Provides the mean and the standard deviation of gray levels
+ *        in a window around every pixel of a row.
+ *
+ * Unlike integral images of the whole image, only the sums over the window rows
+ * are kept for each column, and updated as the window slides down,
+ * so the memory usage is proportional to the image width.
+ * Near the image boundaries, the window is clipped by them.
+ */
+class WindowStats {
+  DECLARE_NON_COPYABLE(WindowStats)
+
+ public:
+  WindowStats(const QImage& gray, QSize windowSize);
+
+  /**
+   * \brief Moves the window to be centered at row \p y.
+   *
+   * Rows have to be visited from top to bottom.
+   */
+  void moveToRow(int y);
+
+  const double* means() const { return m_means.data(); }
+
+  const double* deviations() const { return m_deviations.data(); }
+
+ private:
+  void addRow(int y);
+
+  void subtractRow(int y);
+
+  const uint8_t* m_data;
+  int m_bpl;
+  int m_width;
+  int m_height;
+  int m_windowLowerHalf;
+  int m_windowUpperHalf;
+  int m_windowLeftHalf;
+  int m_windowRightHalf;
+  int m_top;     // The first row included into the column sums.
+  int m_bottom;  // One past the last row included into the column sums.
+  std::vector<uint32_t> m_colSums;
+  std::vector<uint64_t> m_colSqsums;
+  std::vector<double> m_windowSums;
+  std::vector<double> m_windowSqsums;
+  std::vector<int> m_windowWidths;
+  std::vector<double> m_rAreas;  // 1.0 / window area
+  int m_rAreasWindowHeight;      // The window height m_rAreas were computed for.
+  std::vector<double> m_means;
+  std::vector<double> m_deviations;
+};
+
+
+WindowStats::WindowStats(const QImage& gray, const QSize windowSize)
+    : m_data(gray.bits()),
+      m_bpl(gray.bytesPerLine()),
+      m_width(gray.width()),
+      m_height(gray.height()),
+      m_windowLowerHalf(windowSize.height() >> 1),
+      m_windowUpperHalf(windowSize.height() - m_windowLowerHalf),
+      m_windowLeftHalf(windowSize.width() >> 1),
+      m_windowRightHalf(windowSize.width() - m_windowLeftHalf),
+      m_top(0),
+      m_bottom(0),
+      m_colSums(m_width, 0),
+      m_colSqsums(m_width, 0),
+      m_windowSums(m_width),
+      m_windowSqsums(m_width),
+      m_windowWidths(m_width),
+      m_rAreas(m_width),
+      m_rAreasWindowHeight(0),
+      m_means(m_width),
+      m_deviations(m_width) {
+  for (int x = 0; x < m_width; ++x) {
+    const int left = std::max(0, x - m_windowLeftHalf);
+    const int right = std::min(m_width, x + m_windowRightHalf);  // exclusive
+    m_windowWidths[x] = right - left;
+  }
+}
+
+void WindowStats::addRow(const int y) {
+  const uint8_t* line = m_data + m_bpl * y;
+  for (int x = 0; x < m_width; ++x) {
+    const uint32_t pixel = line[x];
+    m_colSums[x] += pixel;
+    m_colSqsums[x] += pixel * pixel;
+  }
+}
+
+void WindowStats::subtractRow(const int y) {
+  const uint8_t* line = m_data + m_bpl * y;
+  for (int x = 0; x < m_width; ++x) {
+    const uint32_t pixel = line[x];
+    m_colSums[x] -= pixel;
+    m_colSqsums[x] -= pixel * pixel;
+  }
+}
+
+void WindowStats::moveToRow(const int y) {
+  const int top = std::max(0, y - m_windowLowerHalf);
+  const int bottom = std::min(m_height, y + m_windowUpperHalf);  // exclusive
+  assert(top >= m_top && bottom >= m_bottom);
+
+  for (; m_bottom < bottom; ++m_bottom) {
+    addRow(m_bottom);
+  }
+  for (; m_top < top; ++m_top) {
+    subtractRow(m_top);
+  }
+
+  // Sums over the window columns.  Sliding the window to the right,
+  // column x + rightHalf - 1 enters it and column x - leftHalf - 1 leaves it.
+  uint64_t sum = 0;
+  uint64_t sqsum = 0;
+  for (int x = 0; x < std::min(m_width, m_windowRightHalf - 1); ++x) {
+    sum += m_colSums[x];
+    sqsum += m_colSqsums[x];
+  }
+  for (int x = 0; x < m_width; ++x) {
+    const int entering = x + m_windowRightHalf - 1;
+    if (entering < m_width) {
+      sum += m_colSums[entering];
+      sqsum += m_colSqsums[entering];
+    }
+    const int leaving = x - m_windowLeftHalf - 1;
+    if (leaving >= 0) {
+      sum -= m_colSums[leaving];
+      sqsum -= m_colSqsums[leaving];
+    }
+    m_windowSums[x] = static_cast<double>(sum);
+    m_windowSqsums[x] = static_cast<double>(sqsum);
+  }
+
+  // The window height only changes near the top and the bottom of the image.
+  const int windowHeight = bottom - top;
+  if (windowHeight != m_rAreasWindowHeight) {
+    m_rAreasWindowHeight = windowHeight;
+    for (int x = 0; x < m_width; ++x) {
+      const int area = windowHeight * m_windowWidths[x];
+      assert(area > 0);  // because windowSize > 0 and w > 0 and h > 0
+      m_rAreas[x] = 1.0 / area;
+    }
+  }
+
+  for (int x = 0; x < m_width; ++x) {
+    const double rArea = m_rAreas[x];
+    const double mean = m_windowSums[x] * rArea;
+    const double sqmean = m_windowSqsums[x] * rArea;
+
+    const double variance = sqmean - mean * mean;
+    m_means[x] = mean;
+    m_deviations[x] = std::sqrt(std::fabs(variance));
+  }
+}  // WindowStats::moveToRow
+
+/**
+ * \brief Writes a row of a binary image, making pixels darker than their thresholds black.
+ */
+void packThresholded(uint32_t* bwLine, const uint8_t* grayLine, const double* thresholds, const int width) {
+  const uint32_t msb = uint32_t(1) << 31;
+  for (int x0 = 0; x0 < width; x0 += 32) {
+    const int count = std::min(32, width - x0);
+    uint32_t word = 0;
+    for (int i = 0; i < count; ++i) {
+      if (int(grayLine[x0 + i]) < thresholds[x0 + i]) {
+        word |= msb >> i;
+      }
+    }
+    bwLine[x0 >> 5] = word;
+  }
+}
+}  // namespace
+
 BinaryImage binarizeOtsu(const QImage& src) {
   return BinaryImage(src, BinaryThreshold::otsuThreshold(src));
 }
@@ -34,66 +212,25 @@ BinaryImage binarizeSauvola(const QImage& src, const QSize windowSize, const dou
   const int w = gray.width();
   const int h = gray.height();
 
-  IntegralImage<uint32_t> integralImage(w, h);
-  IntegralImage<uint64_t> integralSqimage(w, h);
-
-  const uint8_t* grayLine = gray.bits();
-  const int grayBpl = gray.bytesPerLine();
-
-  for (int y = 0; y < h; ++y, grayLine += grayBpl) {
-    integralImage.beginRow();
-    integralSqimage.beginRow();
-    for (int x = 0; x < w; ++x) {
-      const uint32_t pixel = grayLine[x];
-      integralImage.push(pixel);
-      integralSqimage.push(pixel * pixel);
-    }
-  }
-
-  const int windowLowerHalf = windowSize.height() >> 1;
-  const int windowUpperHalf = windowSize.height() - windowLowerHalf;
-  const int windowLeftHalf = windowSize.width() >> 1;
-  const int windowRightHalf = windowSize.width() - windowLeftHalf;
+  WindowStats stats(gray, windowSize);
+  std::vector<double> thresholds(static_cast<size_t>(w));
 
   BinaryImage bwImg(w, h);
   uint32_t* bwLine = bwImg.data();
   const int bwWpl = bwImg.wordsPerLine();
 
-  grayLine = gray.bits();
-  for (int y = 0; y < h; ++y) {
-    const int top = std::max(0, y - windowLowerHalf);
-    const int bottom = std::min(h, y + windowUpperHalf);  // exclusive
+  const uint8_t* grayLine = gray.bits();
+  const int grayBpl = gray.bytesPerLine();
+
+  for (int y = 0; y < h; ++y, grayLine += grayBpl, bwLine += bwWpl) {
+    stats.moveToRow(y);
+    const double* means = stats.means();
+    const double* deviations = stats.deviations();
     for (int x = 0; x < w; ++x) {
-      const int left = std::max(0, x - windowLeftHalf);
-      const int right = std::min(w, x + windowRightHalf);  // exclusive
-      const int area = (bottom - top) * (right - left);
-      assert(area > 0);  // because windowSize > 0 and w > 0 and h > 0
-      const QRect rect(left, top, right - left, bottom - top);
-      const double windowSum = integralImage.sum(rect);
-      const double windowSqsum = integralSqimage.sum(rect);
-
-      const double rArea = 1.0 / area;
-      const double mean = windowSum * rArea;
-      const double sqmean = windowSqsum * rArea;
-
-      const double variance = sqmean - mean * mean;
-      const double deviation = std::sqrt(std::fabs(variance));
-
-      const double threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
-
-      const uint32_t msb = uint32_t(1) << 31;
-      const uint32_t mask = msb >> (x & 31);
-      if (int(grayLine[x]) < threshold) {
-        // black
-        bwLine[x >> 5] |= mask;
-      } else {
-        // white
-        bwLine[x >> 5] &= ~mask;
-      }
+      thresholds[x] = means[x] * (1.0 + k * (deviations[x] / 128.0 - 1.0));
     }
 
-    grayLine += grayBpl;
-    bwLine += bwWpl;
+    packThresholded(bwLine, grayLine, thresholds.data(), w);
   }
   return bwImg;
 }  // binarizeSauvola
@@ -115,60 +252,30 @@ BinaryImage binarizeWolf(const QImage& src,
   const int w = gray.width();
   const int h = gray.height();
 
-  IntegralImage<uint32_t> integralImage(w, h);
-  IntegralImage<uint64_t> integralSqimage(w, h);
-
   const uint8_t* grayLine = gray.bits();
   const int grayBpl = gray.bytesPerLine();
 
+  // The thresholds depend on the global minimum gray level and the maximum deviation.
+  // Rather than storing the window statistics of every pixel, we make two passes.
   uint32_t minGrayLevel = 255;
-
-  for (int y = 0; y < h; ++y, grayLine += grayBpl) {
-    integralImage.beginRow();
-    integralSqimage.beginRow();
-    for (int x = 0; x < w; ++x) {
-      const uint32_t pixel = grayLine[x];
-      integralImage.push(pixel);
-      integralSqimage.push(pixel * pixel);
-      minGrayLevel = std::min(minGrayLevel, pixel);
-    }
-  }
-
-  const int windowLowerHalf = windowSize.height() >> 1;
-  const int windowUpperHalf = windowSize.height() - windowLowerHalf;
-  const int windowLeftHalf = windowSize.width() >> 1;
-  const int windowRightHalf = windowSize.width() - windowLeftHalf;
-
-  std::vector<float> means(w * h, 0);
-  std::vector<float> deviations(w * h, 0);
-
   double maxDeviation = 0;
+  {
+    WindowStats stats(gray, windowSize);
+    for (int y = 0; y < h; ++y, grayLine += grayBpl) {
+      for (int x = 0; x < w; ++x) {
+        minGrayLevel = std::min<uint32_t>(minGrayLevel, grayLine[x]);
+      }
 
-  for (int y = 0; y < h; ++y) {
-    const int top = std::max(0, y - windowLowerHalf);
-    const int bottom = std::min(h, y + windowUpperHalf);  // exclusive
-    for (int x = 0; x < w; ++x) {
-      const int left = std::max(0, x - windowLeftHalf);
-      const int right = std::min(w, x + windowRightHalf);  // exclusive
-      const int area = (bottom - top) * (right - left);
-      assert(area > 0);  // because windowSize > 0 and w > 0 and h > 0
-      const QRect rect(left, top, right - left, bottom - top);
-      const double windowSum = integralImage.sum(rect);
-      const double windowSqsum = integralSqimage.sum(rect);
-
-      const double rArea = 1.0 / area;
-      const double mean = windowSum * rArea;
-      const double sqmean = windowSqsum * rArea;
-
-      const double variance = sqmean - mean * mean;
-      const double deviation = std::sqrt(std::fabs(variance));
-      maxDeviation = std::max(maxDeviation, deviation);
-      means[w * y + x] = (float) mean;
-      deviations[w * y + x] = (float) deviation;
+      stats.moveToRow(y);
+      const double* deviations = stats.deviations();
+      for (int x = 0; x < w; ++x) {
+        maxDeviation = std::max(maxDeviation, deviations[x]);
+      }
     }
   }
 
-  // TODO: integral images can be disposed at this point.
+  WindowStats stats(gray, windowSize);
+  std::vector<double> thresholds(static_cast<size_t>(w));
 
   BinaryImage bwImg(w, h);
   uint32_t* bwLine = bwImg.data();
@@ -176,22 +283,25 @@ BinaryImage binarizeWolf(const QImage& src,
 
   grayLine = gray.bits();
   for (int y = 0; y < h; ++y, grayLine += grayBpl, bwLine += bwWpl) {
+    stats.moveToRow(y);
+    const double* means = stats.means();
+    const double* deviations = stats.deviations();
     for (int x = 0; x < w; ++x) {
-      const float mean = means[y * w + x];
-      const float deviation = deviations[y * w + x];
+      // Statistics used to be stored as floats, and the thresholds are still derived from those.
+      const auto mean = static_cast<float>(means[x]);
+      const auto deviation = static_cast<float>(deviations[x]);
       const double a = 1.0 - deviation / maxDeviation;
-      const double threshold = mean - k * a * (mean - minGrayLevel);
-
-      const uint32_t msb = uint32_t(1) << 31;
-      const uint32_t mask = msb >> (x & 31);
-      if ((grayLine[x] < lowerBound) || ((grayLine[x] <= upperBound) && (int(grayLine[x]) < threshold))) {
-        // black
-        bwLine[x >> 5] |= mask;
-      } else {
-        // white
-        bwLine[x >> 5] &= ~mask;
+      double threshold = mean - k * a * (mean - minGrayLevel);
+      // Gray levels outside of [lowerBound, upperBound] are forced to black or white.
+      if (grayLine[x] < lowerBound) {
+        threshold = 256;
+      } else if (grayLine[x] > upperBound) {
+        threshold = -1;
       }
+      thresholds[x] = threshold;
     }
+
+    packThresholded(bwLine, grayLine, thresholds.data(), w);
   }
   return bwImg;
 }  // binarizeWolf
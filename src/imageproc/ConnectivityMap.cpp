@@ -5,10 +5,13 @@
 
 #include <QDebug>
 #include <QImage>
+#include <algorithm>
 
 #include "BinaryImage.h"
 #include "BitOps.h"
 #include "InfluenceMap.h"
+#include "ParallelFor.h"
+#include "RunLengthComponents.h"
 
 namespace imageproc {
 const uint32_t ConnectivityMap::BACKGROUND = ~uint32_t(0);
@@ -29,8 +32,13 @@ ConnectivityMap::ConnectivityMap(const QSize& size) : m_plainData(nullptr), m_si
   m_plainData = &m_data[0] + 1 + m_stride;
 }
 
-ConnectivityMap::ConnectivityMap(const BinaryImage& image, const Connectivity conn)
+ConnectivityMap::ConnectivityMap(const BinaryImage& image,
+                                 const Connectivity conn,
+                                 std::vector<ConnComp>* const components)
     : m_plainData(nullptr), m_size(image.size()), m_stride(0), m_maxLabel(0) {
+  if (components) {
+    components->assign(1, ConnComp());
+  }
   if (m_size.isEmpty()) {
     return;
   }
@@ -38,28 +46,29 @@ ConnectivityMap::ConnectivityMap(const BinaryImage& image, const Connectivity co
   const int width = m_size.width();
   const int height = m_size.height();
 
-  m_data.resize((width + 2) * (height + 2), BACKGROUND);
+  m_data.resize((width + 2) * (height + 2), 0);
   m_stride = width + 2;
   m_plainData = &m_data[0] + 1 + m_stride;
 
-  uint32_t* dst = m_plainData;
-  const int dstStride = m_stride;
-
-  const uint32_t* src = image.data();
-  const int srcStride = image.wordsPerLine();
-
-  const uint32_t msb = uint32_t(1) << 31;
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      if (src[x >> 5] & (msb >> (x & 31))) {
-        dst[x] = UNTAGGED_FG;
+  const RunLengthComponents runs(image, conn);
+  m_maxLabel = runs.maxLabel();
+
+  // Components don't overlap, so they can be painted in parallel.
+  const int numChunks = std::min<int>(parallelForMaxThreads() * 4, static_cast<int>(m_maxLabel));
+  parallelFor(numChunks, [&](const int chunk) {
+    const uint32_t firstLabel = static_cast<uint32_t>(uint64_t(m_maxLabel) * chunk / numChunks) + 1;
+    const uint32_t lastLabel = static_cast<uint32_t>(uint64_t(m_maxLabel) * (chunk + 1) / numChunks);
+    for (uint32_t label = firstLabel; label <= lastLabel; ++label) {
+      for (const RunLengthComponents::Run* run = runs.runsBegin(label); run != runs.runsEnd(label); ++run) {
+        uint32_t* const line = m_plainData + run->y * m_stride;
+        std::fill(line + run->begin, line + run->end, label);
       }
     }
-    src += srcStride;
-    dst += dstStride;
-  }
+  });
 
-  assignIds(conn);
+  if (components) {
+    *components = runs.components();
+  }
 }
 
 ConnectivityMap::ConnectivityMap(const ConnectivityMap& other)
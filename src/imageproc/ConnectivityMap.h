@@ -11,6 +11,7 @@
 #include <unordered_set>
 #include <vector>
 
+#include "ConnComp.h"
 #include "Connectivity.h"
 #include "FastQueue.h"
 
@@ -48,8 +49,14 @@ class ConnectivityMap {
 
   /**
    * \brief Labels components in a binary image.
+   *
+   * \param components If provided, receives the pixel count, the bounding box
+   *        and the seed of each component, indexed by label.  The element
+   *        at index zero is a null ConnComp standing for the background.
+   *
+   * The image is labeled in bands of rows in parallel.
    */
-  ConnectivityMap(const BinaryImage& image, Connectivity conn);
+  ConnectivityMap(const BinaryImage& image, Connectivity conn, std::vector<ConnComp>* components = nullptr);
 
   /**
    * \brief Same as the version working with BinaryImage
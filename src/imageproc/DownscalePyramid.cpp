@@ -0,0 +1,322 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "DownscalePyramid.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "BadAllocIfNull.h"
+#include "GrayImage.h"
+
+namespace imageproc {
+namespace {
+QImage toLevelZero(const QImage& image) {
+  switch (image.format()) {
+    case QImage::Format_Invalid:
+      return QImage();
+    case QImage::Format_Indexed8:
+    case QImage::Format_Mono:
+    case QImage::Format_MonoLSB:
+      if (!image.allGray()) {
+        break;
+      }
+      // fall through
+    case QImage::Format_Grayscale8:
+      return GrayImage(image).toQImage();
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+      return image;
+    default:
+      break;
+  }
+
+  // Averaging premultiplied components gives the right colors for semi-transparent pixels.
+  const QImage converted(
+      image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32));
+  badAllocIfNull(converted);
+  return converted;
+}
+
+QImage createLike(const QImage& image, const QSize& size) {
+  if (image.depth() == 8) {
+    return GrayImage(size).toQImage();
+  }
+
+  QImage created(size, image.format());
+  badAllocIfNull(created);
+  return created;
+}
+
+/**
+ * The cells of a pyramid level along one axis.  Cell i covers original
+ * pixels [i * cellSize, min((i + 1) * cellSize, originalExtent)).
+ */
+struct LevelAxis {
+  int numCells;
+  int cellSize;
+  int originalExtent;
+
+  int cellWeight(const int cell) const {
+    return (cell == numCells - 1) ? originalExtent - cell * cellSize : cellSize;
+  }
+
+  /**
+   * The number of leading cell pairs where both cells are complete.
+   */
+  int numUniformPairs() const {
+    if ((numCells % 2 == 0) && (cellWeight(numCells - 1) == cellSize)) {
+      return numCells / 2;
+    }
+    return (numCells - 1) / 2;
+  }
+};
+
+/**
+ * Makes the next level, where every cell covers a 2x2 block of cells of \p src.
+ */
+template <int BytesPerPixel>
+QImage halve(const QImage& src, const LevelAxis& hor, const LevelAxis& ver) {
+  const int dstWidth = (hor.numCells + 1) / 2;
+  const int dstHeight = (ver.numCells + 1) / 2;
+  QImage dst(createLike(src, QSize(dstWidth, dstHeight)));
+
+  const int srcBpl = src.bytesPerLine();
+  const int dstBpl = dst.bytesPerLine();
+  const uint8_t* const srcData = src.bits();
+  uint8_t* const dstData = dst.bits();
+
+  // The bulk of the image is made of complete 2x2 blocks.
+  const int uniformWidth = hor.numUniformPairs();
+  const int uniformHeight = ver.numUniformPairs();
+  for (int y = 0; y < uniformHeight; ++y) {
+    const uint8_t* const srcLine1 = srcData + 2 * y * srcBpl;
+    const uint8_t* const srcLine2 = srcLine1 + srcBpl;
+    uint8_t* const dstLine = dstData + y * dstBpl;
+    for (int x = 0; x < uniformWidth; ++x) {
+      for (int c = 0; c < BytesPerPixel; ++c) {
+        const int left = 2 * x * BytesPerPixel + c;
+        const int right = left + BytesPerPixel;
+        const unsigned sum = srcLine1[left] + srcLine1[right] + srcLine2[left] + srcLine2[right];
+        dstLine[x * BytesPerPixel + c] = static_cast<uint8_t>((sum + 2) >> 2);
+      }
+    }
+  }
+
+  // The last column and row, where blocks may be incomplete or cover less of the original image.
+  auto weightedCell = [&](const int x, const int y) {
+    const int srcX1 = 2 * x;
+    const int srcX2 = std::min(srcX1 + 1, hor.numCells - 1);
+    const int srcY1 = 2 * y;
+    const int srcY2 = std::min(srcY1 + 1, ver.numCells - 1);
+    for (int c = 0; c < BytesPerPixel; ++c) {
+      uint64_t sum = 0;
+      uint64_t totalWeight = 0;
+      for (int srcY = srcY1; srcY <= srcY2; ++srcY) {
+        const uint8_t* const srcLine = srcData + srcY * srcBpl;
+        for (int srcX = srcX1; srcX <= srcX2; ++srcX) {
+          const uint64_t weight = uint64_t(hor.cellWeight(srcX)) * ver.cellWeight(srcY);
+          sum += weight * srcLine[srcX * BytesPerPixel + c];
+          totalWeight += weight;
+        }
+      }
+      dstData[y * dstBpl + x * BytesPerPixel + c] = static_cast<uint8_t>((sum + totalWeight / 2) / totalWeight);
+    }
+  };
+  for (int y = 0; y < dstHeight; ++y) {
+    for (int x = (y < uniformHeight) ? uniformWidth : 0; x < dstWidth; ++x) {
+      weightedCell(x, y);
+    }
+  }
+  return dst;
+}  // halve
+
+/**
+ * For every destination pixel along an axis, the level cells it overlaps and
+ * the lengths of the overlaps.  Lengths are measured in original pixels
+ * multiplied by the number of destination pixels, which makes them integers
+ * summing up to originalExtent for every destination pixel.
+ */
+struct AreaMapping {
+  std::vector<int> firstCell;
+  std::vector<int> firstWeight;  // Indices into weights.
+  std::vector<uint32_t> weights;
+
+  AreaMapping(const LevelAxis& axis, const int dstExtent) {
+    const int64_t cellLength = int64_t(axis.cellSize) * dstExtent;
+    const int64_t totalLength = int64_t(axis.originalExtent) * dstExtent;
+    for (int d = 0; d < dstExtent; ++d) {
+      const int64_t from = int64_t(d) * axis.originalExtent;
+      const int64_t to = from + axis.originalExtent;
+      const auto first = static_cast<int>(from / cellLength);
+      const auto last = static_cast<int>(std::min<int64_t>((to - 1) / cellLength, axis.numCells - 1));
+      firstCell.push_back(first);
+      firstWeight.push_back(static_cast<int>(weights.size()));
+      for (int cell = first; cell <= last; ++cell) {
+        const int64_t cellFrom = cell * cellLength;
+        const int64_t cellTo = std::min(cellFrom + cellLength, totalLength);
+        weights.push_back(static_cast<uint32_t>(std::min(to, cellTo) - std::max(from, cellFrom)));
+      }
+    }
+    firstWeight.push_back(static_cast<int>(weights.size()));
+  }
+
+  int numCells(const int d) const { return firstWeight[d + 1] - firstWeight[d]; }
+};
+
+template <int BytesPerPixel>
+QImage areaAverage(const QImage& src, const LevelAxis& hor, const LevelAxis& ver, const QSize& dstSize) {
+  const int dstWidth = dstSize.width();
+  const int dstHeight = dstSize.height();
+  QImage dst(createLike(src, dstSize));
+
+  const AreaMapping horMapping(hor, dstWidth);
+  const AreaMapping verMapping(ver, dstHeight);
+  const uint64_t totalWeight = uint64_t(hor.originalExtent) * ver.originalExtent;
+
+  const int srcBpl = src.bytesPerLine();
+  const int dstBpl = dst.bytesPerLine();
+  const int lineValues = dstWidth * BytesPerPixel;
+  std::vector<uint32_t> horSums(lineValues);
+  std::vector<uint64_t> sums(lineValues);
+
+  for (int dy = 0; dy < dstHeight; ++dy) {
+    std::fill(sums.begin(), sums.end(), 0);
+    for (int i = 0; i < verMapping.numCells(dy); ++i) {
+      const uint8_t* const srcLine = src.bits() + (verMapping.firstCell[dy] + i) * srcBpl;
+      for (int dx = 0; dx < dstWidth; ++dx) {
+        const uint32_t* const weights = &horMapping.weights[horMapping.firstWeight[dx]];
+        const uint8_t* const srcCells = srcLine + horMapping.firstCell[dx] * BytesPerPixel;
+        const int numCells = horMapping.numCells(dx);
+        for (int c = 0; c < BytesPerPixel; ++c) {
+          uint32_t sum = 0;
+          for (int cell = 0; cell < numCells; ++cell) {
+            sum += weights[cell] * srcCells[cell * BytesPerPixel + c];
+          }
+          horSums[dx * BytesPerPixel + c] = sum;
+        }
+      }
+
+      const uint64_t verWeight = verMapping.weights[verMapping.firstWeight[dy] + i];
+      for (int v = 0; v < lineValues; ++v) {
+        sums[v] += verWeight * horSums[v];
+      }
+    }
+
+    uint8_t* const dstLine = dst.bits() + dy * dstBpl;
+    for (int v = 0; v < lineValues; ++v) {
+      dstLine[v] = static_cast<uint8_t>((sums[v] + totalWeight / 2) / totalWeight);
+    }
+  }
+  return dst;
+}  // areaAverage
+}  // namespace
+
+DownscalePyramid::DownscalePyramid(const QImage& image)
+    : m_levels{toLevelZero(image)}, m_size(image.size()), m_isGrayscale(m_levels.front().depth() == 8) {}
+
+DownscalePyramid::DownscalePyramid(const GrayImage& image)
+    : m_levels{image.toQImage()}, m_size(image.size()), m_isGrayscale(true) {}
+
+std::shared_ptr<DownscalePyramid> DownscalePyramid::shared(const QImage& image) {
+  struct Entry {
+    QImage image;  // Keeps the cache key from being reused by another image.
+    std::shared_ptr<DownscalePyramid> pyramid;
+  };
+  static QMutex mutex;
+  static std::vector<Entry> recent;  // Most recently used first.
+  const size_t maxEntries = 2;
+
+  const auto find = [&image]() {
+    const auto it = std::find_if(recent.begin(), recent.end(),
+                                 [&image](const Entry& entry) { return entry.image.cacheKey() == image.cacheKey(); });
+    if (it != recent.end()) {
+      std::rotate(recent.begin(), it, it + 1);
+      return recent.front().pyramid;
+    }
+    return std::shared_ptr<DownscalePyramid>();
+  };
+
+  {
+    const QMutexLocker locker(&mutex);
+    if (std::shared_ptr<DownscalePyramid> pyramid = find()) {
+      return pyramid;
+    }
+  }
+
+  // Converting the image may take a while, so other images are served meanwhile.
+  auto pyramid = std::make_shared<DownscalePyramid>(image);
+
+  const QMutexLocker locker(&mutex);
+  if (std::shared_ptr<DownscalePyramid> other = find()) {
+    return other;
+  }
+  if (recent.size() == maxEntries) {
+    recent.pop_back();
+  }
+  recent.insert(recent.begin(), Entry{image, pyramid});
+  return pyramid;
+}
+
+QImage DownscalePyramid::level(const int idx) {
+  const QMutexLocker locker(&m_mutex);
+  const QSize originalSize(size());
+  while (static_cast<int>(m_levels.size()) <= idx) {
+    const QImage& prev = m_levels.back();
+    const int cellSize = 1 << (static_cast<int>(m_levels.size()) - 1);
+    const LevelAxis hor{prev.width(), cellSize, originalSize.width()};
+    const LevelAxis ver{prev.height(), cellSize, originalSize.height()};
+    m_levels.push_back(isGrayscale() ? halve<1>(prev, hor, ver) : halve<4>(prev, hor, ver));
+  }
+  return m_levels[idx];
+}
+
+QImage DownscalePyramid::scaledTo(const QSize& dstSize) {
+  const QSize originalSize(size());
+  if (dstSize.isEmpty() || (dstSize.width() > originalSize.width()) || (dstSize.height() > originalSize.height())) {
+    throw std::invalid_argument("DownscalePyramid: dstSize must be non-empty and not exceed the original size");
+  }
+
+  // The smallest level that is at least twice as large as dstSize, so that
+  // every destination pixel is averaged from several cells of that level,
+  // unless a level happens to be exactly what was requested.
+  int levelIdx = 0;
+  while ((1 << levelIdx) < std::max(originalSize.width(), originalSize.height())) {
+    const int nextCellSize = 2 << levelIdx;
+    if ((originalSize.width() == dstSize.width() * nextCellSize)
+        && (originalSize.height() == dstSize.height() * nextCellSize)) {
+      ++levelIdx;
+      break;
+    }
+    const int nextWidth = (originalSize.width() + nextCellSize - 1) / nextCellSize;
+    const int nextHeight = (originalSize.height() + nextCellSize - 1) / nextCellSize;
+    if ((nextWidth < dstSize.width() * 2) || (nextHeight < dstSize.height() * 2)) {
+      break;
+    }
+    ++levelIdx;
+  }
+
+  const QImage src(level(levelIdx));
+  const int cellSize = 1 << levelIdx;
+
+  QImage dst;
+  if ((originalSize.width() == dstSize.width() * cellSize) && (originalSize.height() == dstSize.height() * cellSize)) {
+    // The level is exactly what was requested.
+    dst = src;
+  } else {
+    const LevelAxis hor{src.width(), cellSize, originalSize.width()};
+    const LevelAxis ver{src.height(), cellSize, originalSize.height()};
+    dst = isGrayscale() ? areaAverage<1>(src, hor, ver, dstSize) : areaAverage<4>(src, hor, ver, dstSize);
+  }
+
+  const QImage original(level(0));
+  const int dpmX = qRound(double(original.dotsPerMeterX()) * dstSize.width() / originalSize.width());
+  const int dpmY = qRound(double(original.dotsPerMeterY()) * dstSize.height() / originalSize.height());
+  if ((dst.dotsPerMeterX() != dpmX) || (dst.dotsPerMeterY() != dpmY)) {
+    dst.setDotsPerMeterX(dpmX);
+    dst.setDotsPerMeterY(dpmY);
+  }
+  return dst;
+}  // DownscalePyramid::scaledTo
+}  // namespace imageproc
@@ -0,0 +1,93 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_IMAGEPROC_DOWNSCALEPYRAMID_H_
+#define SCANTAILOR_IMAGEPROC_DOWNSCALEPYRAMID_H_
+
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <memory>
+#include <vector>
+
+namespace imageproc {
+class GrayImage;
+
+/**
+ * \brief Produces downscaled versions of an image by area averaging.
+ *
+ * Level 0 of the pyramid is the image itself, and every next level is made
+ * by averaging 2x2 blocks of the previous one.  A scaled image is made from
+ * the smallest level that is still at least twice as large as requested,
+ * by averaging the areas of that level that map to each destination pixel.
+ * The boundaries of destination pixels are mapped into the coordinates of
+ * that level, and a cell they cut contributes in proportion to its overlap.
+ * Such a cell is taken as uniform, so where the content varies within it
+ * the result differs from an exact area average of the original image.
+ * It's exact where the cells of the level don't cross destination pixels,
+ * and close to it on content that is smooth at the scale of the cells.
+ *
+ * Levels are built on demand and kept, so getting several sizes out of
+ * the same pyramid is cheaper than scaling the original image each time.
+ *
+ * Where a level has an odd dimension, or its last cells are already partial,
+ * the last cell of the next level covers less of the original image than
+ * the others, and the averaging is weighted accordingly.
+ *
+ * All the methods are thread-safe.
+ */
+class DownscalePyramid {
+ public:
+  /**
+   * \brief Builds a pyramid of an arbitrary image.
+   *
+   * Grayscale images, including black and white ones, are kept in grayscale,
+   * while other images are converted to QImage::Format_RGB32 or, if they have
+   * an alpha channel, to QImage::Format_ARGB32_Premultiplied.
+   */
+  explicit DownscalePyramid(const QImage& image);
+
+  explicit DownscalePyramid(const GrayImage& image);
+
+  /**
+   * \brief Returns the pyramid of \p image, shared with other callers scaling the same image.
+   *
+   * The pyramids of the two most recently requested images are kept, so that
+   * the levels of a page are reused when it's scaled to several sizes, for
+   * instance for a thumbnail and for display, or when it's displayed again.
+   * Images are told apart by QImage::cacheKey(), which copies of an image share.
+   */
+  static std::shared_ptr<DownscalePyramid> shared(const QImage& image);
+
+  /**
+   * \brief The size of the original image.
+   */
+  QSize size() const { return m_size; }
+
+  /**
+   * \brief Whether scaled images are 8-bit grayscale, as opposed to 32-bit.
+   */
+  bool isGrayscale() const { return m_isGrayscale; }
+
+  /**
+   * \brief Returns the image scaled to \p dstSize.
+   *
+   * A grayscale result is an 8-bit indexed image with a grayscale palette,
+   * which can be turned into a GrayImage without copying.  The resolution of
+   * the result is adjusted to the scaling factor.
+   *
+   * \throw std::invalid_argument If \p dstSize is empty or larger than
+   *        the original image in any dimension.
+   */
+  QImage scaledTo(const QSize& dstSize);
+
+ private:
+  QImage level(int idx);
+
+  QMutex m_mutex;
+  std::vector<QImage> m_levels;
+  QSize m_size;
+  bool m_isGrayscale;
+};
+}  // namespace imageproc
+#endif  // ifndef SCANTAILOR_IMAGEPROC_DOWNSCALEPYRAMID_H_
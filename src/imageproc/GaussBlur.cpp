@@ -6,6 +6,7 @@
 
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/lambda.hpp>
+#include <algorithm>
 #include <cmath>
 
 #include "Constants.h"
@@ -13,11 +14,19 @@
 
 namespace imageproc {
 namespace gauss_blur_impl {
-void findIirConstants(float* nP, float* nM, float* dP, float* dM, float* bdP, float* bdM, float stdDev) {
+IirConstants findIirConstants(const float stdDev) {
   /*  The constants used in the implemenation of a casual sequence
    *  using a 4th order approximation of the gaussian operator
    */
 
+  IirConstants constants{};
+  float* const nP = constants.nP;
+  float* const nM = constants.nM;
+  float* const dP = constants.dP;
+  float* const dM = constants.dM;
+  float* const bdP = constants.bdP;
+  float* const bdM = constants.bdM;
+
   const auto div = static_cast<float>(std::sqrt(2.0 * constants::PI) * stdDev);
   const auto x0 = static_cast<float>(-1.783 / stdDev);
   const auto x1 = static_cast<float>(-1.723 / stdDev);
@@ -72,7 +81,95 @@ void findIirConstants(float* nP, float* nM, float* dP, float* dM, float* bdP, fl
     bdP[i] = dP[i] * a;
     bdM[i] = dM[i] * b;
   }
+  return constants;
 }  // findIirConstants
+
+void filterLanes(float* const data, float* const scratch, const int numItems, const IirConstants& constants) {
+  const float* const nP = constants.nP;
+  const float* const nM = constants.nM;
+  const float* const dP = constants.dP;
+  const float* const dM = constants.dM;
+  const float* const bdP = constants.bdP;
+  const float* const bdM = constants.bdM;
+
+  float* const valP = scratch;
+  float* const valM = scratch + numItems * NUM_LANES;
+  const float* const initialP = data;
+  const float* const initialM = data + (numItems - 1) * NUM_LANES;
+
+  // The operations on each lane are the same, and made in the same order,
+  // as they would be when filtering a single sequence.
+  const int numBoundaryItems = std::min(numItems, 4);
+  for (int item = 0; item < numBoundaryItems; ++item) {
+    float* const vp = valP + item * NUM_LANES;
+    const float* const sp = data + item * NUM_LANES;
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+      vp[lane] = 0.0f;
+    }
+    int i = 0;
+    for (; i <= item; ++i) {
+      for (int lane = 0; lane < NUM_LANES; ++lane) {
+        vp[lane] += nP[i] * sp[lane - i * NUM_LANES] - dP[i] * vp[lane - i * NUM_LANES];
+      }
+    }
+    for (; i <= 4; ++i) {
+      for (int lane = 0; lane < NUM_LANES; ++lane) {
+        vp[lane] += (nP[i] - bdP[i]) * initialP[lane];
+      }
+    }
+  }
+  for (int item = numBoundaryItems; item < numItems; ++item) {
+    float* const vp = valP + item * NUM_LANES;
+    const float* const sp = data + item * NUM_LANES;
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+      float sum = 0.0f;
+      sum += nP[0] * sp[lane] - dP[0] * sum;
+      sum += nP[1] * sp[lane - NUM_LANES] - dP[1] * vp[lane - NUM_LANES];
+      sum += nP[2] * sp[lane - 2 * NUM_LANES] - dP[2] * vp[lane - 2 * NUM_LANES];
+      sum += nP[3] * sp[lane - 3 * NUM_LANES] - dP[3] * vp[lane - 3 * NUM_LANES];
+      sum += nP[4] * sp[lane - 4 * NUM_LANES] - dP[4] * vp[lane - 4 * NUM_LANES];
+      vp[lane] = sum;
+    }
+  }
+
+  for (int item = numItems - 1; item >= numItems - numBoundaryItems; --item) {
+    const int terms = numItems - 1 - item;
+    float* const vm = valM + item * NUM_LANES;
+    const float* const sm = data + item * NUM_LANES;
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+      vm[lane] = 0.0f;
+    }
+    int i = 0;
+    for (; i <= terms; ++i) {
+      for (int lane = 0; lane < NUM_LANES; ++lane) {
+        vm[lane] += nM[i] * sm[lane + i * NUM_LANES] - dM[i] * vm[lane + i * NUM_LANES];
+      }
+    }
+    for (; i <= 4; ++i) {
+      for (int lane = 0; lane < NUM_LANES; ++lane) {
+        vm[lane] += (nM[i] - bdM[i]) * initialM[lane];
+      }
+    }
+  }
+  for (int item = numItems - numBoundaryItems - 1; item >= 0; --item) {
+    float* const vm = valM + item * NUM_LANES;
+    const float* const sm = data + item * NUM_LANES;
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+      float sum = 0.0f;
+      sum += nM[0] * sm[lane] - dM[0] * sum;
+      sum += nM[1] * sm[lane + NUM_LANES] - dM[1] * vm[lane + NUM_LANES];
+      sum += nM[2] * sm[lane + 2 * NUM_LANES] - dM[2] * vm[lane + 2 * NUM_LANES];
+      sum += nM[3] * sm[lane + 3 * NUM_LANES] - dM[3] * vm[lane + 3 * NUM_LANES];
+      sum += nM[4] * sm[lane + 4 * NUM_LANES] - dM[4] * vm[lane + 4 * NUM_LANES];
+      vm[lane] = sum;
+    }
+  }
+
+  const int numValues = numItems * NUM_LANES;
+  for (int i = 0; i < numValues; ++i) {
+    data[i] = valP[i] + valM[i];
+  }
+}  // filterLanes
 }  // namespace gauss_blur_impl
 
 GrayImage gaussBlur(const GrayImage& src, float hSigma, float vSigma) {
@@ -6,10 +6,10 @@
 #define SCANTAILOR_IMAGEPROC_GAUSSBLUR_H_
 
 #include <QSize>
-#include <boost/scoped_array.hpp>
-#include <cstring>
-#include <iterator>
+#include <algorithm>
+#include <vector>
 
+#include "ParallelFor.h"
 #include "ValueConv.h"
 
 namespace imageproc {
@@ -66,6 +66,9 @@ GrayImage gaussBlur(const GrayImage& src, float hSigma, float vSigma);
  * // Convert to uint8_t, with rounding and clipping.
  * gaussBlurGeneric(..., _1 = bind<uint8_t>(RoundAndClipValueConv<uint8_t>(), _2);
  * \endcode
+ *
+ * The work is split between threads, so \p floatReader and \p floatWriter
+ * may be called concurrently, though never for the same grid cell.
  */
 template <typename SrcIt, typename DstIt, typename FloatReader, typename FloatWriter>
 void gaussBlurGeneric(QSize size,
@@ -79,22 +82,46 @@ void gaussBlurGeneric(QSize size,
                       FloatWriter floatWriter);
 
 namespace gauss_blur_impl {
-void findIirConstants(float* nP, float* nM, float* dP, float* dM, float* bdP, float* bdM, float stdDev);
-
-template <typename Src1It, typename Src2It, typename DstIt, typename FloatWriter>
-void save(int numItems, Src1It src1, Src2It src2, DstIt dst, int dstStride, FloatWriter writer) {
-  while (numItems-- != 0) {
-    writer(*dst, *src1 + *src2);
-    ++src1;
-    ++src2;
-    dst += dstStride;
-  }
-}
-
-class FloatToFloatWriter {
- public:
-  void operator()(float& dst, float src) const { dst = src; }
+/**
+ * The number of rows or columns filtered together.  Their values are interleaved,
+ * so that the same operation applies to NUM_LANES adjacent floats.
+ */
+const int NUM_LANES = 8;
+
+struct IirConstants {
+  float nP[5];
+  float nM[5];
+  float dP[5];
+  float dM[5];
+  float bdP[5];
+  float bdM[5];
 };
+
+IirConstants findIirConstants(float stdDev);
+
+/**
+ * \brief Runs the filter along NUM_LANES interleaved sequences of numItems values.
+ *
+ * \param data numItems * NUM_LANES values, where the value of item i in lane l
+ *        is at data[i * NUM_LANES + l].  It's replaced with the filtered values.
+ * \param scratch Space for numItems * NUM_LANES * 2 values.
+ */
+void filterLanes(float* data, float* scratch, int numItems, const IirConstants& constants);
+
+/**
+ * \brief Splits [0, numGroups) into chunks and calls body(first, last) for each of them in parallel.
+ *
+ * \p groupSize is the number of values in a group, which decides if it's worth splitting at all.
+ */
+template <typename Body>
+void forEachGroupChunk(const int numGroups, const int groupSize, Body body) {
+  // Tiny grids are not worth recruiting other threads for.
+  const int minGroupsPerChunk = std::max(1, 16384 / std::max(1, groupSize));
+  const int numChunks = std::max(1, std::min(parallelForMaxThreads() * 4, numGroups / minGroupsPerChunk));
+  parallelFor(numChunks, [&](const int chunk) {
+    body(numGroups * chunk / numChunks, numGroups * (chunk + 1) / numChunks);
+  });
+}
 }  // namespace gauss_blur_impl
 
 template <typename SrcIt, typename DstIt, typename FloatReader, typename FloatWriter>
@@ -107,92 +134,81 @@ void gaussBlurGeneric(const QSize size,
                       const DstIt output,
                       const int outputStride,
                       const FloatWriter floatWriter) {
+  using namespace gauss_blur_impl;
+
   if (size.isEmpty()) {
     return;
   }
 
   const int width = size.width();
   const int height = size.height();
-  const int widthHeightMax = width > height ? width : height;
 
-  boost::scoped_array<float> valP(new float[widthHeightMax]);
-  boost::scoped_array<float> valM(new float[widthHeightMax]);
-  boost::scoped_array<float> intermediateImage(new float[width * height]);
+  // Input is completely read before anything is written to output,
+  // which makes it possible for them to be the same.
+  std::vector<float> intermediateImage(static_cast<size_t>(width) * height);
   const int intermediateStride = width;
 
-  // IIR parameters.
-  float nP[5], nM[5], dP[5], dM[5], bdP[5], bdM[5];
-  // Vertical pass.
-  gauss_blur_impl::findIirConstants(nP, nM, dP, dM, bdP, bdM, vSigma);
-  for (int x = 0; x < width; ++x) {
-    memset(&valP[0], 0, height * sizeof(valP[0]));
-    memset(&valM[0], 0, height * sizeof(valM[0]));
-
-    SrcIt spP(input + x);
-    SrcIt spM(spP + (height - 1) * inputStride);
-    float* vp = &valP[0];
-    float* vm = &valM[0] + height - 1;
-    const float initialP = floatReader(spP[0]);
-    const float initialM = floatReader(spM[0]);
-
-    for (int y = 0; y < height; ++y) {
-      const int terms = y < 4 ? y : 4;
-      int i = 0;
-      int spOff = 0;
-      for (; i <= terms; ++i, spOff += inputStride) {
-        *vp += nP[i] * floatReader(spP[-spOff]) - dP[i] * vp[-i];
-        *vm += nM[i] * floatReader(spM[spOff]) - dM[i] * vm[i];
+  // Vertical pass, on groups of adjacent columns.
+  const IirConstants vConstants(findIirConstants(vSigma));
+  const int numColumnGroups = (width + NUM_LANES - 1) / NUM_LANES;
+  forEachGroupChunk(numColumnGroups, height * NUM_LANES, [&](const int firstGroup, const int lastGroup) {
+    std::vector<float> lanes(static_cast<size_t>(height) * NUM_LANES);
+    std::vector<float> scratch(lanes.size() * 2);
+    for (int group = firstGroup; group < lastGroup; ++group) {
+      const int x0 = group * NUM_LANES;
+      const int numColumns = std::min(NUM_LANES, width - x0);
+
+      SrcIt inputLine(input + x0);
+      for (int y = 0; y < height; ++y) {
+        float* const item = &lanes[y * NUM_LANES];
+        for (int lane = 0; lane < numColumns; ++lane) {
+          item[lane] = floatReader(inputLine[lane]);
+        }
+        // Lanes beyond the grid repeat the last column rather than holding garbage.
+        std::fill(item + numColumns, item + NUM_LANES, item[numColumns - 1]);
+        inputLine += inputStride;
       }
-      for (; i <= 4; ++i) {
-        *vp += (nP[i] - bdP[i]) * initialP;
-        *vm += (nM[i] - bdM[i]) * initialM;
-      }
-      spP += inputStride;
-      spM -= inputStride;
-      ++vp;
-      --vm;
-    }
 
-    gauss_blur_impl::save(height, &valP[0], &valM[0], &intermediateImage[0] + x, intermediateStride,
-                          gauss_blur_impl::FloatToFloatWriter());
-  }
-  // Horizontal pass.
-  gauss_blur_impl::findIirConstants(nP, nM, dP, dM, bdP, bdM, hSigma);
-  const float* intermediateLine = &intermediateImage[0];
-  DstIt outputLine(output);
-  for (int y = 0; y < height; ++y) {
-    memset(&valP[0], 0, width * sizeof(valP[0]));
-    memset(&valM[0], 0, width * sizeof(valM[0]));
-
-    const float* spP = intermediateLine;
-    const float* spM = intermediateLine + width - 1;
-    float* vp = &valP[0];
-    float* vm = &valM[0] + width - 1;
-    const float initialP = spP[0];
-    const float initialM = spM[0];
-
-    for (int x = 0; x < width; ++x) {
-      const int terms = x < 4 ? x : 4;
-      int i = 0;
-      for (; i <= terms; ++i) {
-        *vp += nP[i] * spP[-i] - dP[i] * vp[-i];
-        *vm += nM[i] * spM[i] - dM[i] * vm[i];
-      }
-      for (; i <= 4; ++i) {
-        *vp += (nP[i] - bdP[i]) * initialP;
-        *vm += (nM[i] - bdM[i]) * initialM;
+      filterLanes(lanes.data(), scratch.data(), height, vConstants);
+
+      float* intermediateLine = &intermediateImage[x0];
+      for (int y = 0; y < height; ++y) {
+        std::copy(&lanes[y * NUM_LANES], &lanes[y * NUM_LANES] + numColumns, intermediateLine);
+        intermediateLine += intermediateStride;
       }
-      ++spP;
-      --spM;
-      ++vp;
-      --vm;
     }
+  });
+
+  // Horizontal pass, on groups of adjacent rows transposed into lanes.
+  const IirConstants hConstants(findIirConstants(hSigma));
+  const int numRowGroups = (height + NUM_LANES - 1) / NUM_LANES;
+  forEachGroupChunk(numRowGroups, width * NUM_LANES, [&](const int firstGroup, const int lastGroup) {
+    std::vector<float> lanes(static_cast<size_t>(width) * NUM_LANES);
+    std::vector<float> scratch(lanes.size() * 2);
+    for (int group = firstGroup; group < lastGroup; ++group) {
+      const int y0 = group * NUM_LANES;
+      const int numRows = std::min(NUM_LANES, height - y0);
+
+      for (int lane = 0; lane < NUM_LANES; ++lane) {
+        // Lanes beyond the grid repeat the last row.
+        const int y = y0 + std::min(lane, numRows - 1);
+        const float* const intermediateLine = &intermediateImage[y * intermediateStride];
+        for (int x = 0; x < width; ++x) {
+          lanes[x * NUM_LANES + lane] = intermediateLine[x];
+        }
+      }
 
-    gauss_blur_impl::save(width, &valP[0], &valM[0], outputLine, 1, floatWriter);
+      filterLanes(lanes.data(), scratch.data(), width, hConstants);
 
-    intermediateLine += intermediateStride;
-    outputLine += outputStride;
-  }
+      DstIt outputLine(output + y0 * outputStride);
+      for (int lane = 0; lane < numRows; ++lane) {
+        for (int x = 0; x < width; ++x) {
+          floatWriter(outputLine[x], lanes[x * NUM_LANES + lane]);
+        }
+        outputLine += outputStride;
+      }
+    }
+  });
 }  // gaussBlurGeneric
 }  // namespace imageproc
 #endif  // ifndef SCANTAILOR_IMAGEPROC_GAUSSBLUR_H_
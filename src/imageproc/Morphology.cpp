@@ -4,8 +4,10 @@
 #include "Morphology.h"
 
 #include <QDebug>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 
 #include "BinaryImage.h"
 #include "GrayImage.h"
@@ -49,6 +51,8 @@ Brick Brick::flipped() const {
 }
 
 namespace {
+std::atomic<MorphologyAlgorithm> g_morphologyAlgorithm(MorphologyAlgorithm::DECOMPOSED);
+
 class ReusableImages {
  public:
   void store(BinaryImage& img);
@@ -188,6 +192,22 @@ void spreadInto(BinaryImage& dst,
   }
 }
 
+/**
+ * Combines dst with a copy of itself shifted by (dx, dy).  Pixels within (dx, dy)
+ * from the top-left of dst don't get their share, so dst has to extend beyond
+ * dstRelevantRect by the total of such shifts.
+ */
+void spreadOntoItself(BinaryImage& dst, const QRect& dstRelevantRect, const int dx, const int dy,
+                      const AbstractRasterOp& rop) {
+  QRect dstRect(dst.rect());
+  QRect srcRect(dstRect);
+  dstRect.translate(dx, dy);
+
+  adjustToFit(dstRelevantRect, dstRect, srcRect);
+
+  rop(dst, dstRect, dst, srcRect.topLeft());
+}
+
 void spreadInDirectionLow(BinaryImage& dst,
                           const CoordinateSystem& dstCs,
                           const QRect& dstRelevantRect,
@@ -222,13 +242,7 @@ void spreadInDirectionLow(BinaryImage& dst,
     int dy = dyStep;
     int i = 1;
     for (; (i << 1) <= numSteps; i <<= 1, dx <<= 1, dy <<= 1) {
-      QRect dstRect(dst.rect());
-      QRect srcRect(dstRect);
-      dstRect.translate(dx, dy);
-
-      adjustToFit(dstRelevantRect, dstRect, srcRect);
-
-      rop(dst, dstRect, dst, srcRect.topLeft());
+      spreadOntoItself(dst, dstRelevantRect, dx, dy, rop);
     }
 
     remainingDxMin = dxMin + dx;
@@ -297,6 +311,63 @@ void spreadInDirection(BinaryImage& dst,
   tmpImages.store(tmp);
 }  // spreadInDirection
 
+/**
+ * Same as spreadInDirection(), but takes about log2(numSteps) raster operations.
+ * The largest power of two steps not exceeding numSteps is done by doubling
+ * shifts, and the rest by combining the result with itself shifted by the
+ * number of missing steps.  The two spans overlap, which doesn't matter
+ * for OR and AND.
+ */
+void spreadInDirectionDecomposed(BinaryImage& dst,
+                                 const CoordinateSystem& dstCs,
+                                 const QRect& dstRelevantRect,
+                                 const BinaryImage& src,
+                                 const CoordinateSystem& srcCs,
+                                 ReusableImages& tmpImages,
+                                 const CoordinateSystem& tmpCs,
+                                 const QSize& tmpImageSize,
+                                 const int dxMin,
+                                 const int dxStep,
+                                 const int dyMin,
+                                 const int dyStep,
+                                 const int numSteps,
+                                 const AbstractRasterOp& rop,
+                                 const BWColor initialColor,
+                                 const bool dstCompositionAllowed) {
+  assert(dxStep == 0 || dyStep == 0);
+
+  if (!dstCompositionAllowed && (numSteps < COMPOSITE_THRESHOLD)) {
+    spreadInDirectionLow(dst, dstCs, dstRelevantRect, src, srcCs, dxMin, dxStep, dyMin, dyStep, numSteps, rop,
+                         initialColor, false);
+    return;
+  }
+
+  int powerOfTwoSteps = 1;
+  while ((powerOfTwoSteps << 1) <= numSteps) {
+    powerOfTwoSteps <<= 1;
+  }
+  const int overlapSteps = numSteps - powerOfTwoSteps;
+
+  if (dstCompositionAllowed) {
+    spreadInDirectionLow(dst, dstCs, dstRelevantRect, src, srcCs, dxMin, dxStep, dyMin, dyStep, powerOfTwoSteps, rop,
+                         initialColor, true);
+    if (overlapSteps > 0) {
+      spreadOntoItself(dst, dstRelevantRect, dxStep * overlapSteps, dyStep * overlapSteps, rop);
+    }
+    return;
+  }
+
+  BinaryImage tmp(tmpImages.retrieveOrCreate(tmpImageSize));
+
+  spreadInDirectionLow(tmp, tmpCs, tmp.rect(), src, srcCs, dxMin, dxStep, dyMin, dyStep, powerOfTwoSteps, rop,
+                       initialColor, true);
+
+  spreadInDirectionLow(dst, dstCs, dstRelevantRect, tmp, tmpCs, 0, dxStep * overlapSteps, 0, dyStep * overlapSteps,
+                       (overlapSteps > 0) ? 2 : 1, rop, initialColor, false);
+
+  tmpImages.store(tmp);
+}  // spreadInDirectionDecomposed
+
 void dilateOrErodeBrick(BinaryImage& dst,
                         const BinaryImage& src,
                         const Brick& brick,
@@ -343,21 +414,24 @@ void dilateOrErodeBrick(BinaryImage& dst,
   // image data is already in CPU cache.
   ReusableImages tmpImages;
 
+  const auto spread = (morphologyAlgorithm() == MorphologyAlgorithm::DECOMPOSED) ? &spreadInDirectionDecomposed
+                                                                                 : &spreadInDirection;
+
   if (brick.minY() == brick.maxY()) {
-    spreadInDirection(  // horizontal
+    spread(  // horizontal
         dst, dstCs, dstRelevantRect, src, srcCs, tmpImages, tmpCs, tmpImageRect.size(), brick.minX(), 1, brick.minY(),
         0, brick.width(), rop, !spreadingColor, false);
   } else if (brick.minX() == brick.maxX()) {
-    spreadInDirection(  // vertical
+    spread(  // vertical
         dst, dstCs, dstRelevantRect, src, srcCs, tmpImages, tmpCs, tmpImageRect.size(), brick.minX(), 0, brick.minY(),
         1, brick.height(), rop, !spreadingColor, false);
   } else {
     BinaryImage tmp(tmpArea.size());
-    spreadInDirection(  // horizontal
+    spread(  // horizontal
         tmp, tmpCs, tmpImageRect, src, srcCs, tmpImages, tmpCs, tmpImageRect.size(), brick.minX(), 1, brick.minY(), 0,
         brick.width(), rop, !spreadingColor, true);
 
-    spreadInDirection(  // vertical
+    spread(  // vertical
         dst, dstCs, dstRelevantRect, tmp, tmpCs, tmpImages, tmpCs, tmpImageRect.size(), 0, 0, 0, 1, brick.height(), rop,
         !spreadingColor, false);
   }
@@ -459,6 +533,62 @@ void spreadGrayHorizontal(GrayImage& dst, const GrayImage& src, const int dy, co
   }
 }  // spreadGrayHorizontal
 
+template <typename MinOrMax>
+void selectRows(uint8_t* dst, const uint8_t* src1, const uint8_t* src2, const int width) {
+  for (int x = 0; x < width; ++x) {
+    dst[x] = MinOrMax::select(src1[x], src2[x]);
+  }
+}
+
+/**
+ * The van Herk / Gil-Werman algorithm.  Source pixels are split into blocks
+ * of seLen.  A window of seLen pixels starts in one block and ends in the
+ * next one, so its extremum is the extremum of a suffix of the first block
+ * and a prefix of the next one.  That's 3 comparisons per pixel, whatever
+ * the size of the window.
+ */
+template <typename MinOrMax>
+void spreadGrayHorizontalDecomposed(GrayImage& dst, const GrayImage& src, const int dy, const int dx1, const int dx2) {
+  const int srcStride = src.stride();
+  const int dstStride = dst.stride();
+  const uint8_t* srcLine = src.data() + dy * srcStride + dx1;
+  uint8_t* dstLine = dst.data();
+
+  const int dstWidth = dst.width();
+  const int dstHeight = dst.height();
+
+  const int seLen = dx2 - dx1 + 1;
+  const int srcSpanLen = dstWidth + seLen - 1;
+
+  std::vector<uint8_t> prefixes(srcSpanLen);
+  std::vector<uint8_t> suffixes(srcSpanLen);
+
+  for (int y = 0; y < dstHeight; ++y) {
+    for (int blockFirst = 0; blockFirst < srcSpanLen; blockFirst += seLen) {
+      const int blockLast = std::min(blockFirst + seLen, srcSpanLen) - 1;  // inclusive
+
+      uint8_t extremum = srcLine[blockFirst];
+      prefixes[blockFirst] = extremum;
+      for (int x = blockFirst + 1; x <= blockLast; ++x) {
+        extremum = MinOrMax::select(extremum, srcLine[x]);
+        prefixes[x] = extremum;
+      }
+
+      extremum = srcLine[blockLast];
+      suffixes[blockLast] = extremum;
+      for (int x = blockLast - 1; x >= blockFirst; --x) {
+        extremum = MinOrMax::select(extremum, srcLine[x]);
+        suffixes[x] = extremum;
+      }
+    }
+
+    selectRows<MinOrMax>(dstLine, suffixes.data(), prefixes.data() + seLen - 1, dstWidth);
+
+    srcLine += srcStride;
+    dstLine += dstStride;
+  }
+}  // spreadGrayHorizontalDecomposed
+
 template <typename MinOrMax>
 void spreadGrayHorizontal(GrayImage& dst,
                           const CoordinateSystem& dstCs,
@@ -466,11 +596,16 @@ void spreadGrayHorizontal(GrayImage& dst,
                           const CoordinateSystem& srcCs,
                           const int dy,
                           const int dx1,
-                          const int dx2) {
+                          const int dx2,
+                          const MorphologyAlgorithm algorithm) {
   // src_point = dst_point + dstToSrc;
   const QPoint dstToSrc(dstCs.offsetTo(srcCs));
 
-  spreadGrayHorizontal<MinOrMax>(dst, src, dy + dstToSrc.y(), dx1 + dstToSrc.x(), dx2 + dstToSrc.x());
+  if (algorithm == MorphologyAlgorithm::DECOMPOSED) {
+    spreadGrayHorizontalDecomposed<MinOrMax>(dst, src, dy + dstToSrc.y(), dx1 + dstToSrc.x(), dx2 + dstToSrc.x());
+  } else {
+    spreadGrayHorizontal<MinOrMax>(dst, src, dy + dstToSrc.y(), dx1 + dstToSrc.x(), dx2 + dstToSrc.x());
+  }
 }
 
 template <typename MinOrMax>
@@ -516,6 +651,67 @@ void spreadGrayVertical(GrayImage& dst, const GrayImage& src, const int dx, cons
   }
 }  // spreadGrayVertical
 
+/**
+ * Same as spreadGrayHorizontalDecomposed(), but blocks consist of rows rather
+ * than pixels, and suffixes and prefixes are computed for whole rows at once.
+ * Unlike spreadGrayVertical(), this accesses memory sequentially.
+ */
+template <typename MinOrMax>
+void spreadGrayVerticalDecomposed(GrayImage& dst, const GrayImage& src, const int dx, const int dy1, const int dy2) {
+  const int srcStride = src.stride();
+  const int dstStride = dst.stride();
+  const uint8_t* const srcData = src.data() + dx + dy1 * srcStride;
+  uint8_t* const dstData = dst.data();
+
+  const int dstWidth = dst.width();
+  const int dstHeight = dst.height();
+
+  const int seLen = dy2 - dy1 + 1;
+
+  if (seLen == 1) {
+    for (int y = 0; y < dstHeight; ++y) {
+      memcpy(dstData + y * dstStride, srcData + y * srcStride, dstWidth);
+    }
+    return;
+  }
+
+  std::vector<uint8_t> suffixRow(dstWidth);
+  std::vector<uint8_t> prefixRow(dstWidth);
+
+  // Destination rows of a block start at the same offsets as source rows of the block.
+  for (int blockFirst = 0; blockFirst < dstHeight; blockFirst += seLen) {
+    const int numDstRows = std::min(seLen, dstHeight - blockFirst);
+    const uint8_t* const blockSrc = srcData + blockFirst * srcStride;
+    uint8_t* const blockDst = dstData + blockFirst * dstStride;
+
+    // Suffix extremums of the block.  Those that belong to the destination rows
+    // are stored there directly.  Any window starting in this block ends no
+    // earlier than its last row, so the block is always complete.
+    const uint8_t* suffix = blockSrc + (seLen - 1) * srcStride;
+    if (numDstRows == seLen) {
+      memcpy(blockDst + (seLen - 1) * dstStride, suffix, dstWidth);
+    }
+    for (int i = seLen - 2; i >= 0; --i) {
+      uint8_t* const newSuffix = (i < numDstRows) ? blockDst + i * dstStride : suffixRow.data();
+      selectRows<MinOrMax>(newSuffix, suffix, blockSrc + i * srcStride, dstWidth);
+      suffix = newSuffix;
+    }
+
+    // Prefix extremums of the next block, combined with the suffixes.
+    // The window starting at the first row of a block doesn't reach the next one.
+    const uint8_t* const nextBlockSrc = blockSrc + seLen * srcStride;
+    const uint8_t* prefix = nextBlockSrc;
+    for (int i = 1; i < numDstRows; ++i) {
+      if (i > 1) {
+        selectRows<MinOrMax>(prefixRow.data(), prefix, nextBlockSrc + (i - 1) * srcStride, dstWidth);
+        prefix = prefixRow.data();
+      }
+      uint8_t* const dstLine = blockDst + i * dstStride;
+      selectRows<MinOrMax>(dstLine, dstLine, prefix, dstWidth);
+    }
+  }
+}  // spreadGrayVerticalDecomposed
+
 template <typename MinOrMax>
 void spreadGrayVertical(GrayImage& dst,
                         const CoordinateSystem& dstCs,
@@ -523,11 +719,16 @@ void spreadGrayVertical(GrayImage& dst,
                         const CoordinateSystem& srcCs,
                         const int dx,
                         const int dy1,
-                        const int dy2) {
+                        const int dy2,
+                        const MorphologyAlgorithm algorithm) {
   // src_point = dst_point + dstToSrc;
   const QPoint dstToSrc(dstCs.offsetTo(srcCs));
 
-  spreadGrayVertical<MinOrMax>(dst, src, dx + dstToSrc.x(), dy1 + dstToSrc.y(), dy2 + dstToSrc.y());
+  if (algorithm == MorphologyAlgorithm::DECOMPOSED) {
+    spreadGrayVerticalDecomposed<MinOrMax>(dst, src, dx + dstToSrc.x(), dy1 + dstToSrc.y(), dy2 + dstToSrc.y());
+  } else {
+    spreadGrayVertical<MinOrMax>(dst, src, dx + dstToSrc.x(), dy1 + dstToSrc.y(), dy2 + dstToSrc.y());
+  }
 }
 
 GrayImage extendGrayImage(const GrayImage& src, const QRect& dstArea, const uint8_t background) {
@@ -592,6 +793,7 @@ GrayImage dilateOrErodeGray(const GrayImage& src,
     return dst;
   }
   const CoordinateSystem dstCs(dstArea.topLeft());
+  const MorphologyAlgorithm algorithm = morphologyAlgorithm();
 
   // Each pixel will be a minumum or maximum of a group of pixels
   // in its neighborhood.  The neighborhood is defined by collectArea.
@@ -622,10 +824,11 @@ GrayImage dilateOrErodeGray(const GrayImage& src,
       }
 
       spreadGrayHorizontal<MinOrMax>(tmp, tmpCs, effectiveSrc, effectiveSrcCs, collectArea1.minY(), collectArea1.minX(),
-                                     collectArea1.maxX());
+                                     collectArea1.maxX(), algorithm);
     }
     // Second operation.
-    spreadGrayVertical<MinOrMax>(dst, dstCs, tmp, tmpCs, collectArea2.minX(), collectArea2.minY(), collectArea2.maxY());
+    spreadGrayVertical<MinOrMax>(dst, dstCs, tmp, tmpCs, collectArea2.minX(), collectArea2.minY(), collectArea2.maxY(),
+                                 algorithm);
   } else {
     const QRect effectiveSrcRect(extendByBrick(dstArea, collectArea));
     GrayImage effectiveSrc;
@@ -639,17 +842,25 @@ GrayImage dilateOrErodeGray(const GrayImage& src,
 
     if (collectArea.minY() == collectArea.maxY()) {
       spreadGrayHorizontal<MinOrMax>(dst, dstCs, effectiveSrc, effectiveSrcCs, collectArea.minY(), collectArea.minX(),
-                                     collectArea.maxX());
+                                     collectArea.maxX(), algorithm);
     } else {
       assert(collectArea.minX() == collectArea.maxX());
       spreadGrayVertical<MinOrMax>(dst, dstCs, effectiveSrc, effectiveSrcCs, collectArea.minX(), collectArea.minY(),
-                                   collectArea.maxY());
+                                   collectArea.maxY(), algorithm);
     }
   }
   return dst;
 }  // dilateOrErodeGray
 }  // anonymous namespace
 
+void setMorphologyAlgorithm(const MorphologyAlgorithm algorithm) {
+  g_morphologyAlgorithm.store(algorithm, std::memory_order_relaxed);
+}
+
+MorphologyAlgorithm morphologyAlgorithm() {
+  return g_morphologyAlgorithm.load(std::memory_order_relaxed);
+}
+
 BinaryImage dilateBrick(const BinaryImage& src,
                         const Brick& brick,
                         const QRect& dstArea,
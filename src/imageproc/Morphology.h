@@ -87,6 +87,38 @@ class Brick {
 };
 
 
+/**
+ * \brief The ways the brick operations below can be carried out.
+ *
+ * Both produce identical results.
+ */
+enum class MorphologyAlgorithm {
+  /**
+   * Binary images are spread one step at a time, and the gray vertical
+   * pass builds extremum arrays column by column.  The cost of the binary
+   * operations grows with the size of a brick.
+   */
+  STEPWISE,
+
+  /**
+   * Binary images are spread by doubling shifts, so a brick of size N takes
+   * about log2(N) raster operations per direction.  Gray images are processed
+   * with the van Herk / Gil-Werman algorithm, in loops over whole rows.
+   */
+  DECOMPOSED
+};
+
+/**
+ * \brief Selects the algorithm used by the brick operations.
+ *
+ * The default is MorphologyAlgorithm::DECOMPOSED.  The setting is global
+ * and may be changed at any time from any thread.  Operations in progress
+ * are not affected.
+ */
+void setMorphologyAlgorithm(MorphologyAlgorithm algorithm);
+
+MorphologyAlgorithm morphologyAlgorithm();
+
 /**
  * \brief Turn every black pixel into a brick of black pixels.
  *
@@ -0,0 +1,134 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ParallelBands.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "BadAllocIfNull.h"
+#include "ParallelFor.h"
+
+namespace imageproc {
+namespace {
+// Bands thinner than that aren't worth the overhead of processing their halos.
+const int MIN_BAND_HEIGHT = 64;
+
+QImage bandView(const QImage& src, const RowBand& band) {
+  QImage view(src.constScanLine(band.haloTop), src.width(), band.haloBottom - band.haloTop, src.bytesPerLine(),
+              src.format());
+  if (!src.colorTable().isEmpty()) {
+    view.setColorTable(src.colorTable());
+  }
+  view.setDotsPerMeterX(src.dotsPerMeterX());
+  view.setDotsPerMeterY(src.dotsPerMeterY());
+  return view;
+}
+
+/**
+ * \param dstData The data of a binary image of the same width as \p src.
+ */
+void copyBinaryRows(uint32_t* dstData, const int dstTop, const BinaryImage& src, const int srcTop, const int numRows) {
+  const int wpl = src.wordsPerLine();
+  std::memcpy(dstData + dstTop * wpl, src.data() + srcTop * wpl, sizeof(uint32_t) * wpl * numRows);
+}
+}  // namespace
+
+std::vector<RowBand> splitIntoRowBands(const int height, const int halo) {
+  std::vector<RowBand> bands;
+  if (height <= 0) {
+    return bands;
+  }
+
+  const int minBandHeight = std::max(MIN_BAND_HEIGHT, 2 * std::max(halo, 0));
+  const int numBands = std::max(1, std::min(parallelForMaxThreads(), height / minBandHeight));
+  for (int i = 0; i < numBands; ++i) {
+    RowBand band{};
+    band.top = static_cast<int>(static_cast<int64_t>(height) * i / numBands);
+    band.bottom = static_cast<int>(static_cast<int64_t>(height) * (i + 1) / numBands);
+    band.haloTop = std::max(0, band.top - halo);
+    band.haloBottom = std::min(height, band.bottom + halo);
+    bands.push_back(band);
+  }
+  return bands;
+}
+
+QImage processGrayInBandsImpl(const QImage& src, const int halo, const VirtualFunction<QImage, const QImage&>& op) {
+  const std::vector<RowBand> bands(splitIntoRowBands(src.height(), halo));
+  if (bands.size() <= 1) {
+    return op(src);
+  }
+
+  std::vector<QImage> results(bands.size());
+  parallelFor(static_cast<int>(bands.size()), [&](const int i) { results[i] = op(bandView(src, bands[i])); });
+
+  const QImage& first = results.front();
+  QImage dst(src.width(), src.height(), first.format());
+  badAllocIfNull(dst);
+  dst.setColorTable(first.colorTable());
+  dst.setDotsPerMeterX(first.dotsPerMeterX());
+  dst.setDotsPerMeterY(first.dotsPerMeterY());
+  for (size_t i = 0; i < bands.size(); ++i) {
+    const RowBand& band = bands[i];
+    const QImage& result = results[i];
+    if ((result.format() != dst.format()) || (result.width() != dst.width())
+        || (result.height() != band.haloBottom - band.haloTop)) {
+      throw std::logic_error("processGrayInBands: inconsistent band results");
+    }
+
+    const int rowBytes = std::min(dst.bytesPerLine(), result.bytesPerLine());
+    for (int y = band.top; y < band.bottom; ++y) {
+      std::memcpy(dst.scanLine(y), result.constScanLine(y - band.haloTop), static_cast<size_t>(rowBytes));
+    }
+    results[i] = QImage();  // Save memory.
+  }
+  return dst;
+}  // processGrayInBandsImpl
+
+BinaryImage binarizeInBandsImpl(const QImage& src,
+                                const int halo,
+                                const VirtualFunction<BinaryImage, const QImage&>& op) {
+  const std::vector<RowBand> bands(splitIntoRowBands(src.height(), halo));
+  if (bands.size() <= 1) {
+    return op(src);
+  }
+
+  BinaryImage dst(src.size());
+  // Bands write to disjoint rows of dst, so no locking is needed.
+  uint32_t* const dstData = dst.data();
+  parallelFor(static_cast<int>(bands.size()), [&](const int i) {
+    const RowBand& band = bands[i];
+    const BinaryImage result(op(bandView(src, band)));
+    if (result.size() != QSize(src.width(), band.haloBottom - band.haloTop)) {
+      throw std::logic_error("binarizeInBands: inconsistent band results");
+    }
+    copyBinaryRows(dstData, band.top, result, band.top - band.haloTop, band.bottom - band.top);
+  });
+  return dst;
+}
+
+void processBinaryInBandsImpl(BinaryImage& image, const int halo, const VirtualFunction<void, BinaryImage&>& op) {
+  const std::vector<RowBand> bands(splitIntoRowBands(image.height(), halo));
+  if (bands.size() <= 1) {
+    op(image);
+    return;
+  }
+
+  const BinaryImage& src = image;
+  BinaryImage dst(image.size());
+  uint32_t* const dstData = dst.data();
+  parallelFor(static_cast<int>(bands.size()), [&](const int i) {
+    const RowBand& band = bands[i];
+    BinaryImage bandImage(src.width(), band.haloBottom - band.haloTop);
+    copyBinaryRows(bandImage.data(), 0, src, band.haloTop, bandImage.height());
+    op(bandImage);
+    if (bandImage.size() != QSize(src.width(), band.haloBottom - band.haloTop)) {
+      throw std::logic_error("processBinaryInBands: the band was resized");
+    }
+    copyBinaryRows(dstData, band.top, bandImage, band.top - band.haloTop, band.bottom - band.top);
+  });
+  image.swap(dst);
+}
+}  // namespace imageproc
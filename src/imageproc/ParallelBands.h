@@ -0,0 +1,90 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_IMAGEPROC_PARALLELBANDS_H_
+#define SCANTAILOR_IMAGEPROC_PARALLELBANDS_H_
+
+#include <QImage>
+#include <vector>
+
+#include "BinaryImage.h"
+#include "VirtualFunction.h"
+
+namespace imageproc {
+/**
+ * \brief A horizontal band of image rows.
+ *
+ * Rows [top, bottom) belong to the band, while rows [haloTop, haloBottom)
+ * are the ones an operation on the band gets to see.
+ */
+struct RowBand {
+  int top;
+  int bottom;
+  int haloTop;
+  int haloBottom;
+};
+
+/**
+ * \brief Splits image rows into bands to be processed in parallel.
+ *
+ * Every band is extended by up to \p halo rows in both directions,
+ * but never beyond the image.  Images too small to benefit from splitting
+ * result in a single band covering the whole image.
+ */
+std::vector<RowBand> splitIntoRowBands(int height, int halo);
+
+/**
+ * \brief Runs a local operation producing a grayscale image on horizontal bands in parallel.
+ *
+ * The operation is run on each band together with its halo, and only the band's own
+ * rows of the result are kept.  If every output pixel of \p op depends only on input
+ * rows no further than \p halo away, and image borders are handled based on
+ * the distance to them, the result is identical to op(src).
+ *
+ * \p op will be called like this: QImage result = op(band);
+ * where band is a read-only QImage referencing the rows of \p src.
+ * All the results must have the size of their input and the same format.
+ */
+template <typename Op>
+QImage processGrayInBands(const QImage& src, int halo, Op op);
+
+/**
+ * \brief Same as processGrayInBands(), but for operations producing binary images.
+ *
+ * \p op will be called like this: BinaryImage result = op(band);
+ */
+template <typename Op>
+BinaryImage binarizeInBands(const QImage& src, int halo, Op op);
+
+/**
+ * \brief Same as processGrayInBands(), but for in-place operations on binary images.
+ *
+ * \p op will be called like this: op(band);
+ * where band is a BinaryImage holding a copy of the rows of \p image.
+ */
+template <typename Op>
+void processBinaryInBands(BinaryImage& image, int halo, Op op);
+
+QImage processGrayInBandsImpl(const QImage& src, int halo, const VirtualFunction<QImage, const QImage&>& op);
+
+BinaryImage binarizeInBandsImpl(const QImage& src, int halo, const VirtualFunction<BinaryImage, const QImage&>& op);
+
+void processBinaryInBandsImpl(BinaryImage& image, int halo, const VirtualFunction<void, BinaryImage&>& op);
+
+
+template <typename Op>
+QImage processGrayInBands(const QImage& src, const int halo, Op op) {
+  return processGrayInBandsImpl(src, halo, ProxyFunction<Op, QImage, const QImage&>(op));
+}
+
+template <typename Op>
+BinaryImage binarizeInBands(const QImage& src, const int halo, Op op) {
+  return binarizeInBandsImpl(src, halo, ProxyFunction<Op, BinaryImage, const QImage&>(op));
+}
+
+template <typename Op>
+void processBinaryInBands(BinaryImage& image, const int halo, Op op) {
+  processBinaryInBandsImpl(image, halo, ProxyFunction<Op, void, BinaryImage&>(op));
+}
+}  // namespace imageproc
+#endif  // ifndef SCANTAILOR_IMAGEPROC_PARALLELBANDS_H_
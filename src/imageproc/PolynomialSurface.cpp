@@ -9,6 +9,7 @@
 #include <cmath>
 #include <cstdint>
 #include <stdexcept>
+#include <vector>
 
 #include "AlignedArray.h"
 #include "BinaryImage.h"
@@ -20,6 +21,109 @@
 #include "VecT.h"
 
 namespace imageproc {
+namespace {
+/**
+ * Builds A^T*A and A^T*b from data points, one row at a time.
+ *
+ * An element of A^T*A is a sum of x^(j1 + j2) * y^(i1 + i2) over data points,
+ * so instead of adding numTerms * numTerms products per data point, we sum
+ * x^n over the data points of a row, for n up to 2 * hDegree, and once per row
+ * add those sums to the moments multiplied by powers of y.  A^T*b is built
+ * the same way from the sums of x^j * b.
+ */
+class LeastSquaresAccumulator {
+ public:
+  LeastSquaresAccumulator(int width, int hDegree, int vDegree, double xscale, double yscale);
+
+  void addDataPoint(int x, double dataPoint) {
+    const double* const xPowers = &m_xPowers[x * m_numXMoments];
+    for (int n = 0; n < m_numXMoments; ++n) {
+      m_rowMoments[n] += xPowers[n];
+    }
+    for (int j = 0; j <= m_hDegree; ++j) {
+      m_rowDataMoments[j] += xPowers[j] * dataPoint;
+    }
+  }
+
+  void finishRow(int y);
+
+  void write(MatT<double>& AtA, VecT<double>& Atb) const;
+
+ private:
+  int m_hDegree;
+  int m_vDegree;
+  int m_numXMoments;
+  int m_numYMoments;
+  double m_yscale;
+  std::vector<double> m_xPowers;         // x^n for every x, n < m_numXMoments.
+  std::vector<double> m_rowMoments;      // Sums of x^n over a row.
+  std::vector<double> m_rowDataMoments;  // Sums of x^j * b over a row.
+  std::vector<double> m_moments;         // Sums of x^n * y^m, indexed by [m * m_numXMoments + n].
+  std::vector<double> m_dataMoments;     // Sums of x^j * y^i * b, indexed by [i * (hDegree + 1) + j].
+};
+
+
+LeastSquaresAccumulator::LeastSquaresAccumulator(const int width,
+                                                 const int hDegree,
+                                                 const int vDegree,
+                                                 const double xscale,
+                                                 const double yscale)
+    : m_hDegree(hDegree),
+      m_vDegree(vDegree),
+      m_numXMoments(2 * hDegree + 1),
+      m_numYMoments(2 * vDegree + 1),
+      m_yscale(yscale),
+      m_xPowers(static_cast<size_t>(width) * m_numXMoments),
+      m_rowMoments(m_numXMoments, 0.0),
+      m_rowDataMoments(hDegree + 1, 0.0),
+      m_moments(m_numYMoments * m_numXMoments, 0.0),
+      m_dataMoments((vDegree + 1) * (hDegree + 1), 0.0) {
+  for (int x = 0; x < width; ++x) {
+    const double xAdjusted = xscale * x;
+    double xPower = 1.0;
+    for (int n = 0; n < m_numXMoments; ++n) {
+      m_xPowers[x * m_numXMoments + n] = xPower;
+      xPower *= xAdjusted;
+    }
+  }
+}
+
+void LeastSquaresAccumulator::finishRow(const int y) {
+  const double yAdjusted = m_yscale * y;
+  double yPower = 1.0;
+  for (int m = 0; m < m_numYMoments; ++m) {
+    for (int n = 0; n < m_numXMoments; ++n) {
+      m_moments[m * m_numXMoments + n] += yPower * m_rowMoments[n];
+    }
+    if (m <= m_vDegree) {
+      for (int j = 0; j <= m_hDegree; ++j) {
+        m_dataMoments[m * (m_hDegree + 1) + j] += yPower * m_rowDataMoments[j];
+      }
+    }
+    yPower *= yAdjusted;
+  }
+
+  std::fill(m_rowMoments.begin(), m_rowMoments.end(), 0.0);
+  std::fill(m_rowDataMoments.begin(), m_rowDataMoments.end(), 0.0);
+}
+
+void LeastSquaresAccumulator::write(MatT<double>& AtA, VecT<double>& Atb) const {
+  // Terms are ordered as x^j * y^i, with i in the outer loop.
+  const int numHorTerms = m_hDegree + 1;
+  const int numTerms = numHorTerms * (m_vDegree + 1);
+  for (int p1 = 0; p1 < numTerms; ++p1) {
+    const int i1 = p1 / numHorTerms;
+    const int j1 = p1 % numHorTerms;
+    Atb[p1] = m_dataMoments[p1];
+    for (int p2 = 0; p2 < numTerms; ++p2) {
+      const int i2 = p2 / numHorTerms;
+      const int j2 = p2 % numHorTerms;
+      AtA(p1, p2) = m_moments[(i1 + i2) * m_numXMoments + j1 + j2];
+    }
+  }
+}
+}  // namespace
+
 PolynomialSurface::PolynomialSurface(const int horDegree, const int vertDegree, const GrayImage& src)
     : m_horDegree(horDegree), m_vertDegree(vertDegree) {
   // Note: m_horDegree and m_vertDegree may still change!
@@ -116,49 +220,52 @@ GrayImage PolynomialSurface::render(const QSize& size) const {
   const int height = size.height();
   unsigned char* line = image.data();
   const int bpl = image.stride();
-  const auto numCoeffs = static_cast<int>(m_coeffs.size());
 
   // Pretend that both x and y positions of pixels
   // lie in range of [0, 1].
   const double xscale = calcScale(width);
   const double yscale = calcScale(height);
 
-  AlignedArray<float, 4> vertMatrix(numCoeffs * height);
-  float* out = &vertMatrix[0];
-  for (int y = 0; y < height; ++y) {
+  // x^j for every x, stored row by row for every j.
+  const int numHorTerms = m_horDegree + 1;
+  AlignedArray<float, 4> horPowers(numHorTerms * width);
+  for (int x = 0; x < width; ++x) {
+    const double xAdjusted = x * xscale;
+    double pow = 1.0;
+    for (int j = 0; j < numHorTerms; ++j) {
+      horPowers[j * width + x] = static_cast<float>(pow);
+      pow *= xAdjusted;
+    }
+  }
+
+  // Within a row, the surface is a polynomial in x alone.  Its coefficients
+  // are computed once per row, after which a pixel takes only numHorTerms
+  // multiply-adds, done for a whole row at a time.
+  std::vector<double> rowCoeffs(numHorTerms);
+  AlignedArray<float, 4> sums(width);
+  for (int y = 0; y < height; ++y, line += bpl) {
     const double yAdjusted = y * yscale;
+    std::fill(rowCoeffs.begin(), rowCoeffs.end(), 0.0);
     double pow = 1.0;
-    int pos = 0;
-    for (int i = 0; i <= m_vertDegree; ++i) {
-      for (int j = 0; j <= m_horDegree; ++j, ++pos, ++out) {
-        *out = static_cast<float>(m_coeffs[pos] * pow);
+    for (int i = 0, pos = 0; i <= m_vertDegree; ++i) {
+      for (int j = 0; j < numHorTerms; ++j, ++pos) {
+        rowCoeffs[j] += m_coeffs[pos] * pow;
       }
       pow *= yAdjusted;
     }
-  }
 
-  AlignedArray<float, 4> horMatrix(numCoeffs * width);
-  out = &horMatrix[0];
-  for (int x = 0; x < width; ++x) {
-    const double xAdjusted = x * xscale;
-    for (int i = 0; i <= m_vertDegree; ++i) {
-      double pow = 1.0;
-      for (int j = 0; j <= m_horDegree; ++j, ++out) {
-        *out = static_cast<float>(pow);
-        pow *= xAdjusted;
+    float* const rowSums = sums.data();
+    std::fill(rowSums, rowSums + width, 0.5f / 255.0f);  // for rounding purposes.
+    for (int j = 0; j < numHorTerms; ++j) {
+      const auto coeff = static_cast<float>(rowCoeffs[j]);
+      const float* const powers = &horPowers[j * width];
+      for (int x = 0; x < width; ++x) {
+        rowSums[x] += coeff * powers[x];
       }
     }
-  }
 
-  const float* vertLine = &vertMatrix[0];
-  for (int y = 0; y < height; ++y, line += bpl, vertLine += numCoeffs) {
-    const float* horLine = &horMatrix[0];
-    for (int x = 0; x < width; ++x, horLine += numCoeffs) {
-      float sum = 0.5f / 255.0f;  // for rounding purposes.
-      for (int i = 0; i < numCoeffs; ++i) {
-        sum += horLine[i] * vertLine[i];
-      }
-      const auto isum = (int) (sum * 255.0);
+    for (int x = 0; x < width; ++x) {
+      const auto isum = (int) (rowSums[x] * 255.0);
       line[x] = static_cast<unsigned char>(qBound(0, isum, 255));
     }
   }
@@ -194,73 +301,26 @@ void PolynomialSurface::prepareDataForLeastSquares(const GrayImage& image,
                                                    VecT<double>& Atb,
                                                    const int hDegree,
                                                    const int vDegree) {
-  double* const AtA_data = AtA.data();
-  double* const Atb_data = Atb.data();
-
   const int width = image.width();
   const int height = image.height();
-  const auto numTerms = static_cast<int>(Atb.size());
 
   const uint8_t* line = image.data();
   const int stride = image.stride();
 
   // Pretend that both x and y positions of pixels
   // lie in range of [0, 1].
-  const double xscale = calcScale(width);
-  const double yscale = calcScale(height);
+  LeastSquaresAccumulator accumulator(width, hDegree, vDegree, calcScale(width), calcScale(height));
 
   // To force data samples into [0, 1] range.
   const double dataScale = 1.0 / 255.0;
 
-  // 1, y, y^2, y^3, ...
-  VecT<double> yPowers(vDegree + 1);  // Initialized to 0.
-
-  // Same as yPowers, except yPowers correspond to a given y,
-  // while xPowers are computed for all possible x values.
-  MatT<double> xPowers(hDegree + 1, width);  // Initialized to 0.
-  for (int x = 0; x < width; ++x) {
-    const double xAdjusted = xscale * x;
-    double xPower = 1.0;
-    for (int i = 0; i <= hDegree; ++i) {
-      xPowers(i, x) = xPower;
-      xPower *= xAdjusted;
-    }
-  }
-
-  VecT<double> fullPowers(numTerms);
-
   for (int y = 0; y < height; ++y, line += stride) {
-    const double yAdjusted = yscale * y;
-
-    double yPower = 1.0;
-    for (int i = 0; i <= vDegree; ++i) {
-      yPowers[i] = yPower;
-      yPower *= yAdjusted;
-    }
-
     for (int x = 0; x < width; ++x) {
-      const double dataPoint = dataScale * line[x];
-
-      int pos = 0;
-      for (int i = 0; i <= vDegree; ++i) {
-        for (int j = 0; j <= hDegree; ++j, ++pos) {
-          fullPowers[pos] = yPowers[i] * xPowers(j, x);
-        }
-      }
-
-      double* p_AtA = AtA_data;
-      for (int i = 0; i < numTerms; ++i) {
-        const double iVal = fullPowers[i];
-        Atb_data[i] += iVal * dataPoint;
-
-        for (int j = 0; j < numTerms; ++j) {
-          const double jVal = fullPowers[j];
-          *p_AtA += iVal * jVal;
-          ++p_AtA;
-        }
-      }
+      accumulator.addDataPoint(x, dataScale * line[x]);
     }
+    accumulator.finishRow(y);
   }
+  accumulator.write(AtA, Atb);
 }  // PolynomialSurface::prepareDataForLeastSquares
 
 void PolynomialSurface::prepareDataForLeastSquares(const GrayImage& image,
@@ -269,12 +329,8 @@ void PolynomialSurface::prepareDataForLeastSquares(const GrayImage& image,
                                                    VecT<double>& Atb,
                                                    const int hDegree,
                                                    const int vDegree) {
-  double* const AtA_data = AtA.data();
-  double* const Atb_data = Atb.data();
-
   const int width = image.width();
   const int height = image.height();
-  const auto numTerms = static_cast<int>(Atb.size());
 
   const uint8_t* imageLine = image.data();
   const int imageStride = image.stride();
@@ -284,69 +340,24 @@ void PolynomialSurface::prepareDataForLeastSquares(const GrayImage& image,
 
   // Pretend that both x and y positions of pixels
   // lie in range of [0, 1].
-  const double xscale = calcScale(width);
-  const double yscale = calcScale(height);
+  LeastSquaresAccumulator accumulator(width, hDegree, vDegree, calcScale(width), calcScale(height));
 
   // To force data samples into [0, 1] range.
   const double dataScale = 1.0 / 255.0;
 
-  // 1, y, y^2, y^3, ...
-  VecT<double> yPowers(vDegree + 1);  // Initialized to 0.
-
-  // Same as yPowers, except yPowers correspond to a given y,
-  // while xPowers are computed for all possible x values.
-  MatT<double> xPowers(hDegree + 1, width);  // Initialized to 0.
-  for (int x = 0; x < width; ++x) {
-    const double xAdjusted = xscale * x;
-    double xPower = 1.0;
-    for (int i = 0; i <= hDegree; ++i) {
-      xPowers(i, x) = xPower;
-      xPower *= xAdjusted;
-    }
-  }
-
-  VecT<double> fullPowers(numTerms);
-
   const uint32_t msb = uint32_t(1) << 31;
   for (int y = 0; y < height; ++y) {
-    const double yAdjusted = yscale * y;
-
-    double yPower = 1.0;
-    for (int i = 0; i <= vDegree; ++i) {
-      yPowers[i] = yPower;
-      yPower *= yAdjusted;
-    }
-
     for (int x = 0; x < width; ++x) {
-      if (!(maskLine[x >> 5] & (msb >> (x & 31)))) {
-        continue;
-      }
-
-      const double dataPoint = dataScale * imageLine[x];
-
-      int pos = 0;
-      for (int i = 0; i <= vDegree; ++i) {
-        for (int j = 0; j <= hDegree; ++j, ++pos) {
-          fullPowers[pos] = yPowers[i] * xPowers(j, x);
-        }
-      }
-
-      double* p_AtA = AtA_data;
-      for (int i = 0; i < numTerms; ++i) {
-        const double iVal = fullPowers[i];
-        Atb_data[i] += iVal * dataPoint;
-
-        for (int j = 0; j < numTerms; ++j) {
-          const double jVal = fullPowers[j];
-          *p_AtA += iVal * jVal;
-          ++p_AtA;
-        }
+      if (maskLine[x >> 5] & (msb >> (x & 31))) {
+        accumulator.addDataPoint(x, dataScale * imageLine[x]);
       }
     }
+    accumulator.finishRow(y);
 
     imageLine += imageStride;
     maskLine += maskStride;
   }
+  accumulator.write(AtA, Atb);
 }  // PolynomialSurface::prepareDataForLeastSquares
 
 void PolynomialSurface::fixSquareMatrixRankDeficiency(MatT<double>& mat) {
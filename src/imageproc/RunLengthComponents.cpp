@@ -0,0 +1,220 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "RunLengthComponents.h"
+
+#include <QPoint>
+#include <QRect>
+#include <algorithm>
+
+#include "BinaryImage.h"
+#include "BitOps.h"
+#include "ParallelBands.h"
+#include "ParallelFor.h"
+
+namespace imageproc {
+namespace {
+using Run = RunLengthComponents::Run;
+
+/**
+ * \brief The runs of a band of rows, connected within the band.
+ */
+struct BandRuns {
+  std::vector<Run> runs;
+  // The runs of the i-th row of the band are [rowOffsets[i], rowOffsets[i + 1]).
+  std::vector<uint32_t> rowOffsets;
+  // A union-find forest over the runs.  A parent always has a lower index than its children,
+  // so a root is the first run of its component in raster order.
+  std::vector<uint32_t> parents;
+};
+
+/**
+ * \brief Finds the next pixel of the requested color at or after \p x.
+ *
+ * \return The position of the pixel, or \p width if there is none.
+ */
+int findNextPixel(const uint32_t* line, int x, const int width, const bool black) {
+  const uint32_t invert = black ? 0 : ~uint32_t(0);
+  while (x < width) {
+    const uint32_t word = (line[x >> 5] ^ invert) & (~uint32_t(0) >> (x & 31));
+    if (word) {
+      return std::min(width, (x & ~31) + countMostSignificantZeroes(word));
+    }
+    x = (x & ~31) + 32;
+  }
+  return width;
+}
+
+void extractRuns(const uint32_t* line, const int y, const int width, std::vector<Run>& runs) {
+  int x = findNextPixel(line, 0, width, true);
+  while (x < width) {
+    const int end = findNextPixel(line, x, width, false);
+    runs.push_back(Run{y, x, end});
+    x = findNextPixel(line, end, width, true);
+  }
+}
+
+uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t idx) {
+  while (parents[idx] != idx) {
+    // Path halving.
+    parents[idx] = parents[parents[idx]];
+    idx = parents[idx];
+  }
+  return idx;
+}
+
+void unite(std::vector<uint32_t>& parents, uint32_t idx1, uint32_t idx2) {
+  idx1 = findRoot(parents, idx1);
+  idx2 = findRoot(parents, idx2);
+  if (idx1 < idx2) {
+    parents[idx2] = idx1;
+  } else if (idx2 < idx1) {
+    parents[idx1] = idx2;
+  }
+}
+
+/**
+ * \brief Unites the runs of two adjacent rows that touch each other.
+ *
+ * \param reach 0 for 4-connectivity, 1 for 8-connectivity.
+ * \param offset1 The index of the first run of the upper row in \p parents.
+ * \param offset2 The index of the first run of the lower row in \p parents.
+ */
+void uniteAdjacentRows(std::vector<uint32_t>& parents,
+                       const Run* runs1,
+                       const uint32_t offset1,
+                       const uint32_t numRuns1,
+                       const Run* runs2,
+                       const uint32_t offset2,
+                       const uint32_t numRuns2,
+                       const int reach) {
+  uint32_t i = 0;
+  uint32_t j = 0;
+  while ((i < numRuns1) && (j < numRuns2)) {
+    const Run& run1 = runs1[i];
+    const Run& run2 = runs2[j];
+    if ((run1.begin < run2.end + reach) && (run2.begin < run1.end + reach)) {
+      unite(parents, offset1 + i, offset2 + j);
+    }
+    // Whichever ends first can't touch anything further.
+    if (run1.end < run2.end) {
+      ++i;
+    } else {
+      ++j;
+    }
+  }
+}
+
+void labelBand(const BinaryImage& image, const RowBand& band, const int reach, BandRuns& bandRuns) {
+  const int width = image.width();
+  const int wpl = image.wordsPerLine();
+  const uint32_t* line = image.data() + band.top * wpl;
+
+  bandRuns.rowOffsets.push_back(0);
+  for (int y = band.top; y < band.bottom; ++y, line += wpl) {
+    extractRuns(line, y, width, bandRuns.runs);
+    bandRuns.rowOffsets.push_back(static_cast<uint32_t>(bandRuns.runs.size()));
+  }
+
+  std::vector<uint32_t>& parents = bandRuns.parents;
+  parents.resize(bandRuns.runs.size());
+  for (uint32_t i = 0; i < parents.size(); ++i) {
+    parents[i] = i;
+  }
+
+  const Run* const runs = bandRuns.runs.data();
+  const std::vector<uint32_t>& offsets = bandRuns.rowOffsets;
+  for (size_t row = 1; row + 1 < offsets.size(); ++row) {
+    uniteAdjacentRows(parents, runs + offsets[row - 1], offsets[row - 1], offsets[row] - offsets[row - 1],
+                      runs + offsets[row], offsets[row], offsets[row + 1] - offsets[row], reach);
+  }
+}
+}  // namespace
+
+RunLengthComponents::RunLengthComponents() : m_runOffsets(1, 0), m_components(1) {}
+
+/**
+ * Runs of black pixels are connected within bands of rows in parallel, then the bands
+ * are connected to each other.  Labels are assigned in the raster order of the first pixels
+ * of the components.
+ */
+RunLengthComponents::RunLengthComponents(const BinaryImage& image, const Connectivity conn)
+    : m_size(image.size()), m_runOffsets(1, 0), m_components(1) {
+  if (m_size.isEmpty()) {
+    return;
+  }
+
+  const int reach = (conn == CONN8) ? 1 : 0;
+  const std::vector<RowBand> bands(splitIntoRowBands(m_size.height(), 0));
+  std::vector<BandRuns> bandRuns(bands.size());
+
+  parallelFor(static_cast<int>(bands.size()),
+              [&](const int i) { labelBand(image, bands[i], reach, bandRuns[i]); });
+
+  // Merge the forests, offsetting the indices of every band by the number of runs before it.
+  std::vector<uint32_t> bandOffsets(bands.size() + 1, 0);
+  for (size_t i = 0; i < bands.size(); ++i) {
+    bandOffsets[i + 1] = bandOffsets[i] + static_cast<uint32_t>(bandRuns[i].runs.size());
+  }
+  std::vector<uint32_t> parents(bandOffsets.back());
+  for (size_t i = 0; i < bands.size(); ++i) {
+    const uint32_t offset = bandOffsets[i];
+    std::vector<uint32_t>& bandParents = bandRuns[i].parents;
+    for (uint32_t j = 0; j < bandParents.size(); ++j) {
+      parents[offset + j] = offset + bandParents[j];
+    }
+    std::vector<uint32_t>().swap(bandParents);
+  }
+
+  // Connect the last row of each band to the first row of the next one.
+  for (size_t i = 1; i < bands.size(); ++i) {
+    const BandRuns& upper = bandRuns[i - 1];
+    const BandRuns& lower = bandRuns[i];
+    const uint32_t upperFirst = upper.rowOffsets[upper.rowOffsets.size() - 2];
+    const uint32_t upperLast = upper.rowOffsets.back();
+    uniteAdjacentRows(parents, upper.runs.data() + upperFirst, bandOffsets[i - 1] + upperFirst,
+                      upperLast - upperFirst, lower.runs.data(), bandOffsets[i], lower.rowOffsets[1], reach);
+  }
+
+  // Parents always precede their children, and roots are the first runs of their
+  // components in raster order.  Going in that order, a component gets its label
+  // when its root is reached, and any other run finds its parent already replaced by the label.
+  std::vector<uint32_t>& labels = parents;
+  std::vector<uint32_t> numRuns(1, 0);
+  uint32_t runIdx = 0;
+  for (const BandRuns& band : bandRuns) {
+    for (const Run& run : band.runs) {
+      const uint32_t parent = parents[runIdx];
+      uint32_t label;
+      if (parent == runIdx) {
+        label = static_cast<uint32_t>(m_components.size());
+        m_components.emplace_back(QPoint(run.begin, run.y), QRect(run.begin, run.y, run.length(), 1), 0);
+        numRuns.push_back(0);
+      } else {
+        label = labels[parent];
+      }
+      ConnComp& comp = m_components[label];
+      comp = ConnComp(comp.seed(), comp.rect().united(QRect(run.begin, run.y, run.length(), 1)),
+                      comp.pixCount() + run.length());
+      ++numRuns[label];
+      labels[runIdx] = label;
+      ++runIdx;
+    }
+  }
+
+  // Group the runs by component, keeping the raster order within each.
+  m_runOffsets.resize(m_components.size(), 0);
+  for (size_t label = 1; label < m_components.size(); ++label) {
+    m_runOffsets[label] = m_runOffsets[label - 1] + numRuns[label];
+  }
+  std::vector<uint32_t> nextRun(m_runOffsets.begin(), m_runOffsets.end() - 1);
+  m_runs.resize(labels.size());
+  runIdx = 0;
+  for (const BandRuns& band : bandRuns) {
+    for (const Run& run : band.runs) {
+      m_runs[nextRun[labels[runIdx] - 1]++] = run;
+      ++runIdx;
+    }
+  }
+}  // RunLengthComponents::RunLengthComponents
+}  // namespace imageproc
@@ -0,0 +1,86 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_IMAGEPROC_RUNLENGTHCOMPONENTS_H_
+#define SCANTAILOR_IMAGEPROC_RUNLENGTHCOMPONENTS_H_
+
+#include <QSize>
+#include <cstdint>
+#include <vector>
+
+#include "ConnComp.h"
+#include "Connectivity.h"
+
+namespace imageproc {
+class BinaryImage;
+
+/**
+ * \brief Connected components of a binary image, stored as runs of black pixels.
+ *
+ * Unlike ConnectivityMap, this takes memory proportional to the number of runs
+ * rather than to the area of the image.  Components are labeled the same way
+ * ConnectivityMap labels them, that is from 1 in the raster order of their first pixels.
+ */
+class RunLengthComponents {
+ public:
+  /**
+   * \brief A horizontal run of black pixels, [begin, end) on line y.
+   */
+  struct Run {
+    int y;
+    int begin;
+    int end;
+
+    int length() const { return end - begin; }
+  };
+
+  /**
+   * \brief Constructs a store without any components.
+   */
+  RunLengthComponents();
+
+  /**
+   * \brief Finds the components of a binary image.
+   *
+   * The image is processed in bands of rows in parallel.
+   */
+  RunLengthComponents(const BinaryImage& image, Connectivity conn);
+
+  QSize size() const { return m_size; }
+
+  /**
+   * \brief Returns the number of components, which is also the maximum label.
+   */
+  uint32_t maxLabel() const { return static_cast<uint32_t>(m_components.size() - 1); }
+
+  /**
+   * \brief Returns the pixel count, the bounding box and the seed of a component.
+   *
+   * \param label A label in [1, maxLabel()].  Label 0 stands for the background,
+   *        and gives a null ConnComp.
+   */
+  const ConnComp& component(uint32_t label) const { return m_components[label]; }
+
+  /**
+   * \brief Returns all the components, indexed by label.
+   */
+  const std::vector<ConnComp>& components() const { return m_components; }
+
+  /**
+   * \brief The runs of a component, in raster order.
+   *
+   * \param label A label in [1, maxLabel()].
+   */
+  const Run* runsBegin(uint32_t label) const { return m_runs.data() + m_runOffsets[label - 1]; }
+
+  const Run* runsEnd(uint32_t label) const { return m_runs.data() + m_runOffsets[label]; }
+
+ private:
+  QSize m_size;
+  std::vector<Run> m_runs;
+  // The runs of label l are [m_runOffsets[l - 1], m_runOffsets[l]).
+  std::vector<uint32_t> m_runOffsets;
+  std::vector<ConnComp> m_components;
+};
+}  // namespace imageproc
+#endif  // ifndef SCANTAILOR_IMAGEPROC_RUNLENGTHCOMPONENTS_H_
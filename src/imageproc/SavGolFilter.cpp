@@ -3,6 +3,12 @@
 
 #include "SavGolFilter.h"
 
+#include <QImage>
+#include <QPoint>
+#include <QSize>
+#include <algorithm>
+#include <vector>
+
 #include "Grayscale.h"
 #include "SavGolKernel.h"
 
@@ -12,31 +18,18 @@ int calcNumTerms(const int horDegree, const int vertDegree) {
   return (horDegree + 1) * (vertDegree + 1);
 }
 
-class Kernel : public SavGolKernel {
- public:
-  Kernel(const QSize& size, const QPoint& origin, int horDegree, int vertDegree)
-      : SavGolKernel(size, origin, horDegree, vertDegree) {}
-
-  void convolve(uint8_t* dst, const uint8_t* srcTopLeft, int srcBpl) const;
-};
-
-
-inline void Kernel::convolve(uint8_t* dst, const uint8_t* srcTopLeft, int srcBpl) const {
-  const uint8_t* pSrc = srcTopLeft;
-  const float* pKernel = data();
-  float sum = 0.5;  // For rounding purposes.
-  const int w = width();
-  const int h = height();
-
-  for (int y = 0; y < h; ++y, pSrc += srcBpl) {
-    for (int x = 0; x < w; ++x) {
-      sum += pSrc[x] * *pKernel;
-      ++pKernel;
-    }
-  }
-
-  const auto val = static_cast<int>(sum);
-  *dst = static_cast<uint8_t>(qBound(0, val, 255));
+/**
+ * Returns one-dimensional kernels for every position of the origin within
+ * a window of the given size, one after another.
+ */
+std::vector<float> calcKernelsForAllOrigins(const int windowSize, const int degree) {
+  SavGolKernel kernel(QSize(windowSize, 1), QPoint(0, 0), degree, 0);
+  std::vector<float> kernels(static_cast<size_t>(windowSize) * windowSize);
+  for (int origin = 0; origin < windowSize; ++origin) {
+    kernel.recalcForOrigin(QPoint(origin, 0));
+    std::copy(kernel.data(), kernel.data() + windowSize, &kernels[origin * windowSize]);
+  }
+  return kernels;
 }
 
 QImage savGolFilterGrayToGray(const QImage& src, const QSize& windowSize, const int horDegree, const int vertDegree) {
@@ -52,33 +45,23 @@ QImage savGolFilterGrayToGray(const QImage& src, const QSize& windowSize, const
   }
 
   /*
-   * Consider a 5x5 kernel:
-   * |x|x|T|x|x|
-   * |x|x|T|x|x|
-   * |L|L|C|R|R|
-   * |x|x|B|x|x|
-   * |x|x|B|x|x|
+   * Fitting a polynomial with separate horizontal and vertical degrees to
+   * a rectangular window is the same as fitting rows and then columns,
+   * so a two-dimensional kernel is the outer product of two one-dimensional
+   * ones.  That holds wherever the origin (the pixel being recalculated)
+   * is within the window, which is what happens near the edges of the image,
+   * where the window is kept inside the image and the origin moves towards
+   * the edge instead.  So we filter rows first and then columns, with
+   * a kernel for every position of the origin.
    */
+  const std::vector<float> horKernels(calcKernelsForAllOrigins(kw, horDegree));
+  const std::vector<float> vertKernels(calcKernelsForAllOrigins(kh, vertDegree));
 
-  // Co-ordinates of the central point (C) of the kernel.
-  const QPoint kCenter(kw / 2, kh / 2);
-
-  // Origin is the current hot spot of the kernel.
-  // Normally it's at kCenter, but sometimes we move
-  // it to other locations to avoid parts of the kernel
-  // from going outside of the image area.
-  QPoint kOrigin;
-
-  // Length of the top segment (T) of the kernel.
-  const int kTop = kCenter.y();
-
-  // Length of the bottom segment (B) of the kernel.
-  const int kBottom = kh - kTop - 1;
-
-  // Length of the left segment (L) of the kernel.
-  const int kLeft = kCenter.x();
-  // Length of the right segment (R) of the kernel.
+  // Normally the origin is at the center of the window.
+  const int kLeft = kw / 2;
+  const int kTop = kh / 2;
   const int kRight = kw - kLeft - 1;
+  const int kBottom = kh - kTop - 1;
 
   const uint8_t* const srcData = src.bits();
   const int srcBpl = src.bytesPerLine();
@@ -91,171 +74,68 @@ QImage savGolFilterGrayToGray(const QImage& src, const QSize& windowSize, const
 
   uint8_t* const dstData = dst.bits();
   const int dstBpl = dst.bytesPerLine();
-  // Top-left corner.
-  const uint8_t* srcLine = srcData;
-  uint8_t* dstLine = dstData;
-  Kernel kernel(windowSize, QPoint(0, 0), horDegree, vertDegree);
-  for (int y = 0; y < kTop; ++y, dstLine += dstBpl) {
-    kOrigin.setY(y);
-    for (int x = 0; x < kLeft; ++x) {
-      kOrigin.setX(x);
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-    }
-  }
-
-  // Top area between two corners.
-  kOrigin.setX(kCenter.x());
-  srcLine = srcData - kLeft;
-  dstLine = dstData;
-  for (int y = 0; y < kTop; ++y, dstLine += dstBpl) {
-    kOrigin.setY(y);
-    kernel.recalcForOrigin(kOrigin);
-    for (int x = kLeft; x < width - kRight; ++x) {
-      kernel.convolve(dstLine + x, srcLine + x, srcBpl);
-    }
-  }
-  // Top-right corner.
-  kOrigin.setY(0);
-  srcLine = srcData + width - kw;
-  dstLine = dstData;
-  for (int y = 0; y < kTop; ++y, dstLine += dstBpl) {
-    kOrigin.setX(kCenter.x() + 1);
-    for (int x = width - kRight; x < width; ++x) {
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      kOrigin.rx() += 1;
-    }
-    kOrigin.ry() += 1;
-  }
-  // Central area.
-#if 0
-            // Simple but slow implementation.
-                    kernel.recalcForOrigin(kCenter);
-                    srcLine = srcData - kLeft;
-                    dstLine = dstData + dstBpl * kTop;
-                    for (int y = kTop; y < height - kBottom; ++y) {
-                        for (int x = kLeft; x < width - kRight; ++x) {
-                            kernel.convolve(dstLine + x, srcLine + x, srcBpl);
-                        }
-                        srcLine += srcBpl;
-                        dstLine += dstBpl;
-                    }
-#else
-  // Take advantage of Savitzky-Golay filter being separable.
-  const SavGolKernel horKernel(QSize(windowSize.width(), 1), QPoint(kCenter.x(), 0), horDegree, 0);
-  const SavGolKernel vertKernel(QSize(1, windowSize.height()), QPoint(0, kCenter.y()), 0, vertDegree);
-
-  const int shift = kw - 1;
 
-  // Allocate a 16-byte aligned temporary storage.
-  // That may help the compiler to emit efficient SSE code.
-  const int tempStride = (width - shift + 3) & ~3;
-  AlignedArray<float, 4> tempArray(tempStride * height);
   // Horizontal pass.
-  srcLine = srcData - shift;
-  float* tempLine = tempArray.data() - shift;
+  std::vector<float> temp(static_cast<size_t>(width) * height);
   for (int y = 0; y < height; ++y) {
-    for (int i = shift; i < width; ++i) {
-      float sum = 0.0f;
-
-      const uint8_t* src = srcLine + i;
-      for (int j = 0; j < kw; ++j) {
-        sum += src[j] * horKernel[j];
+    const uint8_t* const srcLine = srcData + y * srcBpl;
+    float* const tempLine = &temp[y * width];
+
+    // Columns with the origin at the center.
+    const float* const kernel = &horKernels[kLeft * kw];
+    for (int j = 0; j < kw; ++j) {
+      const float k = kernel[j];
+      const uint8_t* const srcWindow = srcLine + j - kLeft;
+      for (int x = kLeft; x < width - kRight; ++x) {
+        tempLine[x] += srcWindow[x] * k;
       }
-      tempLine[i] = sum;
     }
-    tempLine += tempStride;
-    srcLine += srcBpl;
-  }
-  // Vertical pass.
-  dstLine = dstData + kTop * dstBpl + kLeft - shift;
-  tempLine = tempArray.data() - shift;
-  for (int y = kTop; y < height - kBottom; ++y) {
-    for (int i = shift; i < width; ++i) {
-      float sum = 0.0f;
 
-      float* tmp = tempLine + i;
-      for (int j = 0; j < kh; ++j, tmp += tempStride) {
-        sum += *tmp * vertKernel[j];
+    // Columns near the left and right edges.
+    auto convolveEdgeColumn = [&](const int x) {
+      const int windowLeft = qBound(0, x - kLeft, width - kw);
+      const float* const edgeKernel = &horKernels[(x - windowLeft) * kw];
+      float sum = 0.0f;
+      for (int j = 0; j < kw; ++j) {
+        sum += srcLine[windowLeft + j] * edgeKernel[j];
       }
-      const auto val = static_cast<int>(sum);
-      dstLine[i] = static_cast<uint8_t>(qBound(0, val, 255));
+      tempLine[x] = sum;
+    };
+    for (int x = 0; x < kLeft; ++x) {
+      convolveEdgeColumn(x);
     }
-
-    tempLine += tempStride;
-    dstLine += dstBpl;
-  }
-#endif  // if 0
-
-  // Left area between two corners.
-  kOrigin.setX(0);
-  kOrigin.setY(kCenter.y() + 1);
-  for (int x = 0; x < kLeft; ++x) {
-    srcLine = srcData;
-    dstLine = dstData + dstBpl * kTop;
-
-    kernel.recalcForOrigin(kOrigin);
-    for (int y = kTop; y < height - kBottom; ++y) {
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      srcLine += srcBpl;
-      dstLine += dstBpl;
+    for (int x = width - kRight; x < width; ++x) {
+      convolveEdgeColumn(x);
     }
-    kOrigin.rx() += 1;
   }
-  // Right area between two corners.
-  kOrigin.setX(kCenter.x() + 1);
-  kOrigin.setY(kCenter.y());
-  for (int x = width - kRight; x < width; ++x) {
-    srcLine = srcData + width - kw;
-    dstLine = dstData + dstBpl * kTop;
 
-    kernel.recalcForOrigin(kOrigin);
-    for (int y = kTop; y < height - kBottom; ++y) {
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      srcLine += srcBpl;
-      dstLine += dstBpl;
+  // Vertical pass.
+  std::vector<float> sums(width);
+  for (int y = 0; y < height; ++y) {
+    const int windowTop = qBound(0, y - kTop, height - kh);
+    const float* const kernel = &vertKernels[(y - windowTop) * kh];
+
+    // Pixels with the origin off center are rounded, the others truncated.
+    if ((y < kTop) || (y >= height - kBottom)) {
+      std::fill(sums.begin(), sums.end(), 0.5f);
+    } else {
+      std::fill(sums.begin(), sums.end(), 0.0f);
+      std::fill(sums.begin(), sums.begin() + kLeft, 0.5f);
+      std::fill(sums.end() - kRight, sums.end(), 0.5f);
     }
-    kOrigin.rx() += 1;
-  }
-
-  // Bottom-left corner.
-  kOrigin.setY(kCenter.y() + 1);
-  srcLine = srcData + srcBpl * (height - kh);
-  dstLine = dstData + dstBpl * (height - kBottom);
-  for (int y = height - kBottom; y < height; ++y, dstLine += dstBpl) {
-    for (int x = 0; x < kLeft; ++x) {
-      kOrigin.setX(x);
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
+    for (int j = 0; j < kh; ++j) {
+      const float k = kernel[j];
+      const float* const tempLine = &temp[(windowTop + j) * width];
+      for (int x = 0; x < width; ++x) {
+        sums[x] += tempLine[x] * k;
+      }
     }
-    kOrigin.ry() += 1;
-  }
 
-  // Bottom area between two corners.
-  kOrigin.setX(kCenter.x());
-  kOrigin.setY(kCenter.y() + 1);
-  srcLine = srcData + srcBpl * (height - kh) - kLeft;
-  dstLine = dstData + dstBpl * (height - kBottom);
-  for (int y = height - kBottom; y < height; ++y, dstLine += dstBpl) {
-    kernel.recalcForOrigin(kOrigin);
-    for (int x = kLeft; x < width - kRight; ++x) {
-      kernel.convolve(dstLine + x, srcLine + x, srcBpl);
-    }
-    kOrigin.ry() += 1;
-  }
-  // Bottom-right corner.
-  kOrigin.setY(kCenter.y() + 1);
-  srcLine = srcData + srcBpl * (height - kh) + (width - kw);
-  dstLine = dstData + dstBpl * (height - kBottom);
-  for (int y = height - kBottom; y < height; ++y, dstLine += dstBpl) {
-    kOrigin.setX(kCenter.x() + 1);
-    for (int x = width - kRight; x < width; ++x) {
-      kernel.recalcForOrigin(kOrigin);
-      kernel.convolve(dstLine + x, srcLine, srcBpl);
-      kOrigin.rx() += 1;
+    uint8_t* const dstLine = dstData + y * dstBpl;
+    for (int x = 0; x < width; ++x) {
+      const auto val = static_cast<int>(sums[x]);
+      dstLine[x] = static_cast<uint8_t>(qBound(0, val, 255));
     }
-    kOrigin.ry() += 1;
   }
   return dst;
 }  // savGolFilterGrayToGray
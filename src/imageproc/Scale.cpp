@@ -5,6 +5,7 @@
 
 #include <cassert>
 
+#include "DownscalePyramid.h"
 #include "GrayImage.h"
 
 namespace imageproc {
@@ -353,6 +354,11 @@ GrayImage scaleToGray(const GrayImage& src, const QSize& dstSize) {
   if (dstSize.isEmpty()) {
     return GrayImage();
   }
+
+  if ((dstSize.width() * 2 <= src.width()) && (dstSize.height() * 2 <= src.height())) {
+    // An area average, mostly done by 2x2 averaging.
+    return GrayImage(DownscalePyramid(src).scaledTo(dstSize));
+  }
   return scaleGrayToGray(src, dstSize);
 }
 }  // namespace imageproc
\ No newline at end of file
@@ -4,7 +4,9 @@
 #include "SeedFill.h"
 
 #include <QDebug>
+#include <vector>
 
+#include "FastQueue.h"
 #include "GrayImage.h"
 #include "SeedFillGeneric.h"
 
@@ -21,182 +23,263 @@ inline uint32_t fillWordHorizontally(uint32_t word, const uint32_t mask) {
   return word;
 }
 
-void seedFill4Iteration(BinaryImage& seed, const BinaryImage& mask) {
-  const int w = seed.width();
-  const int h = seed.height();
+struct WordPosition {
+  int x;  // The index of the word in its line.
+  int y;
 
-  const int seedWpl = seed.wordsPerLine();
-  const int maskWpl = mask.wordsPerLine();
-  const int lastWordIdx = (w - 1) >> 5;
-  const uint32_t lastWordMask = ~uint32_t(0) << (((lastWordIdx + 1) << 5) - w);
+  WordPosition(int x_, int y_) : x(x_), y(y_) {}
+};
 
-  uint32_t* seedLine = seed.data();
-  const uint32_t* maskLine = mask.data();
-  const uint32_t* prevLine = seedLine;
 
-  // Top to bottom.
-  for (int y = 0; y < h; ++y) {
-    uint32_t prevWord = 0;
+/**
+ * \brief The seed and the mask of a binary seed fill, accessed word by word.
+ */
+class WordGrid {
+ public:
+  WordGrid(BinaryImage& seed, const BinaryImage& mask)
+      : m_seed(seed.data()),
+        m_mask(mask.data()),
+        m_seedWpl(seed.wordsPerLine()),
+        m_maskWpl(mask.wordsPerLine()),
+        m_lastWordIdx((seed.width() - 1) >> 5),
+        m_height(seed.height()),
+        m_lastWordMask(~uint32_t(0) << (((m_lastWordIdx + 1) << 5) - seed.width())) {}
+
+  int lastWordIdx() const { return m_lastWordIdx; }
+
+  int height() const { return m_height; }
+
+  uint32_t* seedLine(const int y) const { return m_seed + m_seedWpl * y; }
+
+  const uint32_t* maskLine(const int y) const { return m_mask + m_maskWpl * y; }
+
+  /**
+   * \brief A word of the mask, with its off-screen bits cleared.
+   *
+   * As all the seed words get clipped by their masks on the raster pass,
+   * this ensures the off-screen bits of the seed stay 0, so no garbage can leak in from there.
+   */
+  uint32_t maskWord(const uint32_t* maskLine, const int x) const {
+    return (x == m_lastWordIdx) ? maskLine[x] & m_lastWordMask : maskLine[x];
+  }
 
-    // Make sure offscreen bits are 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Left to right (except the last word).
-    for (int i = 0; i <= lastWordIdx; ++i) {
-      const uint32_t mask = maskLine[i];
-      uint32_t word = prevWord << 31;
-      word |= seedLine[i] | prevLine[i];
-      word &= mask;
-      word = fillWordHorizontally(word, mask);
-      seedLine[i] = word;
-      prevWord = word;
-    }
+ private:
+  uint32_t* m_seed;
+  const uint32_t* m_mask;
+  int m_seedWpl;
+  int m_maskWpl;
+  int m_lastWordIdx;
+  int m_height;
+  uint32_t m_lastWordMask;
+};
 
-    // If we don't do this, prevLine[lastWordIdx] on the next
-    // iteration may contain garbage in the off-screen area.
-    // That garbage can easily leak back.
-    seedLine[lastWordIdx] &= lastWordMask;
 
-    prevLine = seedLine;
-    seedLine += seedWpl;
-    maskLine += maskWpl;
+/**
+ * \brief A queue of words whose changes may still have to spread to their neighbors.
+ *
+ * A word is only present in the queue once at a time.  Unlike in seedFillGenericInPlace(),
+ * where a pixel is final once queued, a word may change several times, so it can be queued again
+ * once it's been popped.
+ */
+class WordQueue {
+ public:
+  WordQueue(const int wordsPerLine, const int height)
+      : m_inQueue(static_cast<size_t>(wordsPerLine) * height, 0), m_wordsPerLine(wordsPerLine) {}
+
+  bool empty() const { return m_queue.empty(); }
+
+  void push(const int x, const int y) {
+    uint8_t& inQueue = m_inQueue[static_cast<size_t>(m_wordsPerLine) * y + x];
+    if (!inQueue) {
+      inQueue = 1;
+      m_queue.push(WordPosition(x, y));
+    }
   }
 
-  seedLine -= seedWpl;
-  maskLine -= maskWpl;
-  prevLine = seedLine;
+  WordPosition pop() {
+    const WordPosition pos(m_queue.front());
+    m_queue.pop();
+    m_inQueue[static_cast<size_t>(m_wordsPerLine) * pos.y + pos.x] = 0;
+    return pos;
+  }
 
-  // Bottom to top.
-  for (int y = h - 1; y >= 0; --y) {
-    uint32_t prevWord = 0;
+ private:
+  FastQueue<WordPosition> m_queue;
+  std::vector<uint8_t> m_inQueue;
+  int m_wordsPerLine;
+};
 
-    // Make sure offscreen bits area 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Right to left.
-    for (int i = lastWordIdx; i >= 0; --i) {
-      const uint32_t mask = maskLine[i];
-      uint32_t word = prevWord >> 31;
-      word |= seedLine[i] | prevLine[i];
-      word &= mask;
-      word = fillWordHorizontally(word, mask);
-      seedLine[i] = word;
-      prevWord = word;
-    }
-    // If we don't do this, prevLine[lastWordIdx] on the next
-    // iteration may contain garbage in the off-screen area.
-    // That garbage can easily leak back.
-    // Fortunately, garbage can't spread through prevWord,
-    // as only 1 bit is used from it, which can't be garbage.
-    seedLine[lastWordIdx] &= lastWordMask;
 
-    prevLine = seedLine;
-    seedLine -= seedWpl;
-    maskLine -= maskWpl;
+/**
+ * \brief Spreads the bits of a neighboring word into word (x, y).
+ *
+ * \param spread The bits of the neighbor, already shifted to where they reach the word.
+ *
+ * If the word changes, it gets queued, so the change spreads further.
+ */
+inline void spreadInto(const WordGrid& grid, WordQueue& queue, const uint32_t spread, const int x, const int y) {
+  uint32_t& word = grid.seedLine(y)[x];
+  const uint32_t mask = grid.maskWord(grid.maskLine(y), x);
+  const uint32_t added = spread & mask & ~word;
+  if (added) {
+    word = fillWordHorizontally(word | added, mask);
+    queue.push(x, y);
   }
-}  // seedFill4Iteration
+}
 
-void seedFill8Iteration(BinaryImage& seed, const BinaryImage& mask) {
-  const int w = seed.width();
-  const int h = seed.height();
+/**
+ * \brief The bits a word spreads into the words above and below it.
+ */
+inline uint32_t verticalSpread(const uint32_t word, const Connectivity connectivity) {
+  return (connectivity == CONN4) ? word : word | (word << 1) | (word >> 1);
+}
+
+/**
+ * \brief The bits the words diagonally adjacent to word x of an adjacent line spread into it.
+ */
+inline uint32_t diagonalSpread(const uint32_t* line, const int x, const int lastWordIdx) {
+  uint32_t word = 0;
+  if (x > 0) {
+    word |= line[x - 1] << 31;
+  }
+  if (x < lastWordIdx) {
+    word |= line[x + 1] >> 31;
+  }
+  return word;
+}
 
-  const int seedWpl = seed.wordsPerLine();
-  const int maskWpl = mask.wordsPerLine();
-  const int lastWordIdx = (w - 1) >> 5;
-  const uint32_t lastWordMask = ~uint32_t(0) << (((lastWordIdx + 1) << 5) - w);
+/**
+ * \brief Spreads word (x, y) into its neighbors to the east and to the south.
+ *
+ * Those are the neighbors the anti-raster pass visits before the word itself.
+ */
+inline void spreadEastAndSouth(const WordGrid& grid,
+                               WordQueue& queue,
+                               const Connectivity connectivity,
+                               const int x,
+                               const int y) {
+  const uint32_t word = grid.seedLine(y)[x];
+  const bool hasEast = x < grid.lastWordIdx();
+  if (hasEast) {
+    spreadInto(grid, queue, word << 31, x + 1, y);
+  }
 
-  uint32_t* seedLine = seed.data();
-  const uint32_t* maskLine = mask.data();
-  const uint32_t* prevLine = seedLine;
+  if (y + 1 < grid.height()) {
+    spreadInto(grid, queue, verticalSpread(word, connectivity), x, y + 1);
+    if (connectivity == CONN8) {
+      if (x > 0) {
+        spreadInto(grid, queue, word >> 31, x - 1, y + 1);
+      }
+      if (hasEast) {
+        spreadInto(grid, queue, word << 31, x + 1, y + 1);
+      }
+    }
+  }
+}
 
-  // Note: we start with prevLine == seedLine, but in this case
-  // prevLine[i + 1] won't be clipped by its mask when we use it to
-  // update seedLine[i].  The wrong value may propagate further from
-  // there, so clipping we do on the anti-raster pass won't help.
-  // That's why we clip the first line here.
-  for (int i = 0; i <= lastWordIdx; ++i) {
-    seedLine[i] &= maskLine[i];
+/**
+ * \brief Top to bottom, left to right.
+ */
+void seedFillRasterPass(const WordGrid& grid, const Connectivity connectivity) {
+  const int lastWordIdx = grid.lastWordIdx();
+
+  // The first line is its own prevLine, so on 8-connectivity its words get bits from
+  // prevLine[x + 1] before that word is clipped by its mask.  The wrong bits may propagate
+  // further from there, that's why we clip the first line upfront.
+  uint32_t* seedLine = grid.seedLine(0);
+  const uint32_t* maskLine = grid.maskLine(0);
+  for (int x = 0; x <= lastWordIdx; ++x) {
+    seedLine[x] &= grid.maskWord(maskLine, x);
   }
 
-  // Top to bottom.
-  for (int y = 0; y < h; ++y) {
+  const uint32_t* prevLine = seedLine;
+  for (int y = 0; y < grid.height(); ++y) {
+    seedLine = grid.seedLine(y);
+    maskLine = grid.maskLine(y);
     uint32_t prevWord = 0;
 
-    // Make sure offscreen bits area 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Left to right (except the last word).
-    int i = 0;
-    for (; i < lastWordIdx; ++i) {
-      const uint32_t mask = maskLine[i];
-      uint32_t word = prevLine[i];
-      word |= (word << 1) | (word >> 1);
-      word |= seedLine[i];
-      word |= prevLine[i + 1] >> 31;
-      word |= prevWord << 31;
-      word &= mask;
-      word = fillWordHorizontally(word, mask);
-      seedLine[i] = word;
+    for (int x = 0; x <= lastWordIdx; ++x) {
+      const uint32_t mask = grid.maskWord(maskLine, x);
+      uint32_t word = verticalSpread(prevLine[x], connectivity);
+      if (connectivity == CONN8) {
+        word |= diagonalSpread(prevLine, x, lastWordIdx);
+      }
+      word |= seedLine[x] | (prevWord << 31);
+      word = fillWordHorizontally(word & mask, mask);
+      seedLine[x] = word;
       prevWord = word;
     }
-    // Last word.
-    const uint32_t mask = maskLine[i] & lastWordMask;
-    uint32_t word = prevLine[i];
-    word |= (word << 1) | (word >> 1);
-    word |= seedLine[i];
-    word |= prevWord << 31;
-    word &= mask;
-    word = fillWordHorizontally(word, mask);
-    seedLine[i] = word;
 
     prevLine = seedLine;
-    seedLine += seedWpl;
-    maskLine += maskWpl;
   }
+}  // seedFillRasterPass
 
-  seedLine -= seedWpl;
-  maskLine -= maskWpl;
-  prevLine = seedLine;
+/**
+ * \brief Bottom to top, right to left.
+ *
+ * Words that end up with bits their already visited neighbors didn't get are queued.
+ */
+void seedFillAntiRasterPass(const WordGrid& grid, WordQueue& queue, const Connectivity connectivity) {
+  const int lastWordIdx = grid.lastWordIdx();
 
-  // Bottom to top.
-  for (int y = h - 1; y >= 0; --y) {
+  const uint32_t* prevLine = grid.seedLine(grid.height() - 1);
+  for (int y = grid.height() - 1; y >= 0; --y) {
+    uint32_t* const seedLine = grid.seedLine(y);
+    const uint32_t* const maskLine = grid.maskLine(y);
     uint32_t prevWord = 0;
 
-    // Make sure offscreen bits area 0.
-    seedLine[lastWordIdx] &= lastWordMask;
-    // Right to left (except the last word).
-    int i = lastWordIdx;
-    for (; i > 0; --i) {
-      const uint32_t mask = maskLine[i];
-      uint32_t word = prevLine[i];
-      word |= (word << 1) | (word >> 1);
-      word |= seedLine[i];
-      word |= prevLine[i - 1] << 31;
-      word |= prevWord >> 31;
-      word &= mask;
-      word = fillWordHorizontally(word, mask);
-      seedLine[i] = word;
+    for (int x = lastWordIdx; x >= 0; --x) {
+      const uint32_t mask = grid.maskWord(maskLine, x);
+      uint32_t word = verticalSpread(prevLine[x], connectivity);
+      if (connectivity == CONN8) {
+        word |= diagonalSpread(prevLine, x, lastWordIdx);
+      }
+      word |= seedLine[x] | (prevWord >> 31);
+      word = fillWordHorizontally(word & mask, mask);
+      seedLine[x] = word;
       prevWord = word;
-    }
 
-    // Last word.
-    const uint32_t mask = maskLine[i];
-    uint32_t word = prevLine[i];
-    word |= (word << 1) | (word >> 1);
-    word |= seedLine[i];
-    word |= prevWord >> 31;
-    word &= mask;
-    word = fillWordHorizontally(word, mask);
-    seedLine[i] = word;
-    // If we don't do this, prevLine[lastWordIdx] on the next
-    // iteration may contain garbage in the off-screen area.
-    // That garbage can easily leak back.
-    // Fortunately, garbage can't spread through prevWord,
-    // as only 1 bit is used from it, which can't be garbage.
-    seedLine[lastWordIdx] &= lastWordMask;
+      spreadEastAndSouth(grid, queue, connectivity, x, y);
+    }
 
     prevLine = seedLine;
-    seedLine -= seedWpl;
-    maskLine -= maskWpl;
   }
-}  // seedFill8Iteration
+}
+
+/**
+ * \brief Spreads the queued words into their neighbors, until the queue is empty.
+ */
+void seedFillSpreadQueued(const WordGrid& grid, WordQueue& queue, const Connectivity connectivity) {
+  while (!queue.empty()) {
+    const WordPosition pos(queue.pop());
+    const uint32_t word = grid.seedLine(pos.y)[pos.x];
+    const uint32_t vertSpread = verticalSpread(word, connectivity);
+    const bool hasWest = pos.x > 0;
+    const bool hasEast = pos.x < grid.lastWordIdx();
+
+    if (hasWest) {
+      spreadInto(grid, queue, word >> 31, pos.x - 1, pos.y);
+    }
+    if (hasEast) {
+      spreadInto(grid, queue, word << 31, pos.x + 1, pos.y);
+    }
+
+    for (const int y : {pos.y - 1, pos.y + 1}) {
+      if ((y < 0) || (y >= grid.height())) {
+        continue;
+      }
+      spreadInto(grid, queue, vertSpread, pos.x, y);
+      if (connectivity == CONN8) {
+        if (hasWest) {
+          spreadInto(grid, queue, word >> 31, pos.x - 1, y);
+        }
+        if (hasEast) {
+          spreadInto(grid, queue, word << 31, pos.x + 1, y);
+        }
+      }
+    }
+  }
+}  // seedFillSpreadQueued
 
 inline uint8_t lightest(uint8_t lhs, uint8_t rhs) {
   return lhs > rhs ? lhs : rhs;
@@ -401,17 +484,19 @@ BinaryImage seedFill(const BinaryImage& seed, const BinaryImage& mask, const Con
     throw std::invalid_argument("seedFill: seed and mask have different sizes");
   }
 
-  BinaryImage prev;
   BinaryImage img(seed);
+  if (img.isNull()) {
+    return img;
+  }
 
-  do {
-    prev = img;
-    if (connectivity == CONN4) {
-      seedFill4Iteration(img, mask);
-    } else {
-      seedFill8Iteration(img, mask);
-    }
-  } while (img != prev);
+  // A raster and an anti-raster pass do most of the work.  What's left
+  // is spreading from the words queued on the anti-raster pass, which
+  // only visits the words that actually change.
+  const WordGrid grid(img, mask);
+  seedFillRasterPass(grid, connectivity);
+  WordQueue queue(grid.lastWordIdx() + 1, grid.height());
+  seedFillAntiRasterPass(grid, queue, connectivity);
+  seedFillSpreadQueued(grid, queue, connectivity);
   return img;
 }
 
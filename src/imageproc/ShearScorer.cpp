@@ -0,0 +1,140 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "ShearScorer.h"
+
+#include <QtGlobal>
+#include <cmath>
+#include <cstdint>
+
+#include "BitOps.h"
+#include "Constants.h"
+#include "Shear.h"
+
+namespace imageproc {
+namespace {
+double calcScore(const BinaryImage& image) {
+  const int width = image.width();
+  const int height = image.height();
+  const uint32_t* line = image.data();
+  const int wpl = image.wordsPerLine();
+  const int lastWordIdx = (width - 1) >> 5;
+  const uint32_t lastWordMask = ~uint32_t(0) << (31 - ((width - 1) & 31));
+
+  double score = 0.0;
+  int lastLineBlackPixels = 0;
+  for (int y = 0; y < height; ++y, line += wpl) {
+    int numBlackPixels = 0;
+    int i = 0;
+    for (; i != lastWordIdx; ++i) {
+      numBlackPixels += countNonZeroBits(line[i]);
+    }
+    numBlackPixels += countNonZeroBits(line[i] & lastWordMask);
+
+    if (y != 0) {
+      const double diff = numBlackPixels - lastLineBlackPixels;
+      score += diff * diff;
+    }
+    lastLineBlackPixels = numBlackPixels;
+  }
+  return score;
+}
+}  // namespace
+
+ShearScorer::ShearScorer(const BinaryImage& image, const double resolutionRatio)
+    : m_image(image), m_resolutionRatio(resolutionRatio), m_haveTransitions(findTransitions()) {}
+
+bool ShearScorer::findTransitions() {
+  const int width = m_image.width();
+  const int height = m_image.height();
+  const int wpl = m_image.wordsPerLine();
+  const uint32_t* const data = m_image.data();
+  const int lastWordIdx = (width - 1) >> 5;
+  const uint32_t lastWordMask = ~uint32_t(0) << (31 - ((width - 1) & 31));
+
+  // Calls visit(x, y) for every pixel that differs from the one above it.
+  // Rows -1 and height are taken to be white.
+  auto forEachTransition = [&](auto visit) {
+    for (int y = 0; y <= height; ++y) {
+      const uint32_t* const line = data + y * wpl;
+      for (int i = 0; i <= lastWordIdx; ++i) {
+        const uint32_t cur = (y < height) ? line[i] : 0;
+        const uint32_t prev = (y > 0) ? line[i - wpl] : 0;
+        uint32_t changes = cur ^ prev;
+        if (i == lastWordIdx) {
+          changes &= lastWordMask;
+        }
+        while (changes) {
+          const int bit = countMostSignificantZeroes(changes);
+          visit((i << 5) + bit, y);
+          changes &= ~(uint32_t(0x80000000) >> bit);
+        }
+      }
+    }
+  };
+
+  // Shearing and scoring an image costs about as much as going through
+  // eight transitions per word of it.  Leave some margin.
+  const int64_t maxTransitions = int64_t(4) * wpl * height;
+
+  m_firstTransition.assign(width + 1, 0);
+  int64_t numTransitions = 0;
+  forEachTransition([&](const int x, int) {
+    ++m_firstTransition[x + 1];
+    ++numTransitions;
+  });
+  if (numTransitions > maxTransitions) {
+    m_firstTransition.clear();
+    return false;
+  }
+
+  for (int x = 0; x < width; ++x) {
+    m_firstTransition[x + 1] += m_firstTransition[x];
+  }
+  m_transitions.resize(numTransitions);
+  std::vector<int> nextTransition(m_firstTransition.begin(), m_firstTransition.end() - 1);
+  forEachTransition([&](const int x, const int y) { m_transitions[nextTransition[x]++] = y; });
+  return true;
+}  // ShearScorer::findTransitions
+
+double ShearScorer::score(const double angle) const {
+  const double shear = std::tan(angle * constants::DEG2RAD) / m_resolutionRatio;
+  const double xOrigin = 0.5 * m_image.width();
+  if (m_haveTransitions) {
+    return scoreFromTransitions(shear, xOrigin);
+  }
+
+  BinaryImage sheared(m_image.size());
+  vShearFromTo(m_image, sheared, shear, xOrigin, WHITE);
+  return calcScore(sheared);
+}
+
+double ShearScorer::scoreFromTransitions(const double shear, const double xOrigin) const {
+  const int width = m_image.width();
+  const int height = m_image.height();
+
+  // The shifts of columns are computed exactly like in vShearFromTo().
+  double shift = 0.5 + shear * (0.5 - xOrigin);
+  const double shiftEnd = 0.5 + shear * (width - 0.5 - xOrigin);
+  const bool noShift = std::floor(shift) == std::floor(shiftEnd);
+
+  // The change in the number of black pixels from the row above, for every row.
+  std::vector<int> rowDeltas(height + 1, 0);
+  for (int x = 0; x < width; ++x, shift += shear) {
+    const int colShift = noShift ? 0 : static_cast<int>(std::floor(shift));
+    int delta = 1;
+    for (int i = m_firstTransition[x]; i < m_firstTransition[x + 1]; ++i) {
+      // Parts of runs shifted off the image are lost.
+      rowDeltas[qBound(0, m_transitions[i] + colShift, height)] += delta;
+      delta = -delta;
+    }
+  }
+
+  double score = 0.0;
+  for (int y = 1; y < height; ++y) {
+    const double diff = rowDeltas[y];
+    score += diff * diff;
+  }
+  return score;
+}  // ShearScorer::scoreFromTransitions
+}  // namespace imageproc
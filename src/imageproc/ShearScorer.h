@@ -0,0 +1,63 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_IMAGEPROC_SHEARSCORER_H_
+#define SCANTAILOR_IMAGEPROC_SHEARSCORER_H_
+
+#include <vector>
+
+#include "BinaryImage.h"
+
+namespace imageproc {
+/**
+ * \brief Scores an image sheared vertically by various angles, for SkewFinder.
+ *
+ * The score of an angle is the sum of the squared differences between the numbers
+ * of black pixels in adjacent rows of the image sheared by vShearFromTo() around
+ * its horizontal center.
+ *
+ * Where the image has few enough black runs in its columns, the number of
+ * black pixels in every row of a sheared image is found from the positions
+ * where runs start and end in every column, without making the sheared image.
+ * Other images, like noise, are sheared and scored.
+ *
+ * score() may be called from several threads at once.
+ */
+class ShearScorer {
+ public:
+  /**
+   * \param image The image to score.
+   * \param resolutionRatio Horizontal optical resolution divided by vertical one.
+   */
+  ShearScorer(const BinaryImage& image, double resolutionRatio);
+
+  /**
+   * \brief Scores the image sheared by \p angle degrees.
+   */
+  double score(double angle) const;
+
+  /**
+   * \brief Whether score() works from the transitions in columns
+   *        rather than by shearing the image.
+   */
+  bool usesTransitions() const { return m_haveTransitions; }
+
+ private:
+  /**
+   * Lists rows where a black run starts or ends, for every column.
+   * Starts and ends alternate within a column, and an end is exclusive.
+   *
+   * \return false if the image had too many transitions to be worth it.
+   */
+  bool findTransitions();
+
+  double scoreFromTransitions(double shear, double xOrigin) const;
+
+  BinaryImage m_image;
+  double m_resolutionRatio;
+  std::vector<int> m_firstTransition;  // For every column, plus one at the end.
+  std::vector<int> m_transitions;
+  bool m_haveTransitions;
+};
+}  // namespace imageproc
+#endif  // ifndef SCANTAILOR_IMAGEPROC_SHEARSCORER_H_
@@ -4,13 +4,12 @@
 #include "SkewFinder.h"
 
 #include <QDebug>
-#include <cmath>
+#include <vector>
 
 #include "BinaryImage.h"
-#include "BitOps.h"
-#include "Constants.h"
+#include "ParallelFor.h"
 #include "ReduceThreshold.h"
-#include "Shear.h"
+#include "ShearScorer.h"
 
 namespace imageproc {
 const double Skew::GOOD_CONFIDENCE = 2.0;
@@ -91,19 +90,28 @@ Skew SkewFinder::findSkew(const BinaryImage& image) const {
     coarseReduced.reduce(i == 0 ? 1 : 2);
   }
 
-  BinaryImage skewed(coarseReduced.image().size());
+  const ShearScorer coarseScorer(coarseReduced.image(), m_resolutionRatio);
   const double coarseStep = 1.0;  // degrees
-  // Coarse linear search.
+  // Coarse linear search.  Angles are scored in parallel,
+  // but the results are looked through in order.
+  std::vector<double> coarseAngles;
+  for (double angle = -m_maxAngle; angle <= m_maxAngle; angle += coarseStep) {
+    coarseAngles.push_back(angle);
+  }
+  std::vector<double> coarseScores(coarseAngles.size());
+  parallelFor(static_cast<int>(coarseAngles.size()),
+              [&](const int i) { coarseScores[i] = coarseScorer.score(coarseAngles[i]); });
+
   int numCoarseScores = 0;
   double sumCoarseScores = 0.0;
   double bestCoarseScore = 0.0;
   double bestCoarseAngle = -m_maxAngle;
-  for (double angle = -m_maxAngle; angle <= m_maxAngle; angle += coarseStep) {
-    const double score = process(coarseReduced, skewed, angle);
+  for (size_t i = 0; i < coarseAngles.size(); ++i) {
+    const double score = coarseScores[i];
     sumCoarseScores += score;
     ++numCoarseScores;
     if (score > bestCoarseScore) {
-      bestCoarseAngle = angle;
+      bestCoarseAngle = coarseAngles[i];
       bestCoarseScore = score;
     }
   }
@@ -120,23 +128,21 @@ Skew SkewFinder::findSkew(const BinaryImage& image) const {
     fineReduced.reduce(i == 0 ? 1 : 2);
   }
 
-  if (m_coarseReduction != m_fineReduction) {
-    skewed = BinaryImage(fineReduced.image().size());
-  }
+  const ShearScorer fineScorer(fineReduced.image(), m_resolutionRatio);
   // Fine binary search.
   double anglePlus = bestCoarseAngle + 0.5 * coarseStep;
   double angleMinus = bestCoarseAngle - 0.5 * coarseStep;
-  double scorePlus = process(fineReduced, skewed, anglePlus);
-  double scoreMinus = process(fineReduced, skewed, angleMinus);
+  double scorePlus = fineScorer.score(anglePlus);
+  double scoreMinus = fineScorer.score(angleMinus);
   const double fineScore1 = scorePlus;
   const double fineScore2 = scoreMinus;
   while (anglePlus - angleMinus > m_accuracy) {
     if (scorePlus > scoreMinus) {
       angleMinus = 0.5 * (anglePlus + angleMinus);
-      scoreMinus = process(fineReduced, skewed, angleMinus);
+      scoreMinus = fineScorer.score(angleMinus);
     } else if (scorePlus < scoreMinus) {
       anglePlus = 0.5 * (anglePlus + angleMinus);
-      scorePlus = process(fineReduced, skewed, anglePlus);
+      scorePlus = fineScorer.score(anglePlus);
     } else {
       // This protects us from unreasonably low m_accuracy.
       break;
@@ -173,38 +179,4 @@ Skew SkewFinder::findSkew(const BinaryImage& image) const {
   }
   return Skew(-bestAngle, confidence - 1.0);
 }  // SkewFinder::findSkew
-
-double SkewFinder::process(const BinaryImage& src, BinaryImage& dst, const double angle) const {
-  const double tg = std::tan(angle * constants::DEG2RAD);
-  const double xCenter = 0.5 * dst.width();
-  vShearFromTo(src, dst, tg / m_resolutionRatio, xCenter, WHITE);
-  return calcScore(dst);
-}
-
-double SkewFinder::calcScore(const BinaryImage& image) {
-  const int width = image.width();
-  const int height = image.height();
-  const uint32_t* line = image.data();
-  const int wpl = image.wordsPerLine();
-  const int lastWordIdx = (width - 1) >> 5;
-  const uint32_t lastWordMask = ~uint32_t(0) << (31 - ((width - 1) & 31));
-
-  double score = 0.0;
-  int lastLineBlackPixels = 0;
-  for (int y = 0; y < height; ++y, line += wpl) {
-    int numBlackPixels = 0;
-    int i = 0;
-    for (; i != lastWordIdx; ++i) {
-      numBlackPixels += countNonZeroBits(line[i]);
-    }
-    numBlackPixels += countNonZeroBits(line[i] & lastWordMask);
-
-    if (y != 0) {
-      const double diff = numBlackPixels - lastLineBlackPixels;
-      score += diff * diff;
-    }
-    lastLineBlackPixels = numBlackPixels;
-  }
-  return score;
-}
-}  // namespace imageproc
\ No newline at end of file
+}  // namespace imageproc
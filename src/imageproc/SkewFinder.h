@@ -135,10 +135,6 @@ class SkewFinder {
  private:
   static const double LOW_SCORE;
 
-  double process(const BinaryImage& src, BinaryImage& dst, double angle) const;
-
-  static double calcScore(const BinaryImage& image);
-
   double m_maxAngle;
   double m_minAngle;
   double m_accuracy;
@@ -4,11 +4,16 @@
 #include "Transform.h"
 
 #include <QDebug>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
 #include "BadAllocIfNull.h"
 #include "ColorMixer.h"
 #include "Grayscale.h"
+#include "ParallelFor.h"
 
 namespace imageproc {
 namespace {
@@ -39,6 +44,183 @@ QSizeF calcSrcUnitSize(const QTransform& xform, const QSizeF& min) {
   return QSizeF(std::max(min32.width(), width), std::max(min32.height(), height));
 }
 
+/**
+ * Source coordinates, in 1/32 of a source pixel, are tracked along
+ * destination rows in fixed point with this many fractional bits.
+ */
+const int FIXED_POINT_BITS = 32;
+
+int64_t toFixedPoint(const double value) {
+  return std::llround(value * double(int64_t(1) << FIXED_POINT_BITS));
+}
+
+/**
+ * Rounds towards zero, like casting \p exact() to int does.
+ *
+ * Rational scaling factors often map pixels exactly to integer coordinates,
+ * where the rounding errors of \p value and of the double \p exact() may take
+ * them to different sides.  Those few are left to \p exact().
+ */
+template <typename Exact>
+int truncateFixedPoint(const int64_t value, const Exact& exact) {
+  const int64_t fractionMask = (int64_t(1) << FIXED_POINT_BITS) - 1;
+  const int64_t tolerance = int64_t(1) << (FIXED_POINT_BITS - 16);
+  const int64_t fraction = value & fractionMask;
+  if ((fraction < tolerance) || (fraction > fractionMask - tolerance)) {
+    return static_cast<int>(exact());
+  }
+  return (value >= 0) ? static_cast<int>(value >> FIXED_POINT_BITS)
+                      : -static_cast<int>((-value) >> FIXED_POINT_BITS);
+}
+
+/**
+ * Divides integers below 2^21 by a constant of up to 2^16 without dividing.
+ */
+class ConstantDivisor {
+ public:
+  explicit ConstantDivisor(const uint32_t divisor) : m_shift(21) {
+    assert((divisor > 0) && (divisor <= (uint32_t(1) << 16)));
+    while ((uint32_t(1) << (m_shift - 21)) < divisor) {
+      ++m_shift;
+    }
+    m_multiplier = ((uint64_t(1) << m_shift) + divisor - 1) / divisor;
+  }
+
+  uint32_t divide(const uint32_t value) const { return static_cast<uint32_t>((value * m_multiplier) >> m_shift); }
+
+ private:
+  int m_shift;
+  uint64_t m_multiplier;
+};
+
+/**
+ * The weights of the Taps source pixels starting from the one with \p src32Begin,
+ * covered by [src32Begin, src32Begin + src32Unit), where src32Unit doesn't exceed 32 * (Taps - 1) + 1.
+ */
+template <int Taps>
+inline void smallSpanWeights(const int src32Begin, const int src32Unit, unsigned* const weights) {
+  const int begin = src32Begin & 31;
+  const int end = begin + src32Unit;
+  for (int i = 0; i < Taps; ++i) {
+    weights[i] = std::max(0, std::min(end, 32 * (i + 1)) - std::max(begin, 32 * i));
+  }
+}
+
+template <int Taps>
+inline uint8_t mixSmallSpan(const uint8_t* const srcData,
+                            const int* const lineOffsets,
+                            const int* const offsets,
+                            const unsigned* const xWeights,
+                            const unsigned* const yWeights,
+                            const ConstantDivisor& divisor,
+                            const uint32_t halfArea) {
+  uint32_t accum = 0;
+  for (int j = 0; j < Taps; ++j) {
+    uint32_t horAccum = 0;
+    for (int i = 0; i < Taps; ++i) {
+      horAccum += srcData[lineOffsets[j] + offsets[i]] * xWeights[i];
+    }
+    accum += horAccum * yWeights[j];
+  }
+  return static_cast<uint8_t>(divisor.divide(accum + halfArea));
+}
+
+template <int Taps>
+inline uint32_t mixSmallSpan(const uint32_t* const srcData,
+                             const int* const lineOffsets,
+                             const int* const offsets,
+                             const unsigned* const xWeights,
+                             const unsigned* const yWeights,
+                             const ConstantDivisor& divisor,
+                             const uint32_t halfArea) {
+  uint32_t redAccum = 0;
+  uint32_t greenAccum = 0;
+  uint32_t blueAccum = 0;
+  for (int j = 0; j < Taps; ++j) {
+    uint32_t red = 0;
+    uint32_t green = 0;
+    uint32_t blue = 0;
+    for (int i = 0; i < Taps; ++i) {
+      const uint32_t rgb = srcData[lineOffsets[j] + offsets[i]];
+      red += ((rgb >> 16) & 0xff) * xWeights[i];
+      green += ((rgb >> 8) & 0xff) * xWeights[i];
+      blue += (rgb & 0xff) * xWeights[i];
+    }
+    redAccum += red * yWeights[j];
+    greenAccum += green * yWeights[j];
+    blueAccum += blue * yWeights[j];
+  }
+  return uint32_t(0xff000000) | (divisor.divide(redAccum + halfArea) << 16)
+         | (divisor.divide(greenAccum + halfArea) << 8) | divisor.divide(blueAccum + halfArea);
+}
+
+/**
+ * Maps the pixels [dxBegin, dxEnd) of a destination row, whose source areas start at
+ * (src32Left[dx], src32Top[dx]), are inside the source image and cover up to Taps x Taps pixels.
+ *
+ * The weights are the same the generic code gives to those pixels, only computed without branching.
+ */
+template <int Taps, typename StorageUnit>
+void mixSmallSpans(const StorageUnit* const srcData,
+                   const int srcStride,
+                   const QSize srcSize,
+                   const int* const src32Left,
+                   const int* const src32Top,
+                   const int src32UnitW,
+                   const int src32UnitH,
+                   StorageUnit* const dstLine,
+                   const int dxBegin,
+                   const int dxEnd) {
+  const int sw = srcSize.width();
+  const int sh = srcSize.height();
+  const ConstantDivisor areaDivisor(src32UnitW * src32UnitH);
+  const uint32_t halfArea = (src32UnitW * src32UnitH) >> 1;
+
+  // Results go through a local buffer, as the compiler can't tell whether dstLine overlaps the source.
+  const int blockSize = 64;
+  StorageUnit block[blockSize];
+  for (int blockBegin = dxBegin; blockBegin < dxEnd; blockBegin += blockSize) {
+    const int blockEnd = std::min(blockBegin + blockSize, dxEnd);
+    for (int dx = blockBegin; dx < blockEnd; ++dx) {
+      const int srcLeft = src32Left[dx] >> 5;
+      const int srcTop = src32Top[dx] >> 5;
+      // Pixels past the source area have zero weights, but they still have to be inside the image.
+      int offsets[Taps];
+      int lineOffsets[Taps];
+      for (int i = 0; i < Taps; ++i) {
+        offsets[i] = std::min(srcLeft + i, sw - 1);
+        lineOffsets[i] = std::min(srcTop + i, sh - 1) * srcStride;
+      }
+      unsigned xWeights[Taps];
+      unsigned yWeights[Taps];
+      smallSpanWeights<Taps>(src32Left[dx], src32UnitW, xWeights);
+      smallSpanWeights<Taps>(src32Top[dx], src32UnitH, yWeights);
+      block[dx - blockBegin]
+          = mixSmallSpan<Taps>(srcData, lineOffsets, offsets, xWeights, yWeights, areaDivisor, halfArea);
+    }
+    std::copy(block, block + (blockEnd - blockBegin), dstLine + blockBegin);
+  }
+}
+
+/**
+ * Whether mixSmallSpan() gives the same results as Mixer, which is so for
+ * the integer gray and RGB mixers.
+ */
+template <typename StorageUnit, typename Mixer>
+struct HasSmallSpanMixing {
+  static const bool value = false;
+};
+
+template <>
+struct HasSmallSpanMixing<uint8_t, GrayColorMixer<uint32_t>> {
+  static const bool value = true;
+};
+
+template <>
+struct HasSmallSpanMixing<uint32_t, RgbColorMixer<uint32_t>> {
+  static const bool value = true;
+};
+
 template <typename StorageUnit, typename Mixer>
 static void transformGeneric(const StorageUnit* const srcData,
                              const int srcStride,
@@ -55,8 +237,6 @@ static void transformGeneric(const StorageUnit* const srcData,
   const int dw = dstRect.width();
   const int dh = dstRect.height();
 
-  StorageUnit* dstLine = dstData;
-
   QTransform invXform;
   invXform.translate(dstRect.x(), dstRect.y());
   invXform *= xform.inverted();
@@ -69,215 +249,276 @@ static void transformGeneric(const StorageUnit* const srcData,
   const int src32UnitW = std::max<int>(1, qRound(src32UnitSize.width()));
   const int src32UnitH = std::max<int>(1, qRound(src32UnitSize.height()));
 
-  for (int dy = 0; dy < dh; ++dy, dstLine += dstStride) {
-    const double fDyCenter = dy + 0.5;
-    const double fSx32Base = fDyCenter * invXform.m21() + invXform.dx();
-    const double fSy32Base = fDyCenter * invXform.m22() + invXform.dy();
-
-    for (int dx = 0; dx < dw; ++dx) {
-      const double fDxCenter = dx + 0.5;
-      const double fSx32Center = fSx32Base + fDxCenter * invXform.m11();
-      const double fSy32Center = fSy32Base + fDxCenter * invXform.m12();
-      int src32Left = (int) fSx32Center - (src32UnitW >> 1);
-      int src32Top = (int) fSy32Center - (src32UnitH >> 1);
-      int src32Right = src32Left + src32UnitW;
-      int src32Bottom = src32Top + src32UnitH;
-      int srcLeft = src32Left >> 5;
-      int srcRight = (src32Right - 1) >> 5;  // inclusive
-      int srcTop = src32Top >> 5;
-      int srcBottom = (src32Bottom - 1) >> 5;  // inclusive
-      assert(srcBottom >= srcTop);
-      assert(srcRight >= srcLeft);
-
-      if ((srcBottom < 0) || (srcRight < 0) || (srcLeft >= sw) || (srcTop >= sh)) {
-        // Completely outside of src image.
-        if (outsideFlags & OutsidePixels::COLOR) {
-          dstLine[dx] = outsideColor;
-        } else {
-          const int srcX = qBound<int>(0, (srcLeft + srcRight) >> 1, sw - 1);
-          const int srcY = qBound<int>(0, (srcTop + srcBottom) >> 1, sh - 1);
-          dstLine[dx] = srcData[srcY * srcStride + srcX];
-        }
-        continue;
+  // Moving one pixel along a destination row moves the source point by these.
+  const int64_t sx32Step = toFixedPoint(invXform.m11());
+  const int64_t sy32Step = toFixedPoint(invXform.m12());
+
+  // Unless downscaling by more than 2x, a destination pixel maps to at most 3x3 source pixels.
+  // Those mapping entirely inside the source image, which are most of them, go through mixSmallSpans().
+  const bool smallSpans = HasSmallSpanMixing<StorageUnit, Mixer>::value && (src32UnitW <= 65) && (src32UnitH <= 65);
+
+  // Maps a destination pixel whose source area starts at (src32Left, src32Top).
+  auto mapPixel = [&](int src32Left, int src32Top) -> StorageUnit {
+    int src32Right = src32Left + src32UnitW;
+    int src32Bottom = src32Top + src32UnitH;
+    int srcLeft = src32Left >> 5;
+    int srcRight = (src32Right - 1) >> 5;  // inclusive
+    int srcTop = src32Top >> 5;
+    int srcBottom = (src32Bottom - 1) >> 5;  // inclusive
+    assert(srcBottom >= srcTop);
+    assert(srcRight >= srcLeft);
+
+    if ((srcBottom < 0) || (srcRight < 0) || (srcLeft >= sw) || (srcTop >= sh)) {
+      // Completely outside of src image.
+      if (outsideFlags & OutsidePixels::COLOR) {
+        return outsideColor;
+      } else {
+        const int srcX = qBound<int>(0, (srcLeft + srcRight) >> 1, sw - 1);
+        const int srcY = qBound<int>(0, (srcTop + srcBottom) >> 1, sh - 1);
+        return srcData[srcY * srcStride + srcX];
       }
+    }
 
-      /*
-       * Note that (intval / 32) is not the same as (intval >> 5).
-       * The former rounds towards zero, while the latter rounds towards
-       * negative infinity.
-       * Likewise, (intval % 32) is not the same as (intval & 31).
-       * The following expression:
-       * topFraction = 32 - (src32Top & 31);
-       * works correctly with both positive and negative src32Top.
-       */
-
-      unsigned backgroundArea = 0;
-
-      if (srcTop < 0) {
-        const unsigned topFraction = 32 - (src32Top & 31);
-        const unsigned horFraction = src32Right - src32Left;
-        backgroundArea += topFraction * horFraction;
-        const unsigned fullPixelsVer = -1 - srcTop;
-        backgroundArea += horFraction * (fullPixelsVer << 5);
-        srcTop = 0;
-        src32Top = 0;
-      }
-      if (srcBottom >= sh) {
-        const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
-        const unsigned horFraction = src32Right - src32Left;
-        backgroundArea += bottomFraction * horFraction;
-        const unsigned fullPixelsVer = srcBottom - sh;
-        backgroundArea += horFraction * (fullPixelsVer << 5);
-        srcBottom = sh - 1;     // inclusive
-        src32Bottom = sh << 5;  // exclusive
-      }
-      if (srcLeft < 0) {
-        const unsigned leftFraction = 32 - (src32Left & 31);
-        const unsigned vertFraction = src32Bottom - src32Top;
-        backgroundArea += leftFraction * vertFraction;
-        const unsigned fullPixelsHor = -1 - srcLeft;
-        backgroundArea += vertFraction * (fullPixelsHor << 5);
-        srcLeft = 0;
-        src32Left = 0;
-      }
-      if (srcRight >= sw) {
-        const unsigned rightFraction = src32Right - (srcRight << 5);
-        const unsigned vertFraction = src32Bottom - src32Top;
-        backgroundArea += rightFraction * vertFraction;
-        const unsigned fullPixelsHor = srcRight - sw;
-        backgroundArea += vertFraction * (fullPixelsHor << 5);
-        srcRight = sw - 1;     // inclusive
-        src32Right = sw << 5;  // exclusive
-      }
-      assert(srcBottom >= srcTop);
-      assert(srcRight >= srcLeft);
+    /*
+     * Note that (intval / 32) is not the same as (intval >> 5).
+     * The former rounds towards zero, while the latter rounds towards
+     * negative infinity.
+     * Likewise, (intval % 32) is not the same as (intval & 31).
+     * The following expression:
+     * topFraction = 32 - (src32Top & 31);
+     * works correctly with both positive and negative src32Top.
+     */
 
-      Mixer mixer;
-      if (outsideFlags & OutsidePixels::WEAK) {
-        backgroundArea = 0;
-      } else {
-        assert(outsideFlags & OutsidePixels::COLOR);
-        mixer.add(outsideColor, backgroundArea);
-      }
+    unsigned backgroundArea = 0;
 
-      const unsigned leftFraction = 32 - (src32Left & 31);
+    if (srcTop < 0) {
       const unsigned topFraction = 32 - (src32Top & 31);
-      const unsigned rightFraction = src32Right - (srcRight << 5);
+      const unsigned horFraction = src32Right - src32Left;
+      backgroundArea += topFraction * horFraction;
+      const unsigned fullPixelsVer = -1 - srcTop;
+      backgroundArea += horFraction * (fullPixelsVer << 5);
+      srcTop = 0;
+      src32Top = 0;
+    }
+    if (srcBottom >= sh) {
       const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
+      const unsigned horFraction = src32Right - src32Left;
+      backgroundArea += bottomFraction * horFraction;
+      const unsigned fullPixelsVer = srcBottom - sh;
+      backgroundArea += horFraction * (fullPixelsVer << 5);
+      srcBottom = sh - 1;     // inclusive
+      src32Bottom = sh << 5;  // exclusive
+    }
+    if (srcLeft < 0) {
+      const unsigned leftFraction = 32 - (src32Left & 31);
+      const unsigned vertFraction = src32Bottom - src32Top;
+      backgroundArea += leftFraction * vertFraction;
+      const unsigned fullPixelsHor = -1 - srcLeft;
+      backgroundArea += vertFraction * (fullPixelsHor << 5);
+      srcLeft = 0;
+      src32Left = 0;
+    }
+    if (srcRight >= sw) {
+      const unsigned rightFraction = src32Right - (srcRight << 5);
+      const unsigned vertFraction = src32Bottom - src32Top;
+      backgroundArea += rightFraction * vertFraction;
+      const unsigned fullPixelsHor = srcRight - sw;
+      backgroundArea += vertFraction * (fullPixelsHor << 5);
+      srcRight = sw - 1;     // inclusive
+      src32Right = sw << 5;  // exclusive
+    }
+    assert(srcBottom >= srcTop);
+    assert(srcRight >= srcLeft);
+
+    Mixer mixer;
+    if (outsideFlags & OutsidePixels::WEAK) {
+      backgroundArea = 0;
+    } else {
+      assert(outsideFlags & OutsidePixels::COLOR);
+      mixer.add(outsideColor, backgroundArea);
+    }
 
-      assert(leftFraction + rightFraction + (srcRight - srcLeft - 1) * 32
-             == static_cast<unsigned>(src32Right - src32Left));
-      assert(topFraction + bottomFraction + (srcBottom - srcTop - 1) * 32
-             == static_cast<unsigned>(src32Bottom - src32Top));
+    const unsigned leftFraction = 32 - (src32Left & 31);
+    const unsigned topFraction = 32 - (src32Top & 31);
+    const unsigned rightFraction = src32Right - (srcRight << 5);
+    const unsigned bottomFraction = src32Bottom - (srcBottom << 5);
 
-      const unsigned srcArea = (src32Bottom - src32Top) * (src32Right - src32Left);
-      if (srcArea == 0) {
-        if ((outsideFlags & OutsidePixels::COLOR)) {
-          dstLine[dx] = outsideColor;
-        } else {
-          const int srcX = qBound<int>(0, (srcLeft + srcRight) >> 1, sw - 1);
-          const int srcY = qBound<int>(0, (srcTop + srcBottom) >> 1, sh - 1);
-          dstLine[dx] = srcData[srcY * srcStride + srcX];
-        }
-        continue;
+    assert(leftFraction + rightFraction + (srcRight - srcLeft - 1) * 32
+           == static_cast<unsigned>(src32Right - src32Left));
+    assert(topFraction + bottomFraction + (srcBottom - srcTop - 1) * 32
+           == static_cast<unsigned>(src32Bottom - src32Top));
+
+    const unsigned srcArea = (src32Bottom - src32Top) * (src32Right - src32Left);
+    if (srcArea == 0) {
+      if ((outsideFlags & OutsidePixels::COLOR)) {
+        return outsideColor;
+      } else {
+        const int srcX = qBound<int>(0, (srcLeft + srcRight) >> 1, sw - 1);
+        const int srcY = qBound<int>(0, (srcTop + srcBottom) >> 1, sh - 1);
+        return srcData[srcY * srcStride + srcX];
       }
+    }
 
-      const StorageUnit* srcLine = &srcData[srcTop * srcStride];
-
-      if (srcTop == srcBottom) {
-        if (srcLeft == srcRight) {
-          // dst pixel maps to a single src pixel
-          const StorageUnit c = srcLine[srcLeft];
-          if (backgroundArea == 0) {
-            // common case optimization
-            dstLine[dx] = c;
-            continue;
-          }
-          mixer.add(c, srcArea);
-        } else {
-          // dst pixel maps to a horizontal line of src pixels
-          const unsigned vertFraction = src32Bottom - src32Top;
-          const unsigned leftArea = vertFraction * leftFraction;
-          const unsigned middleArea = vertFraction << 5;
-          const unsigned rightArea = vertFraction * rightFraction;
+    const StorageUnit* srcLine = &srcData[srcTop * srcStride];
 
-          mixer.add(srcLine[srcLeft], leftArea);
+    if (srcTop == srcBottom) {
+      if (srcLeft == srcRight) {
+        // dst pixel maps to a single src pixel
+        const StorageUnit c = srcLine[srcLeft];
+        if (backgroundArea == 0) {
+          // common case optimization
+          return c;
+        }
+        mixer.add(c, srcArea);
+      } else {
+        // dst pixel maps to a horizontal line of src pixels
+        const unsigned vertFraction = src32Bottom - src32Top;
+        const unsigned leftArea = vertFraction * leftFraction;
+        const unsigned middleArea = vertFraction << 5;
+        const unsigned rightArea = vertFraction * rightFraction;
 
-          for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-            mixer.add(srcLine[sx], middleArea);
-          }
+        mixer.add(srcLine[srcLeft], leftArea);
 
-          mixer.add(srcLine[srcRight], rightArea);
+        for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+          mixer.add(srcLine[sx], middleArea);
         }
-      } else if (srcLeft == srcRight) {
-        // dst pixel maps to a vertical line of src pixels
-        const unsigned horFraction = src32Right - src32Left;
-        const unsigned topArea = horFraction * topFraction;
-        const unsigned middleArea = horFraction << 5;
-        const unsigned bottomArea = horFraction * bottomFraction;
 
-        srcLine += srcLeft;
-        mixer.add(*srcLine, topArea);
+        mixer.add(srcLine[srcRight], rightArea);
+      }
+    } else if (srcLeft == srcRight) {
+      // dst pixel maps to a vertical line of src pixels
+      const unsigned horFraction = src32Right - src32Left;
+      const unsigned topArea = horFraction * topFraction;
+      const unsigned middleArea = horFraction << 5;
+      const unsigned bottomArea = horFraction * bottomFraction;
+
+      srcLine += srcLeft;
+      mixer.add(*srcLine, topArea);
+
+      srcLine += srcStride;
 
+      for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
+        mixer.add(*srcLine, middleArea);
         srcLine += srcStride;
+      }
 
-        for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
-          mixer.add(*srcLine, middleArea);
-          srcLine += srcStride;
-        }
+      mixer.add(*srcLine, bottomArea);
+    } else {
+      // dst pixel maps to a block of src pixels
+      const unsigned topArea = topFraction << 5;
+      const unsigned bottomArea = bottomFraction << 5;
+      const unsigned leftArea = leftFraction << 5;
+      const unsigned rightArea = rightFraction << 5;
+      const unsigned topleftArea = topFraction * leftFraction;
+      const unsigned toprightArea = topFraction * rightFraction;
+      const unsigned bottomleftArea = bottomFraction * leftFraction;
+      const unsigned bottomrightArea = bottomFraction * rightFraction;
+
+      // process the top-left corner
+      mixer.add(srcLine[srcLeft], topleftArea);
+
+      // process the top line (without corners)
+      for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+        mixer.add(srcLine[sx], topArea);
+      }
+
+      // process the top-right corner
+      mixer.add(srcLine[srcRight], toprightArea);
+
+      srcLine += srcStride;
+      // process middle lines
+      for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
+        mixer.add(srcLine[srcLeft], leftArea);
 
-        mixer.add(*srcLine, bottomArea);
-      } else {
-        // dst pixel maps to a block of src pixels
-        const unsigned topArea = topFraction << 5;
-        const unsigned bottomArea = bottomFraction << 5;
-        const unsigned leftArea = leftFraction << 5;
-        const unsigned rightArea = rightFraction << 5;
-        const unsigned topleftArea = topFraction * leftFraction;
-        const unsigned toprightArea = topFraction * rightFraction;
-        const unsigned bottomleftArea = bottomFraction * leftFraction;
-        const unsigned bottomrightArea = bottomFraction * rightFraction;
-
-        // process the top-left corner
-        mixer.add(srcLine[srcLeft], topleftArea);
-
-        // process the top line (without corners)
         for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-          mixer.add(srcLine[sx], topArea);
+          mixer.add(srcLine[sx], 32 * 32);
         }
 
-        // process the top-right corner
-        mixer.add(srcLine[srcRight], toprightArea);
+        mixer.add(srcLine[srcRight], rightArea);
 
         srcLine += srcStride;
-        // process middle lines
-        for (int sy = srcTop + 1; sy < srcBottom; ++sy) {
-          mixer.add(srcLine[srcLeft], leftArea);
+      }
 
-          for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-            mixer.add(srcLine[sx], 32 * 32);
-          }
+      // process bottom-left corner
+      mixer.add(srcLine[srcLeft], bottomleftArea);
 
-          mixer.add(srcLine[srcRight], rightArea);
+      // process the bottom line (without corners)
+      for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
+        mixer.add(srcLine[sx], bottomArea);
+      }
 
-          srcLine += srcStride;
-        }
+      // process the bottom-right corner
+      mixer.add(srcLine[srcRight], bottomrightArea);
+    }
 
-        // process bottom-left corner
-        mixer.add(srcLine[srcLeft], bottomleftArea);
+    return mixer.mix(srcArea + backgroundArea);
+  };
+
+  // Destination pixels are independent from each other, so rows are split
+  // into chunks processed in parallel.  Tiny images are done in a single chunk.
+  const int minRowsPerChunk = std::max(1, 16384 / dw);
+  const int numChunks = std::max(1, std::min(parallelForMaxThreads() * 4, dh / minRowsPerChunk));
+  parallelFor(numChunks, [&](const int chunk) {
+    // Where the source areas of the pixels of a row start.
+    std::vector<int> rowSrc32Left(dw);
+    std::vector<int> rowSrc32Top(dw);
+
+    const int firstRow = dh * chunk / numChunks;
+    const int lastRow = dh * (chunk + 1) / numChunks;
+    StorageUnit* dstLine = dstData + firstRow * dstStride;
+    for (int dy = firstRow; dy < lastRow; ++dy, dstLine += dstStride) {
+      // The first pixel of a row is mapped in floating point, and the rest incrementally,
+      // so that rounding errors don't accumulate over rows.
+      const double fDyCenter = dy + 0.5;
+      const double fSx32Base = fDyCenter * invXform.m21() + invXform.dx();
+      const double fSy32Base = fDyCenter * invXform.m22() + invXform.dy();
+      int64_t sx32 = toFixedPoint(fSx32Base + 0.5 * invXform.m11());
+      int64_t sy32 = toFixedPoint(fSy32Base + 0.5 * invXform.m12());
+      for (int dx = 0; dx < dw; ++dx, sx32 += sx32Step, sy32 += sy32Step) {
+        const double fDxCenter = dx + 0.5;
+        rowSrc32Left[dx] = truncateFixedPoint(sx32, [&]() { return fSx32Base + fDxCenter * invXform.m11(); })
+                           - (src32UnitW >> 1);
+        rowSrc32Top[dx] = truncateFixedPoint(sy32, [&]() { return fSy32Base + fDxCenter * invXform.m12(); })
+                          - (src32UnitH >> 1);
+      }
 
-        // process the bottom line (without corners)
-        for (int sx = srcLeft + 1; sx < srcRight; ++sx) {
-          mixer.add(srcLine[sx], bottomArea);
+      // Pixels whose source areas are inside the source image form a single run,
+      // as the mapping is affine.
+      auto isInside = [&](const int dx) {
+        return (rowSrc32Left[dx] >= 0) && (rowSrc32Top[dx] >= 0) && (rowSrc32Left[dx] + src32UnitW <= (sw << 5))
+               && (rowSrc32Top[dx] + src32UnitH <= (sh << 5));
+      };
+      int insideBegin = dw;
+      int insideEnd = dw;
+      if (smallSpans) {
+        insideBegin = 0;
+        while ((insideBegin < dw) && !isInside(insideBegin)) {
+          ++insideBegin;
+        }
+        insideEnd = dw;
+        while ((insideEnd > insideBegin) && !isInside(insideEnd - 1)) {
+          --insideEnd;
         }
-
-        // process the bottom-right corner
-        mixer.add(srcLine[srcRight], bottomrightArea);
       }
 
-      dstLine[dx] = mixer.mix(srcArea + backgroundArea);
+      for (int dx = 0; dx < insideBegin; ++dx) {
+        dstLine[dx] = mapPixel(rowSrc32Left[dx], rowSrc32Top[dx]);
+      }
+      // Without small spans, the whole row has been mapped pixel by pixel.
+      if (insideBegin < insideEnd) {
+        if (std::max(src32UnitW, src32UnitH) <= 33) {
+          mixSmallSpans<2>(srcData, srcStride, srcSize, rowSrc32Left.data(), rowSrc32Top.data(), src32UnitW,
+                           src32UnitH, dstLine, insideBegin, insideEnd);
+        } else {
+          mixSmallSpans<3>(srcData, srcStride, srcSize, rowSrc32Left.data(), rowSrc32Top.data(), src32UnitW,
+                           src32UnitH, dstLine, insideBegin, insideEnd);
+        }
+      }
+      for (int dx = insideEnd; dx < dw; ++dx) {
+        dstLine[dx] = mapPixel(rowSrc32Left[dx], rowSrc32Top[dx]);
+      }
     }
-  }
+  });
 }  // transformGeneric
 
 template <typename ImageT>
@@ -0,0 +1,30 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Binarize.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration otsu("binarize/otsu", [](const int dpi) -> BenchmarkBody {
+  const QImage page(SyntheticPage::gray(dpi));
+  return [page] { binarizeOtsu(page); };
+});
+
+const PageBenchmarkRegistration sauvola("binarize/sauvola", [](const int dpi) -> BenchmarkBody {
+  const QImage page(SyntheticPage::gray(dpi));
+  const QSize window(dpi / 6, dpi / 6);
+  return [page, window] { binarizeSauvola(page, window); };
+});
+
+const PageBenchmarkRegistration wolf("binarize/wolf", [](const int dpi) -> BenchmarkBody {
+  const QImage page(SyntheticPage::gray(dpi));
+  const QSize window(dpi / 6, dpi / 6);
+  return [page, window] { binarizeWolf(page, window); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,23 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <ConnectivityMap.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration conn4("connectivity_map/conn4", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  return [page] { ConnectivityMap(page, CONN4); };
+});
+
+const PageBenchmarkRegistration conn8("connectivity_map/conn8", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  return [page] { ConnectivityMap(page, CONN8); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,25 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Despeckle.h>
+#include <Dpi.h>
+#include <NullTaskStatus.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration normal("despeckle/normal", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  return [page, dpi] { Despeckle::despeckle(page, Dpi(dpi, dpi), Despeckle::NORMAL, NullTaskStatus()); };
+});
+
+const PageBenchmarkRegistration aggressive("despeckle/aggressive", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  return [page, dpi] { Despeckle::despeckle(page, Dpi(dpi, dpi), Despeckle::AGGRESSIVE, NullTaskStatus()); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,25 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <GaussBlur.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration smallSigma("gauss_blur/small_sigma", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const float sigma = dpi / 150.0f;
+  return [page, sigma] { gaussBlur(page, sigma, sigma); };
+});
+
+const PageBenchmarkRegistration largeSigma("gauss_blur/large_sigma", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const float sigma = dpi / 15.0f;
+  return [page, sigma] { gaussBlur(page, sigma, sigma); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,58 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Morphology.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+// Bricks of the sizes the filters use, relative to the resolution.
+QSize smallBrick(const int dpi) {
+  return QSize(dpi / 100, dpi / 100);
+}
+
+QSize largeBrick(const int dpi) {
+  return QSize(dpi / 10, dpi / 30);
+}
+
+const PageBenchmarkRegistration dilateBinarySmall("morphology/dilate_binary_small", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  const Brick brick(smallBrick(dpi));
+  return [page, brick] { dilateBrick(page, brick); };
+});
+
+const PageBenchmarkRegistration dilateBinaryLarge("morphology/dilate_binary_large", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  const Brick brick(largeBrick(dpi));
+  return [page, brick] { dilateBrick(page, brick); };
+});
+
+const PageBenchmarkRegistration erodeBinaryLarge("morphology/erode_binary_large", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  const Brick brick(largeBrick(dpi));
+  return [page, brick] { erodeBrick(page, brick); };
+});
+
+const PageBenchmarkRegistration dilateGraySmall("morphology/dilate_gray_small", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const Brick brick(smallBrick(dpi));
+  return [page, brick] { dilateGray(page, brick); };
+});
+
+const PageBenchmarkRegistration dilateGrayLarge("morphology/dilate_gray_large", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const Brick brick(largeBrick(dpi));
+  return [page, brick] { dilateGray(page, brick); };
+});
+
+const PageBenchmarkRegistration erodeGrayLarge("morphology/erode_gray_large", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const Brick brick(largeBrick(dpi));
+  return [page, brick] { erodeGray(page, brick); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
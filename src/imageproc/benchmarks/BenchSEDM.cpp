@@ -0,0 +1,23 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <SEDM.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration distToWhite("sedm/dist_to_white", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  return [page] { SEDM(page, SEDM::DIST_TO_WHITE, SEDM::DIST_TO_NO_BORDERS); };
+});
+
+const PageBenchmarkRegistration distToBlack("sedm/dist_to_black", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage page(SyntheticPage::binary(dpi));
+  return [page] { SEDM(page, SEDM::DIST_TO_BLACK, SEDM::DIST_TO_NO_BORDERS); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,31 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Scale.h>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration downscale("scale_to_gray/down_to_150dpi", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const QSize dstSize(page.width() * 150 / dpi, page.height() * 150 / dpi);
+  return [page, dstSize] { scaleToGray(page, dstSize); };
+});
+
+const PageBenchmarkRegistration thumbnail("scale_to_gray/thumbnail", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const QSize dstSize(250, 250 * page.height() / page.width());
+  return [page, dstSize] { scaleToGray(page, dstSize); };
+});
+
+const PageBenchmarkRegistration upscale("scale_to_gray/up_1.5x", [](const int dpi) -> BenchmarkBody {
+  const GrayImage page(SyntheticPage::gray(dpi));
+  const QSize dstSize(page.width() * 3 / 2, page.height() * 3 / 2);
+  return [page, dstSize] { scaleToGray(page, dstSize); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
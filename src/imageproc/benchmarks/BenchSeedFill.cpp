@@ -0,0 +1,36 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Morphology.h>
+#include <SeedFill.h>
+
+#include <algorithm>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+const PageBenchmarkRegistration binary("seed_fill/binary", [](const int dpi) -> BenchmarkBody {
+  const BinaryImage mask(SyntheticPage::binary(dpi));
+  // Only the components with thick enough strokes are tagged.
+  const BinaryImage seed(erodeBrick(mask, QSize(3, 3)));
+  return [seed, mask] { seedFill(seed, mask, CONN8); };
+});
+
+const PageBenchmarkRegistration gray("seed_fill/gray", [](const int dpi) -> BenchmarkBody {
+  const GrayImage mask(SyntheticPage::gray(dpi));
+  // Darkness spreads from the borders only, which fills the holes in the mask.
+  GrayImage seed(mask);
+  uint8_t* line = seed.data();
+  for (int y = 0; y < seed.height(); ++y, line += seed.stride()) {
+    if ((y != 0) && (y != seed.height() - 1)) {
+      std::fill(line + 1, line + seed.width() - 1, 0xff);
+    }
+  }
+  return [seed, mask] { seedFillGray(seed, mask, CONN8); };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,45 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Transform.h>
+
+#include <QTransform>
+
+#include "Benchmark.h"
+#include "SyntheticPage.h"
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+// A small deskewing rotation, the most common transformation in practice.
+QTransform deskew(const QSize& size) {
+  QTransform xform;
+  xform.translate(0.5 * size.width(), 0.5 * size.height());
+  xform.rotate(1.5);
+  xform.translate(-0.5 * size.width(), -0.5 * size.height());
+  return xform;
+}
+
+const PageBenchmarkRegistration color("transform/rotate_color", [](const int dpi) -> BenchmarkBody {
+  const QImage page(SyntheticPage::color(dpi));
+  const QTransform xform(deskew(page.size()));
+  return [page, xform] { transform(page, xform, page.rect(), OutsidePixels::assumeColor(Qt::white)); };
+});
+
+const PageBenchmarkRegistration gray("transform/rotate_gray", [](const int dpi) -> BenchmarkBody {
+  const QImage page(SyntheticPage::gray(dpi).toQImage());
+  const QTransform xform(deskew(page.size()));
+  return [page, xform] { transformToGray(page, xform, page.rect(), OutsidePixels::assumeColor(Qt::white)); };
+});
+
+const PageBenchmarkRegistration downscale("transform/downscale_gray", [](const int dpi) -> BenchmarkBody {
+  const QImage page(SyntheticPage::gray(dpi).toQImage());
+  const QTransform xform(QTransform::fromScale(0.5, 0.5));
+  const QRect dstRect(xform.mapRect(page.rect()));
+  return [page, xform, dstRect] {
+    transformToGray(page, xform, dstRect, OutsidePixels::assumeColor(Qt::white));
+  };
+});
+}  // namespace
+}  // namespace benchmarks
+}  // namespace imageproc
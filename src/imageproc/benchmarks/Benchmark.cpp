@@ -0,0 +1,141 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "Benchmark.h"
+
+#include <PerformanceTimer.h>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <algorithm>
+#include <map>
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+std::map<QString, BenchmarkSetup>& registry() {
+  // A function-local static, as registrations run during static initialization.
+  static std::map<QString, BenchmarkSetup> benchmarks;
+  return benchmarks;
+}
+}  // namespace
+
+BenchmarkRegistration::BenchmarkRegistration(const QString& name, BenchmarkSetup setup) {
+  registry()[name] = std::move(setup);
+}
+
+PageBenchmarkRegistration::PageBenchmarkRegistration(const QString& name,
+                                                     const std::function<BenchmarkBody(int dpi)>& setup) {
+  for (const int dpi : {300, 600}) {
+    registry()[QString("%1/%2dpi").arg(name).arg(dpi)] = [setup, dpi]() { return setup(dpi); };
+  }
+}
+
+BenchmarkRunner::BenchmarkRunner(const double minTimeSec, const int minIterations)
+    : m_minTimeSec(minTimeSec), m_minIterations(std::max(1, minIterations)) {}
+
+std::vector<QString> BenchmarkRunner::benchmarkNames() {
+  std::vector<QString> names;
+  for (const auto& nameAndSetup : registry()) {
+    names.push_back(nameAndSetup.first);
+  }
+  return names;
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::run(const QRegularExpression& filter) const {
+  std::vector<BenchmarkResult> results;
+  for (const auto& nameAndSetup : registry()) {
+    if (filter.match(nameAndSetup.first).hasMatch()) {
+      results.push_back(runOne(nameAndSetup.first, nameAndSetup.second));
+    }
+  }
+  return results;
+}
+
+BenchmarkResult BenchmarkRunner::runOne(const QString& name, const BenchmarkSetup& setup) const {
+  const BenchmarkBody body = setup();
+  body();  // Warm-up.
+
+  std::vector<double> times;
+  double totalSec = 0;
+  while ((static_cast<int>(times.size()) < m_minIterations) || (totalSec < m_minTimeSec)) {
+    const PerformanceTimer timer;
+    body();
+    const double sec = timer.elapsedSec();
+    times.push_back(sec);
+    totalSec += sec;
+  }
+  std::sort(times.begin(), times.end());
+
+  BenchmarkResult result;
+  result.name = name;
+  result.iterations = static_cast<int>(times.size());
+  result.minSec = times.front();
+  const size_t mid = times.size() / 2;
+  result.medianSec = (times.size() % 2 != 0) ? times[mid] : (times[mid - 1] + times[mid]) / 2;
+  result.meanSec = totalSec / times.size();
+  return result;
+}
+
+QJsonDocument BenchmarkRunner::toJson(const std::vector<BenchmarkResult>& results) {
+  QJsonArray benchmarksArray;
+  for (const BenchmarkResult& result : results) {
+    QJsonObject obj;
+    obj["name"] = result.name;
+    obj["iterations"] = result.iterations;
+    obj["minSec"] = result.minSec;
+    obj["medianSec"] = result.medianSec;
+    obj["meanSec"] = result.meanSec;
+    benchmarksArray.append(obj);
+  }
+
+  QJsonObject root;
+  root["benchmarks"] = benchmarksArray;
+  return QJsonDocument(root);
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::fromJson(const QJsonDocument& doc) {
+  std::vector<BenchmarkResult> results;
+  for (const QJsonValue& value : doc.object().value("benchmarks").toArray()) {
+    const QJsonObject obj = value.toObject();
+    BenchmarkResult result;
+    result.name = obj.value("name").toString();
+    result.iterations = obj.value("iterations").toInt();
+    result.minSec = obj.value("minSec").toDouble();
+    result.medianSec = obj.value("medianSec").toDouble();
+    result.meanSec = obj.value("meanSec").toDouble();
+    if (!result.name.isEmpty()) {
+      results.push_back(result);
+    }
+  }
+  return results;
+}
+
+std::vector<BenchmarkComparison> BenchmarkRunner::compare(const std::vector<BenchmarkResult>& results,
+                                                          const std::vector<BenchmarkResult>& baseline,
+                                                          const double tolerance) {
+  std::map<QString, const BenchmarkResult*> baselineByName;
+  for (const BenchmarkResult& result : baseline) {
+    baselineByName[result.name] = &result;
+  }
+
+  std::vector<BenchmarkComparison> comparisons;
+  for (const BenchmarkResult& result : results) {
+    const auto it = baselineByName.find(result.name);
+    if ((it == baselineByName.end()) || (it->second->medianSec <= 0)) {
+      continue;
+    }
+
+    BenchmarkComparison comparison;
+    comparison.name = result.name;
+    comparison.baselineSec = it->second->medianSec;
+    comparison.currentSec = result.medianSec;
+    comparison.ratio = comparison.currentSec / comparison.baselineSec;
+    comparison.regression = comparison.ratio > 1.0 + tolerance;
+    comparisons.push_back(comparison);
+  }
+  return comparisons;
+}
+}  // namespace benchmarks
+}  // namespace imageproc
@@ -0,0 +1,110 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_IMAGEPROC_BENCHMARKS_BENCHMARK_H_
+#define SCANTAILOR_IMAGEPROC_BENCHMARKS_BENCHMARK_H_
+
+#include <QJsonDocument>
+#include <QString>
+#include <functional>
+#include <vector>
+
+class QRegularExpression;
+
+namespace imageproc {
+namespace benchmarks {
+/**
+ * The code being timed.
+ */
+using BenchmarkBody = std::function<void()>;
+
+/**
+ * Prepares the input data, which is not timed, and returns the body to time.
+ */
+using BenchmarkSetup = std::function<BenchmarkBody()>;
+
+struct BenchmarkResult {
+  QString name;
+  int iterations = 0;
+  double minSec = 0;
+  double medianSec = 0;
+  double meanSec = 0;
+};
+
+struct BenchmarkComparison {
+  QString name;
+  double baselineSec = 0;
+  double currentSec = 0;
+  double ratio = 0;  // currentSec / baselineSec
+  bool regression = false;
+};
+
+/**
+ * \brief Registers a benchmark when constructed.
+ *
+ * Meant to be used for static objects, one per benchmark:
+ * \code
+ * static const BenchmarkRegistration reg("kernel/300dpi", [] { ...; return [=] { kernel(...); }; });
+ * \endcode
+ * Names are slash-separated, so that related benchmarks can be selected with a filter.
+ */
+class BenchmarkRegistration {
+ public:
+  BenchmarkRegistration(const QString& name, BenchmarkSetup setup);
+};
+
+
+/**
+ * \brief Registers "<name>/300dpi" and "<name>/600dpi" benchmarks.
+ *
+ * \p setup will be called like this: BenchmarkBody body = setup(dpi);
+ */
+class PageBenchmarkRegistration {
+ public:
+  PageBenchmarkRegistration(const QString& name, const std::function<BenchmarkBody(int dpi)>& setup);
+};
+
+
+class BenchmarkRunner {
+ public:
+  /**
+   * \param minTimeSec Every benchmark is repeated until it runs for at least this long in total
+   * \param minIterations ... and at least this many times.
+   */
+  BenchmarkRunner(double minTimeSec, int minIterations);
+
+  static std::vector<QString> benchmarkNames();
+
+  /**
+   * \brief Runs the benchmarks whose names match \p filter, in the order of their names.
+   *
+   * Every benchmark runs once untimed to warm up the caches.  The median
+   * of the iterations is what the comparisons are based on, as it's the least
+   * sensitive to an occasional hiccup of the machine.
+   */
+  std::vector<BenchmarkResult> run(const QRegularExpression& filter) const;
+
+  static QJsonDocument toJson(const std::vector<BenchmarkResult>& results);
+
+  static std::vector<BenchmarkResult> fromJson(const QJsonDocument& doc);
+
+  /**
+   * \brief Compares the benchmarks present in both sets.
+   *
+   * A benchmark is considered a regression if its median time exceeds
+   * the baseline one by more than \p tolerance, a fraction of the baseline time.
+   */
+  static std::vector<BenchmarkComparison> compare(const std::vector<BenchmarkResult>& results,
+                                                  const std::vector<BenchmarkResult>& baseline,
+                                                  double tolerance);
+
+ private:
+  BenchmarkResult runOne(const QString& name, const BenchmarkSetup& setup) const;
+
+  double m_minTimeSec;
+  int m_minIterations;
+};
+}  // namespace benchmarks
+}  // namespace imageproc
+
+#endif  // ifndef SCANTAILOR_IMAGEPROC_BENCHMARKS_BENCHMARK_H_
@@ -0,0 +1,155 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include "SyntheticPage.h"
+
+#include <BinaryThreshold.h>
+#include <Dpi.h>
+#include <Dpm.h>
+
+#include <QRect>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+
+namespace imageproc {
+namespace benchmarks {
+namespace {
+/**
+ * A small deterministic generator, so that pages don't depend on the standard library.
+ */
+class Random {
+ public:
+  explicit Random(uint32_t seed) : m_state(seed) {}
+
+  uint32_t next() {
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return m_state;
+  }
+
+  int uniform(int from, int to) { return from + static_cast<int>(next() % static_cast<uint32_t>(to - from + 1)); }
+
+ private:
+  uint32_t m_state;
+};
+
+
+void fillRect(GrayImage& image, const QRect& rect, const uint8_t value) {
+  const QRect area(rect.intersected(image.rect()));
+  uint8_t* line = image.data() + area.top() * image.stride();
+  for (int y = area.top(); y <= area.bottom(); ++y, line += image.stride()) {
+    std::fill(line + area.left(), line + area.right() + 1, value);
+  }
+}
+
+void drawGlyph(GrayImage& image, const QRect& box, const int stroke, Random& rnd) {
+  const uint8_t ink = static_cast<uint8_t>(rnd.uniform(20, 60));
+  // A few strokes along the edges and through the middle of the box look enough like letters.
+  const int shape = rnd.uniform(0, 3);
+  fillRect(image, QRect(box.left(), box.top(), stroke, box.height()), ink);
+  if (shape != 0) {
+    fillRect(image, QRect(box.left(), box.bottom() - stroke + 1, box.width(), stroke), ink);
+  }
+  if (shape >= 2) {
+    fillRect(image, QRect(box.right() - stroke + 1, box.top() + box.height() / 2, stroke, box.height() / 2), ink);
+  }
+  if (shape == 3) {
+    fillRect(image, QRect(box.left(), box.top() + box.height() / 2, box.width(), stroke), ink);
+  }
+}
+}  // namespace
+
+GrayImage SyntheticPage::gray(const int dpi) {
+  // Images are implicitly shared, so handing out copies of cached pages is cheap.
+  static std::map<int, GrayImage> cache;
+  GrayImage& cached = cache[dpi];
+  if (cached.isNull()) {
+    cached = generate(dpi);
+  }
+  return cached;
+}
+
+GrayImage SyntheticPage::generate(const int dpi) {
+  const int width = dpi * 17 / 2;
+  const int height = dpi * 11;
+  GrayImage image(QSize(width, height));
+  Random rnd(12345);
+
+  // Paper with a gentle illumination gradient and noise.
+  uint8_t* line = image.data();
+  for (int y = 0; y < height; ++y, line += image.stride()) {
+    const double yShade = 12.0 * std::sin(3.0 * y / height);
+    for (int x = 0; x < width; ++x) {
+      const double shade = yShade + 10.0 * x / width;
+      line[x] = static_cast<uint8_t>(205 + shade + rnd.uniform(-6, 6));
+    }
+  }
+
+  // Lines of text within 1 inch margins, leaving room for a picture.
+  const int stroke = std::max(1, dpi / 100);
+  const QRect picture(width / 2, height / 2, width / 2 - dpi, height / 4);
+  for (int top = dpi; top + dpi / 8 < height - dpi; top += dpi / 4) {
+    int x = dpi;
+    while (x < width - dpi) {
+      const int wordLength = rnd.uniform(2, 9);
+      for (int i = 0; i < wordLength && x < width - dpi; ++i) {
+        const int glyphWidth = dpi * rnd.uniform(4, 8) / 100;
+        const int glyphHeight = dpi * rnd.uniform(7, 10) / 100;
+        const QRect box(x, top + rnd.uniform(0, dpi / 50), glyphWidth, glyphHeight);
+        if (!box.intersects(picture)) {
+          drawGlyph(image, box, stroke, rnd);
+        }
+        x += box.width() + dpi / 50;
+      }
+      x += dpi / 16;
+    }
+  }
+
+  // A halftone-free photo: smooth gradients.
+  line = image.data() + picture.top() * image.stride();
+  for (int y = picture.top(); y <= picture.bottom(); ++y, line += image.stride()) {
+    for (int x = picture.left(); x <= picture.right(); ++x) {
+      const double u = double(x - picture.left()) / picture.width();
+      const double v = double(y - picture.top()) / picture.height();
+      line[x] = static_cast<uint8_t>(40 + 160 * (0.5 + 0.5 * std::sin(6.0 * u + 4.0 * v)));
+    }
+  }
+
+  // Dust.
+  const int numSpeckles = 2000 * (dpi / 100) * (dpi / 100) / 9;
+  for (int i = 0; i < numSpeckles; ++i) {
+    const int size = rnd.uniform(1, std::max(1, dpi / 150));
+    fillRect(image, QRect(rnd.uniform(0, width - 1), rnd.uniform(0, height - 1), size, size), 50);
+  }
+
+  const Dpm dpm(Dpi(dpi, dpi));
+  image.setDotsPerMeterX(dpm.horizontal());
+  image.setDotsPerMeterY(dpm.vertical());
+  return image;
+}  // SyntheticPage::generate
+
+QImage SyntheticPage::color(const int dpi) {
+  const GrayImage grayPage(gray(dpi));
+  QImage image(grayPage.size(), QImage::Format_RGB32);
+  const uint8_t* srcLine = grayPage.data();
+  for (int y = 0; y < image.height(); ++y, srcLine += grayPage.stride()) {
+    auto* dstLine = reinterpret_cast<QRgb*>(image.scanLine(y));
+    for (int x = 0; x < image.width(); ++x) {
+      // Tint it unevenly, so that the channels differ.
+      const int v = srcLine[x];
+      dstLine[x] = qRgb(v, std::max(0, v - 8 + (x & 15)), std::max(0, v - 20 + (y & 31)));
+    }
+  }
+  image.setDotsPerMeterX(grayPage.dotsPerMeterX());
+  image.setDotsPerMeterY(grayPage.dotsPerMeterY());
+  return image;
+}
+
+BinaryImage SyntheticPage::binary(const int dpi) {
+  return BinaryImage(gray(dpi).toQImage(), BinaryThreshold(128));
+}
+}  // namespace benchmarks
+}  // namespace imageproc
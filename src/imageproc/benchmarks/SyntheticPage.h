@@ -0,0 +1,44 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#ifndef SCANTAILOR_IMAGEPROC_BENCHMARKS_SYNTHETICPAGE_H_
+#define SCANTAILOR_IMAGEPROC_BENCHMARKS_SYNTHETICPAGE_H_
+
+#include <BinaryImage.h>
+#include <GrayImage.h>
+
+#include <QImage>
+
+namespace imageproc {
+namespace benchmarks {
+/**
+ * \brief Generates scanned-like US Letter pages.
+ *
+ * A page has a slightly uneven paper background with noise, lines of glyph-like
+ * strokes, a picture and scattered speckles.  The generation is deterministic,
+ * so the same resolution always produces the same page.  Pages are cached,
+ * which makes this class not thread-safe.
+ */
+class SyntheticPage {
+ public:
+  static GrayImage gray(int dpi);
+
+  /**
+   * \brief The grayscale page with a colored picture, in Format_RGB32.
+   */
+  static QImage color(int dpi);
+
+  /**
+   * \brief The grayscale page binarized with a fixed threshold.
+   */
+  static BinaryImage binary(int dpi);
+
+  SyntheticPage() = delete;
+
+ private:
+  static GrayImage generate(int dpi);
+};
+}  // namespace benchmarks
+}  // namespace imageproc
+
+#endif  // ifndef SCANTAILOR_IMAGEPROC_BENCHMARKS_SYNTHETICPAGE_H_
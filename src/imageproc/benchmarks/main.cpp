@@ -0,0 +1,138 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <cstdio>
+
+#include "Benchmark.h"
+
+using namespace imageproc::benchmarks;
+
+namespace {
+enum ExitCode { EXIT_OK = 0, EXIT_REGRESSION = 1, EXIT_BAD_USAGE = 2, EXIT_IO_ERROR = 3 };
+
+int fail(const QString& message, const int exitCode) {
+  std::fprintf(stderr, "imageproc_bench: %s\n", qPrintable(message));
+  return exitCode;
+}
+
+bool readJson(const QString& fileName, QJsonDocument& doc) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  doc = QJsonDocument::fromJson(file.readAll());
+  return doc.isObject();
+}
+
+bool writeJson(const QString& fileName, const QJsonDocument& doc) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  return file.write(doc.toJson()) >= 0;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("imageproc_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Times the imageproc kernels on synthetic 300 and 600 DPI pages.");
+  parser.addHelpOption();
+  const QCommandLineOption listOption("list", "List the benchmarks and exit.");
+  const QCommandLineOption filterOption(QStringList{"f", "filter"},
+                                        "Only run the benchmarks whose names match the regular expression.", "regex",
+                                        ".*");
+  const QCommandLineOption minTimeOption("min-time", "The minimum total time to run each benchmark for.", "seconds",
+                                         "0.5");
+  const QCommandLineOption minIterationsOption("min-iterations", "The minimum number of times to run each benchmark.",
+                                               "count", "3");
+  const QCommandLineOption outputOption(QStringList{"o", "output"},
+                                        "Write the results to a JSON file rather than to the standard output.", "file");
+  const QCommandLineOption baselineOption(QStringList{"b", "baseline"},
+                                          "Compare the results against a JSON file from a previous run.", "file");
+  const QCommandLineOption toleranceOption(
+      "tolerance", "How much slower than the baseline, as a fraction of it, a benchmark may get.", "fraction", "0.1");
+  parser.addOptions(
+      {listOption, filterOption, minTimeOption, minIterationsOption, outputOption, baselineOption, toleranceOption});
+
+  parser.process(app);
+
+  if (parser.isSet(listOption)) {
+    for (const QString& name : BenchmarkRunner::benchmarkNames()) {
+      std::printf("%s\n", qPrintable(name));
+    }
+    return EXIT_OK;
+  }
+
+  const QRegularExpression filter(parser.value(filterOption));
+  if (!filter.isValid()) {
+    return fail(QString("invalid filter: %1").arg(filter.errorString()), EXIT_BAD_USAGE);
+  }
+
+  bool ok = false;
+  const double minTimeSec = parser.value(minTimeOption).toDouble(&ok);
+  if (!ok || (minTimeSec < 0)) {
+    return fail("invalid minimum time.", EXIT_BAD_USAGE);
+  }
+  const int minIterations = parser.value(minIterationsOption).toInt(&ok);
+  if (!ok || (minIterations < 1)) {
+    return fail("invalid minimum number of iterations.", EXIT_BAD_USAGE);
+  }
+  const double tolerance = parser.value(toleranceOption).toDouble(&ok);
+  if (!ok || (tolerance < 0)) {
+    return fail("invalid tolerance.", EXIT_BAD_USAGE);
+  }
+
+  // Read the baseline before spending time on the benchmarks.
+  std::vector<BenchmarkResult> baseline;
+  if (parser.isSet(baselineOption)) {
+    QJsonDocument doc;
+    if (!readJson(parser.value(baselineOption), doc)) {
+      return fail(QString("can't read the baseline from %1").arg(parser.value(baselineOption)), EXIT_IO_ERROR);
+    }
+    baseline = BenchmarkRunner::fromJson(doc);
+  }
+
+  const BenchmarkRunner runner(minTimeSec, minIterations);
+  const std::vector<BenchmarkResult> results = runner.run(filter);
+  for (const BenchmarkResult& result : results) {
+    std::fprintf(stderr, "%-50s %10.3f ms (min %.3f ms, %d iterations)\n", qPrintable(result.name),
+                 result.medianSec * 1000.0, result.minSec * 1000.0, result.iterations);
+  }
+
+  const QJsonDocument resultsDoc(BenchmarkRunner::toJson(results));
+  if (parser.isSet(outputOption)) {
+    if (!writeJson(parser.value(outputOption), resultsDoc)) {
+      return fail(QString("can't write the results to %1").arg(parser.value(outputOption)), EXIT_IO_ERROR);
+    }
+  } else {
+    const QByteArray json(resultsDoc.toJson());
+    std::fwrite(json.constData(), 1, json.size(), stdout);
+  }
+
+  if (!parser.isSet(baselineOption)) {
+    return EXIT_OK;
+  }
+
+  int numRegressions = 0;
+  std::fprintf(stderr, "\nCompared to %s:\n", qPrintable(parser.value(baselineOption)));
+  for (const BenchmarkComparison& cmp : BenchmarkRunner::compare(results, baseline, tolerance)) {
+    std::fprintf(stderr, "%-50s %10.3f -> %10.3f ms  x%.2f%s\n", qPrintable(cmp.name), cmp.baselineSec * 1000.0,
+                 cmp.currentSec * 1000.0, cmp.ratio, cmp.regression ? "  REGRESSION" : "");
+    if (cmp.regression) {
+      ++numRegressions;
+    }
+  }
+  if (numRegressions > 0) {
+    return fail(QString("%1 benchmark(s) regressed by more than %2%").arg(numRegressions).arg(tolerance * 100),
+                EXIT_REGRESSION);
+  }
+  return EXIT_OK;
+}  // main
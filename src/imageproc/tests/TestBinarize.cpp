@@ -1,12 +1,18 @@
 // Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
 // Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
 
+#include <BWColor.h>
 #include <Binarize.h>
 #include <BinaryImage.h>
+#include <Grayscale.h>
 
 #include <QImage>
 #include <QSize>
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
 
 #include "Utils.h"
 
@@ -21,6 +27,136 @@ BOOST_AUTO_TEST_SUITE(BinarizeTestSuite)
                 binarizeWolf(img).toQImage().save("out.png");
             }
 #endif
+
+namespace {
+QImage makeTestImage(const int width, const int height) {
+  // A gradient with noise, so that both dark and light areas with various contrast are present.
+  QImage img(width, height, QImage::Format_Indexed8);
+  img.setColorTable(createGrayscalePalette());
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      img.setPixel(x, y, static_cast<uint>((x * 7 + y * 3 + rand() % 64) % 256));
+    }
+  }
+  return img;
+}
+
+/**
+ * Computes the mean and the deviation of the gray levels in the window around (x, y)
+ * directly, the way an integral image based implementation would.
+ */
+void windowStats(const QImage& img, const QSize windowSize, const int x, const int y, double& mean, double& deviation) {
+  const int windowLowerHalf = windowSize.height() >> 1;
+  const int windowUpperHalf = windowSize.height() - windowLowerHalf;
+  const int windowLeftHalf = windowSize.width() >> 1;
+  const int windowRightHalf = windowSize.width() - windowLeftHalf;
+
+  const int top = std::max(0, y - windowLowerHalf);
+  const int bottom = std::min(img.height(), y + windowUpperHalf);
+  const int left = std::max(0, x - windowLeftHalf);
+  const int right = std::min(img.width(), x + windowRightHalf);
+
+  uint64_t sum = 0;
+  uint64_t sqsum = 0;
+  for (int wy = top; wy < bottom; ++wy) {
+    const uint8_t* line = img.constScanLine(wy);
+    for (int wx = left; wx < right; ++wx) {
+      sum += line[wx];
+      sqsum += line[wx] * line[wx];
+    }
+  }
+
+  const double rArea = 1.0 / ((bottom - top) * (right - left));
+  mean = static_cast<double>(sum) * rArea;
+  const double sqmean = static_cast<double>(sqsum) * rArea;
+  deviation = std::sqrt(std::fabs(sqmean - mean * mean));
+}
+
+BinaryImage referenceSauvola(const QImage& img, const QSize windowSize, const double k) {
+  BinaryImage bw(img.size(), WHITE);
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      double mean;
+      double deviation;
+      windowStats(img, windowSize, x, y, mean, deviation);
+      const double threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
+      if (int(img.constScanLine(y)[x]) < threshold) {
+        bw.setPixel(x, y, BLACK);
+      }
+    }
+  }
+  return bw;
+}
+
+BinaryImage referenceWolf(const QImage& img,
+                          const QSize windowSize,
+                          const unsigned char lowerBound,
+                          const unsigned char upperBound,
+                          const double k) {
+  const int w = img.width();
+  const int h = img.height();
+  std::vector<float> means(w * h);
+  std::vector<float> deviations(w * h);
+  uint32_t minGrayLevel = 255;
+  double maxDeviation = 0;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      double mean;
+      double deviation;
+      windowStats(img, windowSize, x, y, mean, deviation);
+      means[y * w + x] = static_cast<float>(mean);
+      deviations[y * w + x] = static_cast<float>(deviation);
+      maxDeviation = std::max(maxDeviation, deviation);
+      minGrayLevel = std::min<uint32_t>(minGrayLevel, img.constScanLine(y)[x]);
+    }
+  }
+
+  BinaryImage bw(img.size(), WHITE);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const float mean = means[y * w + x];
+      const float deviation = deviations[y * w + x];
+      const double a = 1.0 - deviation / maxDeviation;
+      const double threshold = mean - k * a * (mean - minGrayLevel);
+      const uint8_t pixel = img.constScanLine(y)[x];
+      if ((pixel < lowerBound) || ((pixel <= upperBound) && (int(pixel) < threshold))) {
+        bw.setPixel(x, y, BLACK);
+      }
+    }
+  }
+  return bw;
+}
+
+const QSize windowSizes[] = {QSize(1, 1), QSize(3, 3), QSize(7, 4), QSize(4, 11), QSize(31, 31), QSize(200, 200)};
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_sauvola_matches_reference) {
+  const QImage img(makeTestImage(71, 53));
+  for (const QSize& windowSize : windowSizes) {
+    BOOST_CHECK(binarizeSauvola(img, windowSize, 0.34) == referenceSauvola(img, windowSize, 0.34));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_wolf_matches_reference) {
+  const QImage img(makeTestImage(64, 45));
+  for (const QSize& windowSize : windowSizes) {
+    BOOST_CHECK(binarizeWolf(img, windowSize, 20, 230, 0.3) == referenceWolf(img, windowSize, 20, 230, 0.3));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_single_row_and_column) {
+  const QImage row(makeTestImage(97, 1));
+  BOOST_CHECK(binarizeSauvola(row, QSize(9, 9), 0.2) == referenceSauvola(row, QSize(9, 9), 0.2));
+
+  const QImage column(makeTestImage(1, 97));
+  BOOST_CHECK(binarizeWolf(column, QSize(9, 9), 1, 254, 0.3) == referenceWolf(column, QSize(9, 9), 1, 254, 0.3));
+}
+
+BOOST_AUTO_TEST_CASE(test_null_image) {
+  BOOST_CHECK(binarizeSauvola(QImage(), QSize(5, 5)).isNull());
+  BOOST_CHECK(binarizeWolf(QImage(), QSize(5, 5)).isNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
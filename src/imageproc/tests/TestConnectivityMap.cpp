@@ -0,0 +1,170 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <BinaryImage.h>
+#include <ConnComp.h>
+#include <ConnectivityMap.h>
+#include <ParallelBands.h>
+#include <RunLengthComponents.h>
+
+#include <QRect>
+#include <QSize>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Utils.h"
+
+namespace imageproc {
+namespace tests {
+using namespace utils;
+
+namespace {
+/**
+ * Labels the image with the generic constructor, which doesn't work in bands.
+ */
+ConnectivityMap referenceMap(const BinaryImage& image, const Connectivity conn) {
+  std::vector<uint8_t> pixels(image.width() * image.height());
+  for (int y = 0; y < image.height(); ++y) {
+    for (int x = 0; x < image.width(); ++x) {
+      pixels[y * image.width() + x] = (image.getPixel(x, y) == BLACK) ? 1 : 0;
+    }
+  }
+  return ConnectivityMap(image.size(), pixels.data(), image.width(), conn);
+}
+
+bool sameLabels(const ConnectivityMap& map1, const ConnectivityMap& map2) {
+  if ((map1.size() != map2.size()) || (map1.maxLabel() != map2.maxLabel())) {
+    return false;
+  }
+  for (int y = 0; y < map1.size().height(); ++y) {
+    for (int x = 0; x < map1.size().width(); ++x) {
+      if (map1.data()[y * map1.stride() + x] != map2.data()[y * map2.stride() + x]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool correctStats(const ConnectivityMap& map, const std::vector<ConnComp>& components) {
+  if (components.size() != map.maxLabel() + 1) {
+    return false;
+  }
+
+  std::vector<int> pixCounts(components.size(), 0);
+  std::vector<QRect> rects(components.size());
+  for (int y = 0; y < map.size().height(); ++y) {
+    for (int x = 0; x < map.size().width(); ++x) {
+      const uint32_t label = map.data()[y * map.stride() + x];
+      ++pixCounts[label];
+      rects[label] |= QRect(x, y, 1, 1);
+    }
+  }
+
+  for (uint32_t label = 1; label < components.size(); ++label) {
+    const ConnComp& comp = components[label];
+    if ((comp.pixCount() != pixCounts[label]) || (comp.rect() != rects[label])
+        || (map.data()[comp.seed().y() * map.stride() + comp.seed().x()] != label)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+// Images get split into several bands however many cores there are,
+// while the bands are all processed on the calling thread.
+BOOST_FIXTURE_TEST_SUITE(ConnectivityMapTestSuite, TestParallelForExecutor)
+
+BOOST_AUTO_TEST_CASE(test_same_as_generic) {
+  // Tall enough to be split into bands, which components cross.
+  const QSize sizes[] = {QSize(1, 1), QSize(5, 5), QSize(70, 3), QSize(37, 400), QSize(100, 1000)};
+  BOOST_REQUIRE_EQUAL(splitIntoRowBands(400, 0).size(), 6u);
+  for (const QSize& size : sizes) {
+    for (const Connectivity conn : {CONN4, CONN8}) {
+      const BinaryImage image(randomBinaryImage(size.width(), size.height()));
+      std::vector<ConnComp> components;
+      const ConnectivityMap map(image, conn, &components);
+      BOOST_CHECK(sameLabels(map, referenceMap(image, conn)));
+      BOOST_CHECK(correctStats(map, components));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_vertical_line_across_bands) {
+  BinaryImage image(10, 1000, WHITE);
+  image.fill(QRect(4, 0, 1, 1000), BLACK);
+  image.fill(QRect(0, 500, 3, 1), BLACK);
+
+  std::vector<ConnComp> components;
+  const ConnectivityMap map(image, CONN4, &components);
+  BOOST_REQUIRE_EQUAL(map.maxLabel(), 2u);
+  BOOST_CHECK_EQUAL(components[1].pixCount(), 1000);
+  BOOST_CHECK(components[1].rect() == QRect(4, 0, 1, 1000));
+  BOOST_CHECK_EQUAL(components[2].pixCount(), 3);
+  BOOST_CHECK(components[2].rect() == QRect(0, 500, 3, 1));
+}
+
+BOOST_AUTO_TEST_CASE(test_diagonal_line_across_bands) {
+  // Only 8-connected, and crossing every seam between bands with a single pixel step.
+  BinaryImage image(1000, 1000, WHITE);
+  for (int i = 0; i < 1000; ++i) {
+    image.setPixel(i, i, BLACK);
+  }
+
+  std::vector<ConnComp> components;
+  const ConnectivityMap map8(image, CONN8, &components);
+  BOOST_REQUIRE_EQUAL(map8.maxLabel(), 1u);
+  BOOST_CHECK_EQUAL(components[1].pixCount(), 1000);
+
+  const ConnectivityMap map4(image, CONN4);
+  BOOST_CHECK_EQUAL(map4.maxLabel(), 1000u);
+  BOOST_CHECK(sameLabels(map4, referenceMap(image, CONN4)));
+}
+
+BOOST_AUTO_TEST_CASE(test_white_image) {
+  std::vector<ConnComp> components;
+  const ConnectivityMap map(BinaryImage(50, 300, WHITE), CONN8, &components);
+  BOOST_CHECK_EQUAL(map.maxLabel(), 0u);
+  BOOST_CHECK_EQUAL(components.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_runs_cover_components) {
+  const BinaryImage image(randomBinaryImage(100, 300));
+  for (const Connectivity conn : {CONN4, CONN8}) {
+    const RunLengthComponents runs(image, conn);
+    // ConnectivityMap is painted from runs, so only the generic constructor labels the image on its own.
+    const ConnectivityMap control(referenceMap(image, conn));
+    BOOST_REQUIRE_EQUAL(runs.maxLabel(), control.maxLabel());
+    BOOST_CHECK(correctStats(control, runs.components()));
+
+    std::vector<uint32_t> labels(image.width() * image.height(), 0);
+    for (uint32_t label = 1; label <= runs.maxLabel(); ++label) {
+      int pixCount = 0;
+      const RunLengthComponents::Run* prevRun = nullptr;
+      for (const RunLengthComponents::Run* run = runs.runsBegin(label); run != runs.runsEnd(label); ++run) {
+        if (prevRun) {
+          BOOST_CHECK((run->y > prevRun->y) || ((run->y == prevRun->y) && (run->begin > prevRun->end)));
+        }
+        for (int x = run->begin; x < run->end; ++x) {
+          BOOST_CHECK_EQUAL(labels[run->y * image.width() + x], 0u);
+          labels[run->y * image.width() + x] = label;
+        }
+        pixCount += run->length();
+        prevRun = run;
+      }
+      BOOST_CHECK_EQUAL(pixCount, runs.component(label).pixCount());
+    }
+
+    for (int y = 0; y < image.height(); ++y) {
+      for (int x = 0; x < image.width(); ++x) {
+        BOOST_CHECK_EQUAL(labels[y * image.width() + x], control.data()[y * control.stride() + x]);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
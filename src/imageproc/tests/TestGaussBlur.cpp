@@ -0,0 +1,134 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <GaussBlur.h>
+#include <GrayImage.h>
+
+#include <QSize>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <vector>
+
+namespace imageproc {
+namespace tests {
+
+BOOST_AUTO_TEST_SUITE(GaussBlurTestSuite)
+
+namespace {
+/**
+ * Filters a single sequence the way gaussBlurGeneric() used to, one row or column at a time.
+ */
+void filterSequence(std::vector<float>& data, const float sigma) {
+  const gauss_blur_impl::IirConstants c(gauss_blur_impl::findIirConstants(sigma));
+  const int size = static_cast<int>(data.size());
+  std::vector<float> valP(size, 0.0f);
+  std::vector<float> valM(size, 0.0f);
+
+  for (int y = 0; y < size; ++y) {
+    const int terms = y < 4 ? y : 4;
+    int i = 0;
+    for (; i <= terms; ++i) {
+      valP[y] += c.nP[i] * data[y - i] - c.dP[i] * valP[y - i];
+    }
+    for (; i <= 4; ++i) {
+      valP[y] += (c.nP[i] - c.bdP[i]) * data[0];
+    }
+  }
+  for (int y = size - 1; y >= 0; --y) {
+    const int terms = size - 1 - y < 4 ? size - 1 - y : 4;
+    int i = 0;
+    for (; i <= terms; ++i) {
+      valM[y] += c.nM[i] * data[y + i] - c.dM[i] * valM[y + i];
+    }
+    for (; i <= 4; ++i) {
+      valM[y] += (c.nM[i] - c.bdM[i]) * data[size - 1];
+    }
+  }
+
+  for (int y = 0; y < size; ++y) {
+    data[y] = valP[y] + valM[y];
+  }
+}
+
+std::vector<float> referenceBlur(const std::vector<float>& grid,
+                                 const int width,
+                                 const int height,
+                                 const float hSigma,
+                                 const float vSigma) {
+  std::vector<float> result(grid);
+  std::vector<float> sequence;
+
+  sequence.resize(height);
+  for (int x = 0; x < width; ++x) {
+    for (int y = 0; y < height; ++y) {
+      sequence[y] = result[y * width + x];
+    }
+    filterSequence(sequence, vSigma);
+    for (int y = 0; y < height; ++y) {
+      result[y * width + x] = sequence[y];
+    }
+  }
+
+  sequence.resize(width);
+  for (int y = 0; y < height; ++y) {
+    std::copy(&result[y * width], &result[y * width] + width, sequence.begin());
+    filterSequence(sequence, hSigma);
+    std::copy(sequence.begin(), sequence.end(), &result[y * width]);
+  }
+  return result;
+}
+
+std::vector<float> randomGrid(const int width, const int height) {
+  std::vector<float> grid(width * height);
+  for (float& value : grid) {
+    value = static_cast<float>(rand() % 256);
+  }
+  return grid;
+}
+
+std::vector<float> blur(const std::vector<float>& grid,
+                        const int width,
+                        const int height,
+                        const float hSigma,
+                        const float vSigma) {
+  std::vector<float> result(grid.size());
+  gaussBlurGeneric(QSize(width, height), hSigma, vSigma, grid.data(), width, [](float val) { return val; },
+                   result.data(), width, [](float& dst, float val) { dst = val; });
+  return result;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_matches_sequential_filter) {
+  // Sizes that are and aren't multiples of the number of lanes.
+  const QSize sizes[] = {QSize(1, 1), QSize(3, 7), QSize(8, 16), QSize(37, 61), QSize(300, 201)};
+  for (const QSize& size : sizes) {
+    const std::vector<float> grid(randomGrid(size.width(), size.height()));
+    BOOST_CHECK(blur(grid, size.width(), size.height(), 2.0f, 5.0f)
+                == referenceBlur(grid, size.width(), size.height(), 2.0f, 5.0f));
+    BOOST_CHECK(blur(grid, size.width(), size.height(), 12.0f, 0.5f)
+                == referenceBlur(grid, size.width(), size.height(), 12.0f, 0.5f));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_in_place) {
+  const int width = 123;
+  const int height = 77;
+  const std::vector<float> grid(randomGrid(width, height));
+  const std::vector<float> expected(blur(grid, width, height, 6.0f, 6.0f));
+
+  std::vector<float> inPlace(grid);
+  gaussBlurGeneric(QSize(width, height), 6.0f, 6.0f, inPlace.data(), width, [](float val) { return val; },
+                   inPlace.data(), width, [](float& dst, float val) { dst = val; });
+  BOOST_CHECK(inPlace == expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_image) {
+  GrayImage img(QSize(97, 53));
+  img.fill(0x80);
+  BOOST_CHECK(gaussBlur(img, 10.0f, 3.0f) == img);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
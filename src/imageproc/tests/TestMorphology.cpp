@@ -8,6 +8,7 @@
 
 #include <QImage>
 #include <QPoint>
+#include <QRect>
 #include <QSize>
 #include <boost/test/unit_test.hpp>
 
@@ -19,6 +20,29 @@ using namespace utils;
 
 BOOST_AUTO_TEST_SUITE(MorphologyTestSuite)
 
+namespace {
+class MorphologyAlgorithmGuard {
+ public:
+  MorphologyAlgorithmGuard() : m_savedAlgorithm(morphologyAlgorithm()) {}
+
+  ~MorphologyAlgorithmGuard() { setMorphologyAlgorithm(m_savedAlgorithm); }
+
+ private:
+  MorphologyAlgorithm m_savedAlgorithm;
+};
+
+
+const Brick algorithmTestBricks[] = {Brick(QSize(1, 1)),
+                                     Brick(QSize(9, 1)),
+                                     Brick(QSize(1, 13)),
+                                     Brick(QSize(200, 14)),
+                                     Brick(QSize(14, 200)),
+                                     Brick(QSize(37, 23), QPoint(40, -5)),
+                                     Brick(-3, 2, 60, 65)};
+
+const QRect algorithmTestAreas[] = {QRect(0, 0, 251, 233), QRect(-31, 17, 290, 180), QRect(100, -70, 40, 400)};
+}  // namespace
+
 BOOST_AUTO_TEST_CASE(test_dilate_1x1) {
   static const int inp[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
                             0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0,
@@ -672,6 +696,57 @@ BOOST_AUTO_TEST_CASE(test_hmr_1) {
   BOOST_CHECK(hitMissReplace(img, BLACK, pattern, 3, 3) == control);
 }
 
+BOOST_AUTO_TEST_CASE(test_binary_algorithms_match) {
+  const MorphologyAlgorithmGuard guard;
+  const BinaryImage img(randomBinaryImage(251, 233));
+
+  for (const Brick& brick : algorithmTestBricks) {
+    for (const QRect& area : algorithmTestAreas) {
+      for (const BWColor surroundings : {WHITE, BLACK}) {
+        setMorphologyAlgorithm(MorphologyAlgorithm::STEPWISE);
+        const BinaryImage dilated(dilateBrick(img, brick, area, surroundings));
+        const BinaryImage eroded(erodeBrick(img, brick, area, surroundings));
+
+        setMorphologyAlgorithm(MorphologyAlgorithm::DECOMPOSED);
+        BOOST_CHECK(dilateBrick(img, brick, area, surroundings) == dilated);
+        BOOST_CHECK(erodeBrick(img, brick, area, surroundings) == eroded);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_gray_algorithms_match) {
+  const MorphologyAlgorithmGuard guard;
+  const GrayImage img(randomGrayImage(251, 233));
+
+  for (const Brick& brick : algorithmTestBricks) {
+    for (const QRect& area : algorithmTestAreas) {
+      for (const unsigned char surroundings : {0x00, 0x80, 0xff}) {
+        setMorphologyAlgorithm(MorphologyAlgorithm::STEPWISE);
+        const GrayImage dilated(dilateGray(img, brick, area, surroundings));
+        const GrayImage eroded(erodeGray(img, brick, area, surroundings));
+
+        setMorphologyAlgorithm(MorphologyAlgorithm::DECOMPOSED);
+        BOOST_CHECK(dilateGray(img, brick, area, surroundings) == dilated);
+        BOOST_CHECK(erodeGray(img, brick, area, surroundings) == eroded);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_large_open_algorithms_match) {
+  const MorphologyAlgorithmGuard guard;
+  const BinaryImage img(randomBinaryImage(600, 300));
+
+  setMorphologyAlgorithm(MorphologyAlgorithm::STEPWISE);
+  const BinaryImage opened(openBrick(img, QSize(200, 14), WHITE));
+  const BinaryImage closed(closeBrick(img, QSize(200, 14), WHITE));
+
+  setMorphologyAlgorithm(MorphologyAlgorithm::DECOMPOSED);
+  BOOST_CHECK(openBrick(img, QSize(200, 14), WHITE) == opened);
+  BOOST_CHECK(closeBrick(img, QSize(200, 14), WHITE) == closed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
@@ -0,0 +1,81 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <Binarize.h>
+#include <BinaryImage.h>
+#include <Morphology.h>
+#include <ParallelBands.h>
+#include <SavGolFilter.h>
+
+#include <QImage>
+#include <QSize>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+#include "Utils.h"
+
+namespace imageproc {
+namespace tests {
+using namespace utils;
+
+// Images get split into several bands however many cores there are.
+BOOST_FIXTURE_TEST_SUITE(ParallelBandsTestSuite, TestParallelForExecutor)
+
+BOOST_AUTO_TEST_CASE(test_bands_cover_all_rows) {
+  const int height = 1001;
+  const int halo = 7;
+  const std::vector<RowBand> bands(splitIntoRowBands(height, halo));
+  BOOST_REQUIRE(bands.size() > 1);
+
+  int nextRow = 0;
+  for (const RowBand& band : bands) {
+    BOOST_CHECK_EQUAL(band.top, nextRow);
+    BOOST_CHECK(band.bottom > band.top);
+    BOOST_CHECK_EQUAL(band.haloTop, std::max(0, band.top - halo));
+    BOOST_CHECK_EQUAL(band.haloBottom, std::min(height, band.bottom + halo));
+    nextRow = band.bottom;
+  }
+  BOOST_CHECK_EQUAL(nextRow, height);
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_image) {
+  BOOST_CHECK(splitIntoRowBands(0, 5).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_sav_gol_in_bands) {
+  const QImage src(randomGrayImage(101, 1500));
+  const QSize window(7, 7);
+  BOOST_REQUIRE(splitIntoRowBands(src.height(), window.height()).size() > 1);
+
+  const QImage control(savGolFilter(src, window, 4, 4));
+  const QImage banded(
+      processGrayInBands(src, window.height(), [&](const QImage& band) { return savGolFilter(band, window, 4, 4); }));
+  BOOST_CHECK(banded == control);
+}
+
+BOOST_AUTO_TEST_CASE(test_sauvola_in_bands) {
+  const QImage src(randomGrayImage(77, 1500));
+  const QSize window(15, 31);
+  BOOST_REQUIRE(splitIntoRowBands(src.height(), window.height()).size() > 1);
+
+  const BinaryImage control(binarizeSauvola(src, window));
+  const BinaryImage banded(
+      binarizeInBands(src, window.height(), [&](const QImage& band) { return binarizeSauvola(band, window); }));
+  BOOST_CHECK(banded == control);
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_in_bands) {
+  const BinaryImage src(randomBinaryImage(123, 1500));
+  const QSize brick(5, 9);
+  BOOST_REQUIRE(splitIntoRowBands(src.height(), brick.height() / 2).size() > 1);
+
+  const BinaryImage control(dilateBrick(src, brick));
+  BinaryImage banded(src);
+  processBinaryInBands(banded, brick.height() / 2, [&](BinaryImage& band) { band = dilateBrick(band, brick); });
+  BOOST_CHECK(banded == control);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
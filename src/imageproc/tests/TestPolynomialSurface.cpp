@@ -0,0 +1,87 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <BinaryImage.h>
+#include <GrayImage.h>
+#include <PolynomialSurface.h>
+
+#include <QRect>
+#include <QSize>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace imageproc {
+namespace tests {
+/**
+ * A surface of degree 2 in both directions, with x and y in [0, 1]
+ * and values within [0, 255].
+ */
+static double knownSurface(const double x, const double y) {
+  return 40.0 + 90.0 * x - 50.0 * x * x + 120.0 * y * y + 30.0 * x * y;
+}
+
+static GrayImage renderKnownSurface(const QSize& size) {
+  GrayImage image(size);
+  for (int y = 0; y < size.height(); ++y) {
+    for (int x = 0; x < size.width(); ++x) {
+      const double value = knownSurface(double(x) / (size.width() - 1), double(y) / (size.height() - 1));
+      image.data()[y * image.stride() + x] = static_cast<uint8_t>(std::lround(value));
+    }
+  }
+  return image;
+}
+
+static int maxDifference(const GrayImage& img1, const GrayImage& img2) {
+  int maxDiff = 0;
+  for (int y = 0; y < img1.height(); ++y) {
+    for (int x = 0; x < img1.width(); ++x) {
+      const int diff = std::abs(img1.data()[y * img1.stride() + x] - img2.data()[y * img2.stride() + x]);
+      maxDiff = std::max(maxDiff, diff);
+    }
+  }
+  return maxDiff;
+}
+
+BOOST_AUTO_TEST_SUITE(PolynomialSurfaceTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_known_surface) {
+  const QSize size(97, 61);
+  const PolynomialSurface surface(2, 2, renderKnownSurface(size));
+
+  BOOST_CHECK(maxDifference(surface.render(size), renderKnownSurface(size)) <= 1);
+
+  // Rendering in another size stretches the surface.
+  const QSize otherSize(230, 45);
+  BOOST_CHECK(maxDifference(surface.render(otherSize), renderKnownSurface(otherSize)) <= 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_known_surface_with_mask) {
+  const QSize size(97, 61);
+  GrayImage image(renderKnownSurface(size));
+
+  // Pixels outside of the mask are ruined, and have to be ignored.
+  BinaryImage mask(size, BLACK);
+  mask.fill(QRect(10, 5, 40, 30), WHITE);
+  mask.fill(QRect(60, 40, 37, 21), WHITE);
+  srand(1);
+  for (int y = 0; y < size.height(); ++y) {
+    for (int x = 0; x < size.width(); ++x) {
+      if (((x + y) % 7) == 0) {
+        mask.setPixel(x, y, WHITE);
+      }
+      if (mask.getPixel(x, y) == WHITE) {
+        image.data()[y * image.stride() + x] = static_cast<uint8_t>(rand() % 256);
+      }
+    }
+  }
+
+  const PolynomialSurface surface(2, 2, image, mask);
+  BOOST_CHECK(maxDifference(surface.render(size), renderKnownSurface(size)) <= 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
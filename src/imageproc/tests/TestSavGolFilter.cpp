@@ -0,0 +1,54 @@
+// Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
+// Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
+
+#include <GrayImage.h>
+#include <SavGolFilter.h>
+
+#include <QImage>
+#include <QSize>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+
+namespace imageproc {
+namespace tests {
+BOOST_AUTO_TEST_SUITE(SavGolFilterTestSuite)
+
+BOOST_AUTO_TEST_CASE(test_plane_is_preserved) {
+  // A plane is a polynomial of any degree, so fitting can only lose precision,
+  // including near the edges, where windows are off center.
+  GrayImage img(QSize(41, 29));
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      img.data()[y * img.stride() + x] = static_cast<uint8_t>(20 + 2 * x + 3 * y);
+    }
+  }
+
+  const QSize windows[] = {QSize(7, 7), QSize(5, 9), QSize(8, 4)};
+  for (const QSize& window : windows) {
+    const GrayImage filtered(savGolFilter(img.toQImage(), window, 2, 3));
+    for (int y = 0; y < img.height(); ++y) {
+      for (int x = 0; x < img.width(); ++x) {
+        const int expected = img.data()[y * img.stride() + x];
+        const int actual = filtered.data()[y * filtered.stride() + x];
+        const bool offCenter = (x < window.width() / 2) || (x >= img.width() - (window.width() - 1) / 2)
+                               || (y < window.height() / 2) || (y >= img.height() - (window.height() - 1) / 2);
+        if (offCenter) {
+          BOOST_REQUIRE_EQUAL(actual, expected);
+        } else {
+          // Sums are truncated rather than rounded.
+          BOOST_REQUIRE(actual == expected || actual == expected - 1);
+        }
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_window_larger_than_image) {
+  GrayImage img(QSize(5, 5));
+  img.fill(0x80);
+  BOOST_CHECK(GrayImage(savGolFilter(img.toQImage(), QSize(7, 7), 4, 4)) == img);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}  // namespace tests
+}  // namespace imageproc
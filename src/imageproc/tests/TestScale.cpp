@@ -1,15 +1,18 @@
 // Copyright (C) 2019  Joseph Artsimovich <joseph.artsimovich@gmail.com>, 4lex4 <4lex49@zoho.com>
 // Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
 
+#include <DownscalePyramid.h>
 #include <GrayImage.h>
 #include <Scale.h>
 
 #include <QImage>
 #include <QSize>
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
 
 #include "Utils.h"
 
@@ -73,6 +76,179 @@ BOOST_AUTO_TEST_CASE(test_random_image) {
   // BOOST_CHECK(checkScale(img, QSize(145, 55)));
 }
 
+BOOST_AUTO_TEST_CASE(test_pyramid_exact_halving) {
+  GrayImage img(QSize(64, 48));
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      img.data()[y * img.stride() + x] = static_cast<uint8_t>(rand() % 256);
+    }
+  }
+
+  DownscalePyramid pyramid(img);
+  const GrayImage halved(pyramid.scaledTo(QSize(32, 24)));
+  for (int y = 0; y < halved.height(); ++y) {
+    for (int x = 0; x < halved.width(); ++x) {
+      const uint8_t* const block = img.data() + 2 * y * img.stride() + 2 * x;
+      const int sum = block[0] + block[1] + block[img.stride()] + block[img.stride() + 1];
+      BOOST_REQUIRE_EQUAL(int(halved.data()[y * halved.stride() + x]), (sum + 2) / 4);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid_uniform_color_image) {
+  // Odd sizes make the last cells of every level partial.
+  QImage img(QSize(101, 37), QImage::Format_RGB32);
+  img.fill(qRgb(10, 200, 77));
+
+  DownscalePyramid pyramid(img);
+  const QSize sizes[] = {QSize(101, 37), QSize(50, 18), QSize(13, 5), QSize(7, 30), QSize(1, 1)};
+  for (const QSize& size : sizes) {
+    const QImage scaled(pyramid.scaledTo(size));
+    BOOST_REQUIRE(scaled.size() == size);
+    for (int y = 0; y < size.height(); ++y) {
+      for (int x = 0; x < size.width(); ++x) {
+        BOOST_REQUIRE(scaled.pixel(x, y) == img.pixel(0, 0));
+      }
+    }
+  }
+}
+
+/**
+ * Averages the areas of \p img that map to every pixel of \p dstSize, by the definition.
+ * Lengths are measured in source pixels multiplied by the destination size, which makes them integers.
+ */
+static QImage referenceAreaAverage(const QImage& img, const QSize& dstSize) {
+  const int bytesPerPixel = img.depth() / 8;
+  const int srcWidth = img.width();
+  const int srcHeight = img.height();
+  QImage dst(dstSize, img.format());
+  dst.setColorTable(img.colorTable());
+
+  for (int dy = 0; dy < dstSize.height(); ++dy) {
+    for (int dx = 0; dx < dstSize.width(); ++dx) {
+      for (int c = 0; c < bytesPerPixel; ++c) {
+        int64_t sum = 0;
+        for (int y = 0; y < srcHeight; ++y) {
+          const int64_t yOverlap = std::min<int64_t>((y + 1) * dstSize.height(), (dy + 1) * srcHeight)
+                                   - std::max<int64_t>(y * dstSize.height(), dy * srcHeight);
+          if (yOverlap <= 0) {
+            continue;
+          }
+          for (int x = 0; x < srcWidth; ++x) {
+            const int64_t xOverlap = std::min<int64_t>((x + 1) * dstSize.width(), (dx + 1) * srcWidth)
+                                     - std::max<int64_t>(x * dstSize.width(), dx * srcWidth);
+            if (xOverlap > 0) {
+              sum += xOverlap * yOverlap * img.constScanLine(y)[x * bytesPerPixel + c];
+            }
+          }
+        }
+        const int64_t totalArea = int64_t(srcWidth) * srcHeight;
+        dst.scanLine(dy)[dx * bytesPerPixel + c] = static_cast<uint8_t>((sum + totalArea / 2) / totalArea);
+      }
+    }
+  }
+  return dst;
+}
+
+static bool fuzzyComparePixels(const QImage& img1, const QImage& img2) {
+  BOOST_REQUIRE(img1.size() == img2.size());
+  BOOST_REQUIRE(img1.depth() == img2.depth());
+
+  const int lineSize = img1.width() * img1.depth() / 8;
+  for (int y = 0; y < img1.height(); ++y) {
+    for (int i = 0; i < lineSize; ++i) {
+      if (std::abs(int(img1.constScanLine(y)[i]) - int(img2.constScanLine(y)[i])) > 1) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid_random_images) {
+  // Every level down to 13x5 is an exact halving of the previous one.
+  GrayImage gray(QSize(104, 40));
+  for (int y = 0; y < gray.height(); ++y) {
+    for (int x = 0; x < gray.width(); ++x) {
+      gray.data()[y * gray.stride() + x] = static_cast<uint8_t>(rand() % 256);
+    }
+  }
+  QImage color(QSize(104, 40), QImage::Format_RGB32);
+  for (int y = 0; y < color.height(); ++y) {
+    for (int x = 0; x < color.width(); ++x) {
+      color.setPixel(x, y, qRgb(rand() % 256, rand() % 256, rand() % 256));
+    }
+  }
+  // Integer factors, where the cells of levels don't cross destination pixels.
+  GrayImage grayEven(QSize(96, 36));
+  for (int y = 0; y < grayEven.height(); ++y) {
+    for (int x = 0; x < grayEven.width(); ++x) {
+      grayEven.data()[y * grayEven.stride() + x] = static_cast<uint8_t>(rand() % 256);
+    }
+  }
+
+  // Factors that aren't integers, with the level every size is made from.
+  // Such a level is an area average of the original, and the result is an area average of the level.
+  DownscalePyramid grayPyramid(gray);
+  DownscalePyramid colorPyramid(color);
+  struct {
+    QSize size;
+    QSize levelSize;
+  } const sizes[] = {{QSize(50, 19), QSize(104, 40)},
+                     {QSize(20, 7), QSize(52, 20)},
+                     {QSize(7, 9), QSize(52, 20)},
+                     {QSize(11, 4), QSize(26, 10)},
+                     {QSize(5, 3), QSize(26, 10)}};
+  for (const auto& size : sizes) {
+    BOOST_CHECK(fuzzyComparePixels(grayPyramid.scaledTo(size.size),
+                                   referenceAreaAverage(grayPyramid.scaledTo(size.levelSize), size.size)));
+    BOOST_CHECK(fuzzyComparePixels(colorPyramid.scaledTo(size.size),
+                                   referenceAreaAverage(colorPyramid.scaledTo(size.levelSize), size.size)));
+  }
+
+  DownscalePyramid grayEvenPyramid(grayEven);
+  const QSize evenSizes[] = {QSize(8, 3), QSize(24, 9), QSize(32, 12), QSize(12, 12), QSize(1, 1)};
+  for (const QSize& size : evenSizes) {
+    BOOST_CHECK(fuzzyComparePixels(grayEvenPyramid.scaledTo(size), referenceAreaAverage(grayEven.toQImage(), size)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid_smooth_image) {
+  // On content that changes little from cell to cell, levels are as good as the original.
+  QImage img(QSize(101, 37), QImage::Format_RGB32);
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      img.setPixel(x, y, qRgb(2 * x, 5 * y, x + 3 * y));
+    }
+  }
+
+  DownscalePyramid pyramid(img);
+  const QSize sizes[] = {QSize(13, 5), QSize(50, 18), QSize(7, 30), QSize(100, 36), QSize(1, 1)};
+  for (const QSize& size : sizes) {
+    BOOST_CHECK(fuzzyComparePixels(pyramid.scaledTo(size), referenceAreaAverage(img, size)));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid_is_shared) {
+  QImage img1(QSize(64, 48), QImage::Format_RGB32);
+  img1.fill(qRgb(10, 200, 77));
+  QImage img2(img1.size(), QImage::Format_RGB32);
+  img2.fill(qRgb(77, 10, 200));
+
+  const std::shared_ptr<DownscalePyramid> pyramid1(DownscalePyramid::shared(img1));
+  const std::shared_ptr<DownscalePyramid> pyramid2(DownscalePyramid::shared(img2));
+  BOOST_CHECK(pyramid1 != pyramid2);
+  // A copy of an image shares the pyramid.
+  const QImage copy(img1);
+  BOOST_CHECK(DownscalePyramid::shared(copy) == pyramid1);
+  BOOST_CHECK(DownscalePyramid::shared(img2) == pyramid2);
+  BOOST_CHECK(pyramid2->scaledTo(QSize(16, 12)).pixel(0, 0) == img2.pixel(0, 0));
+
+  // A modified image is a different one.
+  img1.setPixel(0, 0, qRgb(0, 0, 0));
+  BOOST_CHECK(DownscalePyramid::shared(img1) != pyramid1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include <QImage>
 #include <QPoint>
+#include <QRect>
 #include <QSize>
 #include <boost/test/unit_test.hpp>
 
@@ -146,6 +147,49 @@ BOOST_AUTO_TEST_CASE(test_gray_vs_binary) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_binary_spanning_words) {
+  // Wide enough for the components to cross word boundaries, and thin enough for them to snake around.
+  for (int i = 0; i < 100; ++i) {
+    const BinaryImage binSeed(randomBinaryImage(100, 20));
+    const BinaryImage binMask(randomBinaryImage(100, 20));
+    const GrayImage graySeed(toGrayscale(binSeed.toQImage()));
+    const GrayImage grayMask(toGrayscale(binMask.toQImage()));
+
+    for (const Connectivity conn : {CONN4, CONN8}) {
+      const BinaryImage fillBin(seedFill(binSeed, binMask, conn));
+      const GrayImage fillGray(seedFillGray(graySeed, grayMask, conn));
+      if (fillGray != GrayImage(fillBin.toQImage())) {
+        BOOST_ERROR("grayscale fill != binary fill at index " << i << " with connectivity " << conn);
+        dumpBinaryImage(binSeed, "seed");
+        dumpBinaryImage(binMask, "mask");
+        dumpBinaryImage(fillBin, "bin_fill");
+        dumpBinaryImage(BinaryImage(fillGray), "gray_fill");
+        return;
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_serpentine) {
+  // A path running right, down, left, down and so on, to be filled from one end.
+  const int width = 70;
+  const int height = 41;
+  BinaryImage mask(width, height, WHITE);
+  for (int y = 0; y < height; ++y) {
+    if (y % 2 == 0) {
+      mask.fill(QRect(0, y, width, 1), BLACK);
+    } else {
+      mask.setPixel((y % 4 == 1) ? width - 1 : 0, y, BLACK);
+    }
+  }
+
+  BinaryImage seed(width, height, WHITE);
+  seed.setPixel(0, 0, BLACK);
+
+  BOOST_CHECK(seedFill(seed, mask, CONN4) == mask);
+  BOOST_CHECK(seedFill(seed, mask, CONN8) == mask);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
@@ -2,20 +2,58 @@
 // Use of this source code is governed by the GNU GPLv3 license that can be found in the LICENSE file.
 
 #include <BinaryImage.h>
+#include <Constants.h>
+#include <Shear.h>
+#include <ShearScorer.h>
 #include <SkewFinder.h>
 
 #include <QApplication>
 #include <QColor>
 #include <QImage>
 #include <QPainter>
+#include <QRect>
 #include <QString>
 #include <QTransform>
 #include <boost/test/unit_test.hpp>
 #include <cmath>
 #include <cstdlib>
 
+#include "Utils.h"
+
 namespace imageproc {
 namespace tests {
+using namespace utils;
+
+/**
+ * Shears the image the way SkewFinder does, and scores it by counting black pixels in every row.
+ */
+static double referenceScore(const BinaryImage& image, const double angle, const double resolutionRatio) {
+  const BinaryImage sheared(
+      vShear(image, std::tan(angle * constants::DEG2RAD) / resolutionRatio, 0.5 * image.width(), WHITE));
+  double score = 0.0;
+  int lastLineBlackPixels = 0;
+  for (int y = 0; y < sheared.height(); ++y) {
+    const int numBlackPixels = sheared.countBlackPixels(QRect(0, y, sheared.width(), 1));
+    if (y != 0) {
+      const double diff = numBlackPixels - lastLineBlackPixels;
+      score += diff * diff;
+    }
+    lastLineBlackPixels = numBlackPixels;
+  }
+  return score;
+}
+
+static void checkScoresAgainstReference(const ShearScorer& scorer, const BinaryImage& image, const double ratio) {
+  for (int step = -20; step <= 20; ++step) {
+    const double angle = 0.35 * step;
+    BOOST_CHECK_EQUAL(scorer.score(angle), referenceScore(image, angle, ratio));
+  }
+  // Angles shearing columns by more than the image height.
+  for (const double angle : {-60.0, 45.0, 80.0}) {
+    BOOST_CHECK_EQUAL(scorer.score(angle), referenceScore(image, angle, ratio));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE(SkewFinderTestSuite)
 
 BOOST_AUTO_TEST_CASE(test_positive_detection) {
@@ -72,6 +110,32 @@ BOOST_AUTO_TEST_CASE(test_negative_detection) {
   BOOST_CHECK(skew.confidence() < Skew::GOOD_CONFIDENCE);
 }
 
+BOOST_AUTO_TEST_CASE(test_transitions_score_same_as_shearing) {
+  // Lines of words, some of them clipped by the right edge, and a band touching the bottom edge.
+  BinaryImage image(301, 200, WHITE);
+  for (int line = 0; line < 12; ++line) {
+    for (int x = 3 + line % 5; x < image.width(); x += 37) {
+      image.fill(QRect(x, 8 + 15 * line, 29, 7), BLACK);
+    }
+  }
+  image.fill(QRect(0, 190, image.width(), 10), BLACK);
+
+  for (const double ratio : {1.0, 0.5, 1.7}) {
+    const ShearScorer scorer(image, ratio);
+    BOOST_REQUIRE(scorer.usesTransitions());
+    checkScoresAgainstReference(scorer, image, ratio);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_noise_falls_back_to_shearing) {
+  srand(1);
+  const BinaryImage image(randomBinaryImage(157, 91));
+
+  const ShearScorer scorer(image, 1.0);
+  BOOST_REQUIRE(!scorer.usesTransitions());
+  checkScoresAgainstReference(scorer, image, 1.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
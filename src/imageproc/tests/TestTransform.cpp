@@ -5,7 +5,10 @@
 #include <Transform.h>
 
 #include <QImage>
+#include <QPolygonF>
 #include <QSize>
+#include <QTransform>
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
 #include <cmath>
 #include <cstdint>
@@ -45,6 +48,146 @@ BOOST_AUTO_TEST_CASE(test_random_image) {
   BOOST_CHECK(transformToGray(img, nullXform, img.rect(), outsidePixels) == img);
 }
 
+BOOST_AUTO_TEST_CASE(test_translation_of_large_image) {
+  // Large enough to be split into several chunks of rows.
+  GrayImage img(QSize(300, 400));
+  uint8_t* line = img.data();
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      line[x] = static_cast<uint8_t>(rand() % 256);
+    }
+    line += img.stride();
+  }
+
+  const OutsidePixels outsidePixels(OutsidePixels::assumeColor(Qt::white));
+  const QTransform xform(QTransform().translate(-7, -3));
+  const GrayImage transformed(transformToGray(img, xform, img.rect(), outsidePixels));
+
+  for (int y = 0; y < img.height(); ++y) {
+    for (int x = 0; x < img.width(); ++x) {
+      const bool inside = (x + 7 < img.width()) && (y + 3 < img.height());
+      const uint8_t expected = inside ? img.data()[(y + 3) * img.stride() + x + 7] : 0xff;
+      BOOST_REQUIRE_EQUAL(int(transformed.data()[y * transformed.stride() + x]), int(expected));
+    }
+  }
+}
+
+/**
+ * Transforms \p src the way it used to be done: one destination pixel at a time,
+ * with its source area computed in floating point, and pixels mixed by how much
+ * of that area they cover, in 1/32 of a pixel.  Whatever is outside of the image
+ * is filled with \p outsideColor.
+ */
+static QImage referenceTransform(const QImage& src,
+                                 const QTransform& xform,
+                                 const QRect& dstRect,
+                                 const QRgb outsideColor) {
+  const bool gray = (src.format() == QImage::Format_Indexed8);
+  const int bytesPerPixel = gray ? 1 : 4;
+
+  QTransform invXform;
+  invXform.translate(dstRect.x(), dstRect.y());
+  invXform *= xform.inverted();
+  invXform *= QTransform().scale(32.0, 32.0);
+
+  // The centers of the edges of a destination pixel.
+  QPolygonF dstPoly;
+  dstPoly << QPointF(0.5, 0.0) << QPointF(1.0, 0.5) << QPointF(0.5, 1.0) << QPointF(0.0, 0.5);
+  const QRectF unitBounds(invXform.map(dstPoly).boundingRect());
+  const int src32UnitW = std::max(1, qRound(std::max(0.9 * 32.0, unitBounds.width())));
+  const int src32UnitH = std::max(1, qRound(std::max(0.9 * 32.0, unitBounds.height())));
+  const unsigned srcArea = src32UnitW * src32UnitH;
+
+  auto value = [&](const int x, const int y, const int channel) -> unsigned {
+    if ((x < 0) || (y < 0) || (x >= src.width()) || (y >= src.height())) {
+      return gray ? qGray(outsideColor) : (outsideColor >> (channel * 8)) & 0xff;
+    }
+    return src.constScanLine(y)[x * bytesPerPixel + channel];
+  };
+
+  QImage dst(dstRect.size(), src.format());
+  dst.setColorTable(src.colorTable());
+  for (int dy = 0; dy < dstRect.height(); ++dy) {
+    const double fDyCenter = dy + 0.5;
+    const double fSx32Base = fDyCenter * invXform.m21() + invXform.dx();
+    const double fSy32Base = fDyCenter * invXform.m22() + invXform.dy();
+    for (int dx = 0; dx < dstRect.width(); ++dx) {
+      const double fDxCenter = dx + 0.5;
+      const int src32Left = (int) (fSx32Base + fDxCenter * invXform.m11()) - (src32UnitW >> 1);
+      const int src32Top = (int) (fSy32Base + fDxCenter * invXform.m12()) - (src32UnitH >> 1);
+      const int src32Right = src32Left + src32UnitW;
+      const int src32Bottom = src32Top + src32UnitH;
+
+      for (int channel = 0; channel < bytesPerPixel; ++channel) {
+        unsigned accum = 0;
+        for (int y = src32Top >> 5; y <= (src32Bottom - 1) >> 5; ++y) {
+          const int yWeight = std::min((y + 1) * 32, src32Bottom) - std::max(y * 32, src32Top);
+          for (int x = src32Left >> 5; x <= (src32Right - 1) >> 5; ++x) {
+            const int xWeight = std::min((x + 1) * 32, src32Right) - std::max(x * 32, src32Left);
+            accum += value(x, y, channel) * xWeight * yWeight;
+          }
+        }
+        dst.scanLine(dy)[dx * bytesPerPixel + channel] = static_cast<uint8_t>((accum + (srcArea >> 1)) / srcArea);
+      }
+    }
+  }
+  return dst;
+}  // referenceTransform
+
+static int maxDifference(const QImage& img1, const QImage& img2) {
+  BOOST_REQUIRE(img1.size() == img2.size());
+  BOOST_REQUIRE(img1.depth() == img2.depth());
+
+  int maxDiff = 0;
+  const int lineSize = img1.width() * img1.depth() / 8;
+  for (int y = 0; y < img1.height(); ++y) {
+    for (int i = 0; i < lineSize; ++i) {
+      maxDiff = std::max(maxDiff, std::abs(int(img1.constScanLine(y)[i]) - int(img2.constScanLine(y)[i])));
+    }
+  }
+  return maxDiff;
+}
+
+BOOST_AUTO_TEST_CASE(test_rotation_and_scaling_same_as_before) {
+  const QSize size(157, 211);
+  GrayImage gray(size);
+  QImage color(size, QImage::Format_RGB32);
+  for (int y = 0; y < size.height(); ++y) {
+    for (int x = 0; x < size.width(); ++x) {
+      gray.data()[y * gray.stride() + x] = static_cast<uint8_t>(rand() % 256);
+      color.setPixel(x, y, qRgb(rand() % 256, rand() % 256, rand() % 256));
+    }
+  }
+
+  const QPointF center(QRectF(QPointF(0, 0), size).center());
+  auto aroundCenter = [&](const double angle, const double xScale, const double yScale) {
+    return QTransform()
+        .translate(center.x(), center.y())
+        .rotate(angle)
+        .scale(xScale, yScale)
+        .translate(-center.x(), -center.y());
+  };
+  // Downscaling by up to 2x, which goes through fixed weights, and beyond it.
+  // A scale of 2.96, being rational, maps many pixels exactly to integer coordinates.
+  const QTransform xforms[] = {aroundCenter(5, 1, 1),       aroundCenter(-30, 0.7, 0.7), aroundCenter(12, 1.6, 1.6),
+                               aroundCenter(0, 0.8, 1.25),  aroundCenter(3, 0.4, 0.4),   aroundCenter(90, 0.5, 0.5),
+                               aroundCenter(0, 2.96, 2.96), QTransform().translate(0.3, -0.7)};
+
+  const OutsidePixels outsidePixels(OutsidePixels::assumeColor(Qt::white));
+  for (const QTransform& xform : xforms) {
+    // Some of the destination maps outside of the image.
+    const QRect dstRect(xform.mapRect(QRectF(QPointF(0, 0), size)).toAlignedRect().adjusted(-3, -3, 3, 3));
+
+    const QImage grayTransformed(transformToGray(gray.toQImage(), xform, dstRect, outsidePixels).toQImage());
+    const QImage grayReference(referenceTransform(gray.toQImage(), xform, dstRect, 0xffffffff));
+    BOOST_CHECK(maxDifference(grayTransformed, grayReference) <= 1);
+
+    const QImage colorTransformed(transform(color, xform, dstRect, outsidePixels));
+    const QImage colorReference(referenceTransform(color, xform, dstRect, 0xffffffff));
+    BOOST_CHECK(maxDifference(colorTransformed, colorReference) <= 1);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
@@ -8,6 +8,7 @@
 
 #include <QImage>
 #include <QRect>
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
@@ -171,6 +172,21 @@ bool surroundingsIntact(const QImage& img1, const QImage& img2, const QRect& rec
   }
   return true;
 }  // surroundingsIntact
+
+TestParallelForExecutor::TestParallelForExecutor(const int maxThreadCount, const bool startHelpers)
+    : m_maxThreadCount(maxThreadCount), m_startHelpers(startHelpers) {
+  m_pool.setMaxThreadCount(std::max(1, maxThreadCount - 1));
+  setParallelForExecutor(this);
+}
+
+TestParallelForExecutor::~TestParallelForExecutor() {
+  setParallelForExecutor(nullptr);
+  m_pool.waitForDone();
+}
+
+bool TestParallelForExecutor::tryStart(QRunnable* runnable) {
+  return m_startHelpers && m_pool.tryStart(runnable);
+}
 }  // namespace utils
 }  // namespace tests
 }  // namespace imageproc
\ No newline at end of file
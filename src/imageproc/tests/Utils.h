@@ -4,6 +4,10 @@
 #ifndef SCANTAILOR_TESTS_UTILS_H_
 #define SCANTAILOR_TESTS_UTILS_H_
 
+#include <ParallelFor.h>
+
+#include <QThreadPool>
+
 class QImage;
 class QRect;
 
@@ -29,6 +33,30 @@ void dumpBinaryImage(const BinaryImage& img, const char* name = nullptr);
 void dumpGrayImage(const QImage& img, const char* name = nullptr);
 
 bool surroundingsIntact(const QImage& img1, const QImage& img2, const QRect& rect);
+
+/**
+ * \brief Makes parallelFor() act as if there were \p maxThreadCount threads, for as long as it exists.
+ *
+ * Unless \p startHelpers is set, all the work is done on the calling thread,
+ * though split the way it would be for that many threads.  With \p startHelpers,
+ * helpers are started on threads of its own, so the work runs concurrently
+ * even on a single core.
+ */
+class TestParallelForExecutor : public ParallelForExecutor {
+ public:
+  explicit TestParallelForExecutor(int maxThreadCount = 8, bool startHelpers = false);
+
+  ~TestParallelForExecutor() override;
+
+  bool tryStart(QRunnable* runnable) override;
+
+  int maxThreadCount() const override { return m_maxThreadCount; }
+
+ private:
+  QThreadPool m_pool;
+  int m_maxThreadCount;
+  bool m_startHelpers;
+};
 }  // namespace utils
 }  // namespace tests
 }  // namespace imageproc